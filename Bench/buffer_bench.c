@@ -0,0 +1,248 @@
+#define _GNU_SOURCE
+#include <getopt.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+#include "../Buffer/buffer.h"
+
+/*
+  Microbenchmark of the rings in Buffer/buffer.c: one producer and one
+  consumer thread, pinned to different cores, move a fixed number of
+  items through a VideoBuffer (AVFrame references) or an AudioBuffer
+  (byte chunks). Every push/pop call is timed; the report gives ops/s,
+  bytes/s, p50/p99 call latency per side and context switches.
+*/
+
+// The rings consult the player's run/pause state; nothing pauses here
+volatile int is_running = 1;
+volatile int is_paused = 0;
+
+bool checkPauseState() {
+    return is_running;
+}
+
+typedef enum { BENCH_VIDEO, BENCH_AUDIO } BenchKind;
+
+typedef struct {
+    BenchKind kind;
+    int ops;
+    size_t chunk;          // Audio: bytes per call. Video: bytes per frame
+    size_t capacity;       // Audio: ring bytes. Video: slots
+    int cores[2];          // Producer, consumer; -1 leaves the thread unpinned
+
+    AVFrame *frame;        // Video: template every pushed frame references
+    uint64_t *push_ns, *pop_ns;
+    long push_switches, pop_switches;
+} BenchRun;
+
+static uint64_t benchNow() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void benchPin(int core) {
+    if (core < 0) {
+        return;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(core, &set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+        fprintf(stderr, "Warning: could not pin to core %d\n", core);
+    }
+}
+
+// Voluntary + involuntary context switches of the calling thread so far
+static long benchSwitches() {
+    struct rusage usage;
+    getrusage(RUSAGE_THREAD, &usage);
+    return usage.ru_nvcsw + usage.ru_nivcsw;
+}
+
+static void *benchProducer(void *args) {
+    BenchRun *run = args;
+    uint8_t *chunk = calloc(1, run->chunk);
+    benchPin(run->cores[0]);
+    long switches = benchSwitches();
+
+    for (int i = 0; i < run->ops; i++) {
+        uint64_t start = benchNow();
+        if (run->kind == BENCH_VIDEO) {
+            videoBufferPush(&videoBuffer, av_frame_clone(run->frame), i);
+        } else {
+            audioBufferPush(&audioBuffer, chunk, run->chunk);
+        }
+        run->push_ns[i] = benchNow() - start;
+    }
+
+    run->push_switches = benchSwitches() - switches;
+    free(chunk);
+    return NULL;
+}
+
+static void *benchConsumer(void *args) {
+    BenchRun *run = args;
+    uint8_t *chunk = malloc(run->chunk);
+    benchPin(run->cores[1]);
+    long switches = benchSwitches();
+
+    for (int i = 0; i < run->ops; i++) {
+        uint64_t start = benchNow();
+        if (run->kind == BENCH_VIDEO) {
+            AVFrame *frame;
+            double pts;
+            if (videoBufferPop(&videoBuffer, &frame, &pts)) {
+                av_frame_free(&frame);
+            }
+        } else {
+            audioBufferPop(&audioBuffer, chunk, run->chunk);
+        }
+        run->pop_ns[i] = benchNow() - start;
+    }
+
+    run->pop_switches = benchSwitches() - switches;
+    free(chunk);
+    return NULL;
+}
+
+static int compareU64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static double percentile(uint64_t *samples, int count, double p) {
+    qsort(samples, count, sizeof(uint64_t), compareU64);
+    int index = (int)(p * (count - 1) + 0.5);
+    return samples[index] / 1000.0;
+}
+
+// A gray frame of roughly chunk bytes: yuv420p takes 1.5 bytes per pixel
+static AVFrame *benchFrame(size_t bytes) {
+    AVFrame *frame = av_frame_alloc();
+    int width = 64;
+    int height = (int)(bytes / (width * 3 / 2));
+    frame->format = AV_PIX_FMT_YUV420P;
+    frame->width = width;
+    frame->height = height < 2 ? 2 : height & ~1;
+    if (av_frame_get_buffer(frame, 0) < 0) {
+        av_frame_free(&frame);
+    }
+    return frame;
+}
+
+static bool benchRun(BenchRun *run) {
+    run->push_ns = malloc(run->ops * sizeof(uint64_t));
+    run->pop_ns = malloc(run->ops * sizeof(uint64_t));
+
+    if (run->kind == BENCH_VIDEO) {
+        run->frame = benchFrame(run->chunk);
+        if (!run->frame) {
+            return false;
+        }
+        // Unbounded bytes and duration, so only the slot count limits the ring
+        videoBufferInit(&videoBuffer, (int)run->capacity, SIZE_MAX, 1000000, 1);
+    } else {
+        audioBufferInit(&audioBuffer, run->capacity);
+    }
+
+    pthread_t producer, consumer;
+    uint64_t start = benchNow();
+    pthread_create(&consumer, NULL, benchConsumer, run);
+    pthread_create(&producer, NULL, benchProducer, run);
+    pthread_join(producer, NULL);
+    pthread_join(consumer, NULL);
+    double seconds = (benchNow() - start) / 1e9;
+
+    printf("%-5s %9zu %9zu %11.0f %10.1f %9.2f %9.2f %9.2f %9.2f %7ld %7ld\n",
+           run->kind == BENCH_VIDEO ? "video" : "audio", run->chunk, run->capacity,
+           run->ops / seconds, run->ops * (double)run->chunk / seconds / 1048576.0,
+           percentile(run->push_ns, run->ops, 0.50), percentile(run->push_ns, run->ops, 0.99),
+           percentile(run->pop_ns, run->ops, 0.50), percentile(run->pop_ns, run->ops, 0.99),
+           run->push_switches, run->pop_switches);
+
+    if (run->kind == BENCH_VIDEO) {
+        videoBufferDestroy(&videoBuffer);
+        av_frame_free(&run->frame);
+    } else {
+        audioBufferDestroy(&audioBuffer);
+    }
+    free(run->push_ns);
+    free(run->pop_ns);
+    return true;
+}
+
+static void printUsage(const char *program) {
+    fprintf(stderr, "Usage: %s [options]\n", program);
+    fprintf(stderr, "  -n, --ops=N          items moved per configuration (default: 200000)\n");
+    fprintf(stderr, "  -c, --cores=P,C      cores for producer and consumer (default: 0,1; -1 unpinned)\n");
+    fprintf(stderr, "  --video-only / --audio-only\n");
+}
+
+int main(int argc, char **argv) {
+    int ops = 200000;
+    int cores[2] = {0, 1};
+    bool video = true, audio = true;
+
+    static struct option long_options[] = {
+        {"ops", required_argument, NULL, 'n'},
+        {"cores", required_argument, NULL, 'c'},
+        {"video-only", no_argument, NULL, 'v'},
+        {"audio-only", no_argument, NULL, 'a'},
+        {NULL, 0, NULL, 0}
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "n:c:", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 'n': ops = atoi(optarg); break;
+            case 'c':
+                if (sscanf(optarg, "%d,%d", &cores[0], &cores[1]) != 2) {
+                    printUsage(argv[0]);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'v': audio = false; break;
+            case 'a': video = false; break;
+            default:
+                printUsage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    if (ops < 1) {
+        printUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    static const size_t video_frames[] = {64 * 1024, 3 * 1024 * 1024};       // ~SD, ~1080p yuv420p
+    static const size_t video_slots[] = {2, 8, 32, 128};
+    static const size_t audio_chunks[] = {64, 1024, 4096, 16384};
+    static const size_t audio_rings[] = {8192, 65536, 1048576};
+
+    printf("%-5s %9s %9s %11s %10s %9s %9s %9s %9s %7s %7s\n", "ring", "chunk_B", "capacity",
+           "ops/s", "MiB/s", "push_p50", "push_p99", "pop_p50", "pop_p99", "csw_prd", "csw_con");
+    printf("%-5s %9s %9s %11s %10s %9s %9s %9s %9s %7s %7s\n", "", "", "", "", "", "us", "us", "us", "us", "", "");
+
+    for (size_t f = 0; video && f < sizeof(video_frames) / sizeof(video_frames[0]); f++) {
+        for (size_t s = 0; s < sizeof(video_slots) / sizeof(video_slots[0]); s++) {
+            BenchRun run = {BENCH_VIDEO, ops, video_frames[f], video_slots[s], {cores[0], cores[1]}};
+            if (!benchRun(&run)) {
+                fprintf(stderr, "Error: Could not allocate a benchmark frame\n");
+                return EXIT_FAILURE;
+            }
+        }
+    }
+    for (size_t c = 0; audio && c < sizeof(audio_chunks) / sizeof(audio_chunks[0]); c++) {
+        for (size_t r = 0; r < sizeof(audio_rings) / sizeof(audio_rings[0]); r++) {
+            if (audio_chunks[c] > audio_rings[r]) {
+                continue;  // A pop larger than the ring would never be satisfied
+            }
+            BenchRun run = {BENCH_AUDIO, ops, audio_chunks[c], audio_rings[r], {cores[0], cores[1]}};
+            benchRun(&run);
+        }
+    }
+    return EXIT_SUCCESS;
+}
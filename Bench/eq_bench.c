@@ -0,0 +1,140 @@
+#include <getopt.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../Decoding/equalizer.h"
+
+#define BENCH_RATE 44100
+#define BENCH_CHUNK 1024     // Frames per call, about what one decoded audio frame resamples to
+
+static double benchNow() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Two sines and some noise, loud enough that the boosts clip now and then
+static void fillSignal(int16_t *samples, int frames) {
+    unsigned seed = 2024;
+    for (int f = 0; f < frames; f++) {
+        for (int ch = 0; ch < EQ_CHANNELS; ch++) {
+            seed = seed * 1103515245u + 12345u;
+            double noise = ((seed >> 16) & 0x7fff) / 32768.0 - 0.5;
+            double value = 0.4 * sin(2 * M_PI * 55.0 * f / BENCH_RATE + ch) +
+                           0.2 * sin(2 * M_PI * 3100.0 * f / BENCH_RATE) + 0.1 * noise;
+            samples[f * EQ_CHANNELS + ch] = (int16_t)lrint(value * 32767);
+        }
+    }
+}
+
+/*
+  Runs one kernel over the whole signal in decoder-sized chunks, as the
+  audio thread would, and returns the seconds it took. The gains change
+  at the start and again halfway through, so the coefficient ramps are
+  part of what has to match.
+*/
+static double timeKernel(CpuLevel kernel, bool floats, const int16_t *signal, int frames, void *output) {
+    static const double gains[EQ_BANDS] = {6, -4, 3, -2, 5, -6, 2, -3, 4, -5};
+    Equalizer eq;
+    if (!equalizerInit(&eq, BENCH_RATE)) {
+        exit(EXIT_FAILURE);
+    }
+    eq.kernel = kernel;
+    for (int band = 0; band < EQ_BANDS; band++) {
+        equalizerSetGain(&eq, band, gains[band]);
+    }
+    size_t count = (size_t)frames * EQ_CHANNELS;
+    if (floats) {
+        for (size_t i = 0; i < count; i++) {
+            ((float *)output)[i] = signal[i] / 32768.0f;
+        }
+    } else {
+        memcpy(output, signal, count * sizeof(int16_t));
+    }
+
+    double start = benchNow();
+    for (int done = 0; done < frames; done += BENCH_CHUNK) {
+        int chunk = frames - done < BENCH_CHUNK ? frames - done : BENCH_CHUNK;
+        if (done == frames / 2 / BENCH_CHUNK * BENCH_CHUNK) {
+            equalizerSetPreset(&eq, 4);
+        }
+        if (floats) {
+            equalizerProcessFloat(&eq, (float *)output + (size_t)done * EQ_CHANNELS, chunk);
+        } else {
+            equalizerProcess(&eq, (int16_t *)output + (size_t)done * EQ_CHANNELS, chunk);
+        }
+    }
+    double seconds = benchNow() - start;
+    equalizerDestroy(&eq);
+    return seconds;
+}
+
+/*
+  Throughput of the equalizer's biquad cascade with every kernel the
+  CPU has, for S16 input (what the player feeds it, converted to float
+  and back) and for float input. Rates are given as samples per second
+  and per band: samples times bands filtered per second. Every SIMD
+  kernel's output must match the scalar one bit for bit; any mismatch
+  makes the run fail.
+*/
+int main(int argc, char **argv) {
+    int seconds = 60;
+
+    static struct option long_options[] = {
+        {"seconds", required_argument, NULL, 'n'},
+        {NULL, 0, NULL, 0}
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "n:", long_options, NULL)) != -1) {
+        if (opt != 'n' || (seconds = atoi(optarg)) < 1) {
+            fprintf(stderr, "Usage: %s [-n|--seconds=N]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    int frames = seconds * BENCH_RATE;
+    size_t count = (size_t)frames * EQ_CHANNELS;
+    int16_t *signal = malloc(count * sizeof(int16_t));
+    void *reference = malloc(count * sizeof(float)), *output = malloc(count * sizeof(float));
+    if (!signal || !reference || !output) {
+        fprintf(stderr, "Error: Could not allocate %d s of audio\n", seconds);
+        return EXIT_FAILURE;
+    }
+    fillSignal(signal, frames);
+
+    int failures = 0;
+    printf("%d s of stereo audio at %d Hz, %d bands, %d-frame calls\n", seconds, BENCH_RATE, EQ_BANDS, BENCH_CHUNK);
+    printf("%-6s %-8s %10s %14s %10s %9s %s\n", "input", "kernel", "Msample/s", "Msample/s*band", "realtime",
+           "vs scalar", "output");
+    for (int floats = 0; floats <= 1; floats++) {
+        size_t bytes = count * (floats ? sizeof(float) : sizeof(int16_t));
+        double scalar = timeKernel(CPU_SCALAR, floats, signal, frames, reference);
+        for (int k = CPU_SCALAR; k < CPU_LEVEL_COUNT; k++) {
+            if (!cpuHas(k) || k == CPU_AVX512) {
+                continue;   // AVX-512 runs the AVX2 kernel
+            }
+            double elapsed = scalar;
+            bool same = true;
+            if (k != CPU_SCALAR) {
+                memset(output, 0, bytes);
+                elapsed = timeKernel(k, floats, signal, frames, output);
+                same = memcmp(reference, output, bytes) == 0;
+                failures += !same;
+            }
+            double rate = count / elapsed;
+            printf("%-6s %-8s %10.1f %14.1f %9.0fx %8.2fx %s\n", floats ? "float" : "s16", cpuLevelName(k),
+                   rate / 1e6, rate * EQ_BANDS / 1e6, seconds / elapsed, scalar / elapsed,
+                   k == CPU_SCALAR ? "reference" : same ? "bit-exact" : "MISMATCH");
+        }
+    }
+
+    free(signal);
+    free(reference);
+    free(output);
+    if (failures) {
+        fprintf(stderr, "%d kernel outputs differ from the scalar reference\n", failures);
+    }
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
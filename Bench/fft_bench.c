@@ -0,0 +1,127 @@
+#include <getopt.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../Output/spectrum.h"
+
+#define BENCH_RATE 44100
+#define BENCH_TOLERANCE 1e-5   // Largest error against the direct DFT, relative to its largest bin
+
+static double benchNow() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Three sines, one off any bin, and some noise under the analyzer's Hann window
+static void fillSignal(const SpectrumAnalyzer *sa, float *re, float *im) {
+    unsigned seed = 2024;
+    for (int i = 0; i < SPECTRUM_FFT_SIZE; i++) {
+        seed = seed * 1103515245u + 12345u;
+        double noise = ((seed >> 16) & 0x7fff) / 32768.0 - 0.5;
+        double value = 0.5 * sin(2 * M_PI * 440.0 * i / BENCH_RATE) + 0.25 * sin(2 * M_PI * 1234.5 * i / BENCH_RATE) +
+                       0.1 * sin(2 * M_PI * 9000.0 * i / BENCH_RATE) + 0.01 * noise;
+        re[i] = (float)value * sa->window[i];
+        im[i] = 0.0f;
+    }
+}
+
+/*
+  Largest distance between the FFT's bins and those of a direct DFT of
+  the same input in double precision, relative to the largest bin.
+*/
+static double dftError(const float *input, const float *re, const float *im) {
+    static double cosine[SPECTRUM_FFT_SIZE], sine[SPECTRUM_FFT_SIZE];
+    for (int i = 0; i < SPECTRUM_FFT_SIZE; i++) {
+        cosine[i] = cos(2 * M_PI * i / SPECTRUM_FFT_SIZE);
+        sine[i] = sin(2 * M_PI * i / SPECTRUM_FFT_SIZE);
+    }
+    double largest = 0.0, error = 0.0;
+    for (int k = 0; k < SPECTRUM_FFT_SIZE; k++) {
+        double sum_re = 0.0, sum_im = 0.0;
+        for (int n = 0; n < SPECTRUM_FFT_SIZE; n++) {
+            int turn = (int)((long)k * n % SPECTRUM_FFT_SIZE);
+            sum_re += input[n] * cosine[turn];
+            sum_im -= input[n] * sine[turn];
+        }
+        largest = fmax(largest, hypot(sum_re, sum_im));
+        error = fmax(error, hypot(re[k] - sum_re, im[k] - sum_im));
+    }
+    return largest > 0.0 ? error / largest : error;
+}
+
+// Seconds for runs FFTs of the input with one kernel; the last result is left in re and im
+static double timeKernel(CpuLevel kernel, const SpectrumAnalyzer *sa, const float *input, float *re, float *im,
+                         int runs) {
+    double seconds = 0.0;
+    for (int run = 0; run < runs; run++) {
+        memcpy(re, input, sizeof(float) * SPECTRUM_FFT_SIZE);
+        memset(im, 0, sizeof(float) * SPECTRUM_FFT_SIZE);
+        double start = benchNow();
+        spectrumFft(kernel, sa, re, im);
+        seconds += benchNow() - start;
+    }
+    return seconds;
+}
+
+/*
+  Cost of the spectrum analyzer's FFT with every kernel the CPU has.
+  The scalar FFT is checked against a direct DFT, and every SIMD
+  kernel's bins must match the scalar ones bit for bit; either failing
+  makes the run fail.
+*/
+int main(int argc, char **argv) {
+    int runs = 20000;
+
+    static struct option long_options[] = {
+        {"runs", required_argument, NULL, 'n'},
+        {NULL, 0, NULL, 0}
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "n:", long_options, NULL)) != -1) {
+        if (opt != 'n' || (runs = atoi(optarg)) < 1) {
+            fprintf(stderr, "Usage: %s [-n|--runs=N]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    SpectrumAnalyzer *sa = malloc(sizeof(SpectrumAnalyzer));
+    if (!sa || !spectrumInit(sa, NULL, BENCH_RATE)) {
+        fprintf(stderr, "Error: Could not set up the analyzer\n");
+        return EXIT_FAILURE;
+    }
+    static float input[SPECTRUM_FFT_SIZE], im_zero[SPECTRUM_FFT_SIZE];
+    static float ref_re[SPECTRUM_FFT_SIZE], ref_im[SPECTRUM_FFT_SIZE], re[SPECTRUM_FFT_SIZE], im[SPECTRUM_FFT_SIZE];
+    fillSignal(sa, input, im_zero);
+
+    int failures = 0;
+    double scalar = timeKernel(CPU_SCALAR, sa, input, ref_re, ref_im, runs);
+    double error = dftError(input, ref_re, ref_im);
+    failures += error > BENCH_TOLERANCE;
+    printf("%d-point FFT, %d runs; scalar vs direct DFT: relative error %.2e (%s)\n", SPECTRUM_FFT_SIZE, runs, error,
+           error > BENCH_TOLERANCE ? "TOO LARGE" : "ok");
+    printf("%-8s %10s %9s %s\n", "kernel", "us/FFT", "vs scalar", "output");
+    for (int k = CPU_SCALAR; k < CPU_LEVEL_COUNT; k++) {
+        if (!cpuHas(k) || k == CPU_AVX512) {
+            continue;   // No AVX-512 passes, it would run scalar
+        }
+        double elapsed = scalar;
+        bool same = true;
+        if (k != CPU_SCALAR) {
+            elapsed = timeKernel(k, sa, input, re, im, runs);
+            same = memcmp(ref_re, re, sizeof(re)) == 0 && memcmp(ref_im, im, sizeof(im)) == 0;
+            failures += !same;
+        }
+        printf("%-8s %10.2f %8.2fx %s\n", cpuLevelName(k), elapsed / runs * 1e6, scalar / elapsed,
+               k == CPU_SCALAR ? "reference" : same ? "bit-exact" : "MISMATCH");
+    }
+
+    spectrumDestroy(sa);
+    free(sa);
+    if (failures) {
+        fprintf(stderr, "%d FFT checks failed\n", failures);
+    }
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
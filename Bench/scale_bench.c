@@ -0,0 +1,139 @@
+#include <getopt.h>
+#include <libavutil/imgutils.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../Decoding/scaler.h"
+#include "../Util/parallel.h"
+
+static const struct {
+    const char *name;
+    int width, height;
+} resolutions[] = {
+    {"360p", 640, 360},
+    {"720p", 1280, 720},
+    {"1080p", 1920, 1080},
+    {"2160p", 3840, 2160},
+};
+
+static double benchNow() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Smooth gradients plus a little noise, so no converter fast path is taken
+static void fillPattern(AVFrame *frame) {
+    unsigned seed = 12345;
+    for (int y = 0; y < frame->height; y++) {
+        for (int x = 0; x < frame->width; x++) {
+            seed = seed * 1103515245u + 12345u;
+            frame->data[0][y * frame->linesize[0] + x] = (uint8_t)((x + y) / 4 + (seed >> 28));
+        }
+    }
+    for (int y = 0; y < frame->height / 2; y++) {
+        for (int x = 0; x < frame->width / 2; x++) {
+            frame->data[1][y * frame->linesize[1] + x] = (uint8_t)(128 + x / 8 - y / 8);
+            frame->data[2][y * frame->linesize[2] + x] = (uint8_t)(x ^ y);
+        }
+    }
+}
+
+static void printUsage(const char *program) {
+    fprintf(stderr, "Usage: %s [options]\n", program);
+    fprintf(stderr, "  -n, --frames=N    conversions per measurement (default: 50)\n");
+    fprintf(stderr, "  -t, --threads=N   highest thread count measured (default: cores)\n");
+}
+
+/*
+  Benchmark of the slice-parallel swscale yuv420p -> RGB24 conversion
+  the player's convert thread falls back to when no SIMD kernel fits. For every resolution the time per frame
+  is measured at 1, 2, 4 ... threads and each result is compared byte
+  for byte with the single-threaded output.
+*/
+int main(int argc, char **argv) {
+    int frames = 50;
+    int max_threads = parallelDefaultThreads();
+
+    static struct option long_options[] = {
+        {"frames", required_argument, NULL, 'n'},
+        {"threads", required_argument, NULL, 't'},
+        {NULL, 0, NULL, 0}
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "n:t:", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 'n': frames = atoi(optarg); break;
+            case 't': max_threads = atoi(optarg); break;
+            default:
+                printUsage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    if (frames < 1 || max_threads < 1) {
+        printUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (max_threads > SCALER_MAX_SLICES) {
+        max_threads = SCALER_MAX_SLICES;
+    }
+
+    int failures = 0;
+    printf("%-6s %7s %10s %8s %s\n", "res", "threads", "ms/frame", "speedup", "output");
+
+    for (size_t r = 0; r < sizeof(resolutions) / sizeof(resolutions[0]); r++) {
+        int width = resolutions[r].width, height = resolutions[r].height;
+        AVFrame *src = av_frame_alloc();
+        src->format = AV_PIX_FMT_YUV420P;
+        src->width = width;
+        src->height = height;
+        if (av_frame_get_buffer(src, 0) < 0) {
+            fprintf(stderr, "Error: Could not allocate a %dx%d frame\n", width, height);
+            return EXIT_FAILURE;
+        }
+        fillPattern(src);
+
+        int size = av_image_get_buffer_size(AV_PIX_FMT_RGB24, width, height, 1);
+        uint8_t *reference = av_malloc(size), *output = av_malloc(size);
+        uint8_t *dst[4];
+        int dst_linesize[4];
+        double single = 0.0;
+
+        for (int threads = 1; threads <= max_threads; threads *= 2) {
+            ThreadPool pool;
+            SliceScaler scaler;
+            bool pooled = threads > 1 && threadPoolInit(&pool, threads);
+            scalerInit(&scaler, pooled ? &pool : NULL);
+            scaler.kernel = SCALER_SWSCALE;   // The SIMD kernels are timed by yuv2rgb_bench
+
+            uint8_t *target = threads == 1 ? reference : output;
+            av_image_fill_arrays(dst, dst_linesize, target, AV_PIX_FMT_RGB24, width, height, 1);
+            scalerConvert(&scaler, src, dst, dst_linesize, AV_PIX_FMT_RGB24);  // Warm up the contexts
+
+            double start = benchNow();
+            for (int i = 0; i < frames; i++) {
+                scalerConvert(&scaler, src, dst, dst_linesize, AV_PIX_FMT_RGB24);
+            }
+            double per_frame = (benchNow() - start) / frames * 1000.0;
+            if (threads == 1) {
+                single = per_frame;
+            }
+
+            bool same = threads == 1 || memcmp(reference, output, size) == 0;
+            failures += !same;
+            printf("%-6s %7d %10.3f %7.2fx %s\n", resolutions[r].name, threads, per_frame,
+                   single / per_frame, threads == 1 ? "reference" : same ? "identical" : "MISMATCH");
+
+            scalerDestroy(&scaler);
+            if (pooled) {
+                threadPoolDestroy(&pool);
+            }
+        }
+
+        av_free(reference);
+        av_free(output);
+        av_frame_free(&src);
+    }
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -1,16 +1,62 @@
 
 #include "buffer.h"
+#include <math.h>
+#include "../Stats/stats.h"
+#include "../Stats/trace.h"
 
 VideoBuffer videoBuffer;
+DisplayBuffer displayBuffer;
+// Only set up in display-rate mode; pausing and stopping broadcast on it regardless
+DisplayBuffer blendBuffer = {.mutex = PTHREAD_MUTEX_INITIALIZER, .notFull = PTHREAD_COND_INITIALIZER,
+                             .notEmpty = PTHREAD_COND_INITIALIZER};
 AudioBuffer audioBuffer;
+PacketQueue videoPacketQueue;
+PacketQueue audioPacketQueue;
+PacketQueue subtitlePacketQueue;
 
 
 
+// Weight of the newest sample in the production-time moving averages
+#define VIDEO_BUFFER_ADAPT_WEIGHT (1.0 / 16)
+// Standard deviations of production jitter the queue should absorb
+#define VIDEO_BUFFER_JITTER_SIGMAS 4.0
+// Longer gaps between pushes are pauses or loop wraps, not decode time
+#define VIDEO_BUFFER_MAX_PRODUCE 1.0
+
 // Circular Buffer Functions for Video
-void videoBufferInit(VideoBuffer *vb, int size) {
-    vb->pixbufs = malloc(size * sizeof(GdkPixbuf *));
+/*
+  Function videoBufferInit
+  sets up the queue of decoded frames. They stay in the decoder's
+  pixel format until picked for display, so the queue holds reference
+  counted AVFrames rather than converted images.
+  size is the number of slots (the most frames ever queued). Within it
+  the queue holds at most byte_budget bytes and, by default, target_ms
+  worth of frames at frame_rate; the frame limit grows when decode
+  times vary and falls back once they are steady.
+*/
+void videoBufferInit(VideoBuffer *vb, int size, size_t byte_budget, int target_ms, int frame_rate) {
+    vb->frames = malloc(size * sizeof(AVFrame *));
+    vb->pts = malloc(size * sizeof(double));
     vb->size = size;
     vb->start = vb->end = vb->count = 0;
+    vb->finished = false;
+
+    vb->bytes = 0;
+    vb->byte_budget = byte_budget;
+    vb->target_seconds = target_ms / 1000.0;
+    vb->frame_interval = 1.0 / (frame_rate > 0 ? frame_rate : 25);
+    vb->produce_mean = vb->frame_interval;
+    vb->produce_var = 0.0;
+    vb->last_push = 0;
+    vb->limit = (int)ceil(vb->target_seconds / vb->frame_interval);
+    if (vb->limit < VIDEO_BUFFER_MIN_FRAMES) vb->limit = VIDEO_BUFFER_MIN_FRAMES;
+    if (vb->limit > size) vb->limit = size;
+
+    vb->peak_bytes = 0;
+    vb->rgb_bytes = vb->peak_rgb_bytes = 0;
+    vb->min_limit = vb->max_limit = vb->limit;
+    vb->occupancy_sum = vb->occupancy_samples = 0;
+
     pthread_mutex_init(&vb->mutex, NULL);
     pthread_cond_init(&vb->notFull, NULL);
     pthread_cond_init(&vb->notEmpty, NULL);
@@ -18,31 +64,129 @@ void videoBufferInit(VideoBuffer *vb, int size) {
 
 void videoBufferDestroy(VideoBuffer *vb) {
     for (int i = 0; i < vb->count; i++) {
-        g_object_unref(vb->pixbufs[(vb->start + i) % vb->size]);
+        av_frame_free(&vb->frames[(vb->start + i) % vb->size]);
     }
-    free(vb->pixbufs);
+    free(vb->frames);
+    free(vb->pts);
     pthread_mutex_destroy(&vb->mutex);
     pthread_cond_destroy(&vb->notFull);
     pthread_cond_destroy(&vb->notEmpty);
 }
 
-bool videoBufferPush(VideoBuffer *vb, GdkPixbuf *pixbuf) {
+/*
+  Function videoBufferAdapt
+  folds the time the decoder took to produce this frame into moving
+  averages and resizes the frame limit: the duration target plus room
+  for a few standard deviations of production jitter.
+*/
+static void videoBufferAdapt(VideoBuffer *vb, uint64_t now) {
+    double produced = (now - vb->last_push) / 1e9;
+    if (vb->last_push && produced < VIDEO_BUFFER_MAX_PRODUCE) {
+        double diff = produced - vb->produce_mean;
+        vb->produce_mean += VIDEO_BUFFER_ADAPT_WEIGHT * diff;
+        vb->produce_var = (1.0 - VIDEO_BUFFER_ADAPT_WEIGHT) *
+                          (vb->produce_var + VIDEO_BUFFER_ADAPT_WEIGHT * diff * diff);
+    }
+
+    double seconds = vb->target_seconds + VIDEO_BUFFER_JITTER_SIGMAS * sqrt(vb->produce_var);
+    int limit = (int)ceil(seconds / vb->frame_interval);
+    if (limit < VIDEO_BUFFER_MIN_FRAMES) limit = VIDEO_BUFFER_MIN_FRAMES;
+    if (limit > vb->size) limit = vb->size;
+
+    vb->limit = limit;
+    if (limit < vb->min_limit) vb->min_limit = limit;
+    if (limit > vb->max_limit) vb->max_limit = limit;
+}
+
+// Called with the mutex held after count or bytes changed
+static void videoBufferSample(VideoBuffer *vb) {
+    vb->occupancy_sum += vb->count;
+    vb->occupancy_samples++;
+    if (vb->bytes > vb->peak_bytes) {
+        vb->peak_bytes = vb->bytes;
+    }
+    if (vb->rgb_bytes > vb->peak_rgb_bytes) {
+        vb->peak_rgb_bytes = vb->rgb_bytes;
+    }
+    statsRecord(STAT_VIDEO_QUEUE, vb->count);
+    statsRecord(STAT_VIDEO_QUEUE_KIB, vb->bytes / 1024);
+    traceCounter("video_queue", vb->count);
+    traceCounter("video_queue_kib", vb->bytes / 1024);
+}
+
+// Memory held by a decoded frame's buffers
+size_t videoFrameBytes(const AVFrame *frame) {
+    size_t bytes = 0;
+    for (int i = 0; i < AV_NUM_DATA_POINTERS && frame->buf[i]; i++) {
+        bytes += frame->buf[i]->size;
+    }
+    if (bytes == 0) {
+        bytes = av_image_get_buffer_size(frame->format, frame->width, frame->height, 1);
+    }
+    return bytes;
+}
+
+static size_t videoFrameRgbBytes(const AVFrame *frame) {
+    return (size_t)frame->width * frame->height * 3;
+}
+
+// A frame always fits into an empty queue, however large it is
+static bool videoBufferFull(const VideoBuffer *vb, size_t frame_bytes) {
+    if (vb->count == 0) {
+        return false;
+    }
+    return vb->count >= vb->limit || vb->bytes + frame_bytes > vb->byte_budget;
+}
+
+// Takes ownership of frame
+bool videoBufferPush(VideoBuffer *vb, AVFrame *frame, double pts) {
+    size_t frame_bytes = videoFrameBytes(frame);
+    uint64_t wait_start = statsNow();
+    traceBegin("video_push_wait");
     pthread_mutex_lock(&vb->mutex);
-    while (vb->count == vb->size) {
+    videoBufferAdapt(vb, wait_start);
+    while (videoBufferFull(vb, frame_bytes) && is_running) {
         pthread_cond_wait(&vb->notFull, &vb->mutex);
     }
-    vb->pixbufs[vb->end] = g_object_ref(pixbuf);
+    statsRecord(STAT_VIDEO_PUSH_WAIT, statsNow() - wait_start);
+    traceEnd("video_push_wait");
+
+    if (!is_running) {
+        pthread_mutex_unlock(&vb->mutex);
+        av_frame_free(&frame);
+        return false;
+    }
+    vb->frames[vb->end] = frame;
+    vb->pts[vb->end] = pts;
     vb->end = (vb->end + 1) % vb->size;
     vb->count++;
+    vb->bytes += frame_bytes;
+    vb->rgb_bytes += videoFrameRgbBytes(frame);
+    videoBufferSample(vb);
     pthread_cond_signal(&vb->notEmpty);
+    vb->last_push = statsNow();   // Waiting for room is not production time
     pthread_mutex_unlock(&vb->mutex);
     return true;
 }
 
-bool videoBufferPop(VideoBuffer *vb, GdkPixbuf **pixbuf) {
+// Removes the oldest frame, called with the mutex held and count > 0
+static void videoBufferTake(VideoBuffer *vb, AVFrame **frame, double *pts) {
+    *frame = vb->frames[vb->start];
+    *pts = vb->pts[vb->start];
+    vb->start = (vb->start + 1) % vb->size;
+    vb->count--;
+    vb->bytes -= videoFrameBytes(*frame);
+    vb->rgb_bytes -= videoFrameRgbBytes(*frame);
+    videoBufferSample(vb);
+    pthread_cond_signal(&vb->notFull); // Notify that buffer space is available
+}
+
+bool videoBufferPop(VideoBuffer *vb, AVFrame **frame, double *pts) {
+    uint64_t wait_start = statsNow();
+    traceBegin("video_pop_wait");
     pthread_mutex_lock(&vb->mutex);
 
-    while (vb->count == 0 && is_running) {
+    while (vb->count == 0 && is_running && !vb->finished) {
         if (is_paused) {
             pthread_mutex_unlock(&vb->mutex);
             checkPauseState(); // Wait while paused
@@ -50,20 +194,169 @@ bool videoBufferPop(VideoBuffer *vb, GdkPixbuf **pixbuf) {
         }
         pthread_cond_wait(&vb->notEmpty, &vb->mutex);
     }
+    statsRecord(STAT_VIDEO_POP_WAIT, statsNow() - wait_start);
+    traceEnd("video_pop_wait");
 
-    if (!is_running) {
+    if (!is_running || vb->count == 0) {
         pthread_mutex_unlock(&vb->mutex);
         return false;
     }
 
-    *pixbuf = vb->pixbufs[vb->start];
-    vb->start = (vb->start + 1) % vb->size;
-    vb->count--;
-    pthread_cond_signal(&vb->notFull); // Notify that buffer space is available
+    videoBufferTake(vb, frame, pts);
+    pthread_mutex_unlock(&vb->mutex);
+    return true;
+}
+
+// Non-blocking pop, false when no frame is queued
+bool videoBufferTryPop(VideoBuffer *vb, AVFrame **frame, double *pts) {
+    pthread_mutex_lock(&vb->mutex);
+    if (vb->count == 0 || !is_running) {
+        pthread_mutex_unlock(&vb->mutex);
+        return false;
+    }
+
+    videoBufferTake(vb, frame, pts);
     pthread_mutex_unlock(&vb->mutex);
     return true;
 }
 
+// No more frames will be pushed: pops return false once the queue is drained
+void videoBufferFinish(VideoBuffer *vb) {
+    pthread_mutex_lock(&vb->mutex);
+    vb->finished = true;
+    pthread_cond_broadcast(&vb->notEmpty);
+    pthread_mutex_unlock(&vb->mutex);
+}
+
+void videoBufferPrintStats(VideoBuffer *vb, FILE *out) {
+    pthread_mutex_lock(&vb->mutex);
+    fprintf(out, "Video buffer: limit %d..%d frames (last %d, %d slots), mean occupancy %.1f frames, "
+            "peak %.1f of %.1f MiB (%.1f MiB as RGB24)\n",
+            vb->min_limit, vb->max_limit, vb->limit, vb->size,
+            vb->occupancy_samples ? (double)vb->occupancy_sum / vb->occupancy_samples : 0.0,
+            vb->peak_bytes / 1048576.0, vb->byte_budget / 1048576.0, vb->peak_rgb_bytes / 1048576.0);
+    pthread_mutex_unlock(&vb->mutex);
+}
+
+// Circular Buffer Functions for Display
+void displayBufferInit(DisplayBuffer *db, int size) {
+    db->pixbufs = malloc(size * sizeof(GdkPixbuf *));
+    db->pts = malloc(size * sizeof(double));
+    db->size = size;
+    db->start = db->end = db->count = 0;
+    db->finished = false;
+    pthread_mutex_init(&db->mutex, NULL);
+    pthread_cond_init(&db->notFull, NULL);
+    pthread_cond_init(&db->notEmpty, NULL);
+}
+
+void displayBufferDestroy(DisplayBuffer *db) {
+    for (int i = 0; i < db->count; i++) {
+        g_object_unref(db->pixbufs[(db->start + i) % db->size]);
+    }
+    free(db->pixbufs);
+    free(db->pts);
+    pthread_mutex_destroy(&db->mutex);
+    pthread_cond_destroy(&db->notFull);
+    pthread_cond_destroy(&db->notEmpty);
+}
+
+bool displayBufferPush(DisplayBuffer *db, GdkPixbuf *pixbuf, double pts) {
+    pthread_mutex_lock(&db->mutex);
+    while (db->count == db->size && is_running) {
+        pthread_cond_wait(&db->notFull, &db->mutex);
+    }
+
+    if (!is_running) {
+        pthread_mutex_unlock(&db->mutex);
+        return false;
+    }
+    db->pixbufs[db->end] = g_object_ref(pixbuf);
+    db->pts[db->end] = pts;
+    db->end = (db->end + 1) % db->size;
+    db->count++;
+    pthread_cond_signal(&db->notEmpty);
+    pthread_mutex_unlock(&db->mutex);
+    return true;
+}
+
+bool displayBufferPop(DisplayBuffer *db, GdkPixbuf **pixbuf, double *pts) {
+    uint64_t wait_start = statsNow();
+    traceBegin("display_pop_wait");
+    pthread_mutex_lock(&db->mutex);
+
+    while (db->count == 0 && is_running && !db->finished) {
+        if (is_paused) {
+            pthread_mutex_unlock(&db->mutex);
+            checkPauseState(); // Wait while paused
+            pthread_mutex_lock(&db->mutex);
+        }
+        pthread_cond_wait(&db->notEmpty, &db->mutex);
+    }
+    statsRecord(STAT_DISPLAY_WAIT, statsNow() - wait_start);
+    traceEnd("display_pop_wait");
+
+    if (!is_running || db->count == 0) {
+        pthread_mutex_unlock(&db->mutex);
+        return false;
+    }
+
+    *pixbuf = db->pixbufs[db->start];
+    *pts = db->pts[db->start];
+    db->start = (db->start + 1) % db->size;
+    db->count--;
+    pthread_cond_signal(&db->notFull);
+    pthread_mutex_unlock(&db->mutex);
+    return true;
+}
+
+// Newest converted frame if there is one, older ones are released unshown; never waits
+bool displayBufferTryPop(DisplayBuffer *db, GdkPixbuf **pixbuf, double *pts) {
+    pthread_mutex_lock(&db->mutex);
+    if (db->count == 0 || !is_running) {
+        pthread_mutex_unlock(&db->mutex);
+        return false;
+    }
+
+    while (db->count > 1) {
+        g_object_unref(db->pixbufs[db->start]);
+        db->start = (db->start + 1) % db->size;
+        db->count--;
+        statsCount(COUNTER_DROPPED);
+    }
+    *pixbuf = db->pixbufs[db->start];
+    *pts = db->pts[db->start];
+    db->start = (db->start + 1) % db->size;
+    db->count--;
+    pthread_cond_signal(&db->notFull);
+    pthread_mutex_unlock(&db->mutex);
+    return true;
+}
+
+// Oldest frame if its time (or no time) is not after until; never waits, never drops
+bool displayBufferPopDue(DisplayBuffer *db, GdkPixbuf **pixbuf, double *pts, double until) {
+    pthread_mutex_lock(&db->mutex);
+    if (db->count == 0 || !is_running || db->pts[db->start] > until) {
+        pthread_mutex_unlock(&db->mutex);
+        return false;
+    }
+
+    *pixbuf = db->pixbufs[db->start];
+    *pts = db->pts[db->start];
+    db->start = (db->start + 1) % db->size;
+    db->count--;
+    pthread_cond_signal(&db->notFull);
+    pthread_mutex_unlock(&db->mutex);
+    return true;
+}
+
+void displayBufferFinish(DisplayBuffer *db) {
+    pthread_mutex_lock(&db->mutex);
+    db->finished = true;
+    pthread_cond_broadcast(&db->notEmpty);
+    pthread_mutex_unlock(&db->mutex);
+}
+
 // Circular Buffer Functions for Audio
 void audioBufferInit(AudioBuffer *ab, size_t size) {
     ab->buffer =  (uint8_t *)malloc(size);
@@ -148,3 +441,84 @@ bool audioBufferPop(AudioBuffer *ab, uint8_t *data, size_t bytes) {
     pthread_mutex_unlock(&ab->mutex);
     return true;
 }
+
+// Circular Buffer Functions for Packets
+void packetQueueInit(PacketQueue *pq, int size) {
+    pq->packets = malloc(size * sizeof(AVPacket *));
+    pq->kinds = malloc(size * sizeof(PacketKind));
+    pq->size = size;
+    pq->start = pq->end = pq->count = 0;
+    pq->closed = false;
+    pthread_mutex_init(&pq->mutex, NULL);
+    pthread_cond_init(&pq->notFull, NULL);
+    pthread_cond_init(&pq->notEmpty, NULL);
+}
+
+void packetQueueDestroy(PacketQueue *pq) {
+    for (int i = 0; i < pq->count; i++) {
+        av_packet_free(&pq->packets[(pq->start + i) % pq->size]);
+    }
+    free(pq->packets);
+    free(pq->kinds);
+    pthread_mutex_destroy(&pq->mutex);
+    pthread_cond_destroy(&pq->notFull);
+    pthread_cond_destroy(&pq->notEmpty);
+}
+
+// Takes ownership of packet (may be NULL for markers)
+bool packetQueuePush(PacketQueue *pq, AVPacket *packet, PacketKind kind) {
+    pthread_mutex_lock(&pq->mutex);
+    while (pq->count == pq->size && is_running && !pq->closed) {
+        pthread_cond_wait(&pq->notFull, &pq->mutex);
+    }
+
+    if (!is_running || pq->closed) {
+        pthread_mutex_unlock(&pq->mutex);
+        av_packet_free(&packet);
+        return false;
+    }
+
+    pq->packets[pq->end] = packet;
+    pq->kinds[pq->end] = kind;
+    pq->end = (pq->end + 1) % pq->size;
+    pq->count++;
+    pthread_cond_signal(&pq->notEmpty);
+    pthread_mutex_unlock(&pq->mutex);
+    return true;
+}
+
+bool packetQueuePop(PacketQueue *pq, AVPacket **packet, PacketKind *kind) {
+    uint64_t wait_start = statsNow();
+    traceBegin("packet_wait");
+    pthread_mutex_lock(&pq->mutex);
+    while (pq->count == 0 && is_running) {
+        pthread_cond_wait(&pq->notEmpty, &pq->mutex);
+    }
+    statsRecord(STAT_PACKET_WAIT, statsNow() - wait_start);
+    traceEnd("packet_wait");
+
+    if (!is_running) {
+        pthread_mutex_unlock(&pq->mutex);
+        return false;
+    }
+
+    *packet = pq->packets[pq->start];
+    *kind = pq->kinds[pq->start];
+    pq->start = (pq->start + 1) % pq->size;
+    pq->count--;
+    pthread_cond_signal(&pq->notFull);
+    pthread_mutex_unlock(&pq->mutex);
+    return true;
+}
+
+// Drops whatever is queued and makes further pushes no-ops
+void packetQueueClose(PacketQueue *pq) {
+    pthread_mutex_lock(&pq->mutex);
+    for (int i = 0; i < pq->count; i++) {
+        av_packet_free(&pq->packets[(pq->start + i) % pq->size]);
+    }
+    pq->start = pq->end = pq->count = 0;
+    pq->closed = true;
+    pthread_cond_broadcast(&pq->notFull);
+    pthread_mutex_unlock(&pq->mutex);
+}
@@ -5,17 +5,48 @@
 #include <gdk-pixbuf/gdk-pixbuf.h>
 #include <gdk/gdk.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <libavcodec/avcodec.h>
 #include "../Decoding/decoding.h"
 
-// Video Buffer Structure
+// Fewest frames the adaptive limit goes down to
+#define VIDEO_BUFFER_MIN_FRAMES 2
+
+// Video Buffer Structure (decoder -> converter), decoded frames still in their native format
+typedef struct {
+    AVFrame **frames;
+    double *pts;   // Presentation time in seconds, NAN if unknown
+    int size, start, end, count;   // size: slots allocated, the hard frame cap
+
+    // Bounds: queued bytes and a duration target, widened by decode jitter
+    size_t bytes, byte_budget;
+    int limit;                     // Current frame limit, <= size
+    double target_seconds, frame_interval;
+    double produce_mean, produce_var;   // Moving mean/variance of seconds between pushes
+    uint64_t last_push;
+
+    // Reporting
+    size_t peak_bytes;
+    size_t rgb_bytes, peak_rgb_bytes;   // What the same frames would take as RGB24
+    int min_limit, max_limit;
+    uint64_t occupancy_sum, occupancy_samples;
+
+    bool finished;   // Decoder is done, pops fail once the queue is empty
+    pthread_mutex_t mutex;
+    pthread_cond_t notFull, notEmpty;
+} VideoBuffer;
+
+// Display Buffer Structure (converter -> GUI), a few RGB frames ready to show
 typedef struct {
     GdkPixbuf **pixbufs;
+    double *pts;
     int size, start, end, count;
+    bool finished;   // Converter is done, pops fail once the queue is empty
     pthread_mutex_t mutex;
     pthread_cond_t notFull, notEmpty;
-} VideoBuffer;
+} DisplayBuffer;
 
 // Audio Buffer Structure
 typedef struct {
@@ -25,19 +56,60 @@ typedef struct {
     pthread_cond_t notFull, notEmpty;
 } AudioBuffer;
 
+// What a packet queue entry carries besides compressed data
+typedef enum {
+    PACKET_DATA,   // A demuxed packet
+    PACKET_LOOP,   // A-B loop wrapped: drain the decoder, the next packet restarts at A
+    PACKET_EOF,    // Input exhausted
+    PACKET_SWITCH  // Track switched: the marker's stream_index is the new stream (-1 for none)
+} PacketKind;
+
+// Packet Buffer Structure (demuxer -> decoder)
+typedef struct {
+    AVPacket **packets;
+    PacketKind *kinds;
+    int size, start, end, count;
+    bool closed;   // Consumer is gone, pushes are dropped
+    pthread_mutex_t mutex;
+    pthread_cond_t notFull, notEmpty;
+} PacketQueue;
+
 // Global Buffers
 extern VideoBuffer videoBuffer;
+extern DisplayBuffer displayBuffer;
+extern DisplayBuffer blendBuffer;     // Display-rate mode: blended frames, one per display refresh
 extern AudioBuffer audioBuffer;
+extern PacketQueue videoPacketQueue;
+extern PacketQueue audioPacketQueue;
+extern PacketQueue subtitlePacketQueue;
 
 // Buffer Functions
-void videoBufferInit(VideoBuffer *vb, int size);
+void videoBufferInit(VideoBuffer *vb, int size, size_t byte_budget, int target_ms, int frame_rate);
 void videoBufferDestroy(VideoBuffer *vb);
-bool videoBufferPush(VideoBuffer *vb, GdkPixbuf *pixbuf);
-bool videoBufferPop(VideoBuffer *vb, GdkPixbuf **pixbuf);
+bool videoBufferPush(VideoBuffer *vb, AVFrame *frame, double pts);
+bool videoBufferPop(VideoBuffer *vb, AVFrame **frame, double *pts);
+bool videoBufferTryPop(VideoBuffer *vb, AVFrame **frame, double *pts);
+void videoBufferFinish(VideoBuffer *vb);
+void videoBufferPrintStats(VideoBuffer *vb, FILE *out);
+size_t videoFrameBytes(const AVFrame *frame);
+
+void displayBufferInit(DisplayBuffer *db, int size);
+void displayBufferDestroy(DisplayBuffer *db);
+bool displayBufferPush(DisplayBuffer *db, GdkPixbuf *pixbuf, double pts);
+bool displayBufferPop(DisplayBuffer *db, GdkPixbuf **pixbuf, double *pts);
+bool displayBufferTryPop(DisplayBuffer *db, GdkPixbuf **pixbuf, double *pts);
+bool displayBufferPopDue(DisplayBuffer *db, GdkPixbuf **pixbuf, double *pts, double until);
+void displayBufferFinish(DisplayBuffer *db);
 
 void audioBufferInit(AudioBuffer *ab, size_t size);
 void audioBufferDestroy(AudioBuffer *ab);
 bool audioBufferPush(AudioBuffer *ab, const uint8_t *data, size_t bytes);
 bool audioBufferPop(AudioBuffer *ab, uint8_t *data, size_t bytes);
 
+void packetQueueInit(PacketQueue *pq, int size);
+void packetQueueDestroy(PacketQueue *pq);
+bool packetQueuePush(PacketQueue *pq, AVPacket *packet, PacketKind kind);
+bool packetQueuePop(PacketQueue *pq, AVPacket **packet, PacketKind *kind);
+void packetQueueClose(PacketQueue *pq);
+
 #endif // BUFFER_H
\ No newline at end of file
@@ -0,0 +1,74 @@
+#include "packetcache.h"
+
+#include <stdlib.h>
+
+// What one cached packet costs beyond its payload
+#define PACKET_OVERHEAD (sizeof(AVPacket) + sizeof(AVPacket *))
+
+void packetCacheInit(PacketCache *pc, size_t budget) {
+    pc->packets = NULL;
+    pc->count = pc->capacity = 0;
+    pc->bytes = 0;
+    pc->budget = budget;
+    pc->overflowed = false;
+    pc->hits = pc->misses = pc->passes = 0;
+}
+
+void packetCacheClear(PacketCache *pc) {
+    for (int i = 0; i < pc->count; i++) {
+        av_packet_free(&pc->packets[i]);
+    }
+    pc->count = 0;
+    pc->bytes = 0;
+    pc->overflowed = false;
+}
+
+void packetCacheDestroy(PacketCache *pc) {
+    packetCacheClear(pc);
+    free(pc->packets);
+    pc->packets = NULL;
+    pc->capacity = 0;
+}
+
+/*
+  Function packetCacheAdd
+  keeps a new reference to packet's data (no copy for refcounted packets).
+  Returns false, and marks the cache as overflowed, once the budget would
+  be exceeded; the cache is then left as is for the caller to fall back.
+*/
+bool packetCacheAdd(PacketCache *pc, const AVPacket *packet) {
+    size_t cost = packet->size + PACKET_OVERHEAD;
+    if (pc->overflowed || pc->bytes + cost > pc->budget) {
+        pc->overflowed = true;
+        return false;
+    }
+
+    if (pc->count == pc->capacity) {
+        int capacity = pc->capacity ? pc->capacity * 2 : 256;
+        AVPacket **packets = realloc(pc->packets, capacity * sizeof(AVPacket *));
+        if (!packets) {
+            pc->overflowed = true;
+            return false;
+        }
+        pc->packets = packets;
+        pc->capacity = capacity;
+    }
+
+    AVPacket *ref = av_packet_clone(packet);
+    if (!ref) {
+        pc->overflowed = true;
+        return false;
+    }
+    pc->packets[pc->count++] = ref;
+    pc->bytes += cost;
+    return true;
+}
+
+void packetCachePrintStats(const PacketCache *pc, FILE *out) {
+    uint64_t served = pc->hits + pc->misses;
+    fprintf(out, "Loop cache: %d packets, %.1f / %.1f MB%s, pass %llu, %llu hits, %llu misses (%.1f%% from memory)\n",
+            pc->count, pc->bytes / (1024.0 * 1024.0), pc->budget / (1024.0 * 1024.0),
+            pc->overflowed ? " (over budget, looping from disk)" : "",
+            (unsigned long long)pc->passes, (unsigned long long)pc->hits,
+            (unsigned long long)pc->misses, served ? 100.0 * pc->hits / served : 0.0);
+}
@@ -0,0 +1,26 @@
+#ifndef PACKETCACHE_H
+#define PACKETCACHE_H
+
+#include <libavcodec/avcodec.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Compressed packets kept in memory, in demux order, holding AVPacket refs
+typedef struct {
+    AVPacket **packets;
+    int count, capacity;
+    size_t bytes, budget;      // Bytes referenced vs. allowed
+    bool overflowed;           // A packet did not fit into the budget
+    uint64_t hits, misses;     // Packets served from memory vs. re-read from disk
+    uint64_t passes;           // Times the cached range was replayed
+} PacketCache;
+
+void packetCacheInit(PacketCache *pc, size_t budget);
+void packetCacheDestroy(PacketCache *pc);
+void packetCacheClear(PacketCache *pc);
+bool packetCacheAdd(PacketCache *pc, const AVPacket *packet);
+void packetCachePrintStats(const PacketCache *pc, FILE *out);
+
+#endif // PACKETCACHE_H
@@ -0,0 +1,165 @@
+#include "blend.h"
+
+#include <math.h>
+#include "../Stats/stats.h"
+#include "../Stats/trace.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BLEND_X86 1
+#endif
+
+/*
+  dst = a + ((b - a) * w + 64) >> 7 with w in [0, 128]. The product
+  stays within 16 bits (255 * 128 + 64 < 32768), so the SIMD kernels
+  work on 16-bit lanes with an arithmetic shift and round exactly like
+  the scalar one.
+*/
+typedef void (*BlendRow)(const uint8_t *a, const uint8_t *b, uint8_t *dst, size_t bytes, int weight);
+
+static void blendRowScalar(const uint8_t *a, const uint8_t *b, uint8_t *dst, size_t bytes, int weight) {
+    for (size_t x = 0; x < bytes; x++) {
+        int diff = (b[x] - a[x]) * weight + BLEND_WEIGHT_ONE / 2;
+        dst[x] = (uint8_t)(a[x] + (diff >> 7));
+    }
+}
+
+#ifdef BLEND_X86
+__attribute__((target("sse4.1")))
+static inline __m128i blendMix8(__m128i a, __m128i b, __m128i weight, __m128i round) {
+    __m128i diff = _mm_add_epi16(_mm_mullo_epi16(_mm_sub_epi16(b, a), weight), round);
+    return _mm_add_epi16(a, _mm_srai_epi16(diff, 7));
+}
+
+__attribute__((target("sse4.1")))
+static void blendRowSse41(const uint8_t *a, const uint8_t *b, uint8_t *dst, size_t bytes, int weight) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i w = _mm_set1_epi16((short)weight);
+    const __m128i round = _mm_set1_epi16(BLEND_WEIGHT_ONE / 2);
+    size_t x = 0;
+    for (; x + 16 <= bytes; x += 16) {
+        __m128i va = _mm_loadu_si128((const __m128i *)(a + x));
+        __m128i vb = _mm_loadu_si128((const __m128i *)(b + x));
+        __m128i lo = blendMix8(_mm_unpacklo_epi8(va, zero), _mm_unpacklo_epi8(vb, zero), w, round);
+        __m128i hi = blendMix8(_mm_unpackhi_epi8(va, zero), _mm_unpackhi_epi8(vb, zero), w, round);
+        _mm_storeu_si128((__m128i *)(dst + x), _mm_packus_epi16(lo, hi));
+    }
+    blendRowScalar(a + x, b + x, dst + x, bytes - x, weight);
+}
+
+// 16 bytes widened to one 256-bit register of 16-bit lanes
+__attribute__((target("avx2")))
+static inline __m128i blendMix16(const uint8_t *a, const uint8_t *b, __m256i weight, __m256i round) {
+    __m256i va = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)a));
+    __m256i vb = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)b));
+    __m256i diff = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_sub_epi16(vb, va), weight), round);
+    __m256i mixed = _mm256_add_epi16(va, _mm256_srai_epi16(diff, 7));
+    // packus works per 128-bit lane: keep quadwords 0 and 2
+    __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(mixed, mixed), 0x08);
+    return _mm256_castsi256_si128(packed);
+}
+
+__attribute__((target("avx2")))
+static void blendRowAvx2(const uint8_t *a, const uint8_t *b, uint8_t *dst, size_t bytes, int weight) {
+    const __m256i w = _mm256_set1_epi16((short)weight);
+    const __m256i round = _mm256_set1_epi16(BLEND_WEIGHT_ONE / 2);
+    size_t x = 0;
+    for (; x + 32 <= bytes; x += 32) {
+        _mm_storeu_si128((__m128i *)(dst + x), blendMix16(a + x, b + x, w, round));
+        _mm_storeu_si128((__m128i *)(dst + x + 16), blendMix16(a + x + 16, b + x + 16, w, round));
+    }
+    blendRowScalar(a + x, b + x, dst + x, bytes - x, weight);
+}
+#endif
+
+// There is no AVX-512 row; AVX-512 CPUs run the AVX2 one
+#define BLEND_MAX_LEVEL CPU_AVX2
+static const BlendRow blend_rows[CPU_LEVEL_COUNT] = {
+    [CPU_SCALAR] = blendRowScalar,
+#ifdef BLEND_X86
+    [CPU_SSE41] = blendRowSse41,
+    [CPU_AVX2] = blendRowAvx2,
+#endif
+};
+
+void blendRow(CpuLevel kernel, const uint8_t *a, const uint8_t *b, uint8_t *dst, size_t bytes, int weight) {
+    BlendRow row = cpuHas(kernel) && kernel <= BLEND_MAX_LEVEL && blend_rows[kernel] ? blend_rows[kernel] : blendRowScalar;
+    row(a, b, dst, bytes, weight);
+}
+
+void blenderInit(FrameBlender *bl, Scheduler *scheduler, int bands) {
+    bl->scheduler = scheduler;
+    bl->bands = bands < 1 ? 1 : bands > BLEND_MAX_BANDS ? BLEND_MAX_BANDS : bands;
+    bl->kernel = cpuBestLevel(BLEND_MAX_LEVEL);
+    bl->blended = bl->reused = bl->skipped = 0;
+}
+
+static void blenderBand(int index, void *context) {
+    FrameBlender *bl = context;
+    int first = bl->height * index / bl->bands;
+    int last = bl->height * (index + 1) / bl->bands;
+    for (int y = first; y < last; y++) {
+        size_t offset = (size_t)y * bl->rowstride;
+        blendRow(bl->kernel, bl->a + offset, bl->b + offset, bl->dst + offset, bl->row_bytes, bl->weight);
+    }
+}
+
+/*
+  Function blenderMix
+  returns a new reference to the picture weight of the way from a to
+  b. Weights that round to either end, and frames of different sizes,
+  hand back a reference to the nearer frame instead of blending.
+*/
+GdkPixbuf *blenderMix(FrameBlender *bl, GdkPixbuf *a, GdkPixbuf *b, double weight) {
+    int w = (int)lrint(weight * BLEND_WEIGHT_ONE);
+    int width = gdk_pixbuf_get_width(a), height = gdk_pixbuf_get_height(a);
+    bool alpha = gdk_pixbuf_get_has_alpha(a);
+    if (w <= 0 || w >= BLEND_WEIGHT_ONE || width != gdk_pixbuf_get_width(b) ||
+        height != gdk_pixbuf_get_height(b) || alpha != gdk_pixbuf_get_has_alpha(b) ||
+        gdk_pixbuf_get_rowstride(a) != gdk_pixbuf_get_rowstride(b)) {
+        bl->reused++;
+        return g_object_ref(w * 2 < BLEND_WEIGHT_ONE ? a : b);
+    }
+
+    // Same layout as the sources, so one stride serves all three pictures
+    int rowstride = gdk_pixbuf_get_rowstride(a);
+    uint8_t *pixels = g_try_malloc((size_t)rowstride * height);
+    GdkPixbuf *out = pixels ? gdk_pixbuf_new_from_data(pixels, GDK_COLORSPACE_RGB, alpha, 8, width, height,
+                                                       rowstride, (GdkPixbufDestroyNotify)g_free, NULL) : NULL;
+    if (!out) {
+        g_free(pixels);
+        bl->reused++;
+        return g_object_ref(w * 2 < BLEND_WEIGHT_ONE ? a : b);
+    }
+
+    uint64_t start = statsNow();
+    traceBegin("blend");
+    bl->a = gdk_pixbuf_read_pixels(a);
+    bl->b = gdk_pixbuf_read_pixels(b);
+    bl->dst = pixels;
+    bl->rowstride = rowstride;
+    bl->row_bytes = width * (alpha ? 4 : 3);
+    bl->height = height;
+    bl->weight = w;
+    if (bl->scheduler && bl->bands > 1) {
+        schedulerRun(bl->scheduler, TASK_REALTIME, bl->bands, blenderBand, bl);
+    } else {
+        for (int i = 0; i < bl->bands; i++) {
+            blenderBand(i, bl);
+        }
+    }
+    traceEnd("blend");
+    statsRecord(STAT_BLEND, statsNow() - start);
+    bl->blended++;
+    return out;
+}
+
+void blenderPrintStats(const FrameBlender *bl, int display_rate, int frame_rate, FILE *out) {
+    StatsSummary cost;
+    statsSummarize(STAT_BLEND, &cost);
+    fprintf(out, "Blend: %d fps to %d Hz, %s kernel in %d bands: %llu blended, %llu shown unblended, "
+            "%llu slots skipped late; blend mean %.2f ms, p99 %.2f ms, max %.2f ms per frame\n",
+            frame_rate, display_rate, cpuLevelName(bl->kernel), bl->bands, (unsigned long long)bl->blended,
+            (unsigned long long)bl->reused, (unsigned long long)bl->skipped,
+            cost.mean / 1e6, cost.p99 / 1e6, cost.max / 1e6);
+}
@@ -0,0 +1,41 @@
+#ifndef BLEND_H
+#define BLEND_H
+
+#include <gdk-pixbuf/gdk-pixbuf.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "../Util/cpu.h"
+#include "../Util/scheduler.h"
+
+#define BLEND_WEIGHT_ONE 128   // Weights are in 1/128 steps: 0 is all of a, 128 all of b
+#define BLEND_MAX_BANDS 16
+
+/*
+  Mixes two converted RGB frames into the picture shown between them.
+  Rows are split into bands that run as realtime tasks on the shared
+  scheduler; the row kernel is picked by CPU level and matches the
+  scalar one bit for bit.
+*/
+typedef struct {
+    Scheduler *scheduler;      // NULL blends on the calling thread
+    int bands;
+    CpuLevel kernel;
+
+    // Current blend
+    const uint8_t *a, *b;
+    uint8_t *dst;
+    int rowstride, row_bytes, height, weight;
+
+    // Reporting, only touched by the blending thread
+    uint64_t blended, reused, skipped;
+} FrameBlender;
+
+void blendRow(CpuLevel kernel, const uint8_t *a, const uint8_t *b, uint8_t *dst, size_t bytes, int weight);
+
+void blenderInit(FrameBlender *bl, Scheduler *scheduler, int bands);
+GdkPixbuf *blenderMix(FrameBlender *bl, GdkPixbuf *a, GdkPixbuf *b, double weight);
+void blenderPrintStats(const FrameBlender *bl, int display_rate, int frame_rate, FILE *out);
+
+#endif // BLEND_H
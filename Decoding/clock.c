@@ -0,0 +1,140 @@
+#include "clock.h"
+
+#include <math.h>
+#include <pthread.h>
+#include <time.h>
+
+// Longest stretch the clock runs on without a fresh update (covers pauses and stalls)
+#define CLOCK_MAX_EXTRAPOLATION 0.25
+
+static pthread_mutex_t clock_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t clock_changed = PTHREAD_COND_INITIALIZER;
+static double audio_pts = NAN;       // Presentation time of the sample heard at audio_time
+static double audio_time = 0.0;
+
+// Virtual time state, see clockUseVirtual
+static bool virtual_mode = false;
+static bool interrupted = false;
+static double virtual_now = 0.0;
+static double audio_written = 0.0;   // Stream time up to which audio was handed over
+static bool audio_waiting = false;   // Audio output is blocked until virtual time reaches audio_wait_until
+static double audio_wait_until = 0.0;
+static bool audio_finished = false;
+
+// Called with clock_lock held
+static double clockMonotonic() {
+    if (virtual_mode) {
+        return virtual_now;
+    }
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// pts: stream time, in seconds, of the sample reaching the speaker right now
+void clockSetAudio(double pts) {
+    pthread_mutex_lock(&clock_lock);
+    audio_pts = pts;
+    audio_time = clockMonotonic();
+    pthread_mutex_unlock(&clock_lock);
+}
+
+// Current audio position in seconds, NAN until audio has started
+double clockGetAudio() {
+    pthread_mutex_lock(&clock_lock);
+    double pts = audio_pts;
+    double elapsed = clockMonotonic() - audio_time;
+    pthread_mutex_unlock(&clock_lock);
+
+    if (isnan(pts)) {
+        return pts;
+    }
+    return pts + (elapsed < CLOCK_MAX_EXTRAPOLATION ? elapsed : CLOCK_MAX_EXTRAPOLATION);
+}
+
+/*
+  Function clockUseVirtual
+  switches to virtual time, for headless runs that go faster than real
+  time. The driver (the regression harness) moves time forward with
+  clockAdvanceTo; the virtual audio device blocks in clockWaitVirtual
+  until its next chunk is due, and the driver can wait in
+  clockWaitAudioIdle until audio has caught up. Must be called before
+  the pipeline threads start.
+*/
+void clockUseVirtual() {
+    virtual_mode = true;
+}
+
+bool clockIsVirtual() {
+    return virtual_mode;
+}
+
+double clockVirtualNow() {
+    pthread_mutex_lock(&clock_lock);
+    double now = virtual_now;
+    pthread_mutex_unlock(&clock_lock);
+    return now;
+}
+
+// Time never goes backwards
+void clockAdvanceTo(double t) {
+    pthread_mutex_lock(&clock_lock);
+    if (t > virtual_now) {
+        virtual_now = t;
+        if (virtual_now >= audio_wait_until) {
+            audio_waiting = false;  // Audio has work again; idle only once it blocks anew
+        }
+        pthread_cond_broadcast(&clock_changed);
+    }
+    pthread_mutex_unlock(&clock_lock);
+}
+
+// Audio device side: blocks until virtual time reaches t, false once interrupted
+bool clockWaitVirtual(double t) {
+    pthread_mutex_lock(&clock_lock);
+    if (virtual_now < t) {
+        audio_waiting = true;
+        audio_wait_until = t;
+        pthread_cond_broadcast(&clock_changed);
+    }
+    while (virtual_now < t && !interrupted) {
+        pthread_cond_wait(&clock_changed, &clock_lock);
+    }
+    audio_waiting = false;
+    bool running = !interrupted;
+    pthread_mutex_unlock(&clock_lock);
+    return running;
+}
+
+void clockAudioWritten(double end) {
+    pthread_mutex_lock(&clock_lock);
+    audio_written = end;
+    pthread_cond_broadcast(&clock_changed);
+    pthread_mutex_unlock(&clock_lock);
+}
+
+void clockAudioFinished() {
+    pthread_mutex_lock(&clock_lock);
+    audio_finished = true;
+    pthread_cond_broadcast(&clock_changed);
+    pthread_mutex_unlock(&clock_lock);
+}
+
+// Driver side: waits until audio is blocked on virtual time or has ended
+bool clockWaitAudioIdle() {
+    pthread_mutex_lock(&clock_lock);
+    while (!audio_waiting && !audio_finished && !interrupted) {
+        pthread_cond_wait(&clock_changed, &clock_lock);
+    }
+    bool running = !interrupted;
+    pthread_mutex_unlock(&clock_lock);
+    return running;
+}
+
+// Wakes every waiter for shutdown
+void clockInterrupt() {
+    pthread_mutex_lock(&clock_lock);
+    interrupted = true;
+    pthread_cond_broadcast(&clock_changed);
+    pthread_mutex_unlock(&clock_lock);
+}
@@ -0,0 +1,21 @@
+#ifndef CLOCK_H
+#define CLOCK_H
+
+#include <stdbool.h>
+
+// Playback clock driven by the audio output; video is presented against it
+void clockSetAudio(double pts);
+double clockGetAudio();
+
+// Virtual time for headless runs: advanced explicitly, never by the wall clock
+void clockUseVirtual();
+bool clockIsVirtual();
+double clockVirtualNow();
+void clockAdvanceTo(double t);
+bool clockWaitVirtual(double t);
+void clockAudioWritten(double end);
+void clockAudioFinished();
+bool clockWaitAudioIdle();
+void clockInterrupt();
+
+#endif // CLOCK_H
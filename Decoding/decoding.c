@@ -1,4 +1,19 @@
 #include "decoding.h"
+#include <math.h>
+#include "blend.h"
+#include "clock.h"
+#include "demux.h"
+#include "pipeline.h"
+#include "quality.h"
+#include "reverse.h"
+#include "scaler.h"
+#include "../Stats/stats.h"
+#include "../Stats/trace.h"
+
+#define BLEND_MAX_GAP 0.25   // Seconds between frames beyond which the display cuts instead of blending
+
+static FrameBlender blender;
+static QualityController quality;   // Only the video thread touches it until it is joined
 
 volatile int is_running = 1;
 volatile int is_paused = 0;
@@ -16,79 +31,117 @@ bool checkPauseState() {
         pthread_cond_broadcast(&audioBuffer.notEmpty);
         pthread_cond_broadcast(&videoBuffer.notFull);
         pthread_cond_broadcast(&audioBuffer.notFull);
+        pthread_cond_broadcast(&displayBuffer.notEmpty);
+        pthread_cond_broadcast(&displayBuffer.notFull);
+        pthread_cond_broadcast(&blendBuffer.notEmpty);
+        pthread_cond_broadcast(&blendBuffer.notFull);
     }
     return is_running;
 }
 
+// Stop every thread, including those blocked on a full or empty buffer
+void stopPlayback() {
+    is_running = 0;
+    pthread_cond_broadcast(&videoBuffer.notEmpty);
+    pthread_cond_broadcast(&videoBuffer.notFull);
+    pthread_cond_broadcast(&displayBuffer.notEmpty);
+    pthread_cond_broadcast(&displayBuffer.notFull);
+    pthread_cond_broadcast(&blendBuffer.notEmpty);
+    pthread_cond_broadcast(&blendBuffer.notFull);
+    pthread_cond_broadcast(&audioBuffer.notEmpty);
+    pthread_cond_broadcast(&audioBuffer.notFull);
+    pthread_cond_broadcast(&videoPacketQueue.notEmpty);
+    pthread_cond_broadcast(&videoPacketQueue.notFull);
+    pthread_cond_broadcast(&audioPacketQueue.notEmpty);
+    pthread_cond_broadcast(&audioPacketQueue.notFull);
+    pthread_cond_broadcast(&gopCache.notEmpty);
+    pthread_cond_broadcast(&gopCache.notFull);
+    if (demuxer.subtitles_routed) {
+        pthread_cond_broadcast(&subtitlePacketQueue.notEmpty);
+        pthread_cond_broadcast(&subtitlePacketQueue.notFull);
+    }
+    clockInterrupt();
+}
+
+// Stream time of a decoded frame in seconds, NAN if it carries no timestamp
+static double framePts(const AVFrame *frame, int stream_index) {
+    if (frame->best_effort_timestamp == AV_NOPTS_VALUE) {
+        return NAN;
+    }
+    return frame->best_effort_timestamp * av_q2d(demuxer.format_context->streams[stream_index]->time_base);
+}
+
 // Threads
 /*
-  Function videoThread
-  argument that is passed to the pthread_create function 
-  responsible for decoding the frame and pushing it onto the 
-  circular buffer, also initializes the codec.
+  Function queueVideoFrame
+  hands a reference to the decoded frame to the converter; the
+  picture itself is shared with the decoder, not copied.
 */
-void *videoThread(void *args) {
-    DecodeData *data = (DecodeData *)args;
-    const char *input_file = data->input_filename;
-
-    AVFormatContext *format_context = NULL;
-    AVCodecContext *codec_context = NULL;
-    const AVCodec *codec = NULL;
-    struct SwsContext *sws_ctx = NULL;
-    int video_stream_index = -1;
-
-    avformat_network_init();
-    if (avformat_open_input(&format_context, input_file, NULL, NULL) > 0) {
-        fprintf(stderr, "Error: Could not open input file '%s'\n", input_file);
-        return NULL;
+static void queueVideoFrame(AVFrame *frame) {
+    if (!demuxLoopKeeps(&demuxer, demuxer.video_stream_index, frame->best_effort_timestamp)) {
+        return;  // Outside the A-B loop range
     }
+    statsMarkStartup(STARTUP_FIRST_DECODED);
 
-    if (avformat_find_stream_info(format_context, NULL) < 0) {
-        fprintf(stderr, "Error: Could not find stream information\n");
-        avformat_close_input(&format_context);
-        return NULL;
+    AVFrame *queued = av_frame_clone(frame);
+    if (!queued) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        return;
     }
+    videoBufferPush(&videoBuffer, queued, framePts(frame, demuxer.video_stream_index));
+}
 
-    for (int i = 0; i < format_context->nb_streams; i++) {
-        if (format_context->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
-            video_stream_index = i;
+// decode_ns accumulates time spent inside the decoder, excluding queueing
+static void receiveVideoFrames(AVCodecContext *codec_context, AVFrame *frame, uint64_t *decode_ns) {
+    while (true) {
+        uint64_t receive_start = statsNow();
+        traceBegin("video_decode_frame");
+        int ret = avcodec_receive_frame(codec_context, frame);
+        traceEnd("video_decode_frame");
+        *decode_ns += statsNow() - receive_start;
+        if (ret < 0) {
             break;
         }
+        if (is_paused) {
+            checkPauseState();  // Wait while paused
+        }
+        queueVideoFrame(frame);
+        av_frame_unref(frame);
     }
+}
 
-    if (video_stream_index == -1) {
+/*
+  Function decodeVideo
+  responsible for decoding the packets the demuxer routes to
+  the video queue, also initializes the codec. With adaptive
+  quality each packet's decode time feeds the quality controller,
+  whose level changes are applied between packets.
+*/
+static void decodeVideo(const DecodeData *data) {
+    if (demuxer.video_stream_index == -1) {
         fprintf(stderr, "Error: No video stream found\n");
-        avformat_close_input(&format_context);
-        return NULL;
+        return;
     }
 
-    codec = avcodec_find_decoder(format_context->streams[video_stream_index]->codecpar->codec_id);
-    if (!codec) {
-        fprintf(stderr, "Error: Codec not found\n");
-        avformat_close_input(&format_context);
-        return NULL;
+    AVCodecContext *codec_context = demuxer.live ?
+        openLowDelayDecoder(demuxer.format_context, demuxer.video_stream_index, 1) :
+        openStreamDecoder(demuxer.format_context, demuxer.video_stream_index, 1);
+    if (!codec_context) {
+        return;
     }
 
-    codec_context = avcodec_alloc_context3(codec);
-    avcodec_parameters_to_context(codec_context, format_context->streams[video_stream_index]->codecpar);
-    if (avcodec_open2(codec_context, codec, NULL) < 0) {
-        fprintf(stderr, "Error: Could not open codec\n");
-        avcodec_free_context(&codec_context);
-        avformat_close_input(&format_context);
-        return NULL;
-    }
-
-    AVPacket *packet = av_packet_alloc();
     AVFrame *frame = av_frame_alloc();
-    AVFrame *rgb_frame = av_frame_alloc();
-    if (!packet || !frame || !rgb_frame) {
+    if (!frame) {
         fprintf(stderr, "Error: Memory allocation failed\n");
-        av_packet_free(&packet);
-        av_frame_free(&frame);
-        av_frame_free(&rgb_frame);
         avcodec_free_context(&codec_context);
-        avformat_close_input(&format_context);
-        return NULL;
+        return;
+    }
+
+    if (data->adaptive_quality) {
+        AVRational rate = demuxer.format_context->streams[demuxer.video_stream_index]->avg_frame_rate;
+        double interval = rate.num > 0 && rate.den > 0 ? rate.den / (double)rate.num :
+                          1.0 / (data->frame_rate > 0 ? data->frame_rate : 25);
+        qualityInit(&quality, interval);
     }
 
     while (is_running) {
@@ -97,165 +150,360 @@ void *videoThread(void *args) {
             continue;
         }
 
-        if (av_read_frame(format_context, packet) < 0) {
-            break;  // Exit if no more frames to read
+        AVPacket *packet;
+        PacketKind kind;
+        if (!packetQueuePop(&videoPacketQueue, &packet, &kind)) {
+            break;
         }
 
-        if (packet->stream_index == video_stream_index) {
-            if (avcodec_send_packet(codec_context, packet) < 0) {
+        if (kind == PACKET_DATA) {
+            uint64_t send_start = statsNow();
+            traceBegin("video_send_packet");
+            int ret = avcodec_send_packet(codec_context, packet);
+            traceEnd("video_send_packet");
+            uint64_t decode_ns = statsNow() - send_start;
+            av_packet_free(&packet);
+            if (ret < 0) {
                 fprintf(stderr, "Error: Failed to send packet for decoding\n");
                 break;
             }
+            receiveVideoFrames(codec_context, frame, &decode_ns);
+            statsRecord(STAT_VIDEO_DECODE, decode_ns);
+            if (data->adaptive_quality && qualityUpdate(&quality, decode_ns)) {
+                qualityApply(&quality, codec_context);
+            }
+        } else {
+            // Drain frames the decoder still holds back for reordering
+            uint64_t decode_ns = 0;
+            avcodec_send_packet(codec_context, NULL);
+            receiveVideoFrames(codec_context, frame, &decode_ns);
+            if (kind == PACKET_EOF) {
+                break;
+            }
+            avcodec_flush_buffers(codec_context);  // Loop wrapped, restart at A
+        }
+    }
 
-            while (avcodec_receive_frame(codec_context, frame) >= 0) {
-                if (is_paused) {
-                    checkPauseState();  // Wait while paused
-                    continue;
-                }
+    av_frame_free(&frame);
+    avcodec_free_context(&codec_context);
+}
 
-                if (!sws_ctx) {
-                    sws_ctx = sws_getContext(
-                        frame->width, frame->height, codec_context->pix_fmt,
-                        frame->width, frame->height, AV_PIX_FMT_RGB24,
-                        SWS_BILINEAR, NULL, NULL, NULL);
-                }
+/*
+  Function videoThread
+  argument that is passed to the pthread_create function.
+  Closing the queue on exit keeps the demuxer from blocking
+  on a decoder that is gone.
+*/
+void *videoThread(void *args) {
+    statsThreadName("video");
+    traceThreadName("video");
+    decodeVideo(args);
+    packetQueueClose(&videoPacketQueue);
+    videoBufferFinish(&videoBuffer);
+    return NULL;
+}
 
-                int num_bytes = av_image_get_buffer_size(AV_PIX_FMT_RGB24, frame->width, frame->height, 1);
-                uint8_t *buffer = av_malloc(num_bytes * sizeof(uint8_t));
-                av_image_fill_arrays(rgb_frame->data, rgb_frame->linesize, buffer,
-                                     AV_PIX_FMT_RGB24, frame->width, frame->height, 1);
+// Converts one decoded frame to an RGB24 pixbuf, NULL on failure
+static GdkPixbuf *convertFrame(const AVFrame *frame, SliceScaler *scaler) {
+    uint8_t *rgb_data[4];
+    int rgb_linesize[4];
+    int num_bytes = av_image_get_buffer_size(AV_PIX_FMT_RGB24, frame->width, frame->height, 1);
+    uint8_t *buffer = av_malloc(num_bytes * sizeof(uint8_t));
+    if (!buffer) {
+        return NULL;
+    }
+    av_image_fill_arrays(rgb_data, rgb_linesize, buffer,
+                         AV_PIX_FMT_RGB24, frame->width, frame->height, 1);
+
+    uint64_t scale_start = statsNow();
+    traceBegin("sws_scale");
+    bool converted = scalerConvert(scaler, frame, rgb_data, rgb_linesize, AV_PIX_FMT_RGB24);
+    traceEnd("sws_scale");
+    if (!converted) {
+        fprintf(stderr, "Error: Could not create the color converter\n");
+        av_free(buffer);
+        return NULL;
+    }
+    statsRecord(STAT_SCALE, statsNow() - scale_start);
+    statsCount(COUNTER_CONVERTED);
+
+    GdkPixbuf *pixbuf = gdk_pixbuf_new_from_data(
+        rgb_data[0], GDK_COLORSPACE_RGB, FALSE, 8,
+        frame->width, frame->height, rgb_linesize[0],
+        (GdkPixbufDestroyNotify)av_free, buffer);
+    if (!pixbuf) {
+        av_free(buffer);
+    }
+    return pixbuf;
+}
 
-                sws_scale(sws_ctx, (const uint8_t *const *)frame->data, frame->linesize,
-                          0, frame->height, rgb_frame->data, rgb_frame->linesize);
+/*
+  Function convertThread
+  picks the next frame to show and converts only that one. A frame
+  already more than a frame behind the audio clock is skipped, without
+  ever being converted, as long as a newer one is queued behind it;
+  on live inputs every frame with a newer one behind it is skipped.
+  The display buffer is kept short so conversion runs just ahead of
+  presentation; each conversion is split into bands that run as
+  realtime tasks on the shared scheduler (or a small pool of its own).
+*/
+void *convertThread(void *args) {
+    DecodeData *data = (DecodeData *)args;
+    double frame_interval = 1.0 / (data->frame_rate > 0 ? data->frame_rate : 25);
+    ThreadPool pool;
+    SliceScaler scaler;
+
+    statsThreadName("convert");
+    traceThreadName("convert");
+    bool pooled = !data->scheduler && data->convert_threads > 1 && threadPoolInit(&pool, data->convert_threads);
+    if (data->scheduler) {
+        scalerInitScheduled(&scaler, data->scheduler, data->convert_threads);
+    } else {
+        scalerInit(&scaler, pooled ? &pool : NULL);
+    }
+
+    while (is_running) {
+        AVFrame *frame, *next;
+        double pts, next_pts;
+        if (!videoBufferPop(&videoBuffer, &frame, &pts)) {
+            break;
+        }
+
+        // Live input never waits for the audio clock: anything newer makes this frame stale
+        double audio = clockGetAudio();
+        while ((data->live || (!isnan(pts) && !isnan(audio) && audio - pts > frame_interval)) &&
+               videoBufferTryPop(&videoBuffer, &next, &next_pts)) {
+            av_frame_free(&frame);
+            statsCount(COUNTER_DROPPED);
+            traceInstant("drop_late");
+            frame = next;
+            pts = next_pts;
+        }
+
+        GdkPixbuf *pixbuf = convertFrame(frame, &scaler);
+        av_frame_free(&frame);
+        if (pixbuf) {
+            displayBufferPush(&displayBuffer, pixbuf, pts);
+            g_object_unref(pixbuf);
+        }
+    }
 
-                GdkPixbuf *pixbuf = gdk_pixbuf_new_from_data(
-                    rgb_frame->data[0], GDK_COLORSPACE_RGB, FALSE, 8,
-                    frame->width, frame->height, rgb_frame->linesize[0],
-                    (GdkPixbufDestroyNotify)av_free, buffer);
+    displayBufferFinish(&displayBuffer);
+    scalerDestroy(&scaler);
+    if (pooled) {
+        threadPoolDestroy(&pool);
+    }
+    return NULL;
+}
+
+// Conversion work avoided by skipping late frames before sws_scale
+void printConversionStats(FILE *out) {
+    StatsSummary scale;
+    statsSummarize(STAT_SCALE, &scale);
+    uint64_t skipped = statsCounter(COUNTER_DROPPED);
+    fprintf(out, "Conversion: %llu frames converted, %llu late frames skipped unconverted (~%.1f ms of sws_scale saved)\n",
+            (unsigned long long)statsCounter(COUNTER_CONVERTED), (unsigned long long)skipped,
+            skipped * scale.mean / 1e6);
+}
 
-                if (pixbuf) {
-                    videoBufferPush(&videoBuffer, pixbuf);
-                    g_object_unref(pixbuf);
-                } else {
-                    av_free(buffer);
+/*
+  Function blendThread
+  resamples the converted frames to the display rate. Display slots
+  are spaced 1/display_rate apart in media time; each one gets the
+  two frames around it mixed by how far the slot lies between them,
+  so 24 fps on a 60 Hz display moves evenly instead of alternating
+  two and three refreshes per frame. Slots already behind the audio
+  clock are skipped unrendered. The timeline restarts on frames
+  without a timestamp and when time jumps back (A-B loop wrap).
+*/
+void *blendThread(void *args) {
+    DecodeData *data = (DecodeData *)args;
+    double interval = 1.0 / data->display_rate;
+    GdkPixbuf *prev = NULL, *next = NULL;
+    double prev_pts = NAN, next_pts = NAN, slot = NAN;
+
+    statsThreadName("blend");
+    traceThreadName("blend");
+    blenderInit(&blender, data->scheduler, data->convert_threads);
+
+    while (is_running) {
+        // Advance until prev <= slot < next
+        if (!next || (!isnan(slot) && next_pts <= slot)) {
+            if (prev) {
+                g_object_unref(prev);
+            }
+            prev = next;
+            prev_pts = next_pts;
+            next = NULL;
+            if (!displayBufferPop(&displayBuffer, &next, &next_pts)) {
+                break;
+            }
+            if (isnan(next_pts) || (prev && next_pts <= prev_pts)) {
+                if (prev) {
+                    g_object_unref(prev);
+                    prev = NULL;
                 }
+                slot = next_pts;
+            } else if (isnan(slot)) {
+                slot = next_pts;
             }
+            continue;
         }
 
-        av_packet_unref(packet);
-    }
+        if (isnan(slot)) {  // Untimed frame, shown as it is
+            displayBufferPush(&blendBuffer, next, NAN);
+            g_object_unref(next);
+            next = NULL;
+            continue;
+        }
 
-    av_packet_free(&packet);
-    av_frame_free(&frame);
-    av_frame_free(&rgb_frame);
-    avcodec_free_context(&codec_context);
-    avformat_close_input(&format_context);
-    if (sws_ctx) {
-        sws_freeContext(sws_ctx);
+        double audio = clockGetAudio();
+        if (!isnan(audio) && audio - slot > interval) {
+            double behind = ceil((audio - slot) / interval);
+            blender.skipped += (uint64_t)behind;
+            slot += behind * interval;
+            continue;
+        }
+
+        GdkPixbuf *shown;
+        if (next_pts - prev_pts > BLEND_MAX_GAP) {
+            shown = g_object_ref(prev);
+            blender.reused++;
+        } else {
+            shown = blenderMix(&blender, prev, next, (slot - prev_pts) / (next_pts - prev_pts));
+        }
+        displayBufferPush(&blendBuffer, shown, slot);
+        g_object_unref(shown);
+        slot += interval;
     }
 
+    if (prev) {
+        g_object_unref(prev);
+    }
+    if (next) {
+        g_object_unref(next);
+    }
+    displayBufferFinish(&blendBuffer);
     return NULL;
 }
 
-void *audioThread(void *args) {
-    DecodeData *data = (DecodeData *)args;
-    const char *input_file = data->input_filename;
-    AVFormatContext *format_context = NULL;
-    AVCodecContext *codec_context = NULL;
-    const AVCodec *codec = NULL;
-    SwrContext *swr_ctx = NULL;
-    int audio_stream_index = -1;
-
-    // Initialize FFmpeg
-    avformat_network_init();
-    if (avformat_open_input(&format_context, input_file, NULL, NULL) < 0) {
-        fprintf(stderr, "Error: Could not open input file '%s'\n", input_file);
-        return NULL;
+void printBlendStats(const DecodeData *data, FILE *out) {
+    if (data->display_rate > 0) {
+        blenderPrintStats(&blender, data->display_rate, data->frame_rate, out);
     }
-    if (avformat_find_stream_info(format_context, NULL) < 0) {
-        fprintf(stderr, "Error: Could not find stream information\n");
-        avformat_close_input(&format_context);
-        return NULL;
+}
+
+void printQualityStats(const DecodeData *data, FILE *out) {
+    if (data->adaptive_quality) {
+        qualityPrintStats(&quality, out);
     }
+}
 
-    // Find the audio stream
-    for (int i = 0; i < format_context->nb_streams; i++) {
-        if (format_context->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_AUDIO) {
-            audio_stream_index = i;
+/*
+  Function playAudioFrames
+  resamples, equalizes and writes every frame the decoder has ready.
+  After each write the audio clock is set to what is audible now: the
+  end of the frame just written minus what the sink still has buffered.
+*/
+static void playAudioFrames(AVCodecContext *codec_context, int stream_index, AVFrame *frame, SwrContext *swr_ctx,
+                            Equalizer *equalizer, AudioSink *sink, uint8_t *output_buffer, uint64_t *decode_ns) {
+    while (true) {
+        uint64_t receive_start = statsNow();
+        traceBegin("audio_decode_frame");
+        int ret = avcodec_receive_frame(codec_context, frame);
+        traceEnd("audio_decode_frame");
+        *decode_ns += statsNow() - receive_start;
+        if (ret != 0) {
             break;
         }
+        if (is_paused) {
+            checkPauseState();  // Wait while paused
+        }
+
+        if (!demuxLoopKeeps(&demuxer, stream_index, frame->best_effort_timestamp)) {
+            continue;  // Outside the A-B loop range
+        }
+
+        int num_samples = swr_convert(swr_ctx, &output_buffer, OUTPUT_SAMPLE_RATE,
+                                      (const uint8_t **)frame->data, frame->nb_samples);
+        if (num_samples < 0) {
+            fprintf(stderr, "Error: Audio resampling failed\n");
+            continue;
+        }
+        if (equalizer) {
+            traceBegin("audio_equalizer");
+            equalizerProcess(equalizer, (int16_t *)output_buffer, num_samples);
+            traceEnd("audio_equalizer");
+        }
+
+        double pts = framePts(frame, stream_index);
+        uint64_t write_start = statsNow();
+        traceBegin("audio_write");
+        bool written = audioSinkWrite(sink, output_buffer, num_samples, pts);
+        traceEnd("audio_write");
+        if (!written) {
+            if (!is_running) {
+                break;
+            }
+            continue;
+        }
+        statsRecord(STAT_AUDIO_WRITE, statsNow() - write_start);
+        statsMarkStartup(STARTUP_FIRST_AUDIO);
+
+        double latency = audioSinkLatency(sink);
+        if (!isnan(pts) && latency >= 0.0) {
+            clockSetAudio(pts + (double)frame->nb_samples / frame->sample_rate - latency);
+        }
     }
-    if (audio_stream_index == -1) {
-        fprintf(stderr, "Error: Could not find an audio stream\n");
-        avformat_close_input(&format_context);
-        return NULL;
-    }
+}
 
-    // Initialize the codec
-    codec = avcodec_find_decoder(format_context->streams[audio_stream_index]->codecpar->codec_id);
-    if (!codec) {
-        fprintf(stderr, "Error: Codec not found\n");
-        avformat_close_input(&format_context);
-        return NULL;
+// Decoder and resampler for stream_index; both are left NULL on failure
+static bool openAudioTrack(int stream_index, AVCodecContext **codec_context, SwrContext **swr_ctx) {
+    *codec_context = openStreamDecoder(demuxer.format_context, stream_index, 1);
+    if (!*codec_context) {
+        return false;
     }
-    codec_context = avcodec_alloc_context3(codec);
-    avcodec_parameters_to_context(codec_context, format_context->streams[audio_stream_index]->codecpar);
-    if (avcodec_open2(codec_context, codec, NULL) < 0) {
-        fprintf(stderr, "Error: Could not open codec\n");
-        avcodec_free_context(&codec_context);
-        avformat_close_input(&format_context);
-        return NULL;
+    *swr_ctx = openResampler(*codec_context, OUTPUT_SAMPLE_RATE);
+    if (!*swr_ctx) {
+        avcodec_free_context(codec_context);
+        return false;
     }
+    return true;
+}
 
-    // Initialize resampler
-    swr_ctx = swr_alloc_set_opts(
-        NULL,
-        AV_CH_LAYOUT_STEREO,        // Output: Stereo
-        AV_SAMPLE_FMT_S16,          // Output: Signed 16-bit PCM
-        44100,                      // Output: 44.1 kHz sample rate
-        codec_context->channel_layout, // Input channel layout
-        codec_context->sample_fmt,     // Input sample format
-        codec_context->sample_rate,    // Input sample rate
-        0, NULL);
-    if (!swr_ctx || swr_init(swr_ctx) < 0) {
-        fprintf(stderr, "Error: Could not initialize resampler\n");
-        if (swr_ctx) swr_free(&swr_ctx);
-        avcodec_free_context(&codec_context);
-        avformat_close_input(&format_context);
-        return NULL;
+static void decodeAudio(const DecodeData *data) {
+    int stream_index = __atomic_load_n(&demuxer.audio_stream_index, __ATOMIC_ACQUIRE);   // Switches arrive in order with the packets
+    if (stream_index == -1) {
+        fprintf(stderr, "Error: Could not find an audio stream\n");
+        return;
+    }
+
+    // Initialize the codec and resampler
+    AVCodecContext *codec_context;
+    SwrContext *swr_ctx;
+    if (!openAudioTrack(stream_index, &codec_context, &swr_ctx)) {
+        return;
     }
 
-    // Initialize PulseAudio for playback
-    pa_simple *pulse = NULL;
-    pa_sample_spec sample_spec = {
-        .format = PA_SAMPLE_S16LE,
-        .rate = 44100,
-        .channels = 2,
-    };
-    int pulse_error;
-    pulse = pa_simple_new(NULL, "MediaPlayer", PA_STREAM_PLAYBACK, NULL, "Audio", &sample_spec, NULL, NULL, &pulse_error);
-    if (!pulse) {
-        fprintf(stderr, "Error: PulseAudio initialization failed: %s\n", pa_strerror(pulse_error));
+    // Open the audio output
+    AudioSink sink;
+    if (!audioSinkOpen(&sink, &data->audio_sink, OUTPUT_SAMPLE_RATE, OUTPUT_CHANNELS)) {
         swr_free(&swr_ctx);
         avcodec_free_context(&codec_context);
-        avformat_close_input(&format_context);
-        return NULL;
+        return;
     }
 
     // Allocate buffers
-    AVPacket *packet = av_packet_alloc();
     AVFrame *frame = av_frame_alloc();
-    uint8_t *output_buffer = av_malloc(44100 * 2 * 2); // 44.1 kHz, stereo, 16-bit samples
-    if (!packet || !frame || !output_buffer) {
+    uint8_t *output_buffer = av_malloc(OUTPUT_SAMPLE_RATE * OUTPUT_CHANNELS * OUTPUT_BYTES_PER_SAMPLE); // One second
+    if (!frame || !output_buffer) {
         fprintf(stderr, "Error: Could not allocate buffers\n");
-        av_packet_free(&packet);
         av_frame_free(&frame);
         if (output_buffer) av_free(output_buffer);
-        pa_simple_free(pulse);
+        audioSinkClose(&sink);
         swr_free(&swr_ctx);
         avcodec_free_context(&codec_context);
-        avformat_close_input(&format_context);
-        return NULL;
+        return;
     }
 
     // Main decoding loop
@@ -265,49 +513,67 @@ void *audioThread(void *args) {
             continue;
         }
 
-        if (av_read_frame(format_context, packet) < 0) {
-            break;  // Exit if no more frames to read
+        AVPacket *packet;
+        PacketKind kind;
+        if (!packetQueuePop(&audioPacketQueue, &packet, &kind)) {
+            break;
         }
 
-        if (packet->stream_index == audio_stream_index) {
-            if (avcodec_send_packet(codec_context, packet) == 0) {
-                while (avcodec_receive_frame(codec_context, frame) == 0) {
-                    if (is_paused) {
-                        checkPauseState();  // Wait while paused
-                        continue;
-                    }
-
-                    int num_samples = swr_convert(swr_ctx, &output_buffer, 44100,
-                                                  (const uint8_t **)frame->data, frame->nb_samples);
-                    if (num_samples < 0) {
-                        fprintf(stderr, "Error: Audio resampling failed\n");
-                        continue;
-                    }
-
-                    // Calculate the size of the resampled data
-                    int data_size = num_samples * 2 * 2; // Stereo, 16-bit samples
-                    if (pa_simple_write(pulse, output_buffer, data_size, &pulse_error) < 0) {
-                        fprintf(stderr, "Error: PulseAudio write failed: %s\n", pa_strerror(pulse_error));
-                    }
-                }
+        if (kind == PACKET_DATA && !codec_context) {
+            av_packet_free(&packet);   // The track switched to could not be opened
+        } else if (kind == PACKET_SWITCH) {
+            // Play out the old track, then decode the new one into the same sink
+            uint64_t decode_ns = 0;
+            if (codec_context) {
+                avcodec_send_packet(codec_context, NULL);
+                playAudioFrames(codec_context, stream_index, frame, swr_ctx, data->equalizer, &sink, output_buffer, &decode_ns);
+                swr_free(&swr_ctx);
+                avcodec_free_context(&codec_context);
+            }
+            stream_index = packet->stream_index;
+            av_packet_free(&packet);
+            openAudioTrack(stream_index, &codec_context, &swr_ctx);
+        } else if (kind == PACKET_DATA) {
+            uint64_t send_start = statsNow();
+            traceBegin("audio_send_packet");
+            int ret = avcodec_send_packet(codec_context, packet);
+            traceEnd("audio_send_packet");
+            if (ret == 0) {
+                uint64_t decode_ns = statsNow() - send_start;
+                playAudioFrames(codec_context, stream_index, frame, swr_ctx, data->equalizer, &sink, output_buffer, &decode_ns);
+                statsRecord(STAT_AUDIO_DECODE, decode_ns);
+            }
+            av_packet_free(&packet);
+        } else {
+            uint64_t decode_ns = 0;
+            if (codec_context) {
+                avcodec_send_packet(codec_context, NULL);
+                playAudioFrames(codec_context, stream_index, frame, swr_ctx, data->equalizer, &sink, output_buffer, &decode_ns);
+            }
+            if (kind == PACKET_EOF) {
+                break;
+            }
+            if (codec_context) {
+                avcodec_flush_buffers(codec_context);  // Loop wrapped, restart at A
             }
         }
-        av_packet_unref(packet);
-    }
-
-    // Drain any remaining audio
-    if (pa_simple_drain(pulse, &pulse_error) < 0) {
-        fprintf(stderr, "Error: PulseAudio drain failed: %s\n", pa_strerror(pulse_error));
     }
 
-    // Cleanup
-    av_packet_free(&packet);
+    // Drain any remaining audio, then clean up
+    audioSinkClose(&sink);
     av_frame_free(&frame);
     av_free(output_buffer);
-    pa_simple_free(pulse);
     swr_free(&swr_ctx);
     avcodec_free_context(&codec_context);
-    avformat_close_input(&format_context);
+}
 
+void *audioThread(void *args) {
+    statsThreadName("audio");
+    traceThreadName("audio");
+    decodeAudio(args);
+    packetQueueClose(&audioPacketQueue);
+    if (clockIsVirtual()) {
+        clockAudioFinished();
+    }
     return NULL;
-}
\ No newline at end of file
+}
@@ -6,23 +6,41 @@
 #include <libavutil/imgutils.h>
 #include <libswscale/swscale.h>
 #include <libswresample/swresample.h>
-#include <pulse/simple.h>
-#include <pulse/error.h>
 #include <pthread.h>
 #include "../Buffer/buffer.h"
+#include "../IO/mmapio.h"
+#include "../Output/audiosink.h"
+#include "../Util/scheduler.h"
+#include "equalizer.h"
 
 typedef struct {
     char *input_filename;
     int frame_rate;
     GdkPixbuf *pixbuf;
+    IOMode io_mode;
+    bool live;             // Low-latency input: newest frame only, presented on the next display refresh
+    int display_rate;      // > 0: frames are blended to this refresh rate into blendBuffer
+    bool adaptive_quality; // Video decoder shortcuts are taken and dropped with decode load
+    bool reverse;          // Play backwards GOP by GOP, without audio
+    double reverse_from;   // Reverse: seconds to start from, 0 for the end of the input
+    int convert_threads;   // Bands each frame's color conversion is split into
+    Scheduler *scheduler;  // Shared workers for short tasks; NULL: the converter keeps a pool of its own
+    Equalizer *equalizer;  // Resampled audio goes through it on the way to the sink, NULL for none
+    AudioSinkConfig audio_sink;
 } DecodeData;
 
 extern volatile int is_running;
 extern volatile int is_paused;
 
 void *videoThread(void *args);
+void *convertThread(void *args);
+void printConversionStats(FILE *out);
+void *blendThread(void *args);
+void printBlendStats(const DecodeData *data, FILE *out);
+void printQualityStats(const DecodeData *data, FILE *out);
 void *audioThread(void *args);
 void togglePause();
 bool checkPauseState();
+void stopPlayback();
 
 #endif // DECODER_H
\ No newline at end of file
@@ -0,0 +1,532 @@
+#include "demux.h"
+
+#include <math.h>
+#include "pipeline.h"
+#include "../Stats/stats.h"
+#include "../Stats/trace.h"
+
+#define PROBE_SIZE (1024 * 1024)   // Bytes stream info may be gathered from (FFmpeg default: 5 MB)
+#define PROBE_ANALYZE_US 500000    // Media decoded to fill in missing parameters (FFmpeg default: 5 s)
+
+Demuxer demuxer;
+
+static int demuxNthStream(const Demuxer *dmx, enum AVMediaType type, int n) {
+    const AVFormatContext *fc = dmx->format_context;
+    for (int i = 0; i < (int)fc->nb_streams; i++) {
+        if (fc->streams[i]->codecpar->codec_type == type && n-- == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static int demuxTrackCount(const Demuxer *dmx, enum AVMediaType type) {
+    int count = 0;
+    for (int i = 0; i < (int)dmx->format_context->nb_streams; i++) {
+        count += dmx->format_context->streams[i]->codecpar->codec_type == type;
+    }
+    return count;
+}
+
+// Only the selected streams are demuxed; the rest are skipped by the container reader where it can
+static void demuxUpdateDiscard(Demuxer *dmx) {
+    for (int i = 0; i < (int)dmx->format_context->nb_streams; i++) {
+        bool active = i == dmx->video_stream_index || i == dmx->audio_stream_index ||
+                      i == dmx->subtitle_stream_index;
+        dmx->format_context->streams[i]->discard = active ? AVDISCARD_DEFAULT : AVDISCARD_ALL;
+    }
+}
+
+/*
+  Function demuxOpen
+  opens and probes the input once and picks the streams to decode.
+  Both decoder threads read the codec parameters from here instead of
+  opening the file themselves. Probing is bounded: containers with a
+  header (MP4, MKV, ...) are done after it anyway, and headerless ones
+  stop after PROBE_SIZE bytes instead of reading seconds of media.
+*/
+bool demuxOpen(Demuxer *dmx, const char *filename, IOMode io_mode) {
+    dmx->format_context = NULL;
+    dmx->video_stream_index = -1;
+    dmx->audio_stream_index = -1;
+    dmx->subtitle_stream_index = -1;
+    dmx->subtitles_routed = false;
+    dmx->requested_audio = dmx->requested_subtitle = -2;
+    dmx->routed_bytes = dmx->dropped_packets = dmx->dropped_bytes = 0;
+    dmx->last_time = 0.0;
+    dmx->live = io_mode == IO_MODE_LIVE;
+    dmx->arrival_next = 0;
+    for (int i = 0; i < DEMUX_ARRIVALS; i++) {
+        dmx->arrival_pts[i] = NAN;
+    }
+    pthread_mutex_init(&dmx->arrival_lock, NULL);
+    dmx->loop_armed = false;
+    dmx->loop_enabled = false;
+    dmx->loop_state = LOOP_OFF;
+    packetCacheInit(&dmx->loop_cache, 0);
+
+    uint64_t open_start = statsNow();
+    avformat_network_init();
+    if (ioOpenInput(&dmx->format_context, filename, io_mode) < 0) {
+        fprintf(stderr, "Error: Could not open input file '%s'\n", filename);
+        return false;
+    }
+
+    if (!dmx->live) {
+        dmx->format_context->probesize = PROBE_SIZE;
+        dmx->format_context->max_analyze_duration = PROBE_ANALYZE_US;
+    }
+    if (avformat_find_stream_info(dmx->format_context, NULL) < 0) {
+        fprintf(stderr, "Error: Could not find stream information\n");
+        ioCloseInput(&dmx->format_context);
+        return false;
+    }
+
+    dmx->video_stream_index = findFirstStream(dmx->format_context, AVMEDIA_TYPE_VIDEO);
+    dmx->audio_stream_index = findFirstStream(dmx->format_context, AVMEDIA_TYPE_AUDIO);
+
+    if (dmx->video_stream_index == -1 && dmx->audio_stream_index == -1) {
+        fprintf(stderr, "Error: No audio or video stream found\n");
+        ioCloseInput(&dmx->format_context);
+        return false;
+    }
+    demuxUpdateDiscard(dmx);
+    dmx->open_seconds = (statsNow() - open_start) / 1e9;
+    if (dmx->live) {
+        fprintf(stderr, "Live: '%s' opened and probed in %.1f ms\n", filename, dmx->open_seconds * 1e3);
+    }
+    return true;
+}
+
+void demuxClose(Demuxer *dmx) {
+    if (dmx->loop_armed) {
+        packetCachePrintStats(&dmx->loop_cache, stderr);
+    }
+    packetCacheDestroy(&dmx->loop_cache);
+    pthread_mutex_destroy(&dmx->arrival_lock);
+    ioCloseInput(&dmx->format_context);
+}
+
+// Live input: remembers when a video packet was read, keyed by the pts its frame will carry
+static void demuxNoteArrival(Demuxer *dmx, const AVPacket *packet, uint64_t now) {
+    if (packet->pts == AV_NOPTS_VALUE) {
+        return;
+    }
+    double pts = packet->pts * av_q2d(dmx->format_context->streams[packet->stream_index]->time_base);
+    pthread_mutex_lock(&dmx->arrival_lock);
+    dmx->arrival_pts[dmx->arrival_next] = pts;
+    dmx->arrival_ns[dmx->arrival_next] = now;
+    dmx->arrival_next = (dmx->arrival_next + 1) % DEMUX_ARRIVALS;
+    pthread_mutex_unlock(&dmx->arrival_lock);
+}
+
+/*
+  Function demuxRecordPresented
+  called by whatever presents video (GUI or sink) once a frame is on
+  its way out. On live inputs the time since its packet was read is
+  recorded as STAT_INPUT_LATENCY; frames whose packet already left the
+  ring (or that have no pts) are not counted.
+*/
+void demuxRecordPresented(Demuxer *dmx, double pts) {
+    if (!dmx->live || isnan(pts)) {
+        return;
+    }
+    uint64_t arrived = 0;
+    pthread_mutex_lock(&dmx->arrival_lock);
+    for (int i = 0; i < DEMUX_ARRIVALS; i++) {
+        if (fabs(dmx->arrival_pts[i] - pts) < 1e-4) {
+            arrived = dmx->arrival_ns[i];
+            break;
+        }
+    }
+    pthread_mutex_unlock(&dmx->arrival_lock);
+    if (arrived) {
+        statsRecord(STAT_INPUT_LATENCY, statsNow() - arrived);
+    }
+}
+
+void demuxPrintLiveStats(const Demuxer *dmx, FILE *out) {
+    if (!dmx->live) {
+        return;
+    }
+    StatsSummary latency;
+    statsSummarize(STAT_INPUT_LATENCY, &latency);
+    fprintf(out, "Live: open %.1f ms; input-to-present over %llu frames: mean %.1f ms, p50 %.1f ms, p90 %.1f ms, "
+            "p99 %.1f ms, max %.1f ms; %llu frames skipped to stay current\n",
+            dmx->open_seconds * 1e3, (unsigned long long)latency.count, latency.mean / 1e6, latency.p50 / 1e6,
+            latency.p90 / 1e6, latency.p99 / 1e6, latency.max / 1e6,
+            (unsigned long long)statsCounter(COUNTER_DROPPED));
+}
+
+/*
+  Function demuxSelectTracks
+  picks the nth stream of each type (counting from 0 within the type).
+  A negative subtitle_track leaves subtitles off; any other value
+  means a subtitle thread will consume subtitlePacketQueue, so tracks
+  can be switched on later. Every stream not selected is discarded.
+*/
+bool demuxSelectTracks(Demuxer *dmx, int video_track, int audio_track, int subtitle_track) {
+    int video = demuxNthStream(dmx, AVMEDIA_TYPE_VIDEO, video_track);
+    int audio = demuxNthStream(dmx, AVMEDIA_TYPE_AUDIO, audio_track);
+    int subtitle = subtitle_track < 0 ? -1 : demuxNthStream(dmx, AVMEDIA_TYPE_SUBTITLE, subtitle_track);
+
+    if ((video < 0 && demuxTrackCount(dmx, AVMEDIA_TYPE_VIDEO) > 0) ||
+        (audio < 0 && demuxTrackCount(dmx, AVMEDIA_TYPE_AUDIO) > 0) ||
+        (subtitle_track >= 0 && subtitle < 0 && demuxTrackCount(dmx, AVMEDIA_TYPE_SUBTITLE) > 0)) {
+        fprintf(stderr, "Error: No such track (video %d, audio %d, subtitle %d available)\n",
+                demuxTrackCount(dmx, AVMEDIA_TYPE_VIDEO), demuxTrackCount(dmx, AVMEDIA_TYPE_AUDIO),
+                demuxTrackCount(dmx, AVMEDIA_TYPE_SUBTITLE));
+        return false;
+    }
+
+    dmx->video_stream_index = video;
+    dmx->audio_stream_index = audio;
+    dmx->subtitle_stream_index = subtitle;
+    dmx->subtitles_routed = subtitle_track >= 0 && demuxTrackCount(dmx, AVMEDIA_TYPE_SUBTITLE) > 0;
+    demuxUpdateDiscard(dmx);
+    return true;
+}
+
+// Stream index after current among the streams of type, wrapping; off_slot adds "none" to the cycle
+static int demuxNextStream(const Demuxer *dmx, enum AVMediaType type, int current, bool off_slot) {
+    const AVFormatContext *fc = dmx->format_context;
+    int first = -1;
+    bool passed = current < 0;
+
+    for (int i = 0; i < (int)fc->nb_streams; i++) {
+        if (fc->streams[i]->codecpar->codec_type != type) {
+            continue;
+        }
+        if (first < 0) {
+            first = i;
+        }
+        if (passed) {
+            return i;
+        }
+        passed = i == current;
+    }
+    return off_slot ? -1 : first;
+}
+
+/*
+  Function demuxRequestTrack
+  cycles to the next audio or subtitle track (subtitles pass through
+  off). Called from the GUI; the demux thread applies it between two
+  packets, see demuxApplySwitch.
+*/
+void demuxRequestTrack(Demuxer *dmx, enum AVMediaType type) {
+    volatile int *requested = type == AVMEDIA_TYPE_AUDIO ? &dmx->requested_audio : &dmx->requested_subtitle;
+    // The demux thread may be switching tracks right now; it publishes the indices atomically
+    int current = __atomic_load_n(type == AVMEDIA_TYPE_AUDIO ? &dmx->audio_stream_index : &dmx->subtitle_stream_index,
+                                  __ATOMIC_ACQUIRE);
+    if (type == AVMEDIA_TYPE_SUBTITLE && !dmx->subtitles_routed) {
+        return;
+    }
+
+    int pending = __atomic_load_n(requested, __ATOMIC_ACQUIRE);
+    int next = demuxNextStream(dmx, type, pending != -2 ? pending : current, type == AVMEDIA_TYPE_SUBTITLE);
+    __atomic_store_n(requested, next, __ATOMIC_RELEASE);
+
+    if (next < 0) {
+        if (type == AVMEDIA_TYPE_SUBTITLE) {
+            fprintf(stderr, "Subtitles off\n");
+        }
+        return;
+    }
+    AVDictionaryEntry *language = av_dict_get(dmx->format_context->streams[next]->metadata, "language", NULL, 0);
+    fprintf(stderr, "%s track: stream #%d (%s, %s)\n", type == AVMEDIA_TYPE_AUDIO ? "Audio" : "Subtitle", next,
+            language ? language->value : "und",
+            avcodec_get_name(dmx->format_context->streams[next]->codecpar->codec_id));
+}
+
+void demuxSetLoop(Demuxer *dmx, double a, double b, size_t cache_budget) {
+    dmx->loop_a = a;
+    dmx->loop_b = b;
+    dmx->loop_armed = b > a;
+    dmx->loop_enabled = dmx->loop_armed;
+    packetCacheInit(&dmx->loop_cache, cache_budget);
+}
+
+// Releasing lets playback run on past B; the loop cannot be re-entered afterwards
+void demuxToggleLoop(Demuxer *dmx) {
+    if (!dmx->loop_armed || dmx->loop_state == LOOP_OFF) {
+        return;
+    }
+    dmx->loop_enabled = !dmx->loop_enabled;
+    fprintf(stderr, "A-B loop %s\n", dmx->loop_enabled ? "engaged" : "released at B");
+}
+
+/*
+  Function demuxLoopKeeps
+  tells a decoder whether a decoded frame belongs on screen/speaker:
+  pre-roll from the keyframe before A is dropped, and so is anything
+  the decoder still emits at or after B while the loop is engaged.
+*/
+bool demuxLoopKeeps(const Demuxer *dmx, int stream_index, int64_t pts) {
+    if (!dmx->loop_armed || pts == AV_NOPTS_VALUE) {
+        return true;
+    }
+    double t = pts * av_q2d(dmx->format_context->streams[stream_index]->time_base);
+    if (t < dmx->loop_a) {
+        return false;
+    }
+    return !(dmx->loop_enabled && t >= dmx->loop_b);
+}
+
+static PacketQueue *demuxQueueFor(const Demuxer *dmx, int stream_index) {
+    if (stream_index == dmx->video_stream_index) return &videoPacketQueue;
+    if (stream_index == dmx->audio_stream_index) return &audioPacketQueue;
+    if (stream_index == dmx->subtitle_stream_index) return &subtitlePacketQueue;
+    return NULL;
+}
+
+// Hands packet's reference over to the decoder owning its stream
+static bool demuxRoute(Demuxer *dmx, AVPacket *packet) {
+    PacketQueue *queue = demuxQueueFor(dmx, packet->stream_index);
+    AVPacket *routed = queue ? av_packet_alloc() : NULL;
+    if (!routed) {
+        av_packet_unref(packet);   // Held back from a track switched away since
+        return false;
+    }
+    dmx->routed_bytes += packet->size;
+    av_packet_move_ref(routed, packet);
+    return packetQueuePush(queue, routed, PACKET_DATA);
+}
+
+static void demuxSignal(const Demuxer *dmx, PacketKind kind) {
+    if (dmx->video_stream_index >= 0) {
+        packetQueuePush(&videoPacketQueue, NULL, kind);
+    }
+    if (dmx->audio_stream_index >= 0) {
+        packetQueuePush(&audioPacketQueue, NULL, kind);
+    }
+    if (dmx->subtitles_routed) {
+        packetQueuePush(&subtitlePacketQueue, NULL, kind);
+    }
+}
+
+// Tells a decoder which stream its packets come from from now on
+static void demuxSignalSwitch(PacketQueue *queue, int stream_index) {
+    AVPacket *marker = av_packet_alloc();
+    if (marker) {
+        marker->stream_index = stream_index;
+        packetQueuePush(queue, marker, PACKET_SWITCH);
+    }
+}
+
+/*
+  Function demuxApplySwitch
+  makes a track switch requested by the GUI effective at the current
+  read position: discard flags are updated and the decoder gets a
+  marker to reopen for the new stream, so the file is never reopened.
+  While the A-B loop replays from its cache (which holds the old
+  track) the switch waits for the wrap; the cache is then dropped and
+  the loop continues from disk.
+*/
+static bool demuxApplySwitch(Demuxer *dmx, bool at_wrap) {
+    int audio = __atomic_exchange_n(&dmx->requested_audio, -2, __ATOMIC_ACQ_REL);
+    int subtitle = __atomic_exchange_n(&dmx->requested_subtitle, -2, __ATOMIC_ACQ_REL);
+    bool audio_changes = audio != -2 && audio != dmx->audio_stream_index;
+    bool subtitle_changes = subtitle != -2 && subtitle != dmx->subtitle_stream_index;
+
+    if (!audio_changes && !subtitle_changes) {
+        return false;
+    }
+    if (dmx->loop_state == LOOP_REPLAY && !at_wrap) {
+        __atomic_compare_exchange_n(&dmx->requested_audio, &(int){-2}, audio, false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED);
+        __atomic_compare_exchange_n(&dmx->requested_subtitle, &(int){-2}, subtitle, false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED);
+        return false;
+    }
+
+    if (audio_changes) {
+        __atomic_store_n(&dmx->audio_stream_index, audio, __ATOMIC_RELEASE);
+        demuxSignalSwitch(&audioPacketQueue, audio);
+    }
+    if (subtitle_changes) {
+        __atomic_store_n(&dmx->subtitle_stream_index, subtitle, __ATOMIC_RELEASE);
+        demuxSignalSwitch(&subtitlePacketQueue, subtitle);
+    }
+    demuxUpdateDiscard(dmx);
+
+    if (dmx->loop_armed && dmx->loop_state != LOOP_OFF) {
+        packetCacheClear(&dmx->loop_cache);
+        dmx->loop_cache.overflowed = true;   // Cached packets belong to the old track
+    }
+    return true;
+}
+
+// Routed bytes, plus an estimate of what discarding saved from the inactive streams' bitrates
+void demuxPrintTrackStats(const Demuxer *dmx, FILE *out) {
+    const AVFormatContext *fc = dmx->format_context;
+    int64_t inactive_rate = 0;
+    int inactive = 0;
+
+    for (int i = 0; i < (int)fc->nb_streams; i++) {
+        if (fc->streams[i]->discard == AVDISCARD_ALL) {
+            inactive++;
+            inactive_rate += fc->streams[i]->codecpar->bit_rate;
+        }
+    }
+    double skipped = inactive_rate / 8.0 * dmx->last_time - dmx->dropped_bytes;
+    fprintf(out, "Tracks: video #%d, audio #%d, subtitle #%d of %u streams; %.1f MiB routed, "
+            "%d inactive streams: %llu packets (%.1f KiB) read and dropped, ~%.1f MiB skipped unread\n",
+            dmx->video_stream_index, dmx->audio_stream_index, dmx->subtitle_stream_index, fc->nb_streams,
+            dmx->routed_bytes / 1048576.0, inactive, (unsigned long long)dmx->dropped_packets,
+            dmx->dropped_bytes / 1024.0, skipped > 0 ? skipped / 1048576.0 : 0.0);
+}
+
+static bool demuxSeekToA(Demuxer *dmx) {
+    int64_t target = (int64_t)(dmx->loop_a * AV_TIME_BASE);
+    if (av_seek_frame(dmx->format_context, -1, target, AVSEEK_FLAG_BACKWARD) < 0) {
+        fprintf(stderr, "Error: Could not seek to loop start %.3fs\n", dmx->loop_a);
+        return false;
+    }
+    return true;
+}
+
+static double demuxPacketTime(const Demuxer *dmx, const AVPacket *packet) {
+    int64_t ts = packet->dts != AV_NOPTS_VALUE ? packet->dts : packet->pts;
+    if (ts == AV_NOPTS_VALUE) {
+        return -1.0;  // Unknown, keep it with its neighbours
+    }
+    return ts * av_q2d(dmx->format_context->streams[packet->stream_index]->time_base);
+}
+
+/*
+  Function demuxThread
+  reads packets once and routes them to the decoder queues. With an
+  A-B loop armed the first pass from A caches every packet up to B;
+  later passes are replayed from memory without touching the file.
+  Packets read past B are held back in case the loop gets released.
+*/
+void *demuxThread(void *args) {
+    Demuxer *dmx = &demuxer;
+    AVPacket *packet = av_packet_alloc();
+    PacketCache tail;                  // Packets read past B, unbudgeted
+    bool past_b[2] = {false, false};   // Per active stream: video, audio
+    int replay_pos = 0;
+
+    statsThreadName("demux");
+    traceThreadName("demux");
+    packetCacheInit(&tail, SIZE_MAX);
+    if (!packet) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        demuxSignal(dmx, PACKET_EOF);
+        return NULL;
+    }
+
+    if (dmx->loop_armed) {
+        dmx->loop_armed = demuxSeekToA(dmx);
+        dmx->loop_enabled = dmx->loop_armed;
+        dmx->loop_state = dmx->loop_armed ? LOOP_FILL : LOOP_OFF;
+    }
+
+    while (is_running) {
+        bool at_b = false;
+        demuxApplySwitch(dmx, false);
+
+        if (dmx->loop_state == LOOP_REPLAY) {
+            if (replay_pos < dmx->loop_cache.count) {
+                AVPacket *cached = av_packet_clone(dmx->loop_cache.packets[replay_pos++]);
+                dmx->loop_cache.hits++;
+                if (cached) {
+                    dmx->routed_bytes += cached->size;
+                    packetQueuePush(demuxQueueFor(dmx, cached->stream_index), cached, PACKET_DATA);
+                }
+                continue;
+            }
+            at_b = true;
+        } else {
+            uint64_t read_start = statsNow();
+            traceBegin("demux_read");
+            int ret = av_read_frame(dmx->format_context, packet);
+            traceEnd("demux_read");
+            uint64_t read_end = statsNow();
+            statsRecord(STAT_DEMUX, read_end - read_start);
+            if (ret >= 0) {
+                dmx->last_time = fmax(dmx->last_time, demuxPacketTime(dmx, packet));
+                if (dmx->live && packet->stream_index == dmx->video_stream_index) {
+                    demuxNoteArrival(dmx, packet, read_end);
+                }
+            }
+            if (ret < 0) {
+                if (dmx->loop_state == LOOP_OFF) {
+                    break;  // End of input
+                }
+                at_b = true;  // B lies beyond the end of the file
+            } else if (!demuxQueueFor(dmx, packet->stream_index)) {
+                dmx->dropped_packets++;   // The container reader could not skip it
+                dmx->dropped_bytes += packet->size;
+                av_packet_unref(packet);
+                continue;
+            } else if (dmx->loop_state == LOOP_FILL || dmx->loop_state == LOOP_DISK) {
+                int slot = packet->stream_index == dmx->video_stream_index ? 0 : 1;
+                if (packet->stream_index == dmx->subtitle_stream_index && demuxPacketTime(dmx, packet) >= dmx->loop_b) {
+                    packetCacheAdd(&tail, packet);  // Subtitles never decide when B is reached
+                    av_packet_unref(packet);
+                    continue;
+                }
+                if (packet->stream_index != dmx->subtitle_stream_index &&
+                    (past_b[slot] || demuxPacketTime(dmx, packet) >= dmx->loop_b)) {
+                    past_b[slot] = true;
+                    packetCacheAdd(&tail, packet);
+                    av_packet_unref(packet);
+                    at_b = (past_b[0] || dmx->video_stream_index < 0) &&
+                           (past_b[1] || dmx->audio_stream_index < 0);
+                    if (!at_b) {
+                        continue;
+                    }
+                } else {
+                    if (dmx->loop_state == LOOP_FILL) {
+                        packetCacheAdd(&dmx->loop_cache, packet);
+                    } else {
+                        dmx->loop_cache.misses++;
+                    }
+                    demuxRoute(dmx, packet);
+                    continue;
+                }
+            } else {
+                demuxRoute(dmx, packet);
+                continue;
+            }
+        }
+
+        if (!at_b) {
+            continue;
+        }
+
+        // Every active stream reached B
+        if (demuxApplySwitch(dmx, true) && dmx->loop_state == LOOP_REPLAY) {
+            dmx->loop_state = LOOP_DISK;   // Cache dropped, the next pass comes from the file
+        }
+        if (!dmx->loop_enabled) {
+            for (int i = 0; i < tail.count; i++) {
+                demuxRoute(dmx, tail.packets[i]);
+            }
+            packetCacheClear(&tail);
+            dmx->loop_state = LOOP_OFF;
+            continue;
+        }
+
+        if (dmx->loop_state == LOOP_FILL && !dmx->loop_cache.overflowed) {
+            dmx->loop_state = LOOP_REPLAY;
+        } else if (dmx->loop_state != LOOP_REPLAY) {
+            dmx->loop_state = LOOP_DISK;
+            packetCacheClear(&tail);
+            past_b[0] = past_b[1] = false;
+            if (!demuxSeekToA(dmx)) {
+                break;
+            }
+        }
+
+        replay_pos = 0;
+        dmx->loop_cache.passes++;
+        demuxSignal(dmx, PACKET_LOOP);
+        packetCachePrintStats(&dmx->loop_cache, stderr);
+    }
+
+    demuxSignal(dmx, PACKET_EOF);
+    packetCacheDestroy(&tail);
+    av_packet_free(&packet);
+    return NULL;
+}
@@ -0,0 +1,67 @@
+#ifndef DEMUX_H
+#define DEMUX_H
+
+#include <libavformat/avformat.h>
+#include <stdbool.h>
+#include "../Buffer/buffer.h"
+#include "../Buffer/packetcache.h"
+#include "../IO/mmapio.h"
+
+#define DEMUX_ARRIVALS 64   // Live input: video packets remembered until their frame is presented
+
+// A-B loop progress inside the demuxer
+typedef enum {
+    LOOP_OFF,      // Plain forward playback
+    LOOP_FILL,     // First pass from A, caching packets on the way to B
+    LOOP_REPLAY,   // Feeding every pass from the packet cache
+    LOOP_DISK      // Cache over budget: seek back to A and re-read each pass
+} LoopState;
+
+// Single demuxer shared by the video and audio decoders
+typedef struct {
+    AVFormatContext *format_context;
+    bool ready;                  // Opened, probed and tracks picked (atomic); the GUI may come up before
+    int video_stream_index;
+    int audio_stream_index;      // Audio and subtitle indices change on live switches: written atomically
+    int subtitle_stream_index;   // by the demux thread, read atomically from other threads; -1 when off
+    bool subtitles_routed;       // A subtitle thread consumes subtitlePacketQueue
+
+    // Live track switches asked for by the GUI, applied by the demux thread (-2: none pending)
+    volatile int requested_audio, requested_subtitle;
+
+    // Packets of inactive streams are discarded (AVDISCARD_ALL) so most demuxers skip them unread
+    uint64_t routed_bytes;
+    uint64_t dropped_packets, dropped_bytes;   // Inactive packets the demuxer still returned
+    double last_time;                          // Furthest packet time read, seconds
+
+    // Live input (IO_MODE_LIVE): when each video packet was read, matched by pts at present time
+    bool live;
+    double open_seconds;                       // Open and probe, until the first packet can be read
+    double arrival_pts[DEMUX_ARRIVALS];
+    uint64_t arrival_ns[DEMUX_ARRIVALS];
+    int arrival_next;
+    pthread_mutex_t arrival_lock;
+
+    // A-B loop, in seconds of stream presentation time
+    bool loop_armed;
+    volatile bool loop_enabled;
+    double loop_a, loop_b;
+    LoopState loop_state;
+    PacketCache loop_cache;
+} Demuxer;
+
+extern Demuxer demuxer;
+
+bool demuxOpen(Demuxer *dmx, const char *filename, IOMode io_mode);
+void demuxClose(Demuxer *dmx);
+bool demuxSelectTracks(Demuxer *dmx, int video_track, int audio_track, int subtitle_track);
+void demuxRequestTrack(Demuxer *dmx, enum AVMediaType type);
+void demuxPrintTrackStats(const Demuxer *dmx, FILE *out);
+void demuxRecordPresented(Demuxer *dmx, double pts);
+void demuxPrintLiveStats(const Demuxer *dmx, FILE *out);
+void demuxSetLoop(Demuxer *dmx, double a, double b, size_t cache_budget);
+void demuxToggleLoop(Demuxer *dmx);
+bool demuxLoopKeeps(const Demuxer *dmx, int stream_index, int64_t pts);
+void *demuxThread(void *args);
+
+#endif // DEMUX_H
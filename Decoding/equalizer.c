@@ -0,0 +1,526 @@
+#include "equalizer.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../Stats/stats.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define EQ_X86 1
+#endif
+
+#define EQ_DEFAULT_Q 1.41             // About one octave wide
+#define EQ_MAX_HZ_SHARE 0.45          // Centre frequencies stay below this share of the sample rate
+
+Equalizer audioEqualizer;
+
+static const double default_hz[EQ_BANDS] = {31.25, 62.5, 125, 250, 500, 1000, 2000, 4000, 8000, 16000};
+
+static const struct {
+    const char *name;
+    double gains[EQ_BANDS];
+} presets[] = {
+    {"flat", {0, 0, 0, 0, 0, 0, 0, 0, 0, 0}},
+    {"bass", {6, 5, 4, 2, 0, 0, 0, 0, 0, 0}},
+    {"treble", {0, 0, 0, 0, 0, 0, 2, 4, 5, 6}},
+    {"vocal", {-3, -2, -1, 1, 3, 4, 3, 1, 0, -1}},
+    {"rock", {4, 3, 2, 0, -1, -1, 1, 2, 3, 4}},
+    {"pop", {-1, 1, 3, 4, 3, 0, -1, -1, 1, 2}},
+    {"jazz", {3, 2, 1, 2, -1, -1, 0, 1, 2, 3}},
+    {"classical", {3, 2, 1, 0, 0, 0, -1, -1, 0, 2}},
+    {"loudness", {5, 4, 2, 0, -1, 0, 1, 3, 4, 3}},
+};
+#define EQ_PRESETS ((int)(sizeof(presets) / sizeof(presets[0])))
+
+// Every kernel filters interleaved stereo float in place, keeping the filter memory in state
+typedef void (*EqKernel)(const EqCoefficients *c, EqState *state, float *samples, int frames);
+
+static void eqRunScalar(const EqCoefficients *c, EqState *state, float *samples, int frames) {
+    for (int f = 0; f < frames; f++) {
+        for (int ch = 0; ch < EQ_CHANNELS; ch++) {
+            float x = samples[f * EQ_CHANNELS + ch];
+            for (int lane = ch; lane < EQ_BANDS * EQ_CHANNELS; lane += EQ_CHANNELS) {
+                float y = c->b0[lane] * x + state->z1[lane];
+                state->z1[lane] = c->b1[lane] * x - c->a1[lane] * y + state->z2[lane];
+                state->z2[lane] = c->b2[lane] * x - c->a2[lane] * y;
+                x = y;
+            }
+            samples[f * EQ_CHANNELS + ch] = x;
+        }
+    }
+}
+
+/*
+  The SIMD kernels run the cascade as a pipeline: each vector holds
+  both channels of neighbouring bands, and at step t band b filters
+  frame t - b, taking band b - 1's output of the step before. That
+  keeps every lane busy although each band needs the one before it.
+  In the first and last EQ_BANDS - 1 steps some bands have no frame;
+  their memory is left as it was.
+*/
+#ifdef EQ_X86
+#define EQ_SSE_VECTORS (EQ_BANDS / 2)    // Two bands per vector, the last band in lanes 2 and 3 of the last
+
+__attribute__((target("sse4.1")))
+static void eqRunSse41(const EqCoefficients *c, EqState *state, float *samples, int frames) {
+    __m128 b0[EQ_SSE_VECTORS], b1[EQ_SSE_VECTORS], b2[EQ_SSE_VECTORS], a1[EQ_SSE_VECTORS], a2[EQ_SSE_VECTORS];
+    __m128 z1[EQ_SSE_VECTORS], z2[EQ_SSE_VECTORS], y[EQ_SSE_VECTORS], band[EQ_SSE_VECTORS];
+    for (int v = 0; v < EQ_SSE_VECTORS; v++) {
+        b0[v] = _mm_loadu_ps(c->b0 + 4 * v);
+        b1[v] = _mm_loadu_ps(c->b1 + 4 * v);
+        b2[v] = _mm_loadu_ps(c->b2 + 4 * v);
+        a1[v] = _mm_loadu_ps(c->a1 + 4 * v);
+        a2[v] = _mm_loadu_ps(c->a2 + 4 * v);
+        z1[v] = _mm_loadu_ps(state->z1 + 4 * v);
+        z2[v] = _mm_loadu_ps(state->z2 + 4 * v);
+        y[v] = _mm_setzero_ps();
+        band[v] = _mm_setr_ps(2 * v, 2 * v, 2 * v + 1, 2 * v + 1);
+    }
+
+    for (int t = 0; t < frames + EQ_BANDS - 1; t++) {
+        __m128 input = t < frames ? _mm_castpd_ps(_mm_load_sd((const double *)(samples + t * EQ_CHANNELS)))
+                                  : _mm_setzero_ps();
+        bool edge = t < EQ_BANDS - 1 || t >= frames;
+        __m128 newest = _mm_set1_ps((float)t), oldest = _mm_set1_ps((float)(t - frames));
+        for (int v = EQ_SSE_VECTORS - 1; v >= 0; v--) {
+            // Lower band of the pair: the band below's last output; upper band: the lower one's
+            __m128 x = v > 0 ? _mm_shuffle_ps(y[v - 1], y[v], _MM_SHUFFLE(1, 0, 3, 2))
+                             : _mm_shuffle_ps(input, y[0], _MM_SHUFFLE(1, 0, 1, 0));
+            __m128 out = _mm_add_ps(_mm_mul_ps(b0[v], x), z1[v]);
+            __m128 n1 = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(b1[v], x), _mm_mul_ps(a1[v], out)), z2[v]);
+            __m128 n2 = _mm_sub_ps(_mm_mul_ps(b2[v], x), _mm_mul_ps(a2[v], out));
+            if (edge) {
+                __m128 live = _mm_and_ps(_mm_cmple_ps(band[v], newest), _mm_cmpgt_ps(band[v], oldest));
+                n1 = _mm_blendv_ps(z1[v], n1, live);
+                n2 = _mm_blendv_ps(z2[v], n2, live);
+            }
+            z1[v] = n1;
+            z2[v] = n2;
+            y[v] = out;
+        }
+        if (t >= EQ_BANDS - 1) {
+            _mm_storeh_pi((__m64 *)(samples + (t - EQ_BANDS + 1) * EQ_CHANNELS), y[EQ_SSE_VECTORS - 1]);
+        }
+    }
+
+    for (int v = 0; v < EQ_SSE_VECTORS; v++) {
+        _mm_storeu_ps(state->z1 + 4 * v, z1[v]);
+        _mm_storeu_ps(state->z2 + 4 * v, z2[v]);
+    }
+}
+
+#define EQ_AVX2_VECTORS (EQ_SLOTS / 4)   // Four bands per vector, the last band in lanes 2 and 3 of the last
+
+__attribute__((target("avx2")))
+static void eqRunAvx2(const EqCoefficients *c, EqState *state, float *samples, int frames) {
+    __m256 b0[EQ_AVX2_VECTORS], b1[EQ_AVX2_VECTORS], b2[EQ_AVX2_VECTORS], a1[EQ_AVX2_VECTORS], a2[EQ_AVX2_VECTORS];
+    __m256 z1[EQ_AVX2_VECTORS], z2[EQ_AVX2_VECTORS], y[EQ_AVX2_VECTORS], band[EQ_AVX2_VECTORS];
+    for (int v = 0; v < EQ_AVX2_VECTORS; v++) {
+        b0[v] = _mm256_loadu_ps(c->b0 + 8 * v);
+        b1[v] = _mm256_loadu_ps(c->b1 + 8 * v);
+        b2[v] = _mm256_loadu_ps(c->b2 + 8 * v);
+        a1[v] = _mm256_loadu_ps(c->a1 + 8 * v);
+        a2[v] = _mm256_loadu_ps(c->a2 + 8 * v);
+        z1[v] = _mm256_loadu_ps(state->z1 + 8 * v);
+        z2[v] = _mm256_loadu_ps(state->z2 + 8 * v);
+        y[v] = _mm256_setzero_ps();
+        int b = 4 * v;
+        band[v] = _mm256_setr_ps(b, b, b + 1, b + 1, b + 2, b + 2, b + 3, b + 3);
+    }
+
+    for (int t = 0; t < frames + EQ_BANDS - 1; t++) {
+        __m128 input = t < frames ? _mm_castpd_ps(_mm_load_sd((const double *)(samples + t * EQ_CHANNELS)))
+                                  : _mm_setzero_ps();
+        // The new frame where the band below band 0 would have its output: lanes 6 and 7
+        __m256 below = _mm256_insertf128_ps(_mm256_setzero_ps(), _mm_movelh_ps(input, input), 1);
+        bool edge = t < EQ_BANDS - 1 || t >= frames;
+        __m256 newest = _mm256_set1_ps((float)t), oldest = _mm256_set1_ps((float)(t - frames));
+        for (int v = EQ_AVX2_VECTORS - 1; v >= 0; v--) {
+            // Every band's input moves up two lanes, the lowest band's comes from the vector below
+            __m256 across = _mm256_permute2f128_ps(v > 0 ? y[v - 1] : below, y[v], 0x21);
+            __m256 x = _mm256_shuffle_ps(across, y[v], _MM_SHUFFLE(1, 0, 3, 2));
+            __m256 out = _mm256_add_ps(_mm256_mul_ps(b0[v], x), z1[v]);
+            __m256 n1 = _mm256_add_ps(_mm256_sub_ps(_mm256_mul_ps(b1[v], x), _mm256_mul_ps(a1[v], out)), z2[v]);
+            __m256 n2 = _mm256_sub_ps(_mm256_mul_ps(b2[v], x), _mm256_mul_ps(a2[v], out));
+            if (edge) {
+                __m256 live = _mm256_and_ps(_mm256_cmp_ps(band[v], newest, _CMP_LE_OQ),
+                                            _mm256_cmp_ps(band[v], oldest, _CMP_GT_OQ));
+                n1 = _mm256_blendv_ps(z1[v], n1, live);
+                n2 = _mm256_blendv_ps(z2[v], n2, live);
+            }
+            z1[v] = n1;
+            z2[v] = n2;
+            y[v] = out;
+        }
+        if (t >= EQ_BANDS - 1) {
+            _mm_storeh_pi((__m64 *)(samples + (t - EQ_BANDS + 1) * EQ_CHANNELS),
+                          _mm256_castps256_ps128(y[EQ_AVX2_VECTORS - 1]));
+        }
+    }
+
+    for (int v = 0; v < EQ_AVX2_VECTORS; v++) {
+        _mm256_storeu_ps(state->z1 + 8 * v, z1[v]);
+        _mm256_storeu_ps(state->z2 + 8 * v, z2[v]);
+    }
+}
+#endif
+
+// There is no AVX-512 kernel; AVX-512 CPUs run the AVX2 one
+#define EQ_MAX_LEVEL CPU_AVX2
+static const EqKernel eq_kernels[CPU_LEVEL_COUNT] = {
+    [CPU_SCALAR] = eqRunScalar,
+#ifdef EQ_X86
+    [CPU_SSE41] = eqRunSse41,
+    [CPU_AVX2] = eqRunAvx2,
+#endif
+};
+
+/*
+  Function equalizerRun
+  filters frames of interleaved stereo float in place with fixed
+  coefficients. Denormals are flushed meanwhile: filter memory decaying
+  through silence would otherwise slow every kernel down many times.
+*/
+void equalizerRun(CpuLevel kernel, const EqCoefficients *c, EqState *state, float *samples, int frames) {
+    EqKernel run = cpuHas(kernel) && kernel <= EQ_MAX_LEVEL && eq_kernels[kernel] ? eq_kernels[kernel] : eqRunScalar;
+#ifdef EQ_X86
+    unsigned int csr = _mm_getcsr();
+    _mm_setcsr(csr | 0x8040);   // Flush to zero, denormals are zero
+#endif
+    run(c, state, samples, frames);
+#ifdef EQ_X86
+    _mm_setcsr(csr);
+#endif
+}
+
+// RBJ cookbook peaking filter; a flat band is an exact pass-through
+static void bandCoefficients(const EqBand *band, int sample_rate, double c[5]) {
+    if (band->gain_db == 0.0) {
+        c[0] = 1.0;
+        c[1] = c[2] = c[3] = c[4] = 0.0;
+        return;
+    }
+    double a = pow(10.0, band->gain_db / 40.0);
+    double hz = fmin(band->hz, EQ_MAX_HZ_SHARE * sample_rate);
+    double w0 = 2 * M_PI * hz / sample_rate;
+    double alpha = sin(w0) / (2 * band->q);
+    double a0 = 1 + alpha / a;
+    c[0] = (1 + alpha * a) / a0;
+    c[1] = -2 * cos(w0) / a0;
+    c[2] = (1 - alpha * a) / a0;
+    c[3] = -2 * cos(w0) / a0;
+    c[4] = (1 - alpha / a) / a0;
+}
+
+static void setLanes(EqCoefficients *c, int band, const double values[5]) {
+    for (int ch = 0; ch < EQ_CHANNELS; ch++) {
+        int lane = band * EQ_CHANNELS + ch;
+        c->b0[lane] = (float)values[0];
+        c->b1[lane] = (float)values[1];
+        c->b2[lane] = (float)values[2];
+        c->a1[lane] = (float)values[3];
+        c->a2[lane] = (float)values[4];
+    }
+}
+
+static void identity(EqCoefficients *c) {
+    static const double pass[5] = {1.0, 0.0, 0.0, 0.0, 0.0};
+    memset(c, 0, sizeof(EqCoefficients));
+    for (int band = 0; band < EQ_BANDS; band++) {
+        setLanes(c, band, pass);
+    }
+}
+
+bool equalizerInit(Equalizer *eq, int sample_rate) {
+    memset(eq, 0, sizeof(Equalizer));
+    eq->scratch = malloc(sizeof(float) * EQ_SCRATCH_FRAMES * EQ_CHANNELS);
+    if (!eq->scratch) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        return false;
+    }
+    eq->sample_rate = sample_rate;
+    eq->kernel = cpuBestLevel(EQ_MAX_LEVEL);
+    pthread_mutex_init(&eq->lock, NULL);
+    for (int band = 0; band < EQ_BANDS; band++) {
+        eq->bands[band] = (EqBand){default_hz[band], 0.0, EQ_DEFAULT_Q};
+    }
+    eq->enabled = true;
+    identity(&eq->current);
+    eq->to = eq->current;
+    eq->preamp = eq->preamp_to = 1.0f;
+    eq->flat = true;
+    return true;
+}
+
+void equalizerDestroy(Equalizer *eq) {
+    free(eq->scratch);
+    eq->scratch = NULL;
+    pthread_mutex_destroy(&eq->lock);
+}
+
+int equalizerPresetCount() {
+    return EQ_PRESETS;
+}
+
+const char *equalizerPresetName(int preset) {
+    return preset >= 0 && preset < EQ_PRESETS ? presets[preset].name : "custom";
+}
+
+static double clampGain(double gain_db) {
+    return gain_db < -EQ_MAX_GAIN_DB ? -EQ_MAX_GAIN_DB : gain_db > EQ_MAX_GAIN_DB ? EQ_MAX_GAIN_DB : gain_db;
+}
+
+// Caller holds the lock
+static void settingsChanged(Equalizer *eq, int preset) {
+    eq->preset = preset;
+    __atomic_add_fetch(&eq->version, 1, __ATOMIC_RELEASE);
+}
+
+void equalizerSetPreset(Equalizer *eq, int preset) {
+    if (preset < 0 || preset >= EQ_PRESETS) {
+        return;
+    }
+    pthread_mutex_lock(&eq->lock);
+    for (int band = 0; band < EQ_BANDS; band++) {
+        eq->bands[band] = (EqBand){default_hz[band], presets[preset].gains[band], EQ_DEFAULT_Q};
+    }
+    settingsChanged(eq, preset);
+    pthread_mutex_unlock(&eq->lock);
+}
+
+void equalizerSetGain(Equalizer *eq, int band, double gain_db) {
+    if (band < 0 || band >= EQ_BANDS) {
+        return;
+    }
+    pthread_mutex_lock(&eq->lock);
+    if (eq->bands[band].gain_db != clampGain(gain_db)) {
+        eq->bands[band].gain_db = clampGain(gain_db);
+        settingsChanged(eq, -1);
+    }
+    pthread_mutex_unlock(&eq->lock);
+}
+
+void equalizerSetBand(Equalizer *eq, int band, double hz, double gain_db, double q) {
+    if (band < 0 || band >= EQ_BANDS || hz <= 0 || q <= 0) {
+        return;
+    }
+    pthread_mutex_lock(&eq->lock);
+    eq->bands[band] = (EqBand){hz, clampGain(gain_db), q};
+    settingsChanged(eq, -1);
+    pthread_mutex_unlock(&eq->lock);
+}
+
+void equalizerSetEnabled(Equalizer *eq, bool enabled) {
+    pthread_mutex_lock(&eq->lock);
+    eq->enabled = enabled;
+    settingsChanged(eq, eq->preset);
+    pthread_mutex_unlock(&eq->lock);
+}
+
+// Copies the bands and returns the preset they came from, -1 for custom
+int equalizerGetBands(Equalizer *eq, EqBand bands[EQ_BANDS]) {
+    pthread_mutex_lock(&eq->lock);
+    memcpy(bands, eq->bands, sizeof(eq->bands));
+    int preset = eq->preset;
+    pthread_mutex_unlock(&eq->lock);
+    return preset;
+}
+
+/*
+  Function equalizerParse
+  applies --eq: a preset name, or up to EQ_BANDS comma-separated gains
+  in dB from the lowest band up, each optionally GAIN@HZ or GAIN@HZ/Q
+  to move the band (e.g. 4@80/0.7,0,0,-3).
+*/
+bool equalizerParse(Equalizer *eq, const char *spec) {
+    for (int preset = 0; preset < EQ_PRESETS; preset++) {
+        if (strcmp(spec, presets[preset].name) == 0) {
+            equalizerSetPreset(eq, preset);
+            return true;
+        }
+    }
+
+    EqBand bands[EQ_BANDS];
+    equalizerGetBands(eq, bands);
+    const char *token = spec;
+    bool complete = false;
+    for (int band = 0; band < EQ_BANDS && !complete; band++) {
+        double gain_db = 0.0, hz = bands[band].hz, q = bands[band].q;
+        int consumed = 0;
+        if (sscanf(token, "%lf%n", &gain_db, &consumed) != 1) {
+            break;
+        }
+        token += consumed;
+        if (*token == '@' && sscanf(token, "@%lf%n", &hz, &consumed) == 1) {
+            token += consumed;
+            if (*token == '/' && sscanf(token, "/%lf%n", &q, &consumed) == 1) {
+                token += consumed;
+            }
+        }
+        if (hz <= 0 || q <= 0 || (*token && *token != ',')) {
+            break;
+        }
+        bands[band] = (EqBand){hz, clampGain(gain_db), q};
+        complete = *token == '\0';
+        token += !complete;
+    }
+    if (!complete) {
+        fprintf(stderr, "Error: --eq expects a preset (");
+        for (int preset = 0; preset < EQ_PRESETS; preset++) {
+            fprintf(stderr, "%s%s", preset ? ", " : "", presets[preset].name);
+        }
+        fprintf(stderr, ") or up to %d gains in dB, each GAIN[@HZ[/Q]]\n", EQ_BANDS);
+        return false;
+    }
+    for (int band = 0; band < EQ_BANDS; band++) {
+        equalizerSetBand(eq, band, bands[band].hz, bands[band].gain_db, bands[band].q);
+    }
+    return true;
+}
+
+// Next coefficient step of a change; the last one lands exactly on the target
+static void rampStep(Equalizer *eq) {
+    eq->ramp--;
+    eq->segment_left = EQ_RAMP_FRAMES;
+    if (eq->ramp == 0) {
+        eq->current = eq->to;
+        eq->preamp = eq->preamp_to;
+        return;
+    }
+    float share = (float)(EQ_RAMP_STEPS - eq->ramp) / EQ_RAMP_STEPS;
+    const float *from = (const float *)&eq->from, *to = (const float *)&eq->to;
+    float *current = (float *)&eq->current;
+    for (size_t i = 0; i < sizeof(EqCoefficients) / sizeof(float); i++) {
+        current[i] = from[i] + (to[i] - from[i]) * share;
+    }
+    eq->preamp = eq->preamp_from + (eq->preamp_to - eq->preamp_from) * share;
+}
+
+/*
+  Function equalizerSync
+  picks up changed settings on the audio thread and starts a ramp from
+  wherever the coefficients are now. Linear steps between two stable
+  biquads stay stable, their denominators being a convex set. The
+  preamp leaves headroom for the largest boost so that a lone boosted
+  band does not clip.
+*/
+static void equalizerSync(Equalizer *eq) {
+    uint64_t version = __atomic_load_n(&eq->version, __ATOMIC_ACQUIRE);
+    if (version == eq->applied) {
+        return;
+    }
+    EqBand bands[EQ_BANDS];
+    pthread_mutex_lock(&eq->lock);
+    memcpy(bands, eq->bands, sizeof(bands));
+    bool enabled = eq->enabled;
+    eq->applied = eq->version;
+    pthread_mutex_unlock(&eq->lock);
+
+    identity(&eq->to);
+    double boost = 0.0;
+    eq->flat = true;
+    for (int band = 0; band < EQ_BANDS && enabled; band++) {
+        double c[5];
+        bandCoefficients(&bands[band], eq->sample_rate, c);
+        setLanes(&eq->to, band, c);
+        boost = bands[band].gain_db > boost ? bands[band].gain_db : boost;
+        eq->flat = eq->flat && bands[band].gain_db == 0.0;
+    }
+    eq->preamp_to = (float)pow(10.0, -boost / 20.0);
+    eq->from = eq->current;
+    eq->preamp_from = eq->preamp;
+    eq->ramp = EQ_RAMP_STEPS;
+    eq->segment_left = 0;
+    eq->ramps++;
+}
+
+// Filters float frames through the current step of any ramp
+static void equalizerFilter(Equalizer *eq, float *samples, int frames) {
+    for (int done = 0; done < frames;) {
+        if (eq->ramp > 0 && eq->segment_left == 0) {
+            rampStep(eq);
+        }
+        int count = frames - done;
+        if (eq->ramp > 0 && count > eq->segment_left) {
+            count = eq->segment_left;
+        }
+        float *chunk = samples + (size_t)done * EQ_CHANNELS;
+        if (eq->preamp != 1.0f) {
+            for (int i = 0; i < count * EQ_CHANNELS; i++) {
+                chunk[i] *= eq->preamp;
+            }
+        }
+        equalizerRun(eq->kernel, &eq->current, &eq->state, chunk, count);
+        if (eq->ramp > 0) {
+            eq->segment_left -= count;
+        }
+        done += count;
+    }
+}
+
+// True while the audio passes through untouched; the filter memory starts from silence afterwards
+static bool equalizerBypassed(Equalizer *eq, int frames) {
+    equalizerSync(eq);
+    eq->frames += frames;
+    if (!eq->flat || eq->ramp > 0) {
+        return false;
+    }
+    memset(&eq->state, 0, sizeof(EqState));
+    eq->bypassed += frames;
+    return true;
+}
+
+void equalizerProcessFloat(Equalizer *eq, float *samples, int frames) {
+    if (equalizerBypassed(eq, frames)) {
+        return;
+    }
+    uint64_t start = statsNow();
+    equalizerFilter(eq, samples, frames);
+    eq->process_ns += statsNow() - start;
+}
+
+/*
+  Function equalizerProcess
+  filters interleaved stereo S16, what the resampler hands the sink,
+  through float in pieces of EQ_SCRATCH_FRAMES and saturates on the
+  way back.
+*/
+void equalizerProcess(Equalizer *eq, int16_t *samples, int frames) {
+    if (equalizerBypassed(eq, frames)) {
+        return;
+    }
+    uint64_t start = statsNow();
+    for (int done = 0; done < frames; done += EQ_SCRATCH_FRAMES) {
+        int count = frames - done < EQ_SCRATCH_FRAMES ? frames - done : EQ_SCRATCH_FRAMES;
+        int16_t *chunk = samples + (size_t)done * EQ_CHANNELS;
+        for (int i = 0; i < count * EQ_CHANNELS; i++) {
+            eq->scratch[i] = chunk[i] * (1.0f / 32768.0f);
+        }
+        equalizerFilter(eq, eq->scratch, count);
+        for (int i = 0; i < count * EQ_CHANNELS; i++) {
+            float value = eq->scratch[i] * 32768.0f;
+            if (value > INT16_MAX || value < INT16_MIN) {
+                value = value > INT16_MAX ? INT16_MAX : INT16_MIN;
+                eq->clipped++;
+            }
+            chunk[i] = (int16_t)(value + (value < 0 ? -0.5f : 0.5f));   // Rounded, without a libm call per sample
+        }
+    }
+    eq->process_ns += statsNow() - start;
+}
+
+void equalizerPrintStats(const Equalizer *eq, FILE *out) {
+    if (eq->frames == 0) {
+        return;
+    }
+    uint64_t filtered = eq->frames - eq->bypassed;
+    fprintf(out, "Equalizer: %s kernel, %llu of %llu frames filtered, %llu coefficient ramps, %llu samples clipped",
+            cpuLevelName(eq->kernel), (unsigned long long)filtered, (unsigned long long)eq->frames,
+            (unsigned long long)eq->ramps, (unsigned long long)eq->clipped);
+    if (filtered > 0 && eq->process_ns > 0) {
+        fprintf(out, ", %.1f ns per frame (%.0fx real time)", (double)eq->process_ns / filtered,
+                filtered / (eq->process_ns / 1e9) / eq->sample_rate);
+    }
+    fprintf(out, "\n");
+}
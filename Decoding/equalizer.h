@@ -0,0 +1,84 @@
+#ifndef EQUALIZER_H
+#define EQUALIZER_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "../Util/cpu.h"
+
+#define EQ_BANDS 10
+#define EQ_CHANNELS 2                      // Stereo, what the resampler writes
+#define EQ_SLOTS 12                        // Bands padded to whole AVX2 vectors of four bands
+#define EQ_LANES (EQ_SLOTS * EQ_CHANNELS)  // Lane band * EQ_CHANNELS + channel
+#define EQ_MAX_GAIN_DB 12.0
+#define EQ_RAMP_STEPS 16                   // A change is spread over this many coefficient steps...
+#define EQ_RAMP_FRAMES 64                  // ...of this many frames each, 23 ms at 44.1 kHz
+#define EQ_SCRATCH_FRAMES 4096             // S16 input is filtered in pieces of this size
+
+// One peaking filter
+typedef struct {
+    double hz, gain_db, q;
+} EqBand;
+
+// Biquads of every band and channel, normalized to a0 = 1; padding slots are all zero
+typedef struct {
+    float b0[EQ_LANES], b1[EQ_LANES], b2[EQ_LANES], a1[EQ_LANES], a2[EQ_LANES];
+} EqCoefficients;
+
+// Filter memory, transposed direct form II
+typedef struct {
+    float z1[EQ_LANES], z2[EQ_LANES];
+} EqState;
+
+/*
+  Ten-band parametric equalizer on the resampled audio, before the sink
+  and its taps. Settings change from any thread under a lock; the audio
+  thread notices the new version and walks its coefficients there in
+  EQ_RAMP_STEPS steps, so moving a slider never clicks. The cascade runs
+  on float with both channels of two (SSE4.1) or four (AVX2) bands per
+  vector, and is skipped altogether while every band is flat.
+*/
+typedef struct {
+    int sample_rate;
+    CpuLevel kernel;
+
+    // Settings, written by any thread
+    pthread_mutex_t lock;
+    EqBand bands[EQ_BANDS];
+    bool enabled;
+    int preset;                    // Last preset applied, -1 once a band is changed by hand
+    uint64_t version;              // Bumped by every change
+
+    // Filtering, owned by the audio thread
+    uint64_t applied;              // Settings version the coefficients are heading to
+    EqCoefficients current, from, to;
+    float preamp, preamp_from, preamp_to;   // Headroom for the largest boost
+    int ramp;                      // Steps still to take, 0 once current is to
+    int segment_left;              // Frames left at the current step
+    bool flat;                     // to passes audio through unchanged
+    EqState state;
+    float *scratch;
+
+    // Reporting
+    uint64_t frames, bypassed, clipped, ramps, process_ns;
+} Equalizer;
+
+extern Equalizer audioEqualizer;
+
+bool equalizerInit(Equalizer *eq, int sample_rate);
+void equalizerDestroy(Equalizer *eq);
+bool equalizerParse(Equalizer *eq, const char *spec);
+int equalizerPresetCount();
+const char *equalizerPresetName(int preset);
+void equalizerSetPreset(Equalizer *eq, int preset);
+void equalizerSetGain(Equalizer *eq, int band, double gain_db);
+void equalizerSetBand(Equalizer *eq, int band, double hz, double gain_db, double q);
+void equalizerSetEnabled(Equalizer *eq, bool enabled);
+int equalizerGetBands(Equalizer *eq, EqBand bands[EQ_BANDS]);
+void equalizerProcess(Equalizer *eq, int16_t *samples, int frames);
+void equalizerProcessFloat(Equalizer *eq, float *samples, int frames);
+void equalizerRun(CpuLevel kernel, const EqCoefficients *c, EqState *state, float *samples, int frames);
+void equalizerPrintStats(const Equalizer *eq, FILE *out);
+
+#endif // EQUALIZER_H
@@ -0,0 +1,98 @@
+#include "pipeline.h"
+
+#include <stdio.h>
+
+int findFirstStream(const AVFormatContext *format_context, enum AVMediaType type) {
+    for (int i = 0; i < format_context->nb_streams; i++) {
+        if (format_context->streams[i]->codecpar->codec_type == type) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static AVCodecContext *openDecoder(AVFormatContext *format_context, int stream_index, int thread_count,
+                                   int lowres, int flags) {
+    AVStream *stream = format_context->streams[stream_index];
+
+    const AVCodec *codec = avcodec_find_decoder(stream->codecpar->codec_id);
+    if (!codec) {
+        fprintf(stderr, "Error: Codec not found\n");
+        return NULL;
+    }
+
+    AVCodecContext *codec_context = avcodec_alloc_context3(codec);
+    if (!codec_context) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        return NULL;
+    }
+    avcodec_parameters_to_context(codec_context, stream->codecpar);
+    codec_context->pkt_timebase = stream->time_base;
+    codec_context->thread_count = thread_count;
+    codec_context->lowres = lowres < codec->max_lowres ? lowres : codec->max_lowres;
+    codec_context->flags |= flags;
+
+    if (avcodec_open2(codec_context, codec, NULL) < 0) {
+        fprintf(stderr, "Error: Could not open codec\n");
+        avcodec_free_context(&codec_context);
+        return NULL;
+    }
+    return codec_context;
+}
+
+/*
+  Function openStreamDecoder
+  finds and opens the decoder for one stream. thread_count follows
+  AVCodecContext semantics: 1 decodes on the calling thread, 0 lets
+  FFmpeg pick one thread per core.
+*/
+AVCodecContext *openStreamDecoder(AVFormatContext *format_context, int stream_index, int thread_count) {
+    return openDecoder(format_context, stream_index, thread_count, 0, 0);
+}
+
+/*
+  Function openLowDelayDecoder
+  same as openStreamDecoder for live inputs: AV_CODEC_FLAG_LOW_DELAY
+  makes the decoder return each picture as soon as it is decoded
+  rather than holding frames back for reordering it may never need.
+*/
+AVCodecContext *openLowDelayDecoder(AVFormatContext *format_context, int stream_index, int thread_count) {
+    return openDecoder(format_context, stream_index, thread_count, 0, AV_CODEC_FLAG_LOW_DELAY);
+}
+
+/*
+  Function openSizedVideoDecoder
+  same as openStreamDecoder for pictures that are only ever shown at
+  up to max_width x max_height: decoders that support it (lowres:
+  MJPEG, H.263, MPEG-4 part 2, ...) then decode at 1/2, 1/4 or 1/8 of
+  the coded size instead of decoding everything and scaling it away.
+*/
+AVCodecContext *openSizedVideoDecoder(AVFormatContext *format_context, int stream_index, int thread_count,
+                                      int max_width, int max_height) {
+    const AVCodecParameters *par = format_context->streams[stream_index]->codecpar;
+    int lowres = 0;
+    while (lowres < 3 && (par->width >> (lowres + 1)) >= max_width && (par->height >> (lowres + 1)) >= max_height) {
+        lowres++;
+    }
+    return openDecoder(format_context, stream_index, thread_count, lowres, 0);
+}
+
+// Resampler from the decoder's native format to interleaved stereo S16
+SwrContext *openResampler(const AVCodecContext *codec_context, int out_sample_rate) {
+    SwrContext *swr_ctx = swr_alloc_set_opts(
+        NULL,
+        AV_CH_LAYOUT_STEREO,        // Output: Stereo
+        AV_SAMPLE_FMT_S16,          // Output: Signed 16-bit PCM
+        out_sample_rate,            // Output: sample rate
+        codec_context->channel_layout ? codec_context->channel_layout
+                                      : av_get_default_channel_layout(codec_context->channels),
+        codec_context->sample_fmt,     // Input sample format
+        codec_context->sample_rate,    // Input sample rate
+        0, NULL);
+    if (!swr_ctx || swr_init(swr_ctx) < 0) {
+        fprintf(stderr, "Error: Could not initialize resampler\n");
+        if (swr_ctx) swr_free(&swr_ctx);
+        return NULL;
+    }
+    return swr_ctx;
+}
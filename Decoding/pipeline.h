@@ -0,0 +1,25 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libswresample/swresample.h>
+#include <libswscale/swscale.h>
+
+// Output format of the audio path: 44.1 kHz, stereo, signed 16-bit PCM
+#define OUTPUT_SAMPLE_RATE 44100
+#define OUTPUT_CHANNELS 2
+#define OUTPUT_BYTES_PER_SAMPLE 2
+
+/*
+  Shared building blocks of the decode path. Nothing in here depends on
+  GTK or PulseAudio so headless tools can link it on its own.
+*/
+AVCodecContext *openStreamDecoder(AVFormatContext *format_context, int stream_index, int thread_count);
+AVCodecContext *openLowDelayDecoder(AVFormatContext *format_context, int stream_index, int thread_count);
+AVCodecContext *openSizedVideoDecoder(AVFormatContext *format_context, int stream_index, int thread_count,
+                                      int max_width, int max_height);
+SwrContext *openResampler(const AVCodecContext *codec_context, int out_sample_rate);
+int findFirstStream(const AVFormatContext *format_context, enum AVMediaType type);
+
+#endif // PIPELINE_H
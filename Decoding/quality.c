@@ -0,0 +1,107 @@
+#include "quality.h"
+
+#include <string.h>
+
+#define QUALITY_DEGRADE_LOAD 0.8    // Decode time / frame interval that makes it step down
+#define QUALITY_RECOVER_LOAD 0.5    // Predicted load of the better level that lets it step up
+#define QUALITY_RECOVER_WINDOWS 3   // Windows to stay at a level before stepping up
+#define QUALITY_UNKNOWN_GAIN 1.5    // Assumed cost of stepping up when the step down was never measured
+
+static const char *level_names[QUALITY_LEVEL_COUNT] = {
+    [QUALITY_FULL] = "full",
+    [QUALITY_SKIP_LOOP_FILTER] = "skip loop filter",
+    [QUALITY_SKIP_NONREF] = "skip non-reference frames",
+    [QUALITY_SKIP_IDCT] = "skip IDCT on non-keyframes",
+};
+
+void qualityInit(QualityController *qc, double frame_interval) {
+    memset(qc, 0, sizeof(QualityController));
+    qc->frame_interval = frame_interval;
+    qc->level = QUALITY_FULL;
+}
+
+const char *qualityName(QualityLevel level) {
+    return level >= 0 && level < QUALITY_LEVEL_COUNT ? level_names[level] : "unknown";
+}
+
+static void qualityStep(QualityController *qc, QualityLevel level, double mean) {
+    fprintf(stderr, "Quality: decode %.2f ms/frame is %.0f%% of the %.2f ms frame, %s to %s\n",
+            mean * 1e3, mean / qc->frame_interval * 100, qc->frame_interval * 1e3,
+            level > qc->level ? "degrading" : "recovering", level_names[level]);
+    qc->gain_pending = true;
+    qc->before_level = qc->level;
+    qc->before_cost = mean;
+    qc->level = level;
+    qc->windows_at_level = 0;
+    if (level > qc->before_level) {
+        qc->steps_down++;
+    } else {
+        qc->steps_up++;
+    }
+}
+
+/*
+  Function qualityUpdate
+  adds one video packet's decode time (send plus receive). Decisions
+  are made once per QUALITY_WINDOW packets; returns true when the level
+  changed and the caller has to qualityApply it.
+*/
+bool qualityUpdate(QualityController *qc, uint64_t decode_ns) {
+    qc->level_packets[qc->level]++;
+    qc->window_ns += decode_ns;
+    if (++qc->samples < QUALITY_WINDOW) {
+        return false;
+    }
+    double mean = qc->window_ns / 1e9 / qc->samples;
+    qc->samples = 0;
+    qc->window_ns = 0;
+    qc->windows_at_level++;
+
+    if (qc->gain_pending) {
+        // First full window at the new level: what the step really bought (or cost)
+        qc->gain_pending = false;
+        QualityLevel upper = qc->level > qc->before_level ? qc->level : qc->before_level;
+        if (qc->before_cost > 0 && mean > 0) {
+            qc->step_ratio[upper] = qc->level == upper ? mean / qc->before_cost : qc->before_cost / mean;
+        }
+        fprintf(stderr, "Quality: %s -> %s: decode %.2f -> %.2f ms/frame (%+.0f%%)\n",
+                level_names[qc->before_level], level_names[qc->level], qc->before_cost * 1e3, mean * 1e3,
+                qc->before_cost > 0 ? (mean / qc->before_cost - 1) * 100 : 0.0);
+    }
+
+    double load = mean / qc->frame_interval;
+    if (load > QUALITY_DEGRADE_LOAD && qc->level < QUALITY_LEVEL_COUNT - 1) {
+        qualityStep(qc, qc->level + 1, mean);
+        return true;
+    }
+    if (qc->level > QUALITY_FULL && qc->windows_at_level >= QUALITY_RECOVER_WINDOWS) {
+        double ratio = qc->step_ratio[qc->level];
+        double predicted = ratio > 0 ? mean / ratio : mean * QUALITY_UNKNOWN_GAIN;
+        if (predicted / qc->frame_interval < QUALITY_RECOVER_LOAD) {
+            qualityStep(qc, qc->level - 1, mean);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Safe to call between packets; the shortcuts take effect from the next one
+void qualityApply(const QualityController *qc, AVCodecContext *codec_context) {
+    codec_context->skip_loop_filter = qc->level >= QUALITY_SKIP_LOOP_FILTER ? AVDISCARD_ALL : AVDISCARD_DEFAULT;
+    codec_context->skip_frame = qc->level >= QUALITY_SKIP_NONREF ? AVDISCARD_NONREF : AVDISCARD_DEFAULT;
+    codec_context->skip_idct = qc->level >= QUALITY_SKIP_IDCT ? AVDISCARD_NONKEY : AVDISCARD_DEFAULT;
+}
+
+void qualityPrintStats(const QualityController *qc, FILE *out) {
+    uint64_t total = 0;
+    for (int level = 0; level < QUALITY_LEVEL_COUNT; level++) {
+        total += qc->level_packets[level];
+    }
+    fprintf(out, "Quality: %llu steps down, %llu up, ended at %s; packets per level:",
+            (unsigned long long)qc->steps_down, (unsigned long long)qc->steps_up, level_names[qc->level]);
+    for (int level = 0; level < QUALITY_LEVEL_COUNT; level++) {
+        fprintf(out, "%s %s %.1f%%", level ? "," : "", level_names[level],
+                total ? qc->level_packets[level] * 100.0 / total : 0.0);
+    }
+    fprintf(out, "\n");
+}
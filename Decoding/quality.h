@@ -0,0 +1,54 @@
+#ifndef QUALITY_H
+#define QUALITY_H
+
+#include <libavcodec/avcodec.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define QUALITY_WINDOW 30   // Video packets per measurement
+
+// Decoder shortcuts, each level keeps the ones before it
+typedef enum {
+    QUALITY_FULL,
+    QUALITY_SKIP_LOOP_FILTER,   // No deblocking
+    QUALITY_SKIP_NONREF,        // Frames nothing references (mostly B) are not decoded at all
+    QUALITY_SKIP_IDCT,          // Residuals only reconstructed on keyframes
+    QUALITY_LEVEL_COUNT
+} QualityLevel;
+
+/*
+  Watches video decode time per packet against the frame interval and
+  moves the video decoder between quality levels: one step down when
+  decoding eats most of the frame time, one step back up once the
+  cost of the better level, scaled by the gain measured when it was
+  left, fits comfortably again. Only the video decoder is touched;
+  audio always decodes in full.
+*/
+typedef struct {
+    double frame_interval;
+    QualityLevel level;
+
+    // Current window
+    int samples;
+    uint64_t window_ns;
+    int windows_at_level;
+
+    // Step under measurement: the mean before it, reported with the first window after it
+    bool gain_pending;
+    QualityLevel before_level;
+    double before_cost;
+    double step_ratio[QUALITY_LEVEL_COUNT];   // Cost at level / cost at level - 1, 0 until measured
+
+    // Reporting
+    uint64_t level_packets[QUALITY_LEVEL_COUNT];
+    uint64_t steps_down, steps_up;
+} QualityController;
+
+void qualityInit(QualityController *qc, double frame_interval);
+bool qualityUpdate(QualityController *qc, uint64_t decode_ns);
+void qualityApply(const QualityController *qc, AVCodecContext *codec_context);
+const char *qualityName(QualityLevel level);
+void qualityPrintStats(const QualityController *qc, FILE *out);
+
+#endif // QUALITY_H
@@ -0,0 +1,345 @@
+#include "reverse.h"
+
+#include <math.h>
+#include <string.h>
+#include "decoding.h"
+#include "demux.h"
+#include "pipeline.h"
+#include "../Stats/stats.h"
+#include "../Stats/trace.h"
+
+#define REVERSE_SEEK_EPSILON 0.001   // Seconds before a segment's end the seek aims at
+#define REVERSE_SEEK_ATTEMPTS 6      // Seeks that land past the segment end back off 1, 2, 4, ... s
+#define REVERSE_MIN_FRAMES 64        // Initial slots of a segment
+
+// Only set up in reverse mode; stopPlayback broadcasts on it regardless
+GopCache gopCache = {.mutex = PTHREAD_MUTEX_INITIALIZER, .notFull = PTHREAD_COND_INITIALIZER,
+                     .notEmpty = PTHREAD_COND_INITIALIZER};
+
+typedef struct {
+    AVFormatContext *format_context;
+    AVCodecContext *codec_context;
+    int stream_index;
+    double time_base;
+    AVPacket *packet;
+    AVFrame *frame;
+} ReverseDecoder;
+
+void gopCacheInit(GopCache *gc, size_t budget) {
+    memset(gc, 0, sizeof(GopCache));
+    gc->segment_budget = budget / 2;   // One segment shown, one decoded ahead
+    pthread_mutex_init(&gc->mutex, NULL);
+    pthread_cond_init(&gc->notFull, NULL);
+    pthread_cond_init(&gc->notEmpty, NULL);
+}
+
+static void segmentFree(GopSegment *seg) {
+    if (!seg) {
+        return;
+    }
+    for (int i = 0; i < seg->count; i++) {
+        av_frame_free(&seg->frames[i]);
+    }
+    free(seg->frames);
+    free(seg->pts);
+    free(seg);
+}
+
+void gopCacheDestroy(GopCache *gc) {
+    segmentFree(gc->next);
+    gc->next = NULL;
+    pthread_mutex_destroy(&gc->mutex);
+    pthread_cond_destroy(&gc->notFull);
+    pthread_cond_destroy(&gc->notEmpty);
+}
+
+// Takes ownership of seg; blocks while the previous one has not been taken
+static bool gopCachePush(GopCache *gc, GopSegment *seg) {
+    pthread_mutex_lock(&gc->mutex);
+    while (gc->next && is_running) {
+        pthread_cond_wait(&gc->notFull, &gc->mutex);
+    }
+    if (!is_running) {
+        pthread_mutex_unlock(&gc->mutex);
+        segmentFree(seg);
+        return false;
+    }
+    gc->next = seg;
+    pthread_cond_signal(&gc->notEmpty);
+    pthread_mutex_unlock(&gc->mutex);
+    return true;
+}
+
+static bool gopCachePop(GopCache *gc, GopSegment **seg) {
+    pthread_mutex_lock(&gc->mutex);
+    while (!gc->next && !gc->finished && is_running) {
+        pthread_cond_wait(&gc->notEmpty, &gc->mutex);
+    }
+    *seg = is_running ? gc->next : NULL;
+    if (*seg) {
+        gc->next = NULL;
+        pthread_cond_signal(&gc->notFull);
+    }
+    pthread_mutex_unlock(&gc->mutex);
+    return *seg != NULL;
+}
+
+static void gopCacheFinish(GopCache *gc) {
+    pthread_mutex_lock(&gc->mutex);
+    gc->finished = true;
+    pthread_cond_broadcast(&gc->notEmpty);
+    pthread_mutex_unlock(&gc->mutex);
+}
+
+/*
+  Function segmentAppend
+  moves the decoded frame into the segment. Over the budget the oldest
+  frames make room: the segment always ends at the frame shown next,
+  and what was dropped is decoded again from the same keyframe.
+*/
+static bool segmentAppend(GopSegment *seg, AVFrame *frame, double pts, size_t budget) {
+    size_t bytes = videoFrameBytes(frame);
+    while (seg->count > 0 && seg->bytes + bytes > budget) {
+        seg->bytes -= videoFrameBytes(seg->frames[0]);
+        av_frame_free(&seg->frames[0]);
+        memmove(seg->frames, seg->frames + 1, (seg->count - 1) * sizeof(AVFrame *));
+        memmove(seg->pts, seg->pts + 1, (seg->count - 1) * sizeof(double));
+        seg->count--;
+        seg->trimmed = true;
+        seg->dropped++;
+    }
+    if (seg->count == seg->capacity) {
+        int capacity = seg->capacity ? seg->capacity * 2 : REVERSE_MIN_FRAMES;
+        AVFrame **frames = realloc(seg->frames, capacity * sizeof(AVFrame *));
+        if (!frames) {
+            return false;
+        }
+        seg->frames = frames;
+        double *times = realloc(seg->pts, capacity * sizeof(double));
+        if (!times) {
+            return false;
+        }
+        seg->pts = times;
+        seg->capacity = capacity;
+    }
+    AVFrame *kept = av_frame_alloc();
+    if (!kept) {
+        return false;
+    }
+    av_frame_move_ref(kept, frame);
+    seg->frames[seg->count] = kept;
+    seg->pts[seg->count] = pts;
+    seg->count++;
+    seg->bytes += bytes;
+    return true;
+}
+
+// Takes the decoded frames; *more turns false at the first frame at or after end
+static bool segmentReceive(ReverseDecoder *rd, GopSegment *seg, double end, size_t budget, bool *more) {
+    while (avcodec_receive_frame(rd->codec_context, rd->frame) >= 0) {
+        int64_t timestamp = rd->frame->best_effort_timestamp;
+        double pts = timestamp == AV_NOPTS_VALUE ? NAN : timestamp * rd->time_base;
+        if (pts >= end) {
+            av_frame_unref(rd->frame);
+            *more = false;
+            return true;
+        }
+        // Leading pictures of an open GOP reference the GOP before and come out broken
+        if (isnan(pts) || pts < seg->start) {
+            av_frame_unref(rd->frame);
+            seg->dropped++;
+            continue;
+        }
+        bool kept = segmentAppend(seg, rd->frame, pts, budget);
+        av_frame_unref(rd->frame);
+        if (!kept) {
+            fprintf(stderr, "Error: Memory allocation failed\n");
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+  Function decodeSegment
+  seeks to the keyframe at or before seek_at and decodes forward until
+  the first frame at end. Returns NULL if the seek or the decoder
+  failed; a segment without frames means the keyframe found lies at or
+  after end and the caller has to seek further back.
+*/
+static GopSegment *decodeSegment(ReverseDecoder *rd, double seek_at, double end, size_t budget) {
+    if (av_seek_frame(rd->format_context, -1, (int64_t)(seek_at * AV_TIME_BASE), AVSEEK_FLAG_BACKWARD) < 0) {
+        return NULL;
+    }
+    avcodec_flush_buffers(rd->codec_context);
+
+    GopSegment *seg = calloc(1, sizeof(GopSegment));
+    if (!seg) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        return NULL;
+    }
+    seg->start = NAN;
+    bool more = true, ok = true;
+    while (more && ok && is_running) {
+        if (av_read_frame(rd->format_context, rd->packet) < 0) {
+            avcodec_send_packet(rd->codec_context, NULL);  // End of input: drain
+            ok = segmentReceive(rd, seg, end, budget, &more);
+            break;
+        }
+        if (rd->packet->stream_index != rd->stream_index) {
+            av_packet_unref(rd->packet);
+            continue;
+        }
+        if (isnan(seg->start)) {
+            // Decoding has to begin at a keyframe; its time bounds what this segment can show
+            if (!(rd->packet->flags & AV_PKT_FLAG_KEY)) {
+                av_packet_unref(rd->packet);
+                continue;
+            }
+            int64_t timestamp = rd->packet->pts != AV_NOPTS_VALUE ? rd->packet->pts : rd->packet->dts;
+            seg->start = timestamp == AV_NOPTS_VALUE ? -INFINITY : timestamp * rd->time_base;
+            if (seg->start >= end) {
+                av_packet_unref(rd->packet);
+                break;
+            }
+        }
+        int ret = avcodec_send_packet(rd->codec_context, rd->packet);
+        av_packet_unref(rd->packet);
+        if (ret < 0) {
+            fprintf(stderr, "Error: Failed to send packet for decoding\n");
+            continue;  // A broken packet costs its own frames, not the rest of the GOP
+        }
+        ok = segmentReceive(rd, seg, end, budget, &more);
+    }
+    if (!ok) {
+        segmentFree(seg);
+        return NULL;
+    }
+    return seg;
+}
+
+/*
+  Function reverseDecodeThread
+  walks the input backwards one segment at a time, from the requested
+  start (or the end) to the first keyframe. Each segment ends where the
+  previous one began, so every frame is shown exactly once. The demux
+  stage does not run in reverse mode; this stage owns the demuxer.
+*/
+void *reverseDecodeThread(void *args) {
+    DecodeData *data = (DecodeData *)args;
+    GopCache *gc = &gopCache;
+    AVFormatContext *fc = demuxer.format_context;
+    statsThreadName("reverse-decode");
+    traceThreadName("reverse-decode");
+
+    ReverseDecoder rd = {fc, NULL, demuxer.video_stream_index, 0.0, av_packet_alloc(), av_frame_alloc()};
+    if (rd.stream_index == -1) {
+        fprintf(stderr, "Error: No video stream found\n");
+    } else if (!rd.packet || !rd.frame) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+    } else {
+        // Whole GOPs are decoded at once, so frame threads cost no latency that matters here
+        rd.codec_context = openStreamDecoder(fc, rd.stream_index, 0);
+    }
+
+    double file_start = fc->start_time != AV_NOPTS_VALUE ? fc->start_time / (double)AV_TIME_BASE : 0.0;
+    double file_end = fc->duration != AV_NOPTS_VALUE ? file_start + fc->duration / (double)AV_TIME_BASE : NAN;
+    double end = data->reverse_from > 0 ? data->reverse_from : INFINITY;
+    if (rd.codec_context && isinf(end) && isnan(file_end)) {
+        fprintf(stderr, "Error: Reverse playback from the end needs an input with a known duration\n");
+        avcodec_free_context(&rd.codec_context);
+    }
+
+    if (rd.codec_context) {
+        rd.time_base = av_q2d(fc->streams[rd.stream_index]->time_base);
+        for (int i = 0; i < (int)fc->nb_streams; i++) {
+            fc->streams[i]->discard = i == rd.stream_index ? AVDISCARD_DEFAULT : AVDISCARD_ALL;
+        }
+    }
+    AVRational rate = rd.codec_context ? fc->streams[rd.stream_index]->avg_frame_rate : (AVRational){0, 1};
+    double interval = rate.num > 0 && rate.den > 0 ? rate.den / (double)rate.num :
+                      1.0 / (data->frame_rate > 0 ? data->frame_rate : 25);
+
+    while (rd.codec_context && is_running && end > file_start + REVERSE_SEEK_EPSILON) {
+        double target = isnan(file_end) || end < file_end ? end : file_end;
+        double back = 0.0;
+        GopSegment *seg = NULL;
+        uint64_t decode_start = statsNow();
+        traceBegin("reverse_gop");
+        for (int attempt = 0; attempt < REVERSE_SEEK_ATTEMPTS && is_running; attempt++) {
+            double seek_at = fmax(target - REVERSE_SEEK_EPSILON - back, file_start);
+            seg = decodeSegment(&rd, seek_at, end, gc->segment_budget);
+            if (!seg || seg->count > 0 || seek_at <= file_start) {
+                break;
+            }
+            // The seek found a keyframe at or after end: nothing to show from there
+            segmentFree(seg);
+            seg = NULL;
+            back = back > 0 ? back * 2 : 1.0;
+            gc->seek_retries++;
+        }
+        traceEnd("reverse_gop");
+        if (!seg || seg->count == 0) {
+            if (!seg && gc->segments == 0) {
+                fprintf(stderr, "Error: Could not seek to %.3fs for reverse playback\n", target);
+            }
+            segmentFree(seg);
+            break;
+        }
+
+        gc->decode_ns += statsNow() - decode_start;
+        gc->segments++;
+        gc->trimmed += seg->trimmed;
+        gc->frames += seg->count;
+        gc->dropped += seg->dropped;
+        gc->decoded_seconds += (isinf(end) ? seg->pts[seg->count - 1] + interval : end) - seg->pts[0];
+        if (seg->bytes > gc->peak_bytes) {
+            gc->peak_bytes = seg->bytes;
+        }
+
+        // Strictly earlier than end: the next segment stops where this one starts
+        end = seg->trimmed || !isfinite(seg->start) ? seg->pts[0] : seg->start;
+        statsMarkStartup(STARTUP_FIRST_DECODED);
+        if (!gopCachePush(gc, seg)) {
+            break;
+        }
+    }
+
+    gopCacheFinish(gc);
+    av_packet_free(&rd.packet);
+    av_frame_free(&rd.frame);
+    avcodec_free_context(&rd.codec_context);
+    return NULL;
+}
+
+/*
+  Function reverseThread
+  stands in for the video decode stage: hands every segment's frames
+  to the video buffer newest first, where the converter and the
+  display take them as if they came from a forward decoder.
+*/
+void *reverseThread(void *args) {
+    statsThreadName("reverse");
+    traceThreadName("reverse");
+    GopSegment *seg;
+    while (gopCachePop(&gopCache, &seg)) {
+        while (seg->count > 0 && is_running) {
+            int last = --seg->count;
+            videoBufferPush(&videoBuffer, seg->frames[last], seg->pts[last]);  // Owns the frame either way
+        }
+        segmentFree(seg);
+    }
+    videoBufferFinish(&videoBuffer);
+    return NULL;
+}
+
+void gopCachePrintStats(const GopCache *gc, FILE *out) {
+    double decode_seconds = gc->decode_ns / 1e9;
+    fprintf(out, "Reverse: %llu GOP segments (%llu cut to the %.0f MB segment budget), %llu frames kept, "
+            "%llu decoded and dropped, %llu seek retries; %.1f s of video decoded in %.1f s (%.1fx realtime), "
+            "%.1f ms per segment, peak segment %.1f MB\n",
+            (unsigned long long)gc->segments, (unsigned long long)gc->trimmed, gc->segment_budget / 1048576.0,
+            (unsigned long long)gc->frames, (unsigned long long)gc->dropped, (unsigned long long)gc->seek_retries,
+            gc->decoded_seconds, decode_seconds, decode_seconds > 0 ? gc->decoded_seconds / decode_seconds : 0.0,
+            gc->segments ? decode_seconds * 1e3 / gc->segments : 0.0, gc->peak_bytes / 1048576.0);
+}
@@ -0,0 +1,56 @@
+#ifndef REVERSE_H
+#define REVERSE_H
+
+#include <libavcodec/avcodec.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define REVERSE_CACHE_MB 512   // Decoded GOPs held for reverse playback
+
+// Decoded frames of one GOP, or of its tail when the whole GOP does not fit, in presentation order
+typedef struct {
+    AVFrame **frames;
+    double *pts;
+    int count, capacity;
+    size_t bytes;
+    double start;    // Time of the keyframe the decode started from
+    bool trimmed;    // Frames between start and frames[0] did not fit and are decoded again later
+    int dropped;     // Frames decoded but not kept: trimmed, or leading pictures of an open GOP
+} GopSegment;
+
+/*
+  Reverse playback. A decode stage seeks to the keyframe before the
+  earliest frame shown so far, decodes that GOP into a segment and
+  queues it; a present stage hands each segment's frames to the video
+  buffer newest first. One segment is queued ahead, so the GOP before
+  is decoded while the current one is being shown. A GOP larger than
+  half the budget keeps its last frames and is entered again from the
+  same keyframe for the rest.
+*/
+typedef struct {
+    GopSegment *next;          // Decoded ahead, waiting for the present stage
+    size_t segment_budget;
+    bool finished;             // Reached the start of the input, pops fail once next is taken
+    pthread_mutex_t mutex;
+    pthread_cond_t notFull, notEmpty;
+
+    // Reporting, only touched by the decode stage
+    uint64_t segments, trimmed, frames, dropped, seek_retries;
+    uint64_t decode_ns;
+    double decoded_seconds;    // Video time covered by the segments
+    size_t peak_bytes;
+} GopCache;
+
+extern GopCache gopCache;
+
+void gopCacheInit(GopCache *gc, size_t budget);
+void gopCacheDestroy(GopCache *gc);
+void gopCachePrintStats(const GopCache *gc, FILE *out);
+
+void *reverseDecodeThread(void *args);
+void *reverseThread(void *args);
+
+#endif // REVERSE_H
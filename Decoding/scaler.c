@@ -0,0 +1,139 @@
+#include "scaler.h"
+
+#include <libavutil/pixdesc.h>
+#include <string.h>
+
+void scalerInit(SliceScaler *sc, ThreadPool *pool) {
+    memset(sc, 0, sizeof(SliceScaler));
+    sc->pool = pool;
+    sc->kernel = cpuBestLevel(CPU_AVX512);
+    sc->slices = pool ? pool->threads : 1;
+    if (sc->slices > SCALER_MAX_SLICES) {
+        sc->slices = SCALER_MAX_SLICES;
+    }
+}
+
+// Bands go to the shared scheduler; slices is how many a frame is cut into
+void scalerInitScheduled(SliceScaler *sc, Scheduler *scheduler, int slices) {
+    scalerInit(sc, NULL);
+    sc->scheduler = scheduler;
+    sc->slices = slices < 1 ? 1 : slices > SCALER_MAX_SLICES ? SCALER_MAX_SLICES : slices;
+}
+
+void scalerDestroy(SliceScaler *sc) {
+    for (int i = 0; i < SCALER_MAX_SLICES; i++) {
+        sws_freeContext(sc->contexts[i]);
+        sc->contexts[i] = NULL;
+    }
+}
+
+// Sets up the SIMD path when the formats are ones the kernels handle
+static bool scalerDirect(SliceScaler *sc, const AVFrame *src, enum AVPixelFormat dst_format) {
+    if (sc->kernel == SCALER_SWSCALE ||
+        (src->format != AV_PIX_FMT_YUV420P && src->format != AV_PIX_FMT_NV12) ||
+        (dst_format != AV_PIX_FMT_RGB24 && dst_format != AV_PIX_FMT_RGBA)) {
+        return false;
+    }
+    for (int p = 0; p < 3; p++) {
+        sc->yuv.planes[p] = src->data[p];
+        sc->yuv.linesize[p] = src->linesize[p];
+    }
+    sc->yuv.width = src->width;
+    sc->yuv.height = src->height;
+    sc->yuv.nv12 = src->format == AV_PIX_FMT_NV12;
+    return true;
+}
+
+// Moves plane pointers of a format down to picture row y
+static void scalerOffsetPlanes(enum AVPixelFormat format, uint8_t *const planes[4], const int linesize[4],
+                               int y, uint8_t *out[4]) {
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(format);
+    int count = av_pix_fmt_count_planes(format);
+
+    for (int p = 0; p < 4; p++) {
+        if (p >= count || !planes[p]) {
+            out[p] = NULL;
+            continue;
+        }
+        // Chroma planes are 1 and 2; luma and alpha are full height
+        int shift = (p == 1 || p == 2) ? desc->log2_chroma_h : 0;
+        out[p] = planes[p] + (ptrdiff_t)(y >> shift) * linesize[p];
+    }
+}
+
+static void scalerSlice(int index, void *context) {
+    SliceScaler *sc = context;
+    const AVFrame *src = sc->src;
+    int y = index * sc->slice_height;
+    int height = src->height - y < sc->slice_height ? src->height - y : sc->slice_height;
+    if (height <= 0) {
+        return;
+    }
+
+    if (sc->direct) {
+        yuv2rgbRows(sc->kernel, &sc->yuv, y, height, sc->dst[0], sc->dst_linesize[0],
+                    sc->dst_format == AV_PIX_FMT_RGBA);
+        return;
+    }
+
+    sc->contexts[index] = sws_getCachedContext(sc->contexts[index],
+        src->width, height, src->format,
+        src->width, height, sc->dst_format,
+        SWS_BILINEAR, NULL, NULL, NULL);
+    if (!sc->contexts[index]) {
+        sc->failed = true;
+        return;
+    }
+
+    uint8_t *src_planes[4], *dst_planes[4];
+    scalerOffsetPlanes(src->format, (uint8_t *const *)src->data, src->linesize, y, src_planes);
+    scalerOffsetPlanes(sc->dst_format, sc->dst, sc->dst_linesize, y, dst_planes);
+    sws_scale(sc->contexts[index], (const uint8_t *const *)src_planes, src->linesize,
+              0, height, dst_planes, sc->dst_linesize);
+}
+
+/*
+  Function scalerConvert
+  converts src into dst (same dimensions) across the pool. Band heights
+  are rounded to the chroma subsampling of both formats so no band
+  starts in the middle of a chroma row. Paletted and bitstream formats
+  are converted in one piece. No resize happens here, so the common
+  8-bit 4:2:0 cases go to the kernel picked by CPU detection.
+*/
+bool scalerConvert(SliceScaler *sc, const AVFrame *src, uint8_t *const dst[4], const int dst_linesize[4],
+                   enum AVPixelFormat dst_format) {
+    const AVPixFmtDescriptor *src_desc = av_pix_fmt_desc_get(src->format);
+    const AVPixFmtDescriptor *dst_desc = av_pix_fmt_desc_get(dst_format);
+    if (!src_desc || !dst_desc) {
+        return false;
+    }
+
+    int slices = sc->slices;
+    if ((src_desc->flags | dst_desc->flags) & (AV_PIX_FMT_FLAG_PAL | AV_PIX_FMT_FLAG_BITSTREAM)) {
+        slices = 1;
+    }
+    int align = 1 << (src_desc->log2_chroma_h > dst_desc->log2_chroma_h ?
+                      src_desc->log2_chroma_h : dst_desc->log2_chroma_h);
+    int height = (src->height + slices - 1) / slices;
+    height = (height + align - 1) / align * align;
+
+    sc->src = src;
+    memcpy(sc->dst, dst, sizeof(sc->dst));
+    memcpy(sc->dst_linesize, dst_linesize, sizeof(sc->dst_linesize));
+    sc->dst_format = dst_format;
+    sc->slice_height = height;
+    sc->direct = scalerDirect(sc, src, dst_format);
+    sc->failed = false;
+
+    int count = (src->height + height - 1) / height;
+    if (sc->scheduler && count > 1) {
+        schedulerRun(sc->scheduler, TASK_REALTIME, count, scalerSlice, sc);
+    } else if (sc->pool && count > 1) {
+        threadPoolRun(sc->pool, count, scalerSlice, sc);
+    } else {
+        for (int i = 0; i < count; i++) {
+            scalerSlice(i, sc);
+        }
+    }
+    return !sc->failed;
+}
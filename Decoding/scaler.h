@@ -0,0 +1,45 @@
+#ifndef SCALER_H
+#define SCALER_H
+
+#include <libavutil/frame.h>
+#include <libavutil/pixfmt.h>
+#include <libswscale/swscale.h>
+#include <stdbool.h>
+#include "yuv2rgb.h"
+#include "../Util/scheduler.h"
+#include "../Util/threadpool.h"
+
+#define SCALER_MAX_SLICES 16
+#define SCALER_SWSCALE -1   // kernel value that always goes through swscale
+
+/*
+  Same-size color conversion split into horizontal bands, one per
+  pool thread. Every band has its own SwsContext sized to the band, so
+  bands are independent images and need no ordering between them.
+  8-bit yuv420p/nv12 to RGB24/RGBA skips swscale for the SIMD kernels.
+*/
+typedef struct {
+    ThreadPool *pool;          // NULL converts on the calling thread
+    Scheduler *scheduler;      // Shared workers instead of a pool of its own, bands run as realtime tasks
+    int slices;
+    int kernel;                // CpuLevel of the fast path, or SCALER_SWSCALE
+    struct SwsContext *contexts[SCALER_MAX_SLICES];
+
+    // Current conversion
+    const AVFrame *src;
+    uint8_t *dst[4];
+    int dst_linesize[4];
+    enum AVPixelFormat dst_format;
+    int slice_height;
+    bool direct;               // This conversion uses the kernel
+    Yuv2RgbSource yuv;
+    bool failed;
+} SliceScaler;
+
+void scalerInit(SliceScaler *sc, ThreadPool *pool);
+void scalerInitScheduled(SliceScaler *sc, Scheduler *scheduler, int slices);
+void scalerDestroy(SliceScaler *sc);
+bool scalerConvert(SliceScaler *sc, const AVFrame *src, uint8_t *const dst[4], const int dst_linesize[4],
+                   enum AVPixelFormat dst_format);
+
+#endif // SCALER_H
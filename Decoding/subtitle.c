@@ -0,0 +1,415 @@
+#include "subtitle.h"
+
+#include <math.h>
+#include <pango/pangocairo.h>
+#include <string.h>
+#include "decoding.h"
+#include "demux.h"
+#include "pipeline.h"
+#include "../Stats/stats.h"
+#include "../Stats/trace.h"
+
+#define SUBTITLE_FONT "Sans Bold 26"
+#define SUBTITLE_OUTLINE 3          // Black outline around text, pixels
+#define SUBTITLE_DEFAULT_DURATION 5.0  // Events that do not say when they end
+#define SUBTITLE_TEXT_MAX 4096
+
+SubtitleCache subtitleCache;
+
+void subtitleCacheInit(SubtitleCache *cache) {
+    memset(cache, 0, sizeof(SubtitleCache));
+    pthread_mutex_init(&cache->mutex, NULL);
+}
+
+void subtitleCacheDestroy(SubtitleCache *cache) {
+    for (int i = 0; i < cache->count; i++) {
+        if (cache->cues[i].texture) {
+            g_object_unref(cache->cues[i].texture);
+        }
+    }
+    cache->count = 0;
+    pthread_mutex_destroy(&cache->mutex);
+}
+
+// Forgets every cue, e.g. those of a track switched away from
+void subtitleCacheClear(SubtitleCache *cache) {
+    pthread_mutex_lock(&cache->mutex);
+    for (int i = 0; i < cache->count; i++) {
+        if (cache->cues[i].texture) {
+            g_object_unref(cache->cues[i].texture);
+        }
+    }
+    cache->count = 0;
+    pthread_mutex_unlock(&cache->mutex);
+}
+
+// Called with the mutex held
+static SubtitleCue *subtitleCacheFind(SubtitleCache *cache, double start, double end) {
+    for (int i = 0; i < cache->count; i++) {
+        if (fabs(cache->cues[i].start - start) < 1e-3 && fabs(cache->cues[i].end - end) < 1e-3) {
+            return &cache->cues[i];
+        }
+    }
+    return NULL;
+}
+
+static bool subtitleCacheContains(SubtitleCache *cache, double start, double end) {
+    pthread_mutex_lock(&cache->mutex);
+    bool found = subtitleCacheFind(cache, start, end) != NULL;
+    if (found) {
+        cache->reused++;
+    }
+    pthread_mutex_unlock(&cache->mutex);
+    return found;
+}
+
+/*
+  Function subtitleCacheReserve
+  adds a cue whose texture is still being rasterized, so timing
+  changes (subtitleCacheEndAt) find it in order. A full cache drops the
+  cue that ended first.
+*/
+static void subtitleCacheReserve(SubtitleCache *cache, double start, double end) {
+    pthread_mutex_lock(&cache->mutex);
+    if (cache->count == SUBTITLE_CACHE_CUES) {
+        int oldest = 0;
+        for (int i = 1; i < cache->count; i++) {
+            if (cache->cues[i].end < cache->cues[oldest].end) {
+                oldest = i;
+            }
+        }
+        if (cache->cues[oldest].texture) {
+            g_object_unref(cache->cues[oldest].texture);
+        }
+        cache->cues[oldest] = cache->cues[--cache->count];
+        cache->evicted++;
+    }
+    cache->cues[cache->count++] = (SubtitleCue){start, end, NULL};
+    pthread_mutex_unlock(&cache->mutex);
+}
+
+// Takes over the texture reference; dropped if its cue was evicted or cleared meanwhile
+static void subtitleCacheFill(SubtitleCache *cache, double start, GdkTexture *texture, uint64_t raster_ns) {
+    pthread_mutex_lock(&cache->mutex);
+    SubtitleCue *cue = NULL;
+    for (int i = 0; i < cache->count && !cue; i++) {
+        if (!cache->cues[i].texture && fabs(cache->cues[i].start - start) < 1e-3) {
+            cue = &cache->cues[i];
+        }
+    }
+    if (cue) {
+        cue->texture = texture;
+    } else {
+        g_object_unref(texture);
+    }
+    cache->rasterized++;
+    cache->raster_ns += raster_ns;
+    pthread_mutex_unlock(&cache->mutex);
+}
+
+// Bitmap formats send an empty event to take the current one down
+static void subtitleCacheEndAt(SubtitleCache *cache, double t) {
+    pthread_mutex_lock(&cache->mutex);
+    for (int i = 0; i < cache->count; i++) {
+        if (cache->cues[i].start < t && cache->cues[i].end > t) {
+            cache->cues[i].end = t;
+        }
+    }
+    pthread_mutex_unlock(&cache->mutex);
+}
+
+/*
+  Function subtitleCacheLookup
+  returns a new reference to the overlay shown at pts, NULL when no
+  cue covers it. The latest starting cue wins when several overlap.
+*/
+GdkTexture *subtitleCacheLookup(SubtitleCache *cache, double pts) {
+    SubtitleCue *best = NULL;
+    GdkTexture *texture = NULL;
+
+    pthread_mutex_lock(&cache->mutex);
+    for (int i = 0; i < cache->count; i++) {
+        SubtitleCue *cue = &cache->cues[i];
+        if (cue->start <= pts && pts < cue->end && (!best || cue->start > best->start)) {
+            best = cue;
+        }
+    }
+    if (best && best->texture) {
+        texture = g_object_ref(best->texture);   // NULL while the newest cue is still rasterizing
+    }
+    pthread_mutex_unlock(&cache->mutex);
+    return texture;
+}
+
+void subtitleCachePrintStats(SubtitleCache *cache, FILE *out) {
+    pthread_mutex_lock(&cache->mutex);
+    if (cache->rasterized || cache->reused) {
+        fprintf(out, "Subtitles: %llu overlays rasterized (%.2f ms each), %llu reused from cache, %llu evicted\n",
+                (unsigned long long)cache->rasterized,
+                cache->rasterized ? cache->raster_ns / 1e6 / cache->rasterized : 0.0,
+                (unsigned long long)cache->reused, (unsigned long long)cache->evicted);
+    }
+    pthread_mutex_unlock(&cache->mutex);
+}
+
+// Wraps a finished cairo image (premultiplied native ARGB32) as a texture
+static GdkTexture *textureFromSurface(cairo_surface_t *surface) {
+    cairo_surface_flush(surface);
+    int width = cairo_image_surface_get_width(surface);
+    int height = cairo_image_surface_get_height(surface);
+    int stride = cairo_image_surface_get_stride(surface);
+    GBytes *bytes = g_bytes_new(cairo_image_surface_get_data(surface), (gsize)stride * height);
+    GdkTexture *texture = gdk_memory_texture_new(width, height, GDK_MEMORY_DEFAULT, bytes, stride);
+    g_bytes_unref(bytes);
+    return texture;
+}
+
+// Plain text of an ASS event: "ReadOrder,Layer,Style,Name,MarginL,MarginR,MarginV,Effect,Text"
+static void assToText(const char *ass, char *text, size_t size) {
+    for (int fields = 0; fields < 8 && *ass; ass++) {
+        if (*ass == ',') {
+            fields++;
+        }
+    }
+
+    size_t used = 0;
+    bool in_override = false;
+    for (; *ass && used + 1 < size; ass++) {
+        if (in_override) {
+            in_override = *ass != '}';
+        } else if (*ass == '{') {
+            in_override = true;
+        } else if (ass[0] == '\\' && (ass[1] == 'N' || ass[1] == 'n')) {
+            text[used++] = '\n';
+            ass++;
+        } else if (ass[0] == '\\' && ass[1] == 'h') {
+            text[used++] = ' ';
+            ass++;
+        } else {
+            text[used++] = *ass;
+        }
+    }
+    text[used] = '\0';
+}
+
+// White text with a black outline, centered lines
+static GdkTexture *rasterizeText(const char *text) {
+    cairo_surface_t *probe = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, 1, 1);
+    cairo_t *cr = cairo_create(probe);
+    PangoLayout *layout = pango_cairo_create_layout(cr);
+    PangoFontDescription *font = pango_font_description_from_string(SUBTITLE_FONT);
+    pango_layout_set_font_description(layout, font);
+    pango_layout_set_alignment(layout, PANGO_ALIGN_CENTER);
+    pango_layout_set_text(layout, text, -1);
+    pango_font_description_free(font);
+
+    int text_width, text_height;
+    pango_layout_get_pixel_size(layout, &text_width, &text_height);
+    cairo_surface_t *surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32,
+                                                          text_width + 2 * SUBTITLE_OUTLINE,
+                                                          text_height + 2 * SUBTITLE_OUTLINE);
+    cairo_t *target = cairo_create(surface);
+    pango_cairo_update_layout(target, layout);
+    cairo_move_to(target, SUBTITLE_OUTLINE, SUBTITLE_OUTLINE);
+    pango_cairo_layout_path(target, layout);
+    cairo_set_line_width(target, 2 * SUBTITLE_OUTLINE);
+    cairo_set_line_join(target, CAIRO_LINE_JOIN_ROUND);
+    cairo_set_source_rgba(target, 0.0, 0.0, 0.0, 0.85);
+    cairo_stroke_preserve(target);
+    cairo_set_source_rgb(target, 1.0, 1.0, 1.0);
+    cairo_fill(target);
+
+    GdkTexture *texture = textureFromSurface(surface);
+    cairo_destroy(target);
+    cairo_surface_destroy(surface);
+    g_object_unref(layout);
+    cairo_destroy(cr);
+    cairo_surface_destroy(probe);
+    return texture;
+}
+
+// Paletted bitmap rects composited into one image over their bounding box
+static GdkTexture *rasterizeBitmaps(const AVSubtitle *sub) {
+    int x0 = INT32_MAX, y0 = INT32_MAX, x1 = 0, y1 = 0;
+    for (unsigned r = 0; r < sub->num_rects; r++) {
+        const AVSubtitleRect *rect = sub->rects[r];
+        if (rect->type != SUBTITLE_BITMAP || rect->w <= 0 || rect->h <= 0) {
+            continue;
+        }
+        x0 = rect->x < x0 ? rect->x : x0;
+        y0 = rect->y < y0 ? rect->y : y0;
+        x1 = rect->x + rect->w > x1 ? rect->x + rect->w : x1;
+        y1 = rect->y + rect->h > y1 ? rect->y + rect->h : y1;
+    }
+    if (x1 <= x0 || y1 <= y0) {
+        return NULL;
+    }
+
+    cairo_surface_t *surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, x1 - x0, y1 - y0);
+    uint8_t *pixels = cairo_image_surface_get_data(surface);
+    int stride = cairo_image_surface_get_stride(surface);
+    for (unsigned r = 0; r < sub->num_rects; r++) {
+        const AVSubtitleRect *rect = sub->rects[r];
+        if (rect->type != SUBTITLE_BITMAP || rect->w <= 0 || rect->h <= 0) {
+            continue;
+        }
+        const uint32_t *palette = (const uint32_t *)rect->data[1];  // 0xAARRGGBB, straight alpha
+        for (int y = 0; y < rect->h; y++) {
+            const uint8_t *src = rect->data[0] + (size_t)y * rect->linesize[0];
+            uint32_t *dst = (uint32_t *)(pixels + (size_t)(rect->y - y0 + y) * stride) + (rect->x - x0);
+            for (int x = 0; x < rect->w; x++) {
+                uint32_t argb = palette[src[x]];
+                uint32_t a = argb >> 24;
+                uint32_t red = ((argb >> 16) & 0xFF) * a / 255;
+                uint32_t green = ((argb >> 8) & 0xFF) * a / 255;
+                uint32_t blue = (argb & 0xFF) * a / 255;
+                dst[x] = (a << 24) | (red << 16) | (green << 8) | blue;
+            }
+        }
+    }
+    cairo_surface_mark_dirty(surface);
+
+    GdkTexture *texture = textureFromSurface(surface);
+    cairo_surface_destroy(surface);
+    return texture;
+}
+
+static GdkTexture *rasterizeSubtitle(const AVSubtitle *sub) {
+    char text[SUBTITLE_TEXT_MAX], line[SUBTITLE_TEXT_MAX];
+    size_t used = 0;
+
+    text[0] = '\0';
+    for (unsigned r = 0; r < sub->num_rects; r++) {
+        const AVSubtitleRect *rect = sub->rects[r];
+        if (rect->type == SUBTITLE_ASS && rect->ass) {
+            assToText(rect->ass, line, sizeof(line));
+        } else if (rect->type == SUBTITLE_TEXT && rect->text) {
+            snprintf(line, sizeof(line), "%s", rect->text);
+        } else {
+            continue;
+        }
+        used += snprintf(text + used, sizeof(text) - used, "%s%s", used ? "\n" : "", line);
+        if (used >= sizeof(text)) {
+            break;
+        }
+    }
+
+    return text[0] ? rasterizeText(text) : rasterizeBitmaps(sub);
+}
+
+// A decoded event waiting for a worker to rasterize it
+typedef struct {
+    AVSubtitle sub;
+    double start;
+} SubtitleJob;
+
+static void rasterizeJob(int index, void *context) {
+    SubtitleJob *job = context;
+    uint64_t raster_start = statsNow();
+    traceBegin("subtitle_raster");
+    GdkTexture *texture = rasterizeSubtitle(&job->sub);
+    traceEnd("subtitle_raster");
+    if (texture) {
+        subtitleCacheFill(&subtitleCache, job->start, texture, statsNow() - raster_start);
+    }
+    avsubtitle_free(&job->sub);
+    free(job);
+}
+
+/*
+  Function decodeSubtitlePacket
+  decodes one event and reserves its cue in order; rasterizing, the
+  expensive part, is a background task on the scheduler when there is
+  one. Events already in the cache are not rasterized again.
+*/
+static void decodeSubtitlePacket(AVCodecContext *codec_context, AVPacket *packet, AVRational time_base,
+                                 Scheduler *scheduler, TaskGroup *rasterizing) {
+    AVSubtitle sub;
+    int got = 0;
+    if (avcodec_decode_subtitle2(codec_context, &sub, &got, packet) < 0 || !got) {
+        return;
+    }
+    if (packet->pts == AV_NOPTS_VALUE) {
+        avsubtitle_free(&sub);
+        return;
+    }
+
+    double pts = packet->pts * av_q2d(time_base);
+    double start = pts + sub.start_display_time / 1000.0;
+    double end;
+    if (sub.end_display_time > sub.start_display_time && sub.end_display_time != UINT32_MAX) {
+        end = pts + sub.end_display_time / 1000.0;
+    } else if (packet->duration > 0) {
+        end = pts + packet->duration * av_q2d(time_base);
+    } else {
+        end = start + SUBTITLE_DEFAULT_DURATION;
+    }
+
+    SubtitleJob *job = NULL;
+    if (sub.num_rects == 0) {
+        subtitleCacheEndAt(&subtitleCache, start);
+    } else if (!subtitleCacheContains(&subtitleCache, start, end) && (job = malloc(sizeof(SubtitleJob)))) {
+        subtitleCacheReserve(&subtitleCache, start, end);
+        job->sub = sub;
+        job->start = start;
+        if (!scheduler || !schedulerSubmit(scheduler, rasterizing, rasterizeJob, job, 0)) {
+            rasterizeJob(0, job);
+        }
+        return;   // The job owns sub now
+    }
+    avsubtitle_free(&sub);
+}
+
+/*
+  Function subtitleThread
+  decodes the subtitle packets the demuxer routes here and rasterizes
+  each event into the subtitle cache as soon as it arrives.
+*/
+void *subtitleThread(void *args) {
+    Scheduler *scheduler = ((DecodeData *)args)->scheduler;
+    TaskGroup rasterizing;
+    taskGroupInit(&rasterizing, TASK_BACKGROUND);
+    statsThreadName("subtitle");
+    traceThreadName("subtitle");
+
+    int stream_index = __atomic_load_n(&demuxer.subtitle_stream_index, __ATOMIC_ACQUIRE);
+    AVCodecContext *codec_context = stream_index >= 0 ?
+        openStreamDecoder(demuxer.format_context, stream_index, 1) : NULL;
+
+    // Runs while subtitles are off too, a track may be switched on later
+    while (demuxer.subtitles_routed && is_running) {
+        AVPacket *packet;
+        PacketKind kind;
+        if (!packetQueuePop(&subtitlePacketQueue, &packet, &kind)) {
+            break;
+        }
+        if (kind == PACKET_DATA) {
+            if (codec_context) {
+                decodeSubtitlePacket(codec_context, packet, demuxer.format_context->streams[stream_index]->time_base,
+                                     scheduler, &rasterizing);
+            }
+            av_packet_free(&packet);
+        } else if (kind == PACKET_SWITCH) {
+            stream_index = packet->stream_index;
+            av_packet_free(&packet);
+            avcodec_free_context(&codec_context);
+            if (scheduler) {
+                schedulerWait(scheduler, &rasterizing);
+            }
+            subtitleCacheClear(&subtitleCache);
+            codec_context = stream_index >= 0 ?
+                openStreamDecoder(demuxer.format_context, stream_index, 1) : NULL;
+        } else if (kind == PACKET_EOF) {
+            break;
+        } else if (codec_context) {
+            avcodec_flush_buffers(codec_context);  // Loop wrapped, cues come again from A
+        }
+    }
+
+    if (scheduler) {
+        schedulerWait(scheduler, &rasterizing);   // Jobs write into the cache the player destroys next
+    }
+    avcodec_free_context(&codec_context);
+    packetQueueClose(&subtitlePacketQueue);
+    return NULL;
+}
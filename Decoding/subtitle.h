@@ -0,0 +1,42 @@
+#ifndef SUBTITLE_H
+#define SUBTITLE_H
+
+#include <gdk/gdk.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define SUBTITLE_CACHE_CUES 64
+
+// One subtitle event, rasterized once into a texture
+typedef struct {
+    double start, end;     // Stream time in seconds
+    GdkTexture *texture;
+} SubtitleCue;
+
+/*
+  Overlays waiting for (or being) shown. The subtitle thread fills it
+  as soon as packets are demuxed, well ahead of their display time; the
+  GUI only looks textures up. Events seen again (A-B loop replays) are
+  found in the cache and not rasterized a second time.
+*/
+typedef struct {
+    SubtitleCue cues[SUBTITLE_CACHE_CUES];
+    int count;
+    uint64_t rasterized, reused, evicted;
+    uint64_t raster_ns;
+    pthread_mutex_t mutex;
+} SubtitleCache;
+
+extern SubtitleCache subtitleCache;
+
+void subtitleCacheInit(SubtitleCache *cache);
+void subtitleCacheDestroy(SubtitleCache *cache);
+void subtitleCacheClear(SubtitleCache *cache);
+GdkTexture *subtitleCacheLookup(SubtitleCache *cache, double pts);
+void subtitleCachePrintStats(SubtitleCache *cache, FILE *out);
+
+void *subtitleThread(void *args);
+
+#endif // SUBTITLE_H
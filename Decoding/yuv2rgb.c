@@ -0,0 +1,253 @@
+#include "yuv2rgb.h"
+
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define YUV2RGB_X86 1
+#endif
+
+/*
+  16.16 fixed point BT.601 limited range, the matrix swscale applies
+  when no colorspace is set:
+    c = 1.164 (Y - 16), d = U - 128, e = V - 128
+    R = c + 1.596 e,  G = c - 0.392 d - 0.813 e,  B = c + 2.017 d
+  Every intermediate fits into 32 bits, so the SIMD kernels compute
+  exactly what the scalar one does.
+*/
+#define YUV2RGB_Y 76309
+#define YUV2RGB_RV 104597
+#define YUV2RGB_GU 25675
+#define YUV2RGB_GV 53279
+#define YUV2RGB_BU 132201
+#define YUV2RGB_ROUND 32768
+
+typedef void (*Yuv2RgbRow)(const uint8_t *y, const uint8_t *u, const uint8_t *v, int uv_step,
+                           uint8_t *dst, int width, bool rgba);
+
+static inline uint8_t yuv2rgbClamp(int value) {
+    return value < 0 ? 0 : value > 255 ? 255 : (uint8_t)value;
+}
+
+// Pixels [x, width) of one row; the SIMD kernels finish their rows with it
+static void yuv2rgbRowTail(const uint8_t *y, const uint8_t *u, const uint8_t *v, int uv_step,
+                           uint8_t *dst, int x, int width, bool rgba) {
+    int bpp = rgba ? 4 : 3;
+    for (; x < width; x++) {
+        int c = (y[x] - 16) * YUV2RGB_Y;
+        int d = u[(x >> 1) * uv_step] - 128;
+        int e = v[(x >> 1) * uv_step] - 128;
+        uint8_t *out = dst + x * bpp;
+        out[0] = yuv2rgbClamp((c + YUV2RGB_RV * e + YUV2RGB_ROUND) >> 16);
+        out[1] = yuv2rgbClamp((c - YUV2RGB_GU * d - YUV2RGB_GV * e + YUV2RGB_ROUND) >> 16);
+        out[2] = yuv2rgbClamp((c + YUV2RGB_BU * d + YUV2RGB_ROUND) >> 16);
+        if (rgba) {
+            out[3] = 255;
+        }
+    }
+}
+
+static void yuv2rgbRowScalar(const uint8_t *y, const uint8_t *u, const uint8_t *v, int uv_step,
+                             uint8_t *dst, int width, bool rgba) {
+    yuv2rgbRowTail(y, u, v, uv_step, dst, 0, width, rgba);
+}
+
+#ifdef YUV2RGB_X86
+/*
+  All SIMD kernels work on 16 pixels at a time: load 16 luma and 8
+  chroma pairs, duplicate chroma horizontally, compute R, G and B as
+  16 bytes each (the part that differs per instruction set), then
+  interleave and store.
+*/
+__attribute__((target("sse4.1")))
+static inline void yuv2rgbLoad16(const uint8_t *y, const uint8_t *u, const uint8_t *v, int uv_step, int x,
+                                 __m128i *luma, __m128i *cb, __m128i *cr) {
+    __m128i uu, vv;
+    *luma = _mm_loadu_si128((const __m128i *)(y + x));
+    if (uv_step == 2) {
+        // NV12: x is even, so the pair for pixel x starts at byte x
+        __m128i uv = _mm_loadu_si128((const __m128i *)(u + x));
+        uu = _mm_shuffle_epi8(uv, _mm_setr_epi8(0, 2, 4, 6, 8, 10, 12, 14, -1, -1, -1, -1, -1, -1, -1, -1));
+        vv = _mm_shuffle_epi8(uv, _mm_setr_epi8(1, 3, 5, 7, 9, 11, 13, 15, -1, -1, -1, -1, -1, -1, -1, -1));
+    } else {
+        uu = _mm_loadl_epi64((const __m128i *)(u + x / 2));
+        vv = _mm_loadl_epi64((const __m128i *)(v + x / 2));
+    }
+    *cb = _mm_unpacklo_epi8(uu, uu);
+    *cr = _mm_unpacklo_epi8(vv, vv);
+}
+
+__attribute__((target("sse4.1")))
+static inline void yuv2rgbStore16(uint8_t *dst, __m128i r, __m128i g, __m128i b, bool rgba) {
+    __m128i a = _mm_set1_epi8((char)0xFF);
+    __m128i rg_lo = _mm_unpacklo_epi8(r, g), rg_hi = _mm_unpackhi_epi8(r, g);
+    __m128i ba_lo = _mm_unpacklo_epi8(b, a), ba_hi = _mm_unpackhi_epi8(b, a);
+    __m128i p0 = _mm_unpacklo_epi16(rg_lo, ba_lo);
+    __m128i p1 = _mm_unpackhi_epi16(rg_lo, ba_lo);
+    __m128i p2 = _mm_unpacklo_epi16(rg_hi, ba_hi);
+    __m128i p3 = _mm_unpackhi_epi16(rg_hi, ba_hi);
+
+    if (rgba) {
+        _mm_storeu_si128((__m128i *)dst, p0);
+        _mm_storeu_si128((__m128i *)(dst + 16), p1);
+        _mm_storeu_si128((__m128i *)(dst + 32), p2);
+        _mm_storeu_si128((__m128i *)(dst + 48), p3);
+        return;
+    }
+
+    // Drop alpha: 12 useful bytes per 4 pixels. The first three stores
+    // spill 4 bytes into the next group, which overwrites them; the last
+    // one is stored exactly so nothing is written past pixel 16.
+    __m128i pack = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+    _mm_storeu_si128((__m128i *)dst, _mm_shuffle_epi8(p0, pack));
+    _mm_storeu_si128((__m128i *)(dst + 12), _mm_shuffle_epi8(p1, pack));
+    _mm_storeu_si128((__m128i *)(dst + 24), _mm_shuffle_epi8(p2, pack));
+    __m128i last = _mm_shuffle_epi8(p3, pack);
+    _mm_storel_epi64((__m128i *)(dst + 36), last);
+    int32_t tail = _mm_cvtsi128_si32(_mm_srli_si128(last, 8));
+    memcpy(dst + 44, &tail, sizeof(tail));
+}
+
+// Four pixels in 32-bit lanes, from the low 4 bytes of each input
+__attribute__((target("sse4.1")))
+static inline void yuv2rgbMath4(__m128i y8, __m128i u8, __m128i v8, __m128i *r, __m128i *g, __m128i *b) {
+    __m128i round = _mm_set1_epi32(YUV2RGB_ROUND);
+    __m128i c = _mm_mullo_epi32(_mm_sub_epi32(_mm_cvtepu8_epi32(y8), _mm_set1_epi32(16)),
+                                _mm_set1_epi32(YUV2RGB_Y));
+    __m128i d = _mm_sub_epi32(_mm_cvtepu8_epi32(u8), _mm_set1_epi32(128));
+    __m128i e = _mm_sub_epi32(_mm_cvtepu8_epi32(v8), _mm_set1_epi32(128));
+    c = _mm_add_epi32(c, round);
+
+    *r = _mm_srai_epi32(_mm_add_epi32(c, _mm_mullo_epi32(e, _mm_set1_epi32(YUV2RGB_RV))), 16);
+    *g = _mm_srai_epi32(_mm_sub_epi32(_mm_sub_epi32(c, _mm_mullo_epi32(d, _mm_set1_epi32(YUV2RGB_GU))),
+                                      _mm_mullo_epi32(e, _mm_set1_epi32(YUV2RGB_GV))), 16);
+    *b = _mm_srai_epi32(_mm_add_epi32(c, _mm_mullo_epi32(d, _mm_set1_epi32(YUV2RGB_BU))), 16);
+}
+
+// Saturates four vectors of 32-bit lanes into 16 bytes
+__attribute__((target("sse4.1")))
+static inline __m128i yuv2rgbPack16(__m128i a, __m128i b, __m128i c, __m128i d) {
+    return _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d));
+}
+
+__attribute__((target("sse4.1")))
+static void yuv2rgbRowSse41(const uint8_t *y, const uint8_t *u, const uint8_t *v, int uv_step,
+                            uint8_t *dst, int width, bool rgba) {
+    int bpp = rgba ? 4 : 3;
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m128i luma, cb, cr, r[4], g[4], b[4];
+        yuv2rgbLoad16(y, u, v, uv_step, x, &luma, &cb, &cr);
+        yuv2rgbMath4(luma, cb, cr, &r[0], &g[0], &b[0]);
+        yuv2rgbMath4(_mm_srli_si128(luma, 4), _mm_srli_si128(cb, 4), _mm_srli_si128(cr, 4), &r[1], &g[1], &b[1]);
+        yuv2rgbMath4(_mm_srli_si128(luma, 8), _mm_srli_si128(cb, 8), _mm_srli_si128(cr, 8), &r[2], &g[2], &b[2]);
+        yuv2rgbMath4(_mm_srli_si128(luma, 12), _mm_srli_si128(cb, 12), _mm_srli_si128(cr, 12), &r[3], &g[3], &b[3]);
+        yuv2rgbStore16(dst + x * bpp,
+                       yuv2rgbPack16(r[0], r[1], r[2], r[3]),
+                       yuv2rgbPack16(g[0], g[1], g[2], g[3]),
+                       yuv2rgbPack16(b[0], b[1], b[2], b[3]), rgba);
+    }
+    yuv2rgbRowTail(y, u, v, uv_step, dst, x, width, rgba);
+}
+
+// Eight pixels in 32-bit lanes, from the low 8 bytes of each input
+__attribute__((target("avx2")))
+static inline void yuv2rgbMath8(__m128i y8, __m128i u8, __m128i v8, __m256i *r, __m256i *g, __m256i *b) {
+    __m256i round = _mm256_set1_epi32(YUV2RGB_ROUND);
+    __m256i c = _mm256_mullo_epi32(_mm256_sub_epi32(_mm256_cvtepu8_epi32(y8), _mm256_set1_epi32(16)),
+                                   _mm256_set1_epi32(YUV2RGB_Y));
+    __m256i d = _mm256_sub_epi32(_mm256_cvtepu8_epi32(u8), _mm256_set1_epi32(128));
+    __m256i e = _mm256_sub_epi32(_mm256_cvtepu8_epi32(v8), _mm256_set1_epi32(128));
+    c = _mm256_add_epi32(c, round);
+
+    *r = _mm256_srai_epi32(_mm256_add_epi32(c, _mm256_mullo_epi32(e, _mm256_set1_epi32(YUV2RGB_RV))), 16);
+    *g = _mm256_srai_epi32(_mm256_sub_epi32(_mm256_sub_epi32(c, _mm256_mullo_epi32(d, _mm256_set1_epi32(YUV2RGB_GU))),
+                                            _mm256_mullo_epi32(e, _mm256_set1_epi32(YUV2RGB_GV))), 16);
+    *b = _mm256_srai_epi32(_mm256_add_epi32(c, _mm256_mullo_epi32(d, _mm256_set1_epi32(YUV2RGB_BU))), 16);
+}
+
+// packs works per 128-bit lane; the permute puts the 16 words back in pixel order
+__attribute__((target("avx2")))
+static inline __m128i yuv2rgbPack16Avx2(__m256i lo, __m256i hi) {
+    __m256i words = _mm256_permute4x64_epi64(_mm256_packs_epi32(lo, hi), 0xD8);
+    return _mm_packus_epi16(_mm256_castsi256_si128(words), _mm256_extracti128_si256(words, 1));
+}
+
+__attribute__((target("avx2")))
+static void yuv2rgbRowAvx2(const uint8_t *y, const uint8_t *u, const uint8_t *v, int uv_step,
+                           uint8_t *dst, int width, bool rgba) {
+    int bpp = rgba ? 4 : 3;
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m128i luma, cb, cr;
+        __m256i r[2], g[2], b[2];
+        yuv2rgbLoad16(y, u, v, uv_step, x, &luma, &cb, &cr);
+        yuv2rgbMath8(luma, cb, cr, &r[0], &g[0], &b[0]);
+        yuv2rgbMath8(_mm_srli_si128(luma, 8), _mm_srli_si128(cb, 8), _mm_srli_si128(cr, 8), &r[1], &g[1], &b[1]);
+        yuv2rgbStore16(dst + x * bpp,
+                       yuv2rgbPack16Avx2(r[0], r[1]),
+                       yuv2rgbPack16Avx2(g[0], g[1]),
+                       yuv2rgbPack16Avx2(b[0], b[1]), rgba);
+    }
+    yuv2rgbRowTail(y, u, v, uv_step, dst, x, width, rgba);
+}
+
+// Clamps at zero, then the unsigned narrowing saturates at 255
+__attribute__((target("avx512f")))
+static inline __m128i yuv2rgbPack16Avx512(__m512i value) {
+    return _mm512_cvtusepi32_epi8(_mm512_max_epi32(value, _mm512_setzero_si512()));
+}
+
+__attribute__((target("avx512f")))
+static void yuv2rgbRowAvx512(const uint8_t *y, const uint8_t *u, const uint8_t *v, int uv_step,
+                             uint8_t *dst, int width, bool rgba) {
+    int bpp = rgba ? 4 : 3;
+    int x = 0;
+    __m512i round = _mm512_set1_epi32(YUV2RGB_ROUND);
+    for (; x + 16 <= width; x += 16) {
+        __m128i luma, cb, cr;
+        yuv2rgbLoad16(y, u, v, uv_step, x, &luma, &cb, &cr);
+
+        __m512i c = _mm512_mullo_epi32(_mm512_sub_epi32(_mm512_cvtepu8_epi32(luma), _mm512_set1_epi32(16)),
+                                       _mm512_set1_epi32(YUV2RGB_Y));
+        __m512i d = _mm512_sub_epi32(_mm512_cvtepu8_epi32(cb), _mm512_set1_epi32(128));
+        __m512i e = _mm512_sub_epi32(_mm512_cvtepu8_epi32(cr), _mm512_set1_epi32(128));
+        c = _mm512_add_epi32(c, round);
+
+        __m512i r = _mm512_srai_epi32(_mm512_add_epi32(c, _mm512_mullo_epi32(e, _mm512_set1_epi32(YUV2RGB_RV))), 16);
+        __m512i g = _mm512_srai_epi32(_mm512_sub_epi32(_mm512_sub_epi32(c, _mm512_mullo_epi32(d, _mm512_set1_epi32(YUV2RGB_GU))),
+                                                       _mm512_mullo_epi32(e, _mm512_set1_epi32(YUV2RGB_GV))), 16);
+        __m512i b = _mm512_srai_epi32(_mm512_add_epi32(c, _mm512_mullo_epi32(d, _mm512_set1_epi32(YUV2RGB_BU))), 16);
+
+        yuv2rgbStore16(dst + x * bpp, yuv2rgbPack16Avx512(r), yuv2rgbPack16Avx512(g),
+                       yuv2rgbPack16Avx512(b), rgba);
+    }
+    yuv2rgbRowTail(y, u, v, uv_step, dst, x, width, rgba);
+}
+#endif // YUV2RGB_X86
+
+static const Yuv2RgbRow kernel_rows[CPU_LEVEL_COUNT] = {
+    [CPU_SCALAR] = yuv2rgbRowScalar,
+#ifdef YUV2RGB_X86
+    [CPU_SSE41] = yuv2rgbRowSse41,
+    [CPU_AVX2] = yuv2rgbRowAvx2,
+    [CPU_AVX512] = yuv2rgbRowAvx512,
+#endif
+};
+
+/*
+  Function yuv2rgbRows
+  converts picture rows [y, y + rows) into dst, which points at row 0
+  of the destination picture. Unavailable kernels fall back to scalar.
+*/
+void yuv2rgbRows(CpuLevel kernel, const Yuv2RgbSource *src, int y, int rows,
+                 uint8_t *dst, int dst_linesize, bool rgba) {
+    Yuv2RgbRow row = cpuHas(kernel) && kernel_rows[kernel] ? kernel_rows[kernel] : yuv2rgbRowScalar;
+
+    for (int line = y; line < y + rows && line < src->height; line++) {
+        const uint8_t *luma = src->planes[0] + (ptrdiff_t)line * src->linesize[0];
+        const uint8_t *u = src->planes[1] + (ptrdiff_t)(line >> 1) * src->linesize[1];
+        const uint8_t *v = src->nv12 ? u + 1 : src->planes[2] + (ptrdiff_t)(line >> 1) * src->linesize[2];
+        row(luma, u, v, src->nv12 ? 2 : 1, dst + (ptrdiff_t)line * dst_linesize, src->width, rgba);
+    }
+}
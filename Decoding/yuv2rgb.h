@@ -0,0 +1,21 @@
+#ifndef YUV2RGB_H
+#define YUV2RGB_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "../Util/cpu.h"
+
+// Hand-written 8-bit 4:2:0 -> RGB24/RGBA converters, BT.601 limited range, one per CPU level
+
+// Source picture: planar (Y, U, V) or NV12 (Y, interleaved UV)
+typedef struct {
+    const uint8_t *planes[3];
+    int linesize[3];
+    int width, height;
+    bool nv12;
+} Yuv2RgbSource;
+
+void yuv2rgbRows(CpuLevel kernel, const Yuv2RgbSource *src, int y, int rows,
+                 uint8_t *dst, int dst_linesize, bool rgba);
+
+#endif // YUV2RGB_H
@@ -0,0 +1,228 @@
+#include "export.h"
+
+#include <string.h>
+#include <time.h>
+#include "../Decoding/pipeline.h"
+#include "wav.h"
+#include "y4m.h"
+
+typedef struct {
+    ExportJob *job;
+    AVFormatContext *format_context;
+    int video_stream_index, audio_stream_index;
+    AVCodecContext *video_codec, *audio_codec;
+    SwrContext *swr_ctx;
+    AVFrame *frame;
+    uint8_t *pcm;
+    int pcm_capacity;          // In samples per channel
+    FILE *wav_file, *y4m_file;
+    WavWriter wav;
+    Y4mWriter y4m;
+    bool y4m_open;
+    int64_t first_pts, last_pts;   // Video span in stream time base
+} Exporter;
+
+static double exportNow() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static FILE *exportOpenOutput(const char *path) {
+    if (strcmp(path, "-") == 0) {
+        return stdout;
+    }
+    FILE *file = fopen(path, "wb");
+    if (!file) {
+        fprintf(stderr, "Error: Could not create '%s'\n", path);
+    }
+    return file;
+}
+
+static void exportCloseOutput(FILE *file) {
+    if (file && file != stdout) {
+        fclose(file);
+    }
+}
+
+static bool exportAudioFrame(Exporter *ex, const AVFrame *frame) {
+    int out_samples = swr_get_out_samples(ex->swr_ctx, frame ? frame->nb_samples : 0);
+    if (out_samples > ex->pcm_capacity) {
+        av_free(ex->pcm);
+        ex->pcm = av_malloc((size_t)out_samples * OUTPUT_CHANNELS * OUTPUT_BYTES_PER_SAMPLE);
+        ex->pcm_capacity = ex->pcm ? out_samples : 0;
+        if (!ex->pcm) {
+            return false;
+        }
+    }
+
+    int num_samples = swr_convert(ex->swr_ctx, &ex->pcm, ex->pcm_capacity,
+                                  frame ? (const uint8_t **)frame->data : NULL,
+                                  frame ? frame->nb_samples : 0);
+    if (num_samples < 0) {
+        fprintf(stderr, "Error: Audio resampling failed\n");
+        return false;
+    }
+    ex->job->audio_samples += num_samples;
+    return wavWriterWrite(&ex->wav, ex->pcm, (size_t)num_samples * OUTPUT_CHANNELS * OUTPUT_BYTES_PER_SAMPLE);
+}
+
+static bool exportVideoFrame(Exporter *ex, const AVFrame *frame) {
+    if (!ex->y4m_open) {
+        AVStream *stream = ex->format_context->streams[ex->video_stream_index];
+        AVRational rate = stream->avg_frame_rate.num ? stream->avg_frame_rate : stream->r_frame_rate;
+        if (!y4mWriterOpen(&ex->y4m, ex->y4m_file, frame->width, frame->height,
+                           rate, frame->sample_aspect_ratio)) {
+            return false;
+        }
+        ex->y4m_open = true;
+    }
+
+    if (frame->best_effort_timestamp != AV_NOPTS_VALUE) {
+        if (ex->first_pts == AV_NOPTS_VALUE) {
+            ex->first_pts = frame->best_effort_timestamp;
+        }
+        ex->last_pts = frame->best_effort_timestamp;
+    }
+    ex->job->video_frames++;
+    return y4mWriterWrite(&ex->y4m, frame);
+}
+
+// Sends packet (NULL drains) and writes every frame that comes out
+static bool exportDecode(Exporter *ex, AVCodecContext *codec_context, const AVPacket *packet) {
+    if (avcodec_send_packet(codec_context, packet) < 0 && packet) {
+        return true;  // Skip undecodable packets like the player does
+    }
+
+    while (avcodec_receive_frame(codec_context, ex->frame) == 0) {
+        bool ok = codec_context == ex->video_codec ? exportVideoFrame(ex, ex->frame)
+                                                   : exportAudioFrame(ex, ex->frame);
+        av_frame_unref(ex->frame);
+        if (!ok) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool exportOpen(Exporter *ex) {
+    ExportJob *job = ex->job;
+
+    if (ioOpenInput(&ex->format_context, job->input, job->io_mode) < 0) {
+        fprintf(stderr, "Error: Could not open input file '%s'\n", job->input);
+        return false;
+    }
+    if (avformat_find_stream_info(ex->format_context, NULL) < 0) {
+        fprintf(stderr, "Error: Could not find stream information in '%s'\n", job->input);
+        return false;
+    }
+
+    ex->video_stream_index = job->y4m_path ? findFirstStream(ex->format_context, AVMEDIA_TYPE_VIDEO) : -1;
+    ex->audio_stream_index = job->wav_path ? findFirstStream(ex->format_context, AVMEDIA_TYPE_AUDIO) : -1;
+    if (ex->video_stream_index == -1 && ex->audio_stream_index == -1) {
+        fprintf(stderr, "Error: '%s' has none of the requested streams\n", job->input);
+        return false;
+    }
+
+    // Let the demuxer skip everything that is not exported
+    for (int i = 0; i < ex->format_context->nb_streams; i++) {
+        if (i != ex->video_stream_index && i != ex->audio_stream_index) {
+            ex->format_context->streams[i]->discard = AVDISCARD_ALL;
+        }
+    }
+
+    if (ex->video_stream_index >= 0) {
+        ex->video_codec = openStreamDecoder(ex->format_context, ex->video_stream_index, job->thread_count);
+        ex->y4m_file = ex->video_codec ? exportOpenOutput(job->y4m_path) : NULL;
+        if (!ex->y4m_file) {
+            return false;
+        }
+    }
+
+    if (ex->audio_stream_index >= 0) {
+        ex->audio_codec = openStreamDecoder(ex->format_context, ex->audio_stream_index, job->thread_count);
+        ex->swr_ctx = ex->audio_codec ? openResampler(ex->audio_codec, job->sample_rate) : NULL;
+        ex->wav_file = ex->swr_ctx ? exportOpenOutput(job->wav_path) : NULL;
+        if (!ex->wav_file || !wavWriterOpen(&ex->wav, ex->wav_file, job->sample_rate, OUTPUT_CHANNELS)) {
+            return false;
+        }
+    }
+
+    ex->frame = av_frame_alloc();
+    return ex->frame != NULL;
+}
+
+static void exportClose(Exporter *ex) {
+    if (ex->wav_file) {
+        wavWriterClose(&ex->wav);
+        exportCloseOutput(ex->wav_file);
+    }
+    if (ex->y4m_file) {
+        if (ex->y4m_open) {
+            y4mWriterClose(&ex->y4m);
+        }
+        exportCloseOutput(ex->y4m_file);
+    }
+    av_free(ex->pcm);
+    av_frame_free(&ex->frame);
+    swr_free(&ex->swr_ctx);
+    avcodec_free_context(&ex->video_codec);
+    avcodec_free_context(&ex->audio_codec);
+    ioCloseInput(&ex->format_context);
+}
+
+/*
+  Function exportRun
+  decodes job->input as fast as possible into the requested outputs
+  and fills in the job's counters. Runs entirely on the calling thread,
+  so several jobs can be run side by side.
+*/
+bool exportRun(ExportJob *job) {
+    Exporter ex = {0};
+    double start = exportNow();
+
+    ex.job = job;
+    ex.first_pts = ex.last_pts = AV_NOPTS_VALUE;
+    job->ok = false;
+    job->video_frames = job->audio_samples = 0;
+
+    bool ok = exportOpen(&ex);
+    AVPacket *packet = ok ? av_packet_alloc() : NULL;
+
+    while (packet && av_read_frame(ex.format_context, packet) >= 0) {
+        if (packet->stream_index == ex.video_stream_index) {
+            ok = exportDecode(&ex, ex.video_codec, packet);
+        } else if (packet->stream_index == ex.audio_stream_index) {
+            ok = exportDecode(&ex, ex.audio_codec, packet);
+        }
+        av_packet_unref(packet);
+        if (!ok) {
+            fprintf(stderr, "Error: Writing output for '%s' failed\n", job->input);
+            break;
+        }
+    }
+
+    // Flush decoders and the resampler
+    if (ok && ex.video_codec) {
+        ok = exportDecode(&ex, ex.video_codec, NULL);
+    }
+    if (ok && ex.audio_codec) {
+        ok = exportDecode(&ex, ex.audio_codec, NULL) && exportAudioFrame(&ex, NULL);
+    }
+
+    double video_seconds = 0.0;
+    if (ex.video_codec && ex.first_pts != AV_NOPTS_VALUE) {
+        AVStream *stream = ex.format_context->streams[ex.video_stream_index];
+        double frame_seconds = job->video_frames > 1 ?
+            (ex.last_pts - ex.first_pts) * av_q2d(stream->time_base) / (job->video_frames - 1) : 0.0;
+        video_seconds = (ex.last_pts - ex.first_pts) * av_q2d(stream->time_base) + frame_seconds;
+    }
+    double audio_seconds = (double)job->audio_samples / job->sample_rate;
+    job->media_seconds = video_seconds > audio_seconds ? video_seconds : audio_seconds;
+
+    av_packet_free(&packet);
+    exportClose(&ex);
+    job->wall_seconds = exportNow() - start;
+    job->ok = ok;
+    return ok;
+}
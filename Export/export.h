@@ -0,0 +1,25 @@
+#ifndef EXPORT_H
+#define EXPORT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "../IO/mmapio.h"
+
+// One input file run through demux -> decode -> swr_convert/sws_scale -> WAV/Y4M
+typedef struct {
+    const char *input;
+    const char *wav_path;     // NULL skips audio, "-" writes to stdout
+    const char *y4m_path;     // NULL skips video, "-" writes to stdout
+    int sample_rate;
+    int thread_count;         // Decoder threads, see openStreamDecoder
+    IOMode io_mode;
+
+    // Results
+    bool ok;
+    uint64_t video_frames, audio_samples;
+    double media_seconds, wall_seconds;
+} ExportJob;
+
+bool exportRun(ExportJob *job);
+
+#endif // EXPORT_H
@@ -0,0 +1,69 @@
+#include "wav.h"
+
+#include <string.h>
+
+#define WAV_HEADER_SIZE 44
+#define WAV_UNKNOWN_SIZE 0xFFFFFFFFu
+
+static void putLe16(uint8_t *p, uint16_t v) {
+    p[0] = v & 0xff;
+    p[1] = v >> 8;
+}
+
+static void putLe32(uint8_t *p, uint32_t v) {
+    p[0] = v & 0xff;
+    p[1] = (v >> 8) & 0xff;
+    p[2] = (v >> 16) & 0xff;
+    p[3] = v >> 24;
+}
+
+static void wavFillHeader(const WavWriter *writer, uint8_t *header, uint32_t data_bytes) {
+    int block_align = writer->channels * 2;
+
+    memcpy(header, "RIFF", 4);
+    putLe32(header + 4, data_bytes == WAV_UNKNOWN_SIZE ? WAV_UNKNOWN_SIZE : data_bytes + WAV_HEADER_SIZE - 8);
+    memcpy(header + 8, "WAVEfmt ", 8);
+    putLe32(header + 16, 16);                    // fmt chunk size
+    putLe16(header + 20, 1);                     // PCM
+    putLe16(header + 22, writer->channels);
+    putLe32(header + 24, writer->sample_rate);
+    putLe32(header + 28, writer->sample_rate * block_align);
+    putLe16(header + 32, block_align);
+    putLe16(header + 34, 16);                    // Bits per sample
+    memcpy(header + 36, "data", 4);
+    putLe32(header + 40, data_bytes);
+}
+
+bool wavWriterOpen(WavWriter *writer, FILE *file, int sample_rate, int channels) {
+    uint8_t header[WAV_HEADER_SIZE];
+
+    writer->file = file;
+    writer->sample_rate = sample_rate;
+    writer->channels = channels;
+    writer->data_bytes = 0;
+    writer->seekable = ftell(file) == 0 && fseek(file, 0, SEEK_SET) == 0;
+
+    wavFillHeader(writer, header, WAV_UNKNOWN_SIZE);
+    return fwrite(header, 1, sizeof(header), file) == sizeof(header);
+}
+
+bool wavWriterWrite(WavWriter *writer, const uint8_t *data, size_t bytes) {
+    writer->data_bytes += bytes;
+    return fwrite(data, 1, bytes, writer->file) == bytes;
+}
+
+// Patches the RIFF sizes when the output allows it; does not close the FILE
+bool wavWriterClose(WavWriter *writer) {
+    uint8_t header[WAV_HEADER_SIZE];
+
+    if (!writer->seekable || writer->data_bytes >= WAV_UNKNOWN_SIZE - WAV_HEADER_SIZE) {
+        return fflush(writer->file) == 0;
+    }
+
+    wavFillHeader(writer, header, (uint32_t)writer->data_bytes);
+    if (fseek(writer->file, 0, SEEK_SET) != 0 ||
+        fwrite(header, 1, sizeof(header), writer->file) != sizeof(header)) {
+        return false;
+    }
+    return fseek(writer->file, 0, SEEK_END) == 0 && fflush(writer->file) == 0;
+}
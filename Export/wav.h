@@ -0,0 +1,20 @@
+#ifndef WAV_H
+#define WAV_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// Streaming writer for 16-bit PCM RIFF/WAVE files
+typedef struct {
+    FILE *file;
+    int sample_rate, channels;
+    uint64_t data_bytes;
+    bool seekable;   // Sizes are patched on close; pipes keep the "unknown" marker
+} WavWriter;
+
+bool wavWriterOpen(WavWriter *writer, FILE *file, int sample_rate, int channels);
+bool wavWriterWrite(WavWriter *writer, const uint8_t *data, size_t bytes);
+bool wavWriterClose(WavWriter *writer);
+
+#endif // WAV_H
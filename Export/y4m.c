@@ -0,0 +1,90 @@
+#include "y4m.h"
+
+#include <libavutil/imgutils.h>
+
+bool y4mWriterOpen(Y4mWriter *writer, FILE *file, int width, int height,
+                   AVRational frame_rate, AVRational aspect) {
+    writer->file = file;
+    writer->width = width;
+    writer->height = height;
+    writer->sws_ctx = NULL;
+    writer->yuv_frame = NULL;
+    writer->frames = 0;
+
+    if (frame_rate.num <= 0 || frame_rate.den <= 0) {
+        frame_rate = (AVRational){25, 1};
+    }
+    if (aspect.num <= 0 || aspect.den <= 0) {
+        aspect = (AVRational){1, 1};
+    }
+
+    return fprintf(file, "YUV4MPEG2 W%d H%d F%d:%d Ip A%d:%d C420jpeg\n",
+                   width, height, frame_rate.num, frame_rate.den, aspect.num, aspect.den) > 0;
+}
+
+static bool y4mWritePlane(FILE *file, const uint8_t *data, int linesize, int width, int height) {
+    for (int y = 0; y < height; y++) {
+        if (fwrite(data + (size_t)y * linesize, 1, width, file) != (size_t)width) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+  Function y4mWriterWrite
+  writes one frame, converting with sws_scale only when the decoder
+  does not already output 8-bit 4:2:0 at the stream's size.
+*/
+bool y4mWriterWrite(Y4mWriter *writer, const AVFrame *frame) {
+    const AVFrame *out = frame;
+    bool direct = (frame->format == AV_PIX_FMT_YUV420P || frame->format == AV_PIX_FMT_YUVJ420P) &&
+                  frame->width == writer->width && frame->height == writer->height;
+
+    if (!direct) {
+        if (!writer->yuv_frame) {
+            writer->yuv_frame = av_frame_alloc();
+            if (!writer->yuv_frame) {
+                return false;
+            }
+            writer->yuv_frame->format = AV_PIX_FMT_YUV420P;
+            writer->yuv_frame->width = writer->width;
+            writer->yuv_frame->height = writer->height;
+            if (av_frame_get_buffer(writer->yuv_frame, 0) < 0) {
+                av_frame_free(&writer->yuv_frame);
+                return false;
+            }
+        }
+        writer->sws_ctx = sws_getCachedContext(writer->sws_ctx,
+            frame->width, frame->height, frame->format,
+            writer->width, writer->height, AV_PIX_FMT_YUV420P,
+            SWS_BILINEAR, NULL, NULL, NULL);
+        if (!writer->sws_ctx) {
+            return false;
+        }
+        sws_scale(writer->sws_ctx, (const uint8_t *const *)frame->data, frame->linesize,
+                  0, frame->height, writer->yuv_frame->data, writer->yuv_frame->linesize);
+        out = writer->yuv_frame;
+    }
+
+    int chroma_w = (writer->width + 1) / 2;
+    int chroma_h = (writer->height + 1) / 2;
+    if (fputs("FRAME\n", writer->file) < 0 ||
+        !y4mWritePlane(writer->file, out->data[0], out->linesize[0], writer->width, writer->height) ||
+        !y4mWritePlane(writer->file, out->data[1], out->linesize[1], chroma_w, chroma_h) ||
+        !y4mWritePlane(writer->file, out->data[2], out->linesize[2], chroma_w, chroma_h)) {
+        return false;
+    }
+    writer->frames++;
+    return true;
+}
+
+// Releases conversion state; does not close the FILE
+void y4mWriterClose(Y4mWriter *writer) {
+    av_frame_free(&writer->yuv_frame);
+    if (writer->sws_ctx) {
+        sws_freeContext(writer->sws_ctx);
+        writer->sws_ctx = NULL;
+    }
+    fflush(writer->file);
+}
@@ -0,0 +1,24 @@
+#ifndef Y4M_H
+#define Y4M_H
+
+#include <libavutil/frame.h>
+#include <libswscale/swscale.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// Streaming writer for raw YUV4MPEG2 (4:2:0, 8-bit) video
+typedef struct {
+    FILE *file;
+    int width, height;
+    struct SwsContext *sws_ctx;   // Only when decoded frames are not yuv420p
+    AVFrame *yuv_frame;
+    uint64_t frames;
+} Y4mWriter;
+
+bool y4mWriterOpen(Y4mWriter *writer, FILE *file, int width, int height,
+                   AVRational frame_rate, AVRational aspect);
+bool y4mWriterWrite(Y4mWriter *writer, const AVFrame *frame);
+void y4mWriterClose(Y4mWriter *writer);
+
+#endif // Y4M_H
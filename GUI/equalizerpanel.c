@@ -0,0 +1,111 @@
+#include "equalizerpanel.h"
+#include <stdio.h>
+
+#define EQ_PANEL_SLIDER_HEIGHT 120
+#define EQ_PANEL_STEP_DB 0.5
+
+typedef struct {
+    Equalizer *eq;
+    GtkWidget *sliders[EQ_BANDS];
+    GtkWidget *presets;
+    bool syncing;          // Widgets being updated from the equalizer, not by the user
+} EqPanel;
+
+// A slider moved by hand: the band changes and the preset list shows "custom"
+static void onBandChanged(GtkRange *range, gpointer user_data) {
+    EqPanel *panel = user_data;
+    if (panel->syncing) {
+        return;
+    }
+    int band = GPOINTER_TO_INT(g_object_get_data(G_OBJECT(range), "band"));
+    equalizerSetGain(panel->eq, band, gtk_range_get_value(range));
+    panel->syncing = true;
+    gtk_drop_down_set_selected(GTK_DROP_DOWN(panel->presets), equalizerPresetCount());
+    panel->syncing = false;
+}
+
+// A preset picked: the equalizer takes its gains and the sliders follow
+static void onPresetSelected(GObject *object, GParamSpec *pspec, gpointer user_data) {
+    EqPanel *panel = user_data;
+    int preset = (int)gtk_drop_down_get_selected(GTK_DROP_DOWN(object));
+    if (panel->syncing || preset >= equalizerPresetCount()) {
+        return;
+    }
+    equalizerSetPreset(panel->eq, preset);
+    EqBand bands[EQ_BANDS];
+    equalizerGetBands(panel->eq, bands);
+    panel->syncing = true;
+    for (int band = 0; band < EQ_BANDS; band++) {
+        gtk_range_set_value(GTK_RANGE(panel->sliders[band]), bands[band].gain_db);
+    }
+    panel->syncing = false;
+}
+
+static void onEnabledToggled(GtkCheckButton *button, gpointer user_data) {
+    EqPanel *panel = user_data;
+    equalizerSetEnabled(panel->eq, gtk_check_button_get_active(button));
+}
+
+/*
+  Function equalizerPanelNew
+  builds the panel from the equalizer's current settings, which --eq
+  may already have changed. Every change goes straight to the
+  equalizer; the audio thread ramps to it on its next chunk.
+*/
+GtkWidget *equalizerPanelNew(Equalizer *eq) {
+    EqPanel *panel = g_new0(EqPanel, 1);
+    panel->eq = eq;
+    EqBand bands[EQ_BANDS];
+    int preset = equalizerGetBands(eq, bands);
+
+    GtkWidget *box = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 8);
+    g_object_set_data_full(G_OBJECT(box), "eq-panel", panel, g_free);
+    gtk_widget_set_margin_start(box, 8);
+    gtk_widget_set_margin_end(box, 8);
+
+    // Switch and presets on the left, the last entry standing for hand-made settings
+    GtkWidget *controls = gtk_box_new(GTK_ORIENTATION_VERTICAL, 5);
+    gtk_widget_set_valign(controls, GTK_ALIGN_CENTER);
+    GtkWidget *enabled = gtk_check_button_new_with_label("Equalizer");
+    gtk_check_button_set_active(GTK_CHECK_BUTTON(enabled), true);
+    g_signal_connect(enabled, "toggled", G_CALLBACK(onEnabledToggled), panel);
+    gtk_box_append(GTK_BOX(controls), enabled);
+
+    GtkStringList *names = gtk_string_list_new(NULL);
+    for (int i = 0; i <= equalizerPresetCount(); i++) {
+        gtk_string_list_append(names, equalizerPresetName(i));
+    }
+    panel->presets = gtk_drop_down_new(G_LIST_MODEL(names), NULL);
+    gtk_drop_down_set_selected(GTK_DROP_DOWN(panel->presets), preset >= 0 ? preset : equalizerPresetCount());
+    g_signal_connect(panel->presets, "notify::selected", G_CALLBACK(onPresetSelected), panel);
+    gtk_box_append(GTK_BOX(controls), panel->presets);
+    gtk_box_append(GTK_BOX(box), controls);
+
+    // One column per band: gain slider, boosts up, centre frequency below
+    for (int band = 0; band < EQ_BANDS; band++) {
+        GtkWidget *column = gtk_box_new(GTK_ORIENTATION_VERTICAL, 2);
+        gtk_widget_set_hexpand(column, true);
+        GtkWidget *slider = gtk_scale_new_with_range(GTK_ORIENTATION_VERTICAL, -EQ_MAX_GAIN_DB, EQ_MAX_GAIN_DB,
+                                                     EQ_PANEL_STEP_DB);
+        gtk_range_set_inverted(GTK_RANGE(slider), true);
+        gtk_range_set_value(GTK_RANGE(slider), bands[band].gain_db);
+        gtk_scale_set_digits(GTK_SCALE(slider), 1);
+        gtk_scale_set_draw_value(GTK_SCALE(slider), true);
+        gtk_scale_add_mark(GTK_SCALE(slider), 0.0, GTK_POS_RIGHT, NULL);
+        gtk_widget_set_size_request(slider, -1, EQ_PANEL_SLIDER_HEIGHT);
+        g_object_set_data(G_OBJECT(slider), "band", GINT_TO_POINTER(band));
+        g_signal_connect(slider, "value-changed", G_CALLBACK(onBandChanged), panel);
+        panel->sliders[band] = slider;
+        gtk_box_append(GTK_BOX(column), slider);
+
+        char label[16];
+        if (bands[band].hz >= 1000) {
+            snprintf(label, sizeof(label), "%gk", bands[band].hz / 1000);
+        } else {
+            snprintf(label, sizeof(label), "%.0f", bands[band].hz);
+        }
+        gtk_box_append(GTK_BOX(column), gtk_label_new(label));
+        gtk_box_append(GTK_BOX(box), column);
+    }
+    return box;
+}
@@ -0,0 +1,10 @@
+#ifndef EQUALIZERPANEL_H
+#define EQUALIZERPANEL_H
+
+#include <gtk/gtk.h>
+#include "../Decoding/equalizer.h"
+
+// On/off switch, preset list and one vertical gain slider per band, applied to eq as they move
+GtkWidget *equalizerPanelNew(Equalizer *eq);
+
+#endif // EQUALIZERPANEL_H
@@ -1,24 +1,169 @@
 #include "gui.h"
+#include <math.h>
+#include "../Decoding/clock.h"
+#include "../Decoding/subtitle.h"
+#include "equalizerpanel.h"
+#include "spectrumview.h"
+#include "../Stats/stats.h"
+#include "../Stats/trace.h"
+
+#define STATS_OVERLAY_INTERVAL_MS 250
+#define SUBTITLE_MARGIN 24
+#define SPECTRUM_STRIP_HEIGHT 160     // Analyzer shown over the bottom of a video
+#define SPECTRUM_PROBE_WAIT_MS 50     // Polling for the probe result that decides audio-only
+
+static GtkWidget *stats_label = NULL;
+static GtkWidget *video_image = NULL;
+static GtkWidget *subtitle_picture = NULL;
+static GtkWidget *spectrum_view = NULL;
+static GtkWidget *equalizer_panel = NULL;
+static GtkWidget *equalizer_button = NULL;
+static GdkTexture *subtitle_shown = NULL;
+
+// Swaps the subtitle overlay only when a different cue becomes current
+static void updateSubtitle(double pts) {
+    GdkTexture *texture = isnan(pts) ? NULL : subtitleCacheLookup(&subtitleCache, pts);
+    if (texture == subtitle_shown) {
+        if (texture) {
+            g_object_unref(texture);
+        }
+        return;
+    }
+    gtk_picture_set_paintable(GTK_PICTURE(subtitle_picture), (GdkPaintable *)texture);
+    if (subtitle_shown) {
+        g_object_unref(subtitle_shown);
+    }
+    subtitle_shown = texture;
+}
+
+// Shows one converted frame and takes ownership of the pixbuf
+static void presentFrame(GtkWidget *image_widget, GdkPixbuf *pixbuf, double pts) {
+    double audio = clockGetAudio();
+    if (!isnan(pts) && !isnan(audio)) {
+        statsSetAvOffset(pts - audio);
+    }
+
+    uint64_t present_start = statsNow();
+    traceBegin("present");
+    GdkPaintable *paintable =  (GdkPaintable *)gdk_texture_new_for_pixbuf(pixbuf); // Convert to GdkPaintable
+    gtk_image_set_from_paintable(GTK_IMAGE(image_widget), paintable); // Use updated function
+    g_object_unref(paintable); // Decrease reference count of paintable
+    g_object_unref(pixbuf); // Decrease reference count after setting it
+    updateSubtitle(pts);
+    traceEnd("present");
+    statsRecord(STAT_PRESENT, statsNow() - present_start);
+    statsCount(COUNTER_PRESENTED);
+    statsMarkStartup(STARTUP_FIRST_FRAME);
+    demuxRecordPresented(&demuxer, pts);
+}
 
 // GTK Callbacks
 /*
   Function update_display 
   continuously updates the display by popping images
-  callback for our animation functionality
+  callback for our animation functionality.
+  Late frames were already skipped by the converter. Subtitles are
+  separate overlay textures, not drawn into the frame.
 */
 gboolean updateDisplay(GtkWidget *image_widget) {
     if (!is_paused) { // Only update if playing
         GdkPixbuf *pixbuf;
-        if (videoBufferPop(&videoBuffer, &pixbuf)) {
-            GdkPaintable *paintable =  (GdkPaintable *)gdk_texture_new_for_pixbuf(pixbuf); // Convert to GdkPaintable
-            gtk_image_set_from_paintable(GTK_IMAGE(image_widget), paintable); // Use updated function
-            g_object_unref(paintable); // Decrease reference count of paintable
-            g_object_unref(pixbuf); // Decrease reference count after setting it
+        double pts;
+        if (displayBufferPop(&displayBuffer, &pixbuf, &pts)) {
+            presentFrame(image_widget, pixbuf, pts);
         }
     }
     return G_SOURCE_CONTINUE;
 }
 
+/*
+  Function showFirstFrame
+  frame clock tick that runs from the window's first refresh until the
+  first converted frame is up, so startup does not also wait for a
+  tick of the playback timer. The timer takes over from there.
+*/
+static gboolean showFirstFrame(GtkWidget *image_widget, GdkFrameClock *frame_clock, gpointer user_data) {
+    DecodeData *data = user_data;
+    GdkPixbuf *pixbuf;
+    double pts;
+    if (!displayBufferPopDue(&displayBuffer, &pixbuf, &pts, INFINITY)) {   // The oldest: frame 0 is shown, not dropped
+        return is_running && !displayBuffer.finished ? G_SOURCE_CONTINUE : G_SOURCE_REMOVE;
+    }
+    presentFrame(image_widget, pixbuf, pts);
+    g_timeout_add(1000 / data->frame_rate, (GSourceFunc)updateDisplay, image_widget);
+    return G_SOURCE_REMOVE;
+}
+
+/*
+  Function updateDisplayBlended
+  display-rate mode: one blended frame per display refresh, in order.
+  A frame whose slot is still ahead of the audio clock waits for a
+  later refresh, which keeps the two in step when --display-rate is
+  not exactly the monitor's rate.
+*/
+static gboolean updateDisplayBlended(GtkWidget *image_widget, GdkFrameClock *frame_clock, gpointer user_data) {
+    DecodeData *data = user_data;
+    double audio = clockGetAudio();
+    double until = isnan(audio) ? INFINITY : audio + 0.5 / data->display_rate;
+    GdkPixbuf *pixbuf;
+    double pts;
+    if (!is_paused && displayBufferPopDue(&blendBuffer, &pixbuf, &pts, until)) {
+        presentFrame(image_widget, pixbuf, pts);
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+/*
+  Function updateDisplayLive
+  frame clock tick for live inputs: instead of a fixed-rate timer that
+  can hold a ready frame for up to a whole interval, every display
+  refresh shows the newest converted frame, if any, without waiting.
+*/
+static gboolean updateDisplayLive(GtkWidget *image_widget, GdkFrameClock *frame_clock, gpointer user_data) {
+    GdkPixbuf *pixbuf;
+    double pts;
+    if (!is_paused && displayBufferTryPop(&displayBuffer, &pixbuf, &pts)) {
+        presentFrame(image_widget, pixbuf, pts);
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+/*
+  Function stepFrame
+  shows the next converted frame while paused. In reverse mode that is
+  the frame before the one on screen; the converter keeps the display
+  buffer filled from the GOP cache behind it, pause or not.
+*/
+static void stepFrame() {
+    GdkPixbuf *pixbuf;
+    double pts;
+    if (displayBufferPopDue(&displayBuffer, &pixbuf, &pts, INFINITY)) {
+        presentFrame(video_image, pixbuf, pts);
+    }
+}
+
+// Refreshes the stats overlay while it is shown
+static gboolean updateStatsOverlay(gpointer user_data) {
+    if (gtk_widget_get_visible(stats_label)) {
+        char text[2048];
+        statsFormatOverlay(text, sizeof(text));
+        gtk_label_set_text(GTK_LABEL(stats_label), text);
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+// Audio-only inputs get the whole picture area as analyzer once the probe has told
+static gboolean showSpectrumForAudioOnly(gpointer user_data) {
+    if (!__atomic_load_n(&demuxer.ready, __ATOMIC_ACQUIRE)) {
+        return is_running ? G_SOURCE_CONTINUE : G_SOURCE_REMOVE;
+    }
+    if (demuxer.video_stream_index == -1 && __atomic_load_n(&demuxer.audio_stream_index, __ATOMIC_ACQUIRE) != -1) {
+        gtk_widget_set_valign(spectrum_view, GTK_ALIGN_FILL);
+        gtk_widget_set_visible(spectrum_view, true);
+    }
+    return G_SOURCE_REMOVE;
+}
+
 int command_line_cb(GtkApplication *app,
                            GApplicationCommandLine *cmdline,
                            gpointer user_data) {
@@ -45,7 +190,7 @@ int command_line_cb(GtkApplication *app,
 }
 
 void onWindowDestroy(GtkWidget *widget, gpointer app) {
-    is_running = 0;
+    stopPlayback();
     g_application_quit(G_APPLICATION(app));
 }
 
@@ -61,25 +206,65 @@ void onPausePlayToggle(GtkButton *button, gpointer user_data) {
 
     if (!is_paused) {
         // Notify all threads to resume from pause
+        pthread_cond_broadcast(&displayBuffer.notEmpty);
+        pthread_cond_broadcast(&blendBuffer.notEmpty);
         pthread_cond_broadcast(&videoBuffer.notEmpty);
         pthread_cond_broadcast(&audioBuffer.notEmpty);
     }
 }
 
+// Shows / hides the equalizer panel with the EQ button, which 'e' toggles as well
+static void onEqualizerToggle(GtkToggleButton *button, gpointer user_data) {
+    gtk_widget_set_visible(equalizer_panel, gtk_toggle_button_get_active(button));
+}
+
 // Handle key press events
 // Handle key press events using GtkEventControllerKey
 gboolean onKeyPress(GtkEventController *controller, guint keyval, guint keycode, GdkModifierType state, gpointer user_data) {
+    DecodeData *data = user_data;
     if (keyval == GDK_KEY_space) {  // Spacebar is pressed
         onPausePlayToggle(NULL, NULL);  // Toggle Play/Pause
         return TRUE;  // Event handled, stop propagation
     }
+    // The window can be up before the input is probed; track and loop keys wait for it
+    bool ready = __atomic_load_n(&demuxer.ready, __ATOMIC_ACQUIRE);
+    if (keyval == GDK_KEY_l && ready) {  // Release / re-engage the A-B loop
+        demuxToggleLoop(&demuxer);
+        return TRUE;
+    }
+    if (keyval == GDK_KEY_a && ready) {  // Next audio track
+        demuxRequestTrack(&demuxer, AVMEDIA_TYPE_AUDIO);
+        return TRUE;
+    }
+    if (keyval == GDK_KEY_t && ready) {  // Next subtitle track, then off
+        demuxRequestTrack(&demuxer, AVMEDIA_TYPE_SUBTITLE);
+        return TRUE;
+    }
+    if ((keyval == GDK_KEY_comma || keyval == GDK_KEY_Left) && data->reverse && is_paused) {  // One frame back
+        stepFrame();
+        return TRUE;
+    }
+    if (keyval == GDK_KEY_v && spectrum_view) {  // Show / hide the spectrum analyzer
+        gtk_widget_set_visible(spectrum_view, !gtk_widget_get_visible(spectrum_view));
+        return TRUE;
+    }
+    if (keyval == GDK_KEY_e && equalizer_button) {  // Show / hide the equalizer panel
+        GtkToggleButton *button = GTK_TOGGLE_BUTTON(equalizer_button);
+        gtk_toggle_button_set_active(button, !gtk_toggle_button_get_active(button));
+        return TRUE;
+    }
+    if (keyval == GDK_KEY_s && stats_label) {  // Show / hide the stats overlay
+        gtk_widget_set_visible(stats_label, !gtk_widget_get_visible(stats_label));
+        updateStatsOverlay(NULL);
+        return TRUE;
+    }
     return FALSE;  // Let other key events propagate
 }
 
 
 void activate(GtkApplication *app, gpointer user_data) {
         DecodeData *data = (DecodeData *)user_data;
-    GtkWidget *window, *main_box, *scrolled_window, *image_widget, *button_box, *pause_button;
+    GtkWidget *window, *main_box, *overlay, *scrolled_window, *image_widget, *button_box, *pause_button;
     GtkEventController *key_controller;  // Declare the key event controller
 
     // Create the main application window
@@ -89,7 +274,7 @@ void activate(GtkApplication *app, gpointer user_data) {
 
     // Create a key event controller
     key_controller = gtk_event_controller_key_new();
-    g_signal_connect(key_controller, "key-pressed", G_CALLBACK(onKeyPress), NULL);
+    g_signal_connect(key_controller, "key-pressed", G_CALLBACK(onKeyPress), data);
     gtk_widget_add_controller(window, key_controller);  // Attach the controller to the window
 
     // Create a vertical box to hold the image and controls
@@ -102,8 +287,47 @@ void activate(GtkApplication *app, gpointer user_data) {
                                    GTK_POLICY_AUTOMATIC, GTK_POLICY_AUTOMATIC);
     gtk_widget_set_size_request(scrolled_window, 800, 450); // Set a fixed size for the display
     image_widget = gtk_image_new();
+    video_image = image_widget;
     gtk_scrolled_window_set_child(GTK_SCROLLED_WINDOW(scrolled_window), image_widget);
-    gtk_box_append(GTK_BOX(main_box), scrolled_window);
+
+    // Stats overlay on top of the video, toggled with 's'
+    overlay = gtk_overlay_new();
+    gtk_overlay_set_child(GTK_OVERLAY(overlay), scrolled_window);
+    stats_label = gtk_label_new(NULL);
+    gtk_widget_add_css_class(stats_label, "monospace");
+    gtk_widget_add_css_class(stats_label, "osd");
+    gtk_widget_set_halign(stats_label, GTK_ALIGN_START);
+    gtk_widget_set_valign(stats_label, GTK_ALIGN_START);
+    gtk_widget_set_visible(stats_label, false);
+    gtk_overlay_add_overlay(GTK_OVERLAY(overlay), stats_label);
+
+    // Subtitle overlay, bottom centered, textures come from the subtitle cache
+    subtitle_picture = gtk_picture_new();
+    gtk_picture_set_can_shrink(GTK_PICTURE(subtitle_picture), false);
+    gtk_widget_set_halign(subtitle_picture, GTK_ALIGN_CENTER);
+    gtk_widget_set_valign(subtitle_picture, GTK_ALIGN_END);
+    gtk_widget_set_margin_bottom(subtitle_picture, SUBTITLE_MARGIN);
+    gtk_widget_set_can_target(subtitle_picture, false);
+    gtk_overlay_add_overlay(GTK_OVERLAY(overlay), subtitle_picture);
+
+    // Spectrum analyzer fed by the audio sink tap, toggled with 'v', shown by itself for audio-only inputs
+    if (spectrumAnalyzer.ring) {
+        spectrum_view = spectrumViewNew(&spectrumAnalyzer);
+        gtk_widget_set_valign(spectrum_view, GTK_ALIGN_END);
+        gtk_widget_set_size_request(spectrum_view, -1, SPECTRUM_STRIP_HEIGHT);
+        gtk_widget_set_can_target(spectrum_view, false);
+        gtk_widget_set_visible(spectrum_view, false);
+        gtk_overlay_add_overlay(GTK_OVERLAY(overlay), spectrum_view);
+        g_timeout_add(SPECTRUM_PROBE_WAIT_MS, showSpectrumForAudioOnly, NULL);
+    }
+    gtk_box_append(GTK_BOX(main_box), overlay);
+
+    // Equalizer panel between the video and the controls, hidden until asked for
+    if (data->equalizer) {
+        equalizer_panel = equalizerPanelNew(data->equalizer);
+        gtk_widget_set_visible(equalizer_panel, false);
+        gtk_box_append(GTK_BOX(main_box), equalizer_panel);
+    }
 
     // Create a horizontal box for controls
     button_box = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 5);
@@ -113,12 +337,27 @@ void activate(GtkApplication *app, gpointer user_data) {
     pause_button = gtk_button_new_with_label("Pause");
     g_signal_connect(pause_button, "clicked", G_CALLBACK(onPausePlayToggle), NULL);
     gtk_box_append(GTK_BOX(button_box), pause_button);
+    if (equalizer_panel) {
+        equalizer_button = gtk_toggle_button_new_with_label("EQ");
+        g_signal_connect(equalizer_button, "toggled", G_CALLBACK(onEqualizerToggle), NULL);
+        gtk_box_append(GTK_BOX(button_box), equalizer_button);
+    }
 
     // Connect destroy signal to clean up on window close
     g_signal_connect(window, "destroy", G_CALLBACK(onWindowDestroy), app);
 
     // Start updating the display periodically
-    g_timeout_add(1000 / data->frame_rate, (GSourceFunc)updateDisplay, image_widget);
+    statsThreadName("gui");
+    traceThreadName("gui");
+    if (data->live) {
+        gtk_widget_add_tick_callback(image_widget, updateDisplayLive, NULL, NULL);
+    } else if (data->display_rate > 0) {
+        gtk_widget_add_tick_callback(image_widget, updateDisplayBlended, data, NULL);
+    } else {
+        gtk_widget_add_tick_callback(image_widget, showFirstFrame, data, NULL);
+    }
+    g_timeout_add(STATS_OVERLAY_INTERVAL_MS, updateStatsOverlay, NULL);
 
     gtk_widget_set_visible(window, true);
+    statsMarkStartup(STARTUP_WINDOW);
 }
\ No newline at end of file
@@ -4,6 +4,7 @@
 #include <gtk/gtk.h>
 #include <gdk/gdk.h>
 #include "../Decoding/decoding.h"
+#include "../Decoding/demux.h"
 
 void activate(GtkApplication *app, gpointer user_data);
 int command_line_cb(GtkApplication *app, GApplicationCommandLine *cmdline, gpointer user_data);
@@ -0,0 +1,90 @@
+#include "spectrumview.h"
+#include <math.h>
+#include "../Decoding/clock.h"
+#include "../Decoding/decoding.h"
+
+#define SPECTRUM_VIEW_GAP 2.0f         // Pixels between bars
+#define SPECTRUM_VIEW_METER 14.0f      // Width of each level meter
+#define SPECTRUM_VIEW_PEAK 2.0f        // Height of the peak marks
+
+struct _SpectrumView {
+    GtkWidget parent_instance;
+    SpectrumAnalyzer *analyzer;
+    SpectrumFrame frame;               // What is on screen
+};
+
+G_DEFINE_TYPE(SpectrumView, spectrum_view, GTK_TYPE_WIDGET)
+
+// 0 at the floor, 1 at full scale
+static float levelHeight(float db) {
+    float level = (db - SPECTRUM_FLOOR_DB) / -SPECTRUM_FLOOR_DB;
+    return level < 0.0f ? 0.0f : level > 1.0f ? 1.0f : level;
+}
+
+/*
+  Function spectrumViewTick
+  asks for an analysis at the audio clock on every display refresh and
+  redraws once a newer one is published. The FFT runs on a scheduler
+  worker; the main thread only copies the result.
+*/
+static gboolean spectrumViewTick(GtkWidget *widget, GdkFrameClock *frame_clock, gpointer user_data) {
+    SpectrumView *view = SPECTRUM_VIEW(widget);
+    double audio = clockGetAudio();
+    if (!is_paused && !isnan(audio)) {
+        spectrumRequest(view->analyzer, audio);
+    }
+    SpectrumFrame latest;
+    if (spectrumLatest(view->analyzer, &latest) && latest.sequence != view->frame.sequence) {
+        view->frame = latest;
+        gtk_widget_queue_draw(widget);
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+static void spectrum_view_snapshot(GtkWidget *widget, GtkSnapshot *snapshot) {
+    SpectrumView *view = SPECTRUM_VIEW(widget);
+    float width = gtk_widget_get_width(widget), height = gtk_widget_get_height(widget);
+    const GdkRGBA background = {0.05f, 0.05f, 0.07f, 1.0f};
+    const GdkRGBA bar = {0.2f, 0.7f, 0.9f, 1.0f};
+    const GdkRGBA peak = {0.9f, 0.9f, 0.95f, 1.0f};
+    const GdkRGBA rms = {0.3f, 0.8f, 0.4f, 1.0f};
+    gtk_snapshot_append_color(snapshot, &background, &GRAPHENE_RECT_INIT(0, 0, width, height));
+
+    // Bars on the left, one meter per channel on the right
+    float meters = SPECTRUM_CHANNELS * (SPECTRUM_VIEW_METER + SPECTRUM_VIEW_GAP) + SPECTRUM_VIEW_GAP;
+    float slot = (width - meters) / SPECTRUM_BANDS;
+    if (slot <= SPECTRUM_VIEW_GAP) {
+        return;
+    }
+    for (int band = 0; band < SPECTRUM_BANDS; band++) {
+        float x = band * slot + SPECTRUM_VIEW_GAP;
+        float h = levelHeight(view->frame.bands[band]) * height;
+        float p = levelHeight(view->frame.band_peaks[band]) * height;
+        gtk_snapshot_append_color(snapshot, &bar, &GRAPHENE_RECT_INIT(x, height - h, slot - SPECTRUM_VIEW_GAP, h));
+        gtk_snapshot_append_color(snapshot, &peak, &GRAPHENE_RECT_INIT(x, height - p, slot - SPECTRUM_VIEW_GAP,
+                                                                        SPECTRUM_VIEW_PEAK));
+    }
+    for (int c = 0; c < SPECTRUM_CHANNELS; c++) {
+        float x = width - meters + SPECTRUM_VIEW_GAP + c * (SPECTRUM_VIEW_METER + SPECTRUM_VIEW_GAP);
+        float h = levelHeight(view->frame.rms[c]) * height;
+        float p = levelHeight(view->frame.peak[c]) * height;
+        gtk_snapshot_append_color(snapshot, &rms, &GRAPHENE_RECT_INIT(x, height - h, SPECTRUM_VIEW_METER, h));
+        gtk_snapshot_append_color(snapshot, &peak, &GRAPHENE_RECT_INIT(x, height - p, SPECTRUM_VIEW_METER,
+                                                                        SPECTRUM_VIEW_PEAK));
+    }
+}
+
+static void spectrum_view_class_init(SpectrumViewClass *klass) {
+    GTK_WIDGET_CLASS(klass)->snapshot = spectrum_view_snapshot;
+}
+
+// Tick callbacks only run while the widget is mapped: a hidden analyzer costs nothing
+static void spectrum_view_init(SpectrumView *view) {
+    gtk_widget_add_tick_callback(GTK_WIDGET(view), spectrumViewTick, NULL, NULL);
+}
+
+GtkWidget *spectrumViewNew(SpectrumAnalyzer *analyzer) {
+    SpectrumView *view = g_object_new(SPECTRUM_TYPE_VIEW, NULL);
+    view->analyzer = analyzer;
+    return GTK_WIDGET(view);
+}
@@ -0,0 +1,13 @@
+#ifndef SPECTRUMVIEW_H
+#define SPECTRUMVIEW_H
+
+#include <gtk/gtk.h>
+#include "../Output/spectrum.h"
+
+#define SPECTRUM_TYPE_VIEW (spectrum_view_get_type())
+G_DECLARE_FINAL_TYPE(SpectrumView, spectrum_view, SPECTRUM, VIEW, GtkWidget)
+
+// Bars and level meters drawn with snapshot rectangles, refreshed on every frame clock tick while shown
+GtkWidget *spectrumViewNew(SpectrumAnalyzer *analyzer);
+
+#endif // SPECTRUMVIEW_H
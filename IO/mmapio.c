@@ -0,0 +1,419 @@
+#include "mmapio.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define IO_BUFFER_SIZE (64 * 1024)        // AVIOContext buffer handed to the demuxer
+#define IO_WINDOW (4 * 1024 * 1024)       // MADV_WILLNEED window kept ahead of the reader
+#define IO_RANDOM_SPAN (256 * 1024)       // Region switched to MADV_RANDOM around a seek target
+#define IO_SEQUENTIAL_AFTER 4             // Contiguous reads after a seek before readahead resumes
+#define LIVE_PROBE_SIZE (32 * 1024)       // Bytes a live input is probed over, FFmpeg's minimum
+#define LIVE_ANALYZE_US 100000            // Stream info from the first 100 ms of a live input
+
+// One mapping per file, shared by every demuxer that opens it
+typedef struct MappedFile {
+    dev_t dev;
+    ino_t ino;
+    uint8_t *base;
+    size_t size;
+    int refs;
+    size_t advised_end;                   // End of the furthest MADV_WILLNEED window issued so far
+    struct MappedFile *next;
+} MappedFile;
+
+// Per-AVIOContext cursor
+typedef struct {
+    MappedFile *map;   // IO_MODE_MMAP
+    int fd;            // IO_MODE_READ
+    int64_t size;
+    int64_t pos;
+    int sequential_reads;
+    bool random;
+} IOReader;
+
+static pthread_mutex_t map_lock = PTHREAD_MUTEX_INITIALIZER;
+static MappedFile *mapped_files = NULL;
+static IOStats io_stats;
+static IOMode io_stats_mode = IO_MODE_FFMPEG;
+static size_t page_size;
+
+static uint64_t ioNowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void ioCount(uint64_t *counter, uint64_t value) {
+    __atomic_fetch_add(counter, value, __ATOMIC_RELAXED);
+}
+
+static void ioAdvise(void *addr, size_t len, int advice) {
+    if (madvise(addr, len, advice) == 0) {
+        ioCount(&io_stats.madvise_calls, 1);
+    }
+}
+
+IOMode ioParseMode(const char *name) {
+    if (strcmp(name, "mmap") == 0) return IO_MODE_MMAP;
+    if (strcmp(name, "read") == 0) return IO_MODE_READ;
+    if (strcmp(name, "ffmpeg") == 0) return IO_MODE_FFMPEG;
+    fprintf(stderr, "Warning: Unknown I/O mode '%s', using mmap\n", name);
+    return IO_MODE_MMAP;
+}
+
+const char *ioModeName(IOMode mode) {
+    switch (mode) {
+        case IO_MODE_MMAP: return "mmap";
+        case IO_MODE_READ: return "read";
+        case IO_MODE_LIVE: return "live";
+        default: return "ffmpeg";
+    }
+}
+
+// Mapping Registry
+static MappedFile *mappedFileAcquire(int fd, const struct stat *st) {
+    pthread_mutex_lock(&map_lock);
+    for (MappedFile *map = mapped_files; map; map = map->next) {
+        if (map->dev == st->st_dev && map->ino == st->st_ino && map->size == (size_t)st->st_size) {
+            map->refs++;
+            pthread_mutex_unlock(&map_lock);
+            return map;
+        }
+    }
+
+    uint8_t *base = mmap(NULL, st->st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (base == MAP_FAILED) {
+        pthread_mutex_unlock(&map_lock);
+        return NULL;
+    }
+    ioCount(&io_stats.map_calls, 1);
+    if (!page_size) {
+        page_size = sysconf(_SC_PAGESIZE);
+    }
+
+    MappedFile *map = calloc(1, sizeof(MappedFile));
+    if (!map) {
+        munmap(base, st->st_size);
+        pthread_mutex_unlock(&map_lock);
+        return NULL;
+    }
+    map->dev = st->st_dev;
+    map->ino = st->st_ino;
+    map->base = base;
+    map->size = st->st_size;
+    map->refs = 1;
+    map->next = mapped_files;
+    mapped_files = map;
+
+    // Demuxing is mostly a front-to-back walk; let the kernel read ahead aggressively
+    ioAdvise(base, map->size, MADV_SEQUENTIAL);
+    pthread_mutex_unlock(&map_lock);
+    return map;
+}
+
+static void mappedFileRelease(MappedFile *map) {
+    pthread_mutex_lock(&map_lock);
+    if (--map->refs == 0) {
+        for (MappedFile **link = &mapped_files; *link; link = &(*link)->next) {
+            if (*link == map) {
+                *link = map->next;
+                break;
+            }
+        }
+        munmap(map->base, map->size);
+        free(map);
+    }
+    pthread_mutex_unlock(&map_lock);
+}
+
+/*
+  Function mmapFollow
+  keeps a MADV_WILLNEED window in front of the reader so page faults
+  are served from the page cache. Both demuxers walk roughly the same
+  region, so the window is tracked per mapping to avoid duplicate calls.
+*/
+static void mmapFollow(IOReader *reader) {
+    MappedFile *map = reader->map;
+
+    if (reader->random) {
+        if (++reader->sequential_reads < IO_SEQUENTIAL_AFTER) {
+            return;
+        }
+        // Reads have settled into a stream again after the seek
+        size_t start = (reader->pos > IO_RANDOM_SPAN ? reader->pos - IO_RANDOM_SPAN : 0) & ~(page_size - 1);
+        size_t len = FFMIN((size_t)IO_RANDOM_SPAN * 2, map->size - start);
+        ioAdvise(map->base + start, len, MADV_SEQUENTIAL);
+        reader->random = false;
+    }
+
+    size_t start = reader->pos & ~(page_size - 1);
+    size_t end = FFMIN(start + IO_WINDOW, map->size);
+
+    // A reader trailing the other one by less than a window is already covered
+    pthread_mutex_lock(&map_lock);
+    bool covered = start + IO_WINDOW / 2 <= map->advised_end &&
+                   start + 2 * IO_WINDOW >= map->advised_end;
+    if (!covered && end > map->advised_end) {
+        map->advised_end = end;
+    }
+    pthread_mutex_unlock(&map_lock);
+
+    if (!covered && end > start) {
+        ioAdvise(map->base + start, end - start, MADV_WILLNEED);
+    }
+}
+
+// AVIOContext Callbacks for IO_MODE_MMAP
+static int mmapRead(void *opaque, uint8_t *buf, int buf_size) {
+    IOReader *reader = opaque;
+    uint64_t start = ioNowNs();
+
+    if (reader->pos >= reader->size) {
+        return AVERROR_EOF;
+    }
+
+    mmapFollow(reader);
+
+    size_t bytes = FFMIN((int64_t)buf_size, reader->size - reader->pos);
+    memcpy(buf, reader->map->base + reader->pos, bytes);
+    reader->pos += bytes;
+
+    ioCount(&io_stats.callbacks, 1);
+    ioCount(&io_stats.bytes, bytes);
+    ioCount(&io_stats.busy_ns, ioNowNs() - start);
+    return bytes;
+}
+
+static int64_t mmapSeek(void *opaque, int64_t offset, int whence) {
+    IOReader *reader = opaque;
+    int64_t target;
+
+    if (whence == AVSEEK_SIZE) {
+        return reader->size;
+    }
+
+    switch (whence & ~AVSEEK_FORCE) {
+        case SEEK_SET: target = offset; break;
+        case SEEK_CUR: target = reader->pos + offset; break;
+        case SEEK_END: target = reader->size + offset; break;
+        default: return AVERROR(EINVAL);
+    }
+    if (target < 0) {
+        return AVERROR(EINVAL);
+    }
+
+    // Long jumps (index lookups, user seeks) should not drag a sequential window along
+    if (llabs(target - reader->pos) > IO_WINDOW && target < reader->size) {
+        MappedFile *map = reader->map;
+        size_t start = (target > IO_RANDOM_SPAN ? target - IO_RANDOM_SPAN : 0) & ~(page_size - 1);
+        size_t len = FFMIN((size_t)IO_RANDOM_SPAN * 2, map->size - start);
+        ioAdvise(map->base + start, len, MADV_RANDOM);
+        reader->random = true;
+        reader->sequential_reads = 0;
+    }
+
+    reader->pos = target;
+    return target;
+}
+
+// AVIOContext Callbacks for IO_MODE_READ
+static int fileRead(void *opaque, uint8_t *buf, int buf_size) {
+    IOReader *reader = opaque;
+    uint64_t start = ioNowNs();
+
+    ssize_t bytes = read(reader->fd, buf, buf_size);
+    ioCount(&io_stats.read_calls, 1);
+    if (bytes < 0) {
+        return AVERROR(errno);
+    }
+    if (bytes == 0) {
+        return AVERROR_EOF;
+    }
+
+    ioCount(&io_stats.callbacks, 1);
+    ioCount(&io_stats.bytes, bytes);
+    ioCount(&io_stats.busy_ns, ioNowNs() - start);
+    return bytes;
+}
+
+static int64_t fileSeek(void *opaque, int64_t offset, int whence) {
+    IOReader *reader = opaque;
+
+    if (whence == AVSEEK_SIZE) {
+        return reader->size;
+    }
+
+    off_t pos = lseek(reader->fd, offset, whence & ~AVSEEK_FORCE);
+    ioCount(&io_stats.seek_calls, 1);
+    return pos < 0 ? AVERROR(errno) : pos;
+}
+
+static void ioReaderFree(IOReader *reader) {
+    if (reader->map) {
+        mappedFileRelease(reader->map);
+    }
+    if (reader->fd >= 0) {
+        close(reader->fd);
+    }
+    free(reader);
+}
+
+/*
+  Function ioOpenLive
+  opens stdin ("-") or a FIFO through FFmpeg without the regular-file
+  check: opening a FIFO just to fstat and close it would leave the
+  writer with a broken pipe. Format probing and avformat_find_stream_info
+  stop after LIVE_PROBE_SIZE bytes / LIVE_ANALYZE_US, and the demuxer
+  returns packets as soon as they are parsed instead of buffering them.
+*/
+static int ioOpenLive(AVFormatContext **format_context, const char *filename) {
+    AVFormatContext *context = avformat_alloc_context();
+    if (!context) {
+        return AVERROR(ENOMEM);
+    }
+    context->flags |= AVFMT_FLAG_NOBUFFER;
+    context->probesize = LIVE_PROBE_SIZE;
+    context->max_analyze_duration = LIVE_ANALYZE_US;
+    context->fps_probe_size = 0;   // Do not wait for frames to estimate the rate
+
+    int ret = avformat_open_input(&context, strcmp(filename, "-") == 0 ? "pipe:0" : filename, NULL, NULL);
+    if (ret >= 0) {
+        *format_context = context;
+    }
+    return ret;
+}
+
+/*
+  Function ioOpenInput
+  drop-in replacement for avformat_open_input. Regular files get a
+  custom AVIOContext (mmap or counted read) unless IO_MODE_FFMPEG is
+  requested; anything else (pipes, URLs) falls back to FFmpeg.
+  IO_MODE_LIVE inputs go to ioOpenLive.
+*/
+int ioOpenInput(AVFormatContext **format_context, const char *filename, IOMode mode) {
+    struct stat st;
+    int fd = -1;
+
+    if (mode == IO_MODE_LIVE) {
+        return ioOpenLive(format_context, filename);
+    }
+    if (mode != IO_MODE_FFMPEG) {
+        fd = open(filename, O_RDONLY | O_CLOEXEC);
+    }
+    if (fd < 0 || fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        return avformat_open_input(format_context, filename, NULL, NULL);
+    }
+
+    IOReader *reader = calloc(1, sizeof(IOReader));
+    if (!reader) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        close(fd);
+        return AVERROR(ENOMEM);
+    }
+    reader->fd = -1;
+    reader->size = st.st_size;
+
+    if (mode == IO_MODE_MMAP) {
+        reader->map = mappedFileAcquire(fd, &st);
+        close(fd);
+        if (!reader->map) {
+            fprintf(stderr, "Warning: mmap of '%s' failed, using FFmpeg file I/O\n", filename);
+            free(reader);
+            return avformat_open_input(format_context, filename, NULL, NULL);
+        }
+    } else {
+        reader->fd = fd;
+    }
+    io_stats_mode = mode;
+
+    uint8_t *buffer = av_malloc(IO_BUFFER_SIZE);
+    AVIOContext *pb = avio_alloc_context(buffer, IO_BUFFER_SIZE, 0, reader,
+                                         mode == IO_MODE_MMAP ? mmapRead : fileRead, NULL,
+                                         mode == IO_MODE_MMAP ? mmapSeek : fileSeek);
+    AVFormatContext *context = avformat_alloc_context();
+    if (!buffer || !pb || !context) {
+        avformat_free_context(context);
+        if (pb) {
+            av_freep(&pb->buffer);
+            avio_context_free(&pb);
+        } else {
+            av_free(buffer);
+        }
+        ioReaderFree(reader);
+        return AVERROR(ENOMEM);
+    }
+
+    context->pb = pb;
+    context->flags |= AVFMT_FLAG_CUSTOM_IO;
+
+    int ret = avformat_open_input(&context, filename, NULL, NULL);
+    if (ret < 0) {
+        // avformat_open_input frees the context on failure but never a custom pb
+        av_freep(&pb->buffer);
+        avio_context_free(&pb);
+        ioReaderFree(reader);
+        return ret;
+    }
+
+    *format_context = context;
+    return ret;
+}
+
+void ioCloseInput(AVFormatContext **format_context) {
+    if (!*format_context) {
+        return;
+    }
+
+    AVIOContext *pb = (*format_context)->pb;
+    bool custom_io = ((*format_context)->flags & AVFMT_FLAG_CUSTOM_IO) != 0;
+    avformat_close_input(format_context);
+
+    if (custom_io && pb) {
+        IOReader *reader = pb->opaque;
+        av_freep(&pb->buffer);
+        avio_context_free(&pb);
+        ioReaderFree(reader);
+    }
+}
+
+void ioGetStats(IOStats *stats) {
+    stats->read_calls = __atomic_load_n(&io_stats.read_calls, __ATOMIC_RELAXED);
+    stats->seek_calls = __atomic_load_n(&io_stats.seek_calls, __ATOMIC_RELAXED);
+    stats->madvise_calls = __atomic_load_n(&io_stats.madvise_calls, __ATOMIC_RELAXED);
+    stats->map_calls = __atomic_load_n(&io_stats.map_calls, __ATOMIC_RELAXED);
+    stats->callbacks = __atomic_load_n(&io_stats.callbacks, __ATOMIC_RELAXED);
+    stats->bytes = __atomic_load_n(&io_stats.bytes, __ATOMIC_RELAXED);
+    stats->busy_ns = __atomic_load_n(&io_stats.busy_ns, __ATOMIC_RELAXED);
+}
+
+void ioPrintStats(FILE *out) {
+    IOStats stats;
+    struct rusage usage;
+
+    ioGetStats(&stats);
+    if (stats.callbacks == 0) {
+        return;  // FFmpeg did the I/O itself, nothing was counted
+    }
+    getrusage(RUSAGE_SELF, &usage);
+
+    double mb = stats.bytes / (1024.0 * 1024.0);
+    double ms = stats.busy_ns / 1e6;
+    fprintf(out, "I/O (%s): %.1f MB in %llu callbacks, %.2f ms inside reads (%.0f MB/s)\n",
+            ioModeName(io_stats_mode), mb, (unsigned long long)stats.callbacks, ms,
+            ms > 0 ? mb / (ms / 1000.0) : 0.0);
+    fprintf(out, "I/O syscalls: %llu read, %llu lseek, %llu mmap, %llu madvise; page faults: %ld minor, %ld major\n",
+            (unsigned long long)stats.read_calls, (unsigned long long)stats.seek_calls,
+            (unsigned long long)stats.map_calls, (unsigned long long)stats.madvise_calls,
+            usage.ru_minflt, usage.ru_majflt);
+}
@@ -0,0 +1,37 @@
+#ifndef MMAPIO_H
+#define MMAPIO_H
+
+#include <libavformat/avformat.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// How the demuxers get at the bytes of the input file
+typedef enum {
+    IO_MODE_MMAP,    // Shared mmap() of the file, madvise() windows follow the reader
+    IO_MODE_READ,    // read()/lseek() backed AVIOContext, same pattern as FFmpeg's file protocol
+    IO_MODE_FFMPEG,  // Let FFmpeg open the URL itself (pipes, network, ...)
+    IO_MODE_LIVE     // FFmpeg I/O for stdin ("-") and FIFOs: minimal probing, no demuxer buffering
+} IOMode;
+
+// Counters shared by every AVIOContext opened through ioOpenInput
+typedef struct {
+    uint64_t read_calls;     // read() syscalls (IO_MODE_READ)
+    uint64_t seek_calls;     // lseek() syscalls (IO_MODE_READ)
+    uint64_t madvise_calls;  // madvise() syscalls (IO_MODE_MMAP)
+    uint64_t map_calls;      // mmap() syscalls (IO_MODE_MMAP)
+    uint64_t callbacks;      // AVIOContext read callbacks
+    uint64_t bytes;          // Bytes handed to the demuxers
+    uint64_t busy_ns;        // Time spent inside the read callbacks
+} IOStats;
+
+IOMode ioParseMode(const char *name);
+const char *ioModeName(IOMode mode);
+
+int ioOpenInput(AVFormatContext **format_context, const char *filename, IOMode mode);
+void ioCloseInput(AVFormatContext **format_context);
+
+void ioGetStats(IOStats *stats);
+void ioPrintStats(FILE *out);
+
+#endif // MMAPIO_H
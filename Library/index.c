@@ -0,0 +1,158 @@
+#include "index.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+  Function indexValid
+  checks that everything the header and records point at lies inside
+  the mapping and that every path is NUL-terminated where its length
+  says, so lookups never read past the file. Sizes are compared by
+  subtraction so corrupt 64-bit values cannot wrap around.
+*/
+static bool indexValid(const LibraryHeader *header, size_t map_size) {
+    uint64_t records_end = sizeof(LibraryHeader) + (uint64_t)header->record_count * sizeof(LibraryRecord);
+    if (memcmp(header->magic, LIBRARY_MAGIC, 8) != 0 || header->version != LIBRARY_VERSION ||
+        records_end > map_size || header->strings_offset < records_end || header->strings_offset > map_size ||
+        header->strings_size > map_size - header->strings_offset) {
+        return false;
+    }
+    const LibraryRecord *records = (const LibraryRecord *)(header + 1);
+    const char *strings = (const char *)header + header->strings_offset;
+    for (uint32_t i = 0; i < header->record_count; i++) {
+        const LibraryRecord *record = &records[i];
+        if (record->path_offset >= header->strings_size ||
+            record->path_length >= header->strings_size - record->path_offset ||
+            strings[record->path_offset + record->path_length] != '\0') {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Maps an existing index; a missing, foreign or damaged file just yields an empty index
+bool libraryIndexOpen(LibraryIndex *index, const char *path) {
+    struct stat st;
+
+    memset(index, 0, sizeof(LibraryIndex));
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(LibraryHeader)) {
+        close(fd);
+        return false;
+    }
+
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return false;
+    }
+
+    const LibraryHeader *header = map;
+    if (!indexValid(header, st.st_size)) {
+        fprintf(stderr, "Warning: Ignoring incompatible or damaged index '%s'\n", path);
+        munmap(map, st.st_size);
+        return false;
+    }
+
+    index->map = map;
+    index->map_size = st.st_size;
+    index->header = header;
+    index->records = (const LibraryRecord *)(header + 1);
+    index->strings = (const char *)map + header->strings_offset;
+    return true;
+}
+
+void libraryIndexClose(LibraryIndex *index) {
+    if (index->map) {
+        munmap(index->map, index->map_size);
+    }
+    memset(index, 0, sizeof(LibraryIndex));
+}
+
+const char *libraryRecordPath(const LibraryIndex *index, const LibraryRecord *record) {
+    return index->strings + record->path_offset;
+}
+
+// Binary search over the sorted records, directly on the mapping
+const LibraryRecord *libraryIndexFind(const LibraryIndex *index, const char *path) {
+    if (!index->header) {
+        return NULL;
+    }
+
+    int low = 0, high = (int)index->header->record_count - 1;
+    while (low <= high) {
+        int mid = low + (high - low) / 2;
+        int cmp = strcmp(path, libraryRecordPath(index, &index->records[mid]));
+        if (cmp == 0) {
+            return &index->records[mid];
+        }
+        if (cmp < 0) {
+            high = mid - 1;
+        } else {
+            low = mid + 1;
+        }
+    }
+    return NULL;
+}
+
+static int compareEntries(const void *a, const void *b) {
+    return strcmp(((const LibraryEntry *)a)->path, ((const LibraryEntry *)b)->path);
+}
+
+/*
+  Function libraryIndexWrite
+  sorts entries by path and writes them next to path, then renames
+  the result into place so readers never see a half-written index.
+*/
+bool libraryIndexWrite(const char *path, LibraryEntry *entries, int count) {
+    qsort(entries, count, sizeof(LibraryEntry), compareEntries);
+
+    LibraryHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, LIBRARY_MAGIC, 8);
+    header.version = LIBRARY_VERSION;
+    header.record_count = count;
+    header.strings_offset = sizeof(LibraryHeader) + (uint64_t)count * sizeof(LibraryRecord);
+
+    LibraryRecord *records = malloc((size_t)count * sizeof(LibraryRecord) + 1);
+    for (int i = 0; i < count; i++) {
+        records[i] = entries[i].record;
+        records[i].path_length = strlen(entries[i].path);
+        records[i].path_offset = header.strings_size;
+        header.strings_size += records[i].path_length + 1;
+    }
+
+    size_t tmp_length = strlen(path) + 5;
+    char *tmp_path = malloc(tmp_length);
+    snprintf(tmp_path, tmp_length, "%s.tmp", path);
+
+    FILE *file = fopen(tmp_path, "wb");
+    bool ok = file != NULL;
+    if (ok) {
+        ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+             fwrite(records, sizeof(LibraryRecord), count, file) == (size_t)count;
+        for (int i = 0; ok && i < count; i++) {
+            ok = fwrite(entries[i].path, 1, records[i].path_length + 1, file) == records[i].path_length + 1;
+        }
+        ok = fclose(file) == 0 && ok;
+    }
+    if (ok && rename(tmp_path, path) < 0) {
+        ok = false;
+    }
+    if (!ok) {
+        fprintf(stderr, "Error: Could not write index '%s'\n", path);
+        unlink(tmp_path);
+    }
+
+    free(tmp_path);
+    free(records);
+    return ok;
+}
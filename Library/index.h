@@ -0,0 +1,67 @@
+#ifndef LIBRARY_INDEX_H
+#define LIBRARY_INDEX_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+  On-disk layout, little-endian, meant to be mmap()ed and used in place:
+    LibraryHeader
+    LibraryRecord[record_count]   sorted by path (byte order)
+    char strings[strings_size]    NUL-terminated paths
+*/
+#define LIBRARY_MAGIC "MPLIDX01"
+#define LIBRARY_VERSION 1
+
+#define LIBRARY_PROBE_FAILED 0x1   // Not a media file (kept so re-scans skip it)
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t record_count;
+    uint64_t strings_offset;
+    uint64_t strings_size;
+} LibraryHeader;
+
+typedef struct {
+    uint64_t path_offset;          // Into the string table
+    uint32_t path_length;
+    uint32_t flags;
+    int64_t mtime_ns;              // Change detection, together with file_size
+    uint64_t file_size;
+    int64_t duration_us;
+    uint32_t video_codec;          // enum AVCodecID of the first stream of each type
+    uint32_t audio_codec;
+    uint16_t width, height;
+    uint32_t sample_rate;
+    uint8_t stream_count;
+    uint8_t video_streams, audio_streams, subtitle_streams;
+    uint8_t channels;
+    uint8_t reserved[3];
+} LibraryRecord;
+
+_Static_assert(sizeof(LibraryRecord) == 64, "LibraryRecord is part of the file format");
+
+// A record together with its path, before it is written out
+typedef struct {
+    char *path;
+    LibraryRecord record;
+} LibraryEntry;
+
+// Read-only view of an index file
+typedef struct {
+    void *map;
+    size_t map_size;
+    const LibraryHeader *header;
+    const LibraryRecord *records;
+    const char *strings;
+} LibraryIndex;
+
+bool libraryIndexOpen(LibraryIndex *index, const char *path);
+void libraryIndexClose(LibraryIndex *index);
+const LibraryRecord *libraryIndexFind(const LibraryIndex *index, const char *path);
+const char *libraryRecordPath(const LibraryIndex *index, const LibraryRecord *record);
+bool libraryIndexWrite(const char *path, LibraryEntry *entries, int count);
+
+#endif // LIBRARY_INDEX_H
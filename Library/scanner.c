@@ -0,0 +1,255 @@
+#include "scanner.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <libavformat/avformat.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "../Util/parallel.h"
+
+// Enough to identify streams and codec parameters of well-formed files
+#define SCAN_PROBESIZE (256 * 1024)
+#define SCAN_ANALYZE_DURATION (AV_TIME_BASE / 2)
+
+typedef struct {
+    LibraryEntry *entries;
+    int count, capacity;
+    int *to_probe;             // Indexes into entries
+    int probe_count;
+    const LibraryIndex *old_index;
+    const char *index_path;
+    char temp_path[PATH_MAX + 8];   // Where libraryIndexWrite puts the new index before renaming it
+    bool out_of_memory;        // Walk stopped early, the index must not be written
+    int matched;               // Entries that had a record in the old index
+    int reused;
+    IOMode io_mode;
+} Scan;
+
+static double scanNow() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+  Function libraryProbe
+  fills record with what the player needs to know about a file,
+  using a reduced probesize/analyzeduration so each probe touches
+  only the start of the file.
+*/
+bool libraryProbe(const char *path, IOMode io_mode, LibraryRecord *record) {
+    AVFormatContext *format_context = NULL;
+
+    if (ioOpenInput(&format_context, path, io_mode) < 0) {
+        record->flags |= LIBRARY_PROBE_FAILED;
+        return false;
+    }
+    format_context->probesize = SCAN_PROBESIZE;
+    format_context->max_analyze_duration = SCAN_ANALYZE_DURATION;
+
+    if (avformat_find_stream_info(format_context, NULL) < 0) {
+        record->flags |= LIBRARY_PROBE_FAILED;
+        ioCloseInput(&format_context);
+        return false;
+    }
+
+    record->duration_us = format_context->duration != AV_NOPTS_VALUE ? format_context->duration : -1;
+    record->stream_count = FFMIN(format_context->nb_streams, 255);
+
+    for (int i = 0; i < format_context->nb_streams; i++) {
+        const AVCodecParameters *par = format_context->streams[i]->codecpar;
+        switch (par->codec_type) {
+            case AVMEDIA_TYPE_VIDEO:
+                if (format_context->streams[i]->disposition & AV_DISPOSITION_ATTACHED_PIC) {
+                    break;  // Cover art is not a video track
+                }
+                if (record->video_streams++ == 0) {
+                    record->video_codec = par->codec_id;
+                    record->width = par->width;
+                    record->height = par->height;
+                }
+                break;
+            case AVMEDIA_TYPE_AUDIO:
+                if (record->audio_streams++ == 0) {
+                    record->audio_codec = par->codec_id;
+                    record->sample_rate = par->sample_rate;
+                    record->channels = par->channels;
+                }
+                break;
+            case AVMEDIA_TYPE_SUBTITLE:
+                record->subtitle_streams++;
+                break;
+            default:
+                break;
+        }
+    }
+
+    if (record->video_streams == 0 && record->audio_streams == 0) {
+        record->flags |= LIBRARY_PROBE_FAILED;
+    }
+    ioCloseInput(&format_context);
+    return !(record->flags & LIBRARY_PROBE_FAILED);
+}
+
+static bool scanAddFile(Scan *scan, const char *path, const struct stat *st) {
+    if (scan->count == scan->capacity) {
+        int capacity = scan->capacity ? scan->capacity * 2 : 1024;
+        LibraryEntry *entries = realloc(scan->entries, capacity * sizeof(LibraryEntry));
+        if (entries) {
+            scan->entries = entries;
+        }
+        int *to_probe = entries ? realloc(scan->to_probe, capacity * sizeof(int)) : NULL;
+        if (!to_probe) {
+            fprintf(stderr, "Error: Memory allocation failed after %d files\n", scan->count);
+            return false;
+        }
+        scan->to_probe = to_probe;
+        scan->capacity = capacity;
+    }
+
+    LibraryEntry *entry = &scan->entries[scan->count];
+    entry->path = strdup(path);
+    if (!entry->path) {
+        fprintf(stderr, "Error: Memory allocation failed after %d files\n", scan->count);
+        return false;
+    }
+    memset(&entry->record, 0, sizeof(LibraryRecord));
+    entry->record.mtime_ns = (int64_t)st->st_mtim.tv_sec * 1000000000 + st->st_mtim.tv_nsec;
+    entry->record.file_size = st->st_size;
+
+    const LibraryRecord *old = libraryIndexFind(scan->old_index, path);
+    if (old) {
+        scan->matched++;
+    }
+    if (old && old->mtime_ns == entry->record.mtime_ns && old->file_size == entry->record.file_size) {
+        entry->record = *old;
+        scan->reused++;
+    } else {
+        scan->to_probe[scan->probe_count++] = scan->count;
+    }
+    scan->count++;
+    return true;
+}
+
+/*
+  Function scanDirectory
+  depth-first walk; fstatat on the directory fd keeps path lookups
+  short. Symlinks to files are indexed, symlinks to directories are
+  not followed: one pointing at an ancestor would recurse forever.
+  The index itself and its temporary file are left out. Stops as soon
+  as a file cannot be added.
+*/
+static void scanDirectory(Scan *scan, const char *dir_path) {
+    DIR *dir = opendir(dir_path);
+    if (!dir) {
+        fprintf(stderr, "Warning: Could not open directory '%s'\n", dir_path);
+        return;
+    }
+
+    char path[PATH_MAX];
+    struct dirent *item;
+    while (!scan->out_of_memory && (item = readdir(dir)) != NULL) {
+        struct stat st;
+
+        if (item->d_name[0] == '.') {
+            continue;  // Hidden files, "." and ".."
+        }
+        if (snprintf(path, sizeof(path), "%s/%s", dir_path, item->d_name) >= (int)sizeof(path)) {
+            continue;
+        }
+        if (fstatat(dirfd(dir), item->d_name, &st, AT_SYMLINK_NOFOLLOW) < 0) {
+            continue;
+        }
+        if (S_ISLNK(st.st_mode) && (fstatat(dirfd(dir), item->d_name, &st, 0) < 0 || S_ISDIR(st.st_mode))) {
+            continue;   // Dangling, or a directory reached through a link
+        }
+
+        if (S_ISDIR(st.st_mode)) {
+            scanDirectory(scan, path);
+        } else if (S_ISREG(st.st_mode) && strcmp(path, scan->index_path) != 0 && strcmp(path, scan->temp_path) != 0) {
+            scan->out_of_memory = !scanAddFile(scan, path, &st);
+        }
+    }
+    closedir(dir);
+}
+
+static void scanProbeTask(int index, void *context) {
+    Scan *scan = context;
+    LibraryEntry *entry = &scan->entries[scan->to_probe[index]];
+    libraryProbe(entry->path, scan->io_mode, &entry->record);
+}
+
+/*
+  Function libraryScan
+  brings the index at index_path up to date with the files under roots.
+  Unchanged files are carried over from the mapped old index without
+  being opened; only new or modified files are probed, in parallel.
+*/
+bool libraryScan(const char *index_path, char *const *roots, int root_count,
+                 int threads, IOMode io_mode, ScanStats *stats) {
+    LibraryIndex old_index;
+    Scan scan;
+    char resolved[PATH_MAX];
+    char index_resolved[PATH_MAX];
+
+    memset(&scan, 0, sizeof(scan));
+    memset(stats, 0, sizeof(ScanStats));
+    libraryIndexOpen(&old_index, index_path);
+    scan.old_index = &old_index;
+    scan.io_mode = io_mode;
+
+    // Compare against the absolute index path so the index never indexes itself
+    if (realpath(index_path, index_resolved)) {
+        scan.index_path = index_resolved;
+    } else {
+        scan.index_path = index_path;
+    }
+    snprintf(scan.temp_path, sizeof(scan.temp_path), "%s.tmp", scan.index_path);
+
+    double start = scanNow();
+    for (int i = 0; i < root_count; i++) {
+        if (!realpath(roots[i], resolved)) {
+            fprintf(stderr, "Warning: Skipping '%s'\n", roots[i]);
+            continue;
+        }
+        scanDirectory(&scan, resolved);
+    }
+    stats->walk_seconds = scanNow() - start;
+    if (scan.out_of_memory) {
+        scan.probe_count = 0;   // Nothing is probed or written for a partial walk
+    }
+
+    start = scanNow();
+    parallelFor(scan.probe_count, threads, scanProbeTask, &scan);
+    stats->probe_seconds = scanNow() - start;
+
+    stats->files = scan.count;
+    stats->reused = scan.reused;
+    stats->probed = scan.probe_count;
+    for (int i = 0; i < scan.probe_count; i++) {
+        stats->failed += (scan.entries[scan.to_probe[i]].record.flags & LIBRARY_PROBE_FAILED) != 0;
+    }
+    stats->removed = old_index.header ? (int)old_index.header->record_count - scan.matched : 0;
+
+    // Nothing changed: keep the existing file as is
+    bool ok = !scan.out_of_memory;
+    start = scanNow();
+    if (ok && (scan.probe_count > 0 || stats->removed > 0 || !old_index.header)) {
+        libraryIndexClose(&old_index);
+        ok = libraryIndexWrite(index_path, scan.entries, scan.count);
+    }
+    stats->write_seconds = scanNow() - start;
+
+    libraryIndexClose(&old_index);
+    for (int i = 0; i < scan.count; i++) {
+        free(scan.entries[i].path);
+    }
+    free(scan.entries);
+    free(scan.to_probe);
+    return ok;
+}
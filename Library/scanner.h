@@ -0,0 +1,21 @@
+#ifndef LIBRARY_SCANNER_H
+#define LIBRARY_SCANNER_H
+
+#include <stdbool.h>
+#include "index.h"
+#include "../IO/mmapio.h"
+
+typedef struct {
+    int files;         // Regular files found under the roots
+    int reused;        // Unchanged since the last scan (mtime and size match)
+    int probed;        // New or modified, probed with FFmpeg
+    int failed;        // Probed but not media
+    int removed;       // In the old index but gone from disk
+    double walk_seconds, probe_seconds, write_seconds;
+} ScanStats;
+
+bool libraryProbe(const char *path, IOMode io_mode, LibraryRecord *record);
+bool libraryScan(const char *index_path, char *const *roots, int root_count,
+                 int threads, IOMode io_mode, ScanStats *stats);
+
+#endif // LIBRARY_SCANNER_H
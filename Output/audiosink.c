@@ -0,0 +1,217 @@
+#include "audiosink.h"
+
+#include <pulse/error.h>
+#include <string.h>
+#include <time.h>
+#include "../Decoding/clock.h"
+
+#define PACED_SINK_BUFFER 0.1     // Seconds a paced null/WAV sink accepts ahead of real time
+#define VIRTUAL_SINK_BUFFER 0.1   // Same for the virtual device, in virtual time
+
+static double sinkNow() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// spec: pulse, null or wav:FILE
+bool audioSinkParse(const char *spec, AudioSinkConfig *config) {
+    config->path = NULL;
+    if (strcmp(spec, "pulse") == 0) {
+        config->kind = AUDIO_SINK_PULSE;
+    } else if (strcmp(spec, "null") == 0) {
+        config->kind = AUDIO_SINK_NULL;
+    } else if (strncmp(spec, "wav:", 4) == 0 && spec[4]) {
+        config->kind = AUDIO_SINK_WAV;
+        config->path = spec + 4;
+    } else {
+        fprintf(stderr, "Error: Unknown audio sink '%s' (pulse, null or wav:FILE)\n", spec);
+        return false;
+    }
+    return true;
+}
+
+const char *audioSinkName(AudioSinkKind kind) {
+    switch (kind) {
+        case AUDIO_SINK_PULSE: return "pulse";
+        case AUDIO_SINK_NULL: return "null";
+        case AUDIO_SINK_WAV: return "wav";
+        default: return "virtual";
+    }
+}
+
+bool audioSinkOpen(AudioSink *sink, const AudioSinkConfig *config, int sample_rate, int channels) {
+    memset(sink, 0, sizeof(AudioSink));
+    sink->config = *config;
+    sink->sample_rate = sample_rate;
+    sink->channels = channels;
+    sink->wall_start = sinkNow();
+
+    switch (config->kind) {
+        case AUDIO_SINK_PULSE: {
+            pa_sample_spec sample_spec = {
+                .format = PA_SAMPLE_S16LE,
+                .rate = sample_rate,
+                .channels = channels,
+            };
+            // A short target keeps the server from queueing seconds of audio ahead of live video
+            uint32_t target = (uint32_t)(config->latency * sample_rate) * channels * 2;
+            pa_buffer_attr attr = {
+                .maxlength = (uint32_t)-1,
+                .tlength = target,
+                .prebuf = (uint32_t)-1,
+                .minreq = (uint32_t)-1,
+                .fragsize = (uint32_t)-1,
+            };
+            int pulse_error;
+            sink->pulse = pa_simple_new(NULL, "MediaPlayer", PA_STREAM_PLAYBACK, NULL, "Audio", &sample_spec,
+                                        NULL, target > 0 ? &attr : NULL, &pulse_error);
+            if (!sink->pulse) {
+                fprintf(stderr, "Error: PulseAudio initialization failed: %s\n", pa_strerror(pulse_error));
+                return false;
+            }
+            return true;
+        }
+        case AUDIO_SINK_WAV:
+            sink->file = strcmp(config->path, "-") == 0 ? stdout : fopen(config->path, "wb");
+            if (!sink->file || !wavWriterOpen(&sink->wav, sink->file, sample_rate, channels)) {
+                fprintf(stderr, "Error: Could not write audio to '%s'\n", config->path);
+                if (sink->file && sink->file != stdout) {
+                    fclose(sink->file);
+                }
+                sink->file = NULL;
+                return false;
+            }
+            return true;
+        default:
+            return true;
+    }
+}
+
+/*
+  Function audioSinkPace
+  makes a null or WAV sink consume samples like a sound card: writes
+  block once more than PACED_SINK_BUFFER is queued ahead of real time.
+  After an underrun (pause, stall) the device restarts from now.
+*/
+static void audioSinkPace(AudioSink *sink) {
+    double now = sinkNow();
+    if (sink->start == 0.0 || now - sink->start > sink->written) {
+        sink->start = now - sink->written;
+    }
+
+    double ahead = sink->written - (now - sink->start);
+    if (ahead > PACED_SINK_BUFFER) {
+        double wait = ahead - PACED_SINK_BUFFER;
+        struct timespec ts = {(time_t)wait, (long)((wait - (time_t)wait) * 1e9)};
+        nanosleep(&ts, NULL);
+    }
+}
+
+// false when the samples could not be played or the virtual clock was interrupted
+bool audioSinkWrite(AudioSink *sink, const uint8_t *samples, int count, double pts) {
+    size_t bytes = (size_t)count * sink->channels * sizeof(int16_t);
+    double duration = (double)count / sink->sample_rate;
+    bool paced = !sink->config.fast && (sink->config.kind == AUDIO_SINK_NULL || sink->config.kind == AUDIO_SINK_WAV);
+    bool ok = true;
+
+    if (paced) {
+        audioSinkPace(sink);
+    }
+    if (sink->config.kind == AUDIO_SINK_VIRTUAL && !clockWaitVirtual(pts + duration - VIRTUAL_SINK_BUFFER)) {
+        return false;
+    }
+    if (sink->config.tap) {
+        sink->config.tap((const int16_t *)samples, count, pts, sink->config.tap_context);
+    }
+
+    switch (sink->config.kind) {
+        case AUDIO_SINK_PULSE: {
+            int pulse_error;
+            if (pa_simple_write(sink->pulse, samples, bytes, &pulse_error) < 0) {
+                fprintf(stderr, "Error: PulseAudio write failed: %s\n", pa_strerror(pulse_error));
+                ok = false;
+            }
+            break;
+        }
+        case AUDIO_SINK_WAV:
+            ok = wavWriterWrite(&sink->wav, samples, bytes);
+            if (!ok) {
+                fprintf(stderr, "Error: Could not write audio to '%s'\n", sink->config.path);
+            }
+            break;
+        case AUDIO_SINK_VIRTUAL:
+            clockAudioWritten(pts + duration);
+            break;
+        default:
+            break;
+    }
+
+    if (ok) {
+        sink->written += duration;
+        sink->end = pts + duration;
+    }
+    return ok;
+}
+
+/*
+  Function audioSinkLatency
+  returns the seconds written but not heard yet, negative when the
+  device cannot tell. A fast sink plays everything the moment it is
+  written.
+*/
+double audioSinkLatency(AudioSink *sink) {
+    switch (sink->config.kind) {
+        case AUDIO_SINK_PULSE: {
+            int pulse_error;
+            pa_usec_t latency = pa_simple_get_latency(sink->pulse, &pulse_error);
+            return latency == (pa_usec_t)-1 ? -1.0 : latency / 1e6;
+        }
+        case AUDIO_SINK_VIRTUAL: {
+            double queued = sink->end - clockVirtualNow();
+            return queued > 0.0 ? queued : 0.0;
+        }
+        default: {
+            if (sink->config.fast || sink->start == 0.0) {
+                return 0.0;
+            }
+            double queued = sink->written - (sinkNow() - sink->start);
+            return queued > 0.0 ? queued : 0.0;
+        }
+    }
+}
+
+// Plays out what is queued, then releases the device
+void audioSinkClose(AudioSink *sink) {
+    int pulse_error;
+
+    switch (sink->config.kind) {
+        case AUDIO_SINK_PULSE:
+            if (sink->pulse) {
+                if (pa_simple_drain(sink->pulse, &pulse_error) < 0) {
+                    fprintf(stderr, "Error: PulseAudio drain failed: %s\n", pa_strerror(pulse_error));
+                }
+                pa_simple_free(sink->pulse);
+                sink->pulse = NULL;
+            }
+            return;
+        case AUDIO_SINK_WAV:
+            if (sink->file) {
+                wavWriterClose(&sink->wav);
+                if (sink->file != stdout) {
+                    fclose(sink->file);
+                }
+                sink->file = NULL;
+            }
+            break;
+        default:
+            break;
+    }
+
+    if (sink->config.kind != AUDIO_SINK_VIRTUAL) {
+        double wall = sinkNow() - sink->wall_start;
+        fprintf(stderr, "Audio sink %s%s: %.2fs of audio in %.2fs (%.1fx realtime)\n",
+                audioSinkName(sink->config.kind), sink->config.fast ? " (fast)" : "",
+                sink->written, wall, wall > 0 ? sink->written / wall : 0.0);
+    }
+}
@@ -0,0 +1,50 @@
+#ifndef AUDIOSINK_H
+#define AUDIOSINK_H
+
+#include <pulse/simple.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "../Export/wav.h"
+
+// Where decoded audio goes
+typedef enum {
+    AUDIO_SINK_PULSE,     // PulseAudio playback stream
+    AUDIO_SINK_NULL,      // Discards samples, paced like a sound card unless fast
+    AUDIO_SINK_WAV,       // 16-bit WAV capture of exactly what would be played
+    AUDIO_SINK_VIRTUAL    // Plays on the virtual clock (headless regression runs)
+} AudioSinkKind;
+
+// Receives every chunk written to a sink (interleaved signed 16-bit)
+typedef void (*AudioTap)(const int16_t *samples, int count, double pts, void *context);
+
+typedef struct {
+    AudioSinkKind kind;
+    const char *path;     // WAV output, "-" for stdout
+    bool fast;            // Null and WAV: take samples as fast as they come instead of in real time
+    AudioTap tap;
+    void *tap_context;
+    double latency;       // Pulse: target buffering in seconds, 0 leaves it to the server (~2 s)
+} AudioSinkConfig;
+
+typedef struct {
+    AudioSinkConfig config;
+    int sample_rate, channels;
+    pa_simple *pulse;
+    FILE *file;
+    WavWriter wav;
+    double start;         // Monotonic time the paced device started playing, 0 before the first write
+    double written;       // Seconds of audio handed to the sink
+    double end;           // Stream time where the last chunk ended
+    double wall_start;
+} AudioSink;
+
+bool audioSinkParse(const char *spec, AudioSinkConfig *config);
+const char *audioSinkName(AudioSinkKind kind);
+
+bool audioSinkOpen(AudioSink *sink, const AudioSinkConfig *config, int sample_rate, int channels);
+bool audioSinkWrite(AudioSink *sink, const uint8_t *samples, int count, double pts);
+double audioSinkLatency(AudioSink *sink);
+void audioSinkClose(AudioSink *sink);
+
+#endif // AUDIOSINK_H
@@ -0,0 +1,339 @@
+#include "spectrum.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../Stats/stats.h"
+#include "../Stats/trace.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SPECTRUM_X86 1
+#endif
+
+#define SPECTRUM_LOW_HZ 40.0
+#define SPECTRUM_HIGH_HZ 16000.0
+#define SPECTRUM_FALL_DB 60.0f        // Per second, bars and meters
+#define SPECTRUM_PEAK_FALL_DB 20.0f   // Per second, the marks above the bars
+#define SPECTRUM_MAX_STEP 0.1         // Seconds of falloff applied at most between two analyses
+
+SpectrumAnalyzer spectrumAnalyzer;
+
+/*
+  One radix-2 pass over n points: butterflies of span half, with the
+  twiddles of that span laid out contiguously.
+*/
+typedef void (*FftStage)(float *re, float *im, const float *wr, const float *wi, int n, int half);
+
+static void fftStageScalar(float *re, float *im, const float *wr, const float *wi, int n, int half) {
+    for (int start = 0; start < n; start += 2 * half) {
+        float *ar = re + start, *ai = im + start, *br = ar + half, *bi = ai + half;
+        for (int k = 0; k < half; k++) {
+            float tr = wr[k] * br[k] - wi[k] * bi[k];
+            float ti = wr[k] * bi[k] + wi[k] * br[k];
+            br[k] = ar[k] - tr;
+            bi[k] = ai[k] - ti;
+            ar[k] = ar[k] + tr;
+            ai[k] = ai[k] + ti;
+        }
+    }
+}
+
+#ifdef SPECTRUM_X86
+__attribute__((target("sse4.1")))
+static void fftStageSse41(float *re, float *im, const float *wr, const float *wi, int n, int half) {
+    for (int start = 0; start < n; start += 2 * half) {
+        float *ar = re + start, *ai = im + start, *br = ar + half, *bi = ai + half;
+        for (int k = 0; k < half; k += 4) {
+            __m128 w_r = _mm_loadu_ps(wr + k), w_i = _mm_loadu_ps(wi + k);
+            __m128 b_r = _mm_loadu_ps(br + k), b_i = _mm_loadu_ps(bi + k);
+            __m128 a_r = _mm_loadu_ps(ar + k), a_i = _mm_loadu_ps(ai + k);
+            __m128 t_r = _mm_sub_ps(_mm_mul_ps(w_r, b_r), _mm_mul_ps(w_i, b_i));
+            __m128 t_i = _mm_add_ps(_mm_mul_ps(w_r, b_i), _mm_mul_ps(w_i, b_r));
+            _mm_storeu_ps(br + k, _mm_sub_ps(a_r, t_r));
+            _mm_storeu_ps(bi + k, _mm_sub_ps(a_i, t_i));
+            _mm_storeu_ps(ar + k, _mm_add_ps(a_r, t_r));
+            _mm_storeu_ps(ai + k, _mm_add_ps(a_i, t_i));
+        }
+    }
+}
+
+__attribute__((target("avx2")))
+static void fftStageAvx2(float *re, float *im, const float *wr, const float *wi, int n, int half) {
+    for (int start = 0; start < n; start += 2 * half) {
+        float *ar = re + start, *ai = im + start, *br = ar + half, *bi = ai + half;
+        for (int k = 0; k < half; k += 8) {
+            __m256 w_r = _mm256_loadu_ps(wr + k), w_i = _mm256_loadu_ps(wi + k);
+            __m256 b_r = _mm256_loadu_ps(br + k), b_i = _mm256_loadu_ps(bi + k);
+            __m256 a_r = _mm256_loadu_ps(ar + k), a_i = _mm256_loadu_ps(ai + k);
+            __m256 t_r = _mm256_sub_ps(_mm256_mul_ps(w_r, b_r), _mm256_mul_ps(w_i, b_i));
+            __m256 t_i = _mm256_add_ps(_mm256_mul_ps(w_r, b_i), _mm256_mul_ps(w_i, b_r));
+            _mm256_storeu_ps(br + k, _mm256_sub_ps(a_r, t_r));
+            _mm256_storeu_ps(bi + k, _mm256_sub_ps(a_i, t_i));
+            _mm256_storeu_ps(ar + k, _mm256_add_ps(a_r, t_r));
+            _mm256_storeu_ps(ai + k, _mm256_add_ps(a_i, t_i));
+        }
+    }
+}
+#endif
+
+// Spans narrower than a vector stay scalar; there are no AVX-512 passes
+#define SPECTRUM_MAX_LEVEL CPU_AVX2
+static const FftStage fft_stages[CPU_LEVEL_COUNT] = {
+    [CPU_SCALAR] = fftStageScalar,
+#ifdef SPECTRUM_X86
+    [CPU_SSE41] = fftStageSse41,
+    [CPU_AVX2] = fftStageAvx2,
+#endif
+};
+static const int fft_lanes[CPU_LEVEL_COUNT] = {[CPU_SCALAR] = 1, [CPU_SSE41] = 4, [CPU_AVX2] = 8};
+
+/*
+  Function spectrumFft
+  in-place forward FFT of SPECTRUM_FFT_SIZE points, unnormalized.
+  Levels the CPU lacks or without passes of their own run scalar.
+*/
+void spectrumFft(CpuLevel kernel, const SpectrumAnalyzer *sa, float *re, float *im) {
+    for (int i = 0; i < SPECTRUM_FFT_SIZE; i++) {
+        int j = sa->reversed[i];
+        if (j > i) {
+            float r = re[i], m = im[i];
+            re[i] = re[j];
+            im[i] = im[j];
+            re[j] = r;
+            im[j] = m;
+        }
+    }
+    bool simd = cpuHas(kernel) && kernel <= SPECTRUM_MAX_LEVEL && fft_stages[kernel];
+    for (int half = 1; half < SPECTRUM_FFT_SIZE; half <<= 1) {
+        FftStage stage = simd && half >= fft_lanes[kernel] ? fft_stages[kernel] : fftStageScalar;
+        stage(re, im, sa->twiddle_re + half - 1, sa->twiddle_im + half - 1, SPECTRUM_FFT_SIZE, half);
+    }
+}
+
+bool spectrumInit(SpectrumAnalyzer *sa, Scheduler *scheduler, int sample_rate) {
+    memset(sa, 0, sizeof(SpectrumAnalyzer));
+    sa->ring = calloc((size_t)SPECTRUM_RING_FRAMES * SPECTRUM_CHANNELS, sizeof(int16_t));
+    if (!sa->ring) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        return false;
+    }
+    sa->sample_rate = sample_rate;
+    sa->scheduler = scheduler;
+    sa->kernel = cpuBestLevel(SPECTRUM_MAX_LEVEL);
+    taskGroupInit(&sa->analysing, TASK_BACKGROUND);
+    pthread_mutex_init(&sa->ring_lock, NULL);
+    pthread_mutex_init(&sa->publish_lock, NULL);
+    for (int i = 0; i < SPECTRUM_MARKS; i++) {
+        sa->marks[i].pts = NAN;
+    }
+
+    for (int i = 0; i < SPECTRUM_FFT_SIZE; i++) {
+        sa->window[i] = 0.5f - 0.5f * (float)cos(2 * M_PI * i / SPECTRUM_FFT_SIZE);   // Hann
+        int reversed = 0;
+        for (int bit = 0; bit < SPECTRUM_FFT_BITS; bit++) {
+            reversed |= ((i >> bit) & 1) << (SPECTRUM_FFT_BITS - 1 - bit);
+        }
+        sa->reversed[i] = (uint16_t)reversed;
+    }
+    for (int half = 1; half < SPECTRUM_FFT_SIZE; half <<= 1) {
+        for (int k = 0; k < half; k++) {
+            sa->twiddle_re[half - 1 + k] = (float)cos(-M_PI * k / half);
+            sa->twiddle_im[half - 1 + k] = (float)sin(-M_PI * k / half);
+        }
+    }
+
+    // Every bar gets at least one bin of its own
+    for (int band = 0; band <= SPECTRUM_BANDS; band++) {
+        double hz = SPECTRUM_LOW_HZ * pow(SPECTRUM_HIGH_HZ / SPECTRUM_LOW_HZ, (double)band / SPECTRUM_BANDS);
+        int bin = (int)lrint(hz * SPECTRUM_FFT_SIZE / sample_rate);
+        if (band > 0 && bin <= sa->band_first[band - 1]) {
+            bin = sa->band_first[band - 1] + 1;
+        }
+        sa->band_first[band] = bin < SPECTRUM_FFT_SIZE / 2 ? bin : SPECTRUM_FFT_SIZE / 2;
+    }
+    for (int band = 0; band < SPECTRUM_BANDS; band++) {
+        sa->state.bands[band] = sa->state.band_peaks[band] = SPECTRUM_FLOOR_DB;
+    }
+    for (int c = 0; c < SPECTRUM_CHANNELS; c++) {
+        sa->state.peak[c] = sa->state.rms[c] = SPECTRUM_FLOOR_DB;
+    }
+    return true;
+}
+
+// The task may still be running: the scheduler has to outlive this call
+void spectrumDestroy(SpectrumAnalyzer *sa) {
+    if (sa->scheduler) {
+        schedulerWait(sa->scheduler, &sa->analysing);
+    }
+    free(sa->ring);
+    sa->ring = NULL;
+    pthread_mutex_destroy(&sa->ring_lock);
+    pthread_mutex_destroy(&sa->publish_lock);
+}
+
+/*
+  Function spectrumTap
+  AudioTap of the sink: copies interleaved stereo S16 into the ring
+  and remembers the chunk's time. Nothing is analysed here, so the
+  audio thread only pays for the copy.
+*/
+void spectrumTap(const int16_t *samples, int count, double pts, void *context) {
+    SpectrumAnalyzer *sa = context;
+    pthread_mutex_lock(&sa->ring_lock);
+    sa->marks[sa->mark_next] = (SpectrumMark){pts, sa->written, count};
+    sa->mark_next = (sa->mark_next + 1) % SPECTRUM_MARKS;
+    for (int done = 0; done < count;) {
+        int position = (int)(sa->written % SPECTRUM_RING_FRAMES);
+        int frames = count - done < SPECTRUM_RING_FRAMES - position ? count - done : SPECTRUM_RING_FRAMES - position;
+        memcpy(sa->ring + (size_t)position * SPECTRUM_CHANNELS, samples + (size_t)done * SPECTRUM_CHANNELS,
+               (size_t)frames * SPECTRUM_CHANNELS * sizeof(int16_t));
+        sa->written += frames;
+        done += frames;
+    }
+    pthread_mutex_unlock(&sa->ring_lock);
+}
+
+// Ring position of audio time pts, searching the newest chunks first; caller holds ring_lock
+static bool spectrumLocate(const SpectrumAnalyzer *sa, double pts, uint64_t *frame) {
+    for (int i = 1; i <= SPECTRUM_MARKS; i++) {
+        const SpectrumMark *mark = &sa->marks[(sa->mark_next - i + SPECTRUM_MARKS) % SPECTRUM_MARKS];
+        if (isnan(mark->pts) || sa->written - mark->frame > SPECTRUM_RING_FRAMES) {
+            return false;
+        }
+        double offset = (pts - mark->pts) * sa->sample_rate;
+        if (offset >= 0 && offset <= mark->count) {
+            *frame = mark->frame + (uint64_t)offset;
+            return true;
+        }
+    }
+    return false;
+}
+
+static float levelDb(double power) {
+    float db = power > 0 ? (float)(10 * log10(power)) : SPECTRUM_FLOOR_DB;
+    return db > SPECTRUM_FLOOR_DB ? db : SPECTRUM_FLOOR_DB;
+}
+
+// Rises at once, falls at rate dB per second
+static float fall(float shown, float level, float rate, float dt) {
+    float lowered = shown - rate * dt;
+    return level > lowered ? level : lowered;
+}
+
+/*
+  Function spectrumAnalyze
+  scheduler task: windows the SPECTRUM_FFT_SIZE frames that end at the
+  requested audio time, mixed to mono, and turns the FFT into bars in
+  dBFS (a full-scale sine reads 0). Peak and RMS per channel come from
+  the same frames.
+*/
+static void spectrumAnalyze(int index, void *context) {
+    (void)index;
+    SpectrumAnalyzer *sa = context;
+    uint64_t start = statsNow();
+    traceBegin("spectrum");
+
+    double peak[SPECTRUM_CHANNELS] = {0}, squares[SPECTRUM_CHANNELS] = {0};
+    uint64_t end = 0;
+    pthread_mutex_lock(&sa->ring_lock);
+    bool found = spectrumLocate(sa, sa->request_pts, &end) && end >= SPECTRUM_FFT_SIZE &&
+                 sa->written - (end - SPECTRUM_FFT_SIZE) <= SPECTRUM_RING_FRAMES;
+    if (found) {
+        uint64_t first = end - SPECTRUM_FFT_SIZE;
+        for (int i = 0; i < SPECTRUM_FFT_SIZE; i++) {
+            const int16_t *frame = sa->ring + ((first + i) % SPECTRUM_RING_FRAMES) * SPECTRUM_CHANNELS;
+            float mono = 0.0f;
+            for (int c = 0; c < SPECTRUM_CHANNELS; c++) {
+                float sample = frame[c] / 32768.0f;
+                peak[c] = fabs(sample) > peak[c] ? fabs(sample) : peak[c];
+                squares[c] += sample * sample;
+                mono += sample;
+            }
+            sa->re[i] = mono / SPECTRUM_CHANNELS * sa->window[i];
+            sa->im[i] = 0.0f;
+        }
+    }
+    pthread_mutex_unlock(&sa->ring_lock);
+
+    if (found) {
+        spectrumFft(sa->kernel, sa, sa->re, sa->im);
+
+        uint64_t now = statsNow();
+        float dt = sa->last_ns ? (float)fmin((now - sa->last_ns) / 1e9, SPECTRUM_MAX_STEP) : 0.0f;
+        sa->last_ns = now;
+        // Hann-windowed full-scale sine: N / 4 in its bin
+        double full_scale = (SPECTRUM_FFT_SIZE / 4.0) * (SPECTRUM_FFT_SIZE / 4.0);
+        SpectrumFrame *state = &sa->state;
+        for (int band = 0; band < SPECTRUM_BANDS; band++) {
+            double power = 0.0;
+            for (int bin = sa->band_first[band]; bin < sa->band_first[band + 1]; bin++) {
+                double p = (double)sa->re[bin] * sa->re[bin] + (double)sa->im[bin] * sa->im[bin];
+                power = p > power ? p : power;
+            }
+            float level = levelDb(power / full_scale);
+            state->bands[band] = fall(state->bands[band], level, SPECTRUM_FALL_DB, dt);
+            state->band_peaks[band] = fall(state->band_peaks[band], level, SPECTRUM_PEAK_FALL_DB, dt);
+        }
+        for (int c = 0; c < SPECTRUM_CHANNELS; c++) {
+            state->peak[c] = fall(state->peak[c], levelDb(peak[c] * peak[c]), SPECTRUM_FALL_DB, dt);
+            state->rms[c] = fall(state->rms[c], levelDb(squares[c] / SPECTRUM_FFT_SIZE), SPECTRUM_FALL_DB, dt);
+        }
+        state->pts = sa->request_pts;
+        state->sequence++;
+
+        pthread_mutex_lock(&sa->publish_lock);
+        sa->published = *state;
+        pthread_mutex_unlock(&sa->publish_lock);
+    }
+
+    traceEnd("spectrum");
+    uint64_t elapsed = statsNow() - start;
+    sa->analysis_ns += elapsed;
+    sa->analyses++;
+    if (!sa->first_ns) {
+        sa->first_ns = start;
+    }
+}
+
+/*
+  Function spectrumRequest
+  called once per display refresh with the audio clock. Never waits:
+  while the previous analysis is still running the refresh is skipped
+  and the view keeps the last result.
+*/
+void spectrumRequest(SpectrumAnalyzer *sa, double pts) {
+    if (__atomic_load_n(&sa->analysing.pending, __ATOMIC_ACQUIRE) > 0) {
+        sa->busy++;
+        return;
+    }
+    sa->request_pts = pts;
+    if (!sa->scheduler || !schedulerSubmit(sa->scheduler, &sa->analysing, spectrumAnalyze, sa, 0)) {
+        spectrumAnalyze(0, sa);
+    }
+}
+
+// Copies the latest analysis; false before the first one
+bool spectrumLatest(SpectrumAnalyzer *sa, SpectrumFrame *frame) {
+    pthread_mutex_lock(&sa->publish_lock);
+    *frame = sa->published;
+    pthread_mutex_unlock(&sa->publish_lock);
+    return frame->sequence > 0;
+}
+
+// Reads counters the analysis task updates: call after spectrumDestroy has waited for it
+void spectrumPrintStats(const SpectrumAnalyzer *sa, FILE *out) {
+    if (sa->analyses == 0) {
+        return;
+    }
+    // Share of one core while the analyzer was shown
+    double span = sa->last_ns > sa->first_ns ? (sa->last_ns - sa->first_ns) / 1e9 : 0.0;
+    fprintf(out, "Spectrum: %llu analyses (%llu refreshes skipped while one ran), %d-point %s FFT, "
+            "mean %.1f us",
+            (unsigned long long)sa->analyses, (unsigned long long)sa->busy, SPECTRUM_FFT_SIZE,
+            cpuLevelName(sa->kernel), sa->analysis_ns / 1e3 / sa->analyses);
+    if (span >= 1.0) {
+        fprintf(out, ", %.2f%% of one core", sa->analysis_ns / 1e9 / span * 100);
+    }
+    fprintf(out, "\n");
+}
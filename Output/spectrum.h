@@ -0,0 +1,84 @@
+#ifndef SPECTRUM_H
+#define SPECTRUM_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "../Util/cpu.h"
+#include "../Util/scheduler.h"
+
+#define SPECTRUM_FFT_BITS 11
+#define SPECTRUM_FFT_SIZE (1 << SPECTRUM_FFT_BITS)   // 46 ms at 44.1 kHz
+#define SPECTRUM_BANDS 48                            // Log-spaced bars, 40 Hz to 16 kHz
+#define SPECTRUM_CHANNELS 2
+#define SPECTRUM_RING_FRAMES (1 << 18)               // ~6 s at 44.1 kHz, more than PulseAudio queues ahead
+#define SPECTRUM_MARKS 512                           // Chunks whose time is remembered
+#define SPECTRUM_FLOOR_DB -90.0f
+
+// What the view draws, levels in dBFS from SPECTRUM_FLOOR_DB to 0
+typedef struct {
+    float bands[SPECTRUM_BANDS];
+    float band_peaks[SPECTRUM_BANDS];                // Held for a moment, then falling
+    float peak[SPECTRUM_CHANNELS], rms[SPECTRUM_CHANNELS];
+    double pts;                                      // Audio time analysed
+    uint64_t sequence;                               // Bumped by every analysis, 0 before the first
+} SpectrumFrame;
+
+// Where a chunk of fed audio sits in the ring
+typedef struct {
+    double pts;
+    uint64_t frame;
+    int count;
+} SpectrumMark;
+
+/*
+  Spectrum and level meters of the PCM going to the audio sink. The
+  audio tap only copies samples into a ring; the GUI asks for an
+  analysis at the audio clock once per display refresh, and it runs as
+  a background task on the shared scheduler, at most one at a time.
+  The FFT is radix-2 on split real/imaginary arrays, with SSE4.1 and
+  AVX2 butterflies picked by CPU level.
+*/
+typedef struct {
+    int sample_rate;
+    CpuLevel kernel;
+
+    // Written by the audio tap
+    int16_t *ring;                                   // Interleaved stereo frames
+    uint64_t written;                                // Frames fed so far
+    SpectrumMark marks[SPECTRUM_MARKS];
+    int mark_next;
+    pthread_mutex_t ring_lock;
+
+    // Analysis, owned by the one task in flight
+    Scheduler *scheduler;
+    TaskGroup analysing;
+    double request_pts;
+    float re[SPECTRUM_FFT_SIZE], im[SPECTRUM_FFT_SIZE];
+    float window[SPECTRUM_FFT_SIZE];
+    float twiddle_re[SPECTRUM_FFT_SIZE], twiddle_im[SPECTRUM_FFT_SIZE];   // Stage with span h at h - 1
+    uint16_t reversed[SPECTRUM_FFT_SIZE];
+    int band_first[SPECTRUM_BANDS + 1];              // FFT bins of each bar
+    SpectrumFrame state;
+    uint64_t last_ns;
+
+    // Result handed to the GUI
+    SpectrumFrame published;
+    pthread_mutex_t publish_lock;
+
+    // Reporting
+    uint64_t analyses, busy, analysis_ns, first_ns;
+} SpectrumAnalyzer;
+
+extern SpectrumAnalyzer spectrumAnalyzer;
+
+bool spectrumInit(SpectrumAnalyzer *sa, Scheduler *scheduler, int sample_rate);
+void spectrumDestroy(SpectrumAnalyzer *sa);
+void spectrumTap(const int16_t *samples, int count, double pts, void *context);
+void spectrumRequest(SpectrumAnalyzer *sa, double pts);
+bool spectrumLatest(SpectrumAnalyzer *sa, SpectrumFrame *frame);
+void spectrumFft(CpuLevel kernel, const SpectrumAnalyzer *sa, float *re, float *im);
+void spectrumPrintStats(const SpectrumAnalyzer *sa, FILE *out);
+
+#endif // SPECTRUM_H
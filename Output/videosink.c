@@ -0,0 +1,144 @@
+#include "videosink.h"
+
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "../Buffer/buffer.h"
+#include "../Decoding/clock.h"
+#include "../Decoding/demux.h"
+#include "../Stats/stats.h"
+#include "../Stats/trace.h"
+
+// spec: gtk, null or raw:FILE
+bool videoSinkParse(const char *spec, VideoSinkConfig *config) {
+    config->path = NULL;
+    if (strcmp(spec, "gtk") == 0) {
+        config->kind = VIDEO_SINK_GTK;
+    } else if (strcmp(spec, "null") == 0) {
+        config->kind = VIDEO_SINK_NULL;
+    } else if (strncmp(spec, "raw:", 4) == 0 && spec[4]) {
+        config->kind = VIDEO_SINK_RAW;
+        config->path = spec + 4;
+    } else {
+        fprintf(stderr, "Error: Unknown video sink '%s' (gtk, null or raw:FILE)\n", spec);
+        return false;
+    }
+    return true;
+}
+
+const char *videoSinkName(VideoSinkKind kind) {
+    switch (kind) {
+        case VIDEO_SINK_GTK: return "gtk";
+        case VIDEO_SINK_NULL: return "null";
+        default: return "raw";
+    }
+}
+
+static double sinkNow() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void sleepUntil(double t) {
+    struct timespec ts = {(time_t)t, (long)((t - (time_t)t) * 1e9)};
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+    }
+}
+
+// Packed rows, without the pixbuf's row padding
+static bool writeRawFrame(FILE *file, GdkPixbuf *pixbuf) {
+    const uint8_t *pixels = gdk_pixbuf_read_pixels(pixbuf);
+    int width = gdk_pixbuf_get_width(pixbuf), height = gdk_pixbuf_get_height(pixbuf);
+    int rowstride = gdk_pixbuf_get_rowstride(pixbuf);
+    size_t row_bytes = (size_t)width * gdk_pixbuf_get_n_channels(pixbuf);
+
+    for (int y = 0; y < height; y++) {
+        if (fwrite(pixels + (size_t)y * rowstride, 1, row_bytes, file) != row_bytes) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+  Function videoSinkRun
+  presents frames from source (displayBuffer, or blendBuffer at the
+  display rate) without GTK on the calling thread until it runs dry at end of stream or playback stops. Paced, a frame is
+  taken every 1/frame_rate like the GUI timer does; fast, every frame
+  is taken as soon as it is converted, so the frame rate reached is the
+  ceiling of decode + convert + queue.
+*/
+bool videoSinkRun(const VideoSinkConfig *config, DisplayBuffer *source, int frame_rate) {
+    double interval = 1.0 / (frame_rate > 0 ? frame_rate : 25);
+    FILE *file = NULL;
+    bool ok = true;
+    uint64_t frames = 0;
+    double first_pts = NAN, last_pts = NAN;
+
+    if (config->kind == VIDEO_SINK_RAW) {
+        file = strcmp(config->path, "-") == 0 ? stdout : fopen(config->path, "wb");
+        if (!file) {
+            fprintf(stderr, "Error: Could not write video to '%s'\n", config->path);
+            return false;
+        }
+    }
+
+    double start = sinkNow(), due = start;
+    while (is_running) {
+        if (!config->fast) {
+            sleepUntil(due);
+            due = fmax(due, sinkNow()) + interval;  // No burst to catch up after a stall, like the GUI timer
+        }
+
+        GdkPixbuf *pixbuf;
+        double pts;
+        if (!displayBufferPop(source, &pixbuf, &pts)) {
+            break;
+        }
+        double audio = clockGetAudio();
+        if (!isnan(pts) && !isnan(audio)) {
+            statsSetAvOffset(pts - audio);
+        }
+
+        uint64_t present_start = statsNow();
+        traceBegin("present");
+        if (file && ok) {
+            if (frames == 0) {
+                fprintf(stderr, "Raw video: %dx%d rgb24 at %d fps in '%s'\n", gdk_pixbuf_get_width(pixbuf),
+                        gdk_pixbuf_get_height(pixbuf), frame_rate, config->path);
+            }
+            ok = writeRawFrame(file, pixbuf);
+            if (!ok) {
+                fprintf(stderr, "Error: Could not write video to '%s'\n", config->path);
+            }
+        }
+        g_object_unref(pixbuf);
+        traceEnd("present");
+        statsRecord(STAT_PRESENT, statsNow() - present_start);
+        statsCount(COUNTER_PRESENTED);
+        statsMarkStartup(STARTUP_FIRST_FRAME);
+        demuxRecordPresented(&demuxer, pts);
+
+        if (isnan(first_pts)) {
+            first_pts = pts;
+        }
+        last_pts = pts;
+        frames++;
+    }
+
+    double wall = sinkNow() - start;
+    double media = frames && !isnan(first_pts) ? last_pts - first_pts + interval : 0.0;
+    fprintf(stderr, "Video sink %s%s: %llu frames in %.2fs (%.1f fps, %.1fx realtime)\n",
+            videoSinkName(config->kind), config->fast ? " (fast)" : "", (unsigned long long)frames, wall,
+            wall > 0 ? frames / wall : 0.0, wall > 0 ? media / wall : 0.0);
+
+    if (file && file != stdout) {
+        ok = fclose(file) == 0 && ok;
+    } else if (file) {
+        ok = fflush(file) == 0 && ok;
+    }
+    return ok;
+}
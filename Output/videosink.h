@@ -0,0 +1,24 @@
+#ifndef VIDEOSINK_H
+#define VIDEOSINK_H
+
+#include <stdbool.h>
+#include "../Buffer/buffer.h"
+
+// Where converted frames are presented
+typedef enum {
+    VIDEO_SINK_GTK,   // The player window
+    VIDEO_SINK_NULL,  // Discards frames: decode + convert + queue without rendering
+    VIDEO_SINK_RAW    // Appends packed RGB24 frames to a file
+} VideoSinkKind;
+
+typedef struct {
+    VideoSinkKind kind;
+    const char *path;   // Raw output, "-" for stdout
+    bool fast;          // Null and raw: present as soon as a frame is ready instead of at the frame rate
+} VideoSinkConfig;
+
+bool videoSinkParse(const char *spec, VideoSinkConfig *config);
+const char *videoSinkName(VideoSinkKind kind);
+bool videoSinkRun(const VideoSinkConfig *config, DisplayBuffer *source, int frame_rate);
+
+#endif // VIDEOSINK_H
@@ -0,0 +1,242 @@
+#include "synth.h"
+
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#define SYNTH_GOP 12
+#define SYNTH_B_FRAMES 2
+#define SYNTH_QSCALE 3             // MPEG-4 quantizer, low enough to keep the code blocks clean
+#define SYNTH_AUDIO_FRAME 1024     // Samples per PCM packet
+#define SYNTH_TONE_LEVEL 12000.0
+
+typedef struct {
+    AVFormatContext *format_context;
+    AVCodecContext *video, *audio;
+    AVStream *video_stream, *audio_stream;
+    AVPacket *packet;
+} SynthWriter;
+
+// Pitch of the tone at stream time t: steps by 100 Hz each second, repeating every 5 s
+double synthToneFrequency(double t) {
+    return 400.0 + 100.0 * ((int)floor(t) % 5);
+}
+
+// 16 index bits followed by their low byte inverted as a check
+static uint32_t synthCode(int index) {
+    uint32_t value = (uint32_t)index & 0xFFFF;
+    return value | ((~value & 0xFF) << 16);
+}
+
+static void synthDrawFrame(AVFrame *frame, int index) {
+    int block_width = frame->width / SYNTH_CODE_COLUMNS;
+    int code_height = SYNTH_CODE_ROWS * SYNTH_CODE_ROW_HEIGHT;
+    uint32_t code = synthCode(index);
+
+    for (int y = 0; y < frame->height; y++) {
+        uint8_t *row = frame->data[0] + (size_t)y * frame->linesize[0];
+        for (int x = 0; x < frame->width; x++) {
+            if (y < code_height) {
+                int bit = (y / SYNTH_CODE_ROW_HEIGHT) * SYNTH_CODE_COLUMNS + x / block_width;
+                row[x] = (code >> bit) & 1 ? 235 : 16;
+            } else {
+                row[x] = 16 + ((x + y + 4 * index) & 0x7F);  // Moving ramp, gives the encoder motion
+            }
+        }
+    }
+    for (int plane = 1; plane < 3; plane++) {
+        for (int y = 0; y < frame->height / 2; y++) {
+            memset(frame->data[plane] + (size_t)y * frame->linesize[plane], 128, frame->width / 2);
+        }
+    }
+}
+
+/*
+  Function synthReadFrameIndex
+  recovers the index from the center of each code block of a converted
+  picture; -1 when the check byte does not match.
+*/
+int synthReadFrameIndex(const uint8_t *rgb, int linesize, int channels, int width) {
+    int block_width = width / SYNTH_CODE_COLUMNS;
+    uint32_t code = 0;
+
+    for (int bit = 0; bit < SYNTH_CODE_COLUMNS * SYNTH_CODE_ROWS; bit++) {
+        int x = (bit % SYNTH_CODE_COLUMNS) * block_width + block_width / 2;
+        int y = (bit / SYNTH_CODE_COLUMNS) * SYNTH_CODE_ROW_HEIGHT + SYNTH_CODE_ROW_HEIGHT / 2;
+        if (rgb[(size_t)y * linesize + (size_t)x * channels + 1] > 128) {  // Green follows luma on grey
+            code |= 1u << bit;
+        }
+    }
+
+    int index = code & 0xFFFF;
+    return synthCode(index) == code ? index : -1;
+}
+
+// Sends one frame (NULL flushes) and writes every packet the encoder returns
+static bool synthEncode(SynthWriter *writer, AVCodecContext *codec_context, AVStream *stream, AVFrame *frame) {
+    if (avcodec_send_frame(codec_context, frame) < 0) {
+        return false;
+    }
+    while (true) {
+        int ret = avcodec_receive_packet(codec_context, writer->packet);
+        if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+            return true;
+        }
+        if (ret < 0) {
+            return false;
+        }
+        av_packet_rescale_ts(writer->packet, codec_context->time_base, stream->time_base);
+        writer->packet->stream_index = stream->index;
+        if (av_interleaved_write_frame(writer->format_context, writer->packet) < 0) {
+            return false;
+        }
+    }
+}
+
+static AVCodecContext *synthOpenEncoder(SynthWriter *writer, enum AVCodecID codec_id, AVStream **stream,
+                                        void (*configure)(AVCodecContext *, const SynthClip *),
+                                        const SynthClip *clip) {
+    const AVCodec *codec = avcodec_find_encoder(codec_id);
+    if (!codec) {
+        fprintf(stderr, "Error: Encoder '%s' not available\n", avcodec_get_name(codec_id));
+        return NULL;
+    }
+    AVCodecContext *codec_context = avcodec_alloc_context3(codec);
+    *stream = avformat_new_stream(writer->format_context, NULL);
+    if (!codec_context || !*stream) {
+        avcodec_free_context(&codec_context);
+        return NULL;
+    }
+
+    configure(codec_context, clip);
+    if (writer->format_context->oformat->flags & AVFMT_GLOBALHEADER) {
+        codec_context->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+    }
+    if (avcodec_open2(codec_context, codec, NULL) < 0 ||
+        avcodec_parameters_from_context((*stream)->codecpar, codec_context) < 0) {
+        fprintf(stderr, "Error: Could not open encoder '%s'\n", codec->name);
+        avcodec_free_context(&codec_context);
+        return NULL;
+    }
+    (*stream)->time_base = codec_context->time_base;
+    return codec_context;
+}
+
+static void synthConfigureVideo(AVCodecContext *codec_context, const SynthClip *clip) {
+    codec_context->width = clip->width;
+    codec_context->height = clip->height;
+    codec_context->pix_fmt = AV_PIX_FMT_YUV420P;
+    codec_context->time_base = (AVRational){1, clip->frame_rate};
+    codec_context->framerate = (AVRational){clip->frame_rate, 1};
+    codec_context->gop_size = SYNTH_GOP;
+    codec_context->max_b_frames = SYNTH_B_FRAMES;  // Decode order differs from display order
+    codec_context->flags |= AV_CODEC_FLAG_QSCALE;
+    codec_context->global_quality = FF_QP2LAMBDA * SYNTH_QSCALE;
+}
+
+static void synthConfigureAudio(AVCodecContext *codec_context, const SynthClip *clip) {
+    codec_context->sample_fmt = AV_SAMPLE_FMT_S16;
+    codec_context->sample_rate = clip->sample_rate;
+    codec_context->channel_layout = AV_CH_LAYOUT_MONO;
+    codec_context->channels = 1;
+    codec_context->time_base = (AVRational){1, clip->sample_rate};
+}
+
+static void synthWriterClose(SynthWriter *writer) {
+    avcodec_free_context(&writer->video);
+    avcodec_free_context(&writer->audio);
+    av_packet_free(&writer->packet);
+    if (writer->format_context) {
+        avio_closep(&writer->format_context->pb);
+        avformat_free_context(writer->format_context);
+    }
+}
+
+/*
+  Function synthWriteClip
+  encodes the clip with audio interleaved at frame granularity: after
+  video frame i the audio runs up to the end of that frame.
+*/
+bool synthWriteClip(const SynthClip *clip) {
+    SynthWriter writer = {0};
+    AVFrame *picture = av_frame_alloc();
+    AVFrame *samples = av_frame_alloc();
+    bool ok = false;
+
+    if (avformat_alloc_output_context2(&writer.format_context, NULL, "matroska", clip->path) < 0) {
+        fprintf(stderr, "Error: Could not create '%s'\n", clip->path);
+        goto done;
+    }
+    writer.packet = av_packet_alloc();
+    writer.video = synthOpenEncoder(&writer, AV_CODEC_ID_MPEG4, &writer.video_stream, synthConfigureVideo, clip);
+    writer.audio = synthOpenEncoder(&writer, AV_CODEC_ID_PCM_S16LE, &writer.audio_stream, synthConfigureAudio, clip);
+    if (!picture || !samples || !writer.packet || !writer.video || !writer.audio) {
+        goto done;
+    }
+    if (avio_open(&writer.format_context->pb, clip->path, AVIO_FLAG_WRITE) < 0 ||
+        avformat_write_header(writer.format_context, NULL) < 0) {
+        fprintf(stderr, "Error: Could not write '%s'\n", clip->path);
+        goto done;
+    }
+
+    picture->format = AV_PIX_FMT_YUV420P;
+    picture->width = clip->width;
+    picture->height = clip->height;
+    samples->format = AV_SAMPLE_FMT_S16;
+    samples->sample_rate = clip->sample_rate;
+    samples->channel_layout = AV_CH_LAYOUT_MONO;
+    samples->channels = 1;
+    samples->nb_samples = SYNTH_AUDIO_FRAME;
+    if (av_frame_get_buffer(picture, 0) < 0 || av_frame_get_buffer(samples, 0) < 0) {
+        goto done;
+    }
+
+    int frame_count = clip->frame_rate * clip->seconds;
+    int64_t sample_count = (int64_t)clip->sample_rate * clip->seconds;
+    int64_t sample_pos = 0;
+    double phase = 0.0;
+
+    for (int i = 0; i < frame_count; i++) {
+        if (av_frame_make_writable(picture) < 0) {
+            goto done;
+        }
+        synthDrawFrame(picture, i);
+        picture->pts = i;
+        if (!synthEncode(&writer, writer.video, writer.video_stream, picture)) {
+            goto done;
+        }
+
+        int64_t audio_end = (int64_t)(i + 1) * clip->sample_rate / clip->frame_rate;
+        while (sample_pos < audio_end && sample_pos < sample_count) {
+            if (av_frame_make_writable(samples) < 0) {
+                goto done;
+            }
+            int16_t *pcm = (int16_t *)samples->data[0];
+            for (int s = 0; s < SYNTH_AUDIO_FRAME; s++) {
+                double t = (double)(sample_pos + s) / clip->sample_rate;
+                phase += 2.0 * M_PI * synthToneFrequency(t) / clip->sample_rate;
+                pcm[s] = (int16_t)(SYNTH_TONE_LEVEL * sin(phase));
+            }
+            samples->pts = sample_pos;
+            if (!synthEncode(&writer, writer.audio, writer.audio_stream, samples)) {
+                goto done;
+            }
+            sample_pos += SYNTH_AUDIO_FRAME;
+        }
+    }
+
+    ok = synthEncode(&writer, writer.video, writer.video_stream, NULL) &&
+         synthEncode(&writer, writer.audio, writer.audio_stream, NULL) &&
+         av_write_trailer(writer.format_context) == 0;
+
+done:
+    if (!ok) {
+        fprintf(stderr, "Error: Could not generate test clip '%s'\n", clip->path);
+    }
+    av_frame_free(&picture);
+    av_frame_free(&samples);
+    synthWriterClose(&writer);
+    return ok;
+}
@@ -0,0 +1,31 @@
+#ifndef SYNTH_H
+#define SYNTH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Frame index code: 24 blocks (8 x 3) across the top of the picture
+#define SYNTH_CODE_COLUMNS 8
+#define SYNTH_CODE_ROWS 3
+#define SYNTH_CODE_ROW_HEIGHT 32
+
+/*
+  Synthetic test clip: MPEG-4 video with B-frames and a PCM tone in a
+  Matroska file. Every picture carries its frame index in large
+  black/white blocks that survive lossy coding and color conversion;
+  the tone steps its pitch every second so audio content can be tied
+  back to a presentation time.
+*/
+typedef struct {
+    const char *path;
+    int width, height;      // Width a multiple of SYNTH_CODE_COLUMNS, height >= 96
+    int frame_rate;
+    int seconds;
+    int sample_rate;        // Mono, signed 16-bit
+} SynthClip;
+
+bool synthWriteClip(const SynthClip *clip);
+int synthReadFrameIndex(const uint8_t *rgb, int linesize, int channels, int width);
+double synthToneFrequency(double t);
+
+#endif // SYNTH_H
@@ -0,0 +1,325 @@
+#include "stats.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*
+  Every thread that records gets its own block of histograms, so the
+  hot path is a thread-local lookup plus a few relaxed stores: only the
+  owner ever writes a block, readers sum all blocks with relaxed loads.
+  Blocks are never freed; the list only grows by a lock-free push.
+*/
+typedef struct StatsThread {
+    uint64_t buckets[STAT_COUNT][STATS_BUCKETS];
+    uint64_t count[STAT_COUNT];
+    uint64_t sum[STAT_COUNT];
+    uint64_t max[STAT_COUNT];
+    uint64_t counters[COUNTER_COUNT];
+    char name[16];
+    struct StatsThread *next;
+} StatsThread;
+
+// Overlay shows value * overlay_scale in overlay_unit
+static const struct {
+    const char *name;
+    double overlay_scale;
+    const char *overlay_unit;
+} metric_info[STAT_COUNT] = {
+    [STAT_DEMUX] = {"demux", 1e-6, "ms"},
+    [STAT_VIDEO_DECODE] = {"video_decode", 1e-6, "ms"},
+    [STAT_AUDIO_DECODE] = {"audio_decode", 1e-6, "ms"},
+    [STAT_SCALE] = {"sws_scale", 1e-6, "ms"},
+    [STAT_VIDEO_PUSH_WAIT] = {"video_push_wait", 1e-6, "ms"},
+    [STAT_VIDEO_POP_WAIT] = {"video_pop_wait", 1e-6, "ms"},
+    [STAT_DISPLAY_WAIT] = {"display_wait", 1e-6, "ms"},
+    [STAT_PACKET_WAIT] = {"packet_wait", 1e-6, "ms"},
+    [STAT_AUDIO_WRITE] = {"audio_write", 1e-6, "ms"},
+    [STAT_PRESENT] = {"present", 1e-6, "ms"},
+    [STAT_VIDEO_QUEUE] = {"video_queue_frames", 1.0, "frames"},
+    [STAT_VIDEO_QUEUE_KIB] = {"video_queue_kib", 1.0 / 1024, "MiB"},
+    [STAT_AV_OFFSET] = {"av_offset_us", 1e-3, "ms"},
+    [STAT_INPUT_LATENCY] = {"input_to_present", 1e-6, "ms"},
+    [STAT_BLEND] = {"blend", 1e-6, "ms"},
+};
+
+static const char *startup_names[STARTUP_COUNT] = {
+    [STARTUP_LAUNCH] = "launch",
+    [STARTUP_PROBED] = "probed",
+    [STARTUP_WINDOW] = "window",
+    [STARTUP_FIRST_DECODED] = "first_decoded",
+    [STARTUP_FIRST_FRAME] = "first_frame",
+    [STARTUP_FIRST_AUDIO] = "first_audio",
+};
+
+static const char *counter_names[COUNTER_COUNT] = {
+    [COUNTER_PRESENTED] = "presented_frames",
+    [COUNTER_DROPPED] = "dropped_frames",
+    [COUNTER_CONVERTED] = "converted_frames",
+};
+
+static StatsThread *stats_threads = NULL;
+static __thread StatsThread *stats_local = NULL;
+static int64_t stats_av_offset_us = 0;
+static uint64_t stats_startup_ns[STARTUP_COUNT];
+
+uint64_t statsNow() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// Stands in for a block that could not be allocated; it is not in the list, so what goes there is lost
+static StatsThread stats_discard;
+
+static StatsThread *statsLocal() {
+    if (!stats_local) {
+        StatsThread *block = calloc(1, sizeof(StatsThread));
+        if (!block) {
+            return &stats_discard;
+        }
+        strcpy(block->name, "thread");
+        block->next = __atomic_load_n(&stats_threads, __ATOMIC_RELAXED);
+        while (!__atomic_compare_exchange_n(&stats_threads, &block->next, block, false,
+                                            __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+        }
+        stats_local = block;
+    }
+    return stats_local;
+}
+
+void statsThreadName(const char *name) {
+    StatsThread *block = statsLocal();
+    strncpy(block->name, name, sizeof(block->name) - 1);
+}
+
+// Four buckets per power of two: values are kept to within 25%
+static int statsBucket(uint64_t value) {
+    if (value < 4) {
+        return (int)value;
+    }
+    int msb = 63 - __builtin_clzll(value);
+    return 4 + (msb - 2) * 4 + (int)((value >> (msb - 2)) & 3);
+}
+
+static double statsBucketValue(int bucket) {
+    if (bucket < 4) {
+        return bucket;
+    }
+    int msb = (bucket - 4) / 4 + 2;
+    double low = (double)(4 + (bucket - 4) % 4) * (double)(1ull << (msb - 2));
+    return low + (double)(1ull << (msb - 2)) / 2.0;  // Middle of the bucket
+}
+
+static void statsBump(uint64_t *slot, uint64_t value) {
+    __atomic_store_n(slot, __atomic_load_n(slot, __ATOMIC_RELAXED) + value, __ATOMIC_RELAXED);
+}
+
+void statsRecord(StatsMetric metric, uint64_t value) {
+    StatsThread *block = statsLocal();
+    statsBump(&block->buckets[metric][statsBucket(value)], 1);
+    statsBump(&block->count[metric], 1);
+    statsBump(&block->sum[metric], value);
+    if (value > block->max[metric]) {
+        __atomic_store_n(&block->max[metric], value, __ATOMIC_RELAXED);
+    }
+}
+
+void statsCount(StatsCounter counter) {
+    statsBump(&statsLocal()->counters[counter], 1);
+}
+
+void statsSetAvOffset(double seconds) {
+    int64_t us = (int64_t)(seconds * 1e6);
+    __atomic_store_n(&stats_av_offset_us, us, __ATOMIC_RELAXED);
+    statsRecord(STAT_AV_OFFSET, us < 0 ? -us : us);
+}
+
+// Only the first call per mark counts, so every presenter can call it unconditionally
+void statsMarkStartup(StartupMark mark) {
+    uint64_t unset = 0;
+    __atomic_compare_exchange_n(&stats_startup_ns[mark], &unset, statsNow(), false,
+                                __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+}
+
+// Milliseconds from launch to mark, negative if it was never reached
+static double statsStartupMs(StartupMark mark) {
+    uint64_t launch = __atomic_load_n(&stats_startup_ns[STARTUP_LAUNCH], __ATOMIC_RELAXED);
+    uint64_t at = __atomic_load_n(&stats_startup_ns[mark], __ATOMIC_RELAXED);
+    return launch && at ? (at - launch) / 1e6 : -1.0;
+}
+
+/*
+  Function statsPrintStartup
+  one line of startup milestones relative to launch. Time to first
+  frame is checked against target_ms; milestones never reached (no
+  window, no audio) are left out.
+*/
+void statsPrintStartup(FILE *out, double target_ms) {
+    const char *separator = " ";
+    fprintf(out, "Startup:");
+    for (int m = STARTUP_PROBED; m < STARTUP_COUNT; m++) {
+        double ms = statsStartupMs(m);
+        if (ms >= 0.0) {
+            fprintf(out, "%s%s %.1f ms", separator, startup_names[m], ms);
+            separator = ", ";
+        }
+    }
+    double ttff = statsStartupMs(STARTUP_FIRST_FRAME);
+    if (ttff >= 0.0) {
+        fprintf(out, " (time to first frame %s the %.0f ms target)", ttff <= target_ms ? "within" : "over", target_ms);
+    }
+    fprintf(out, "\n");
+}
+
+static void statsSummarizeBuckets(const uint64_t *buckets, uint64_t count, uint64_t sum, uint64_t max,
+                                  StatsSummary *summary) {
+    const double quantiles[3] = {0.50, 0.90, 0.99};
+    double *targets[3] = {&summary->p50, &summary->p90, &summary->p99};
+    uint64_t seen = 0;
+    int next = 0;
+
+    memset(summary, 0, sizeof(StatsSummary));
+    summary->count = count;
+    summary->max = max;
+    if (count == 0) {
+        return;
+    }
+    summary->mean = (double)sum / count;
+
+    for (int b = 0; b < STATS_BUCKETS && next < 3; b++) {
+        seen += buckets[b];
+        while (next < 3 && seen >= (uint64_t)ceil(quantiles[next] * count)) {
+            *targets[next] = fmin(statsBucketValue(b), (double)max);
+            next++;
+        }
+    }
+}
+
+static void statsMerge(const StatsThread *only, StatsMetric metric, uint64_t *buckets,
+                       uint64_t *count, uint64_t *sum, uint64_t *max) {
+    memset(buckets, 0, STATS_BUCKETS * sizeof(uint64_t));
+    *count = *sum = *max = 0;
+
+    for (StatsThread *block = __atomic_load_n(&stats_threads, __ATOMIC_ACQUIRE); block; block = block->next) {
+        if (only && block != only) {
+            continue;
+        }
+        for (int b = 0; b < STATS_BUCKETS; b++) {
+            buckets[b] += __atomic_load_n(&block->buckets[metric][b], __ATOMIC_RELAXED);
+        }
+        *count += __atomic_load_n(&block->count[metric], __ATOMIC_RELAXED);
+        *sum += __atomic_load_n(&block->sum[metric], __ATOMIC_RELAXED);
+        uint64_t block_max = __atomic_load_n(&block->max[metric], __ATOMIC_RELAXED);
+        if (block_max > *max) {
+            *max = block_max;
+        }
+    }
+}
+
+void statsSummarize(StatsMetric metric, StatsSummary *summary) {
+    uint64_t buckets[STATS_BUCKETS], count, sum, max;
+    statsMerge(NULL, metric, buckets, &count, &sum, &max);
+    statsSummarizeBuckets(buckets, count, sum, max, summary);
+}
+
+uint64_t statsCounter(StatsCounter counter) {
+    uint64_t total = 0;
+    for (StatsThread *block = __atomic_load_n(&stats_threads, __ATOMIC_ACQUIRE); block; block = block->next) {
+        total += __atomic_load_n(&block->counters[counter], __ATOMIC_RELAXED);
+    }
+    return total;
+}
+
+// Text for the on-screen overlay
+void statsFormatOverlay(char *text, size_t size) {
+    size_t used = snprintf(text, size, "%-18s %7s %8s %8s %8s\n", "metric", "count", "p50", "p99", "max");
+
+    for (int m = 0; m < STAT_COUNT && used < size; m++) {
+        StatsSummary summary;
+        double scale = metric_info[m].overlay_scale;
+
+        statsSummarize(m, &summary);
+        used += snprintf(text + used, size - used, "%-18s %7llu %8.2f %8.2f %8.2f %s\n",
+                         metric_info[m].name, (unsigned long long)summary.count,
+                         summary.p50 * scale, summary.p99 * scale, summary.max * scale,
+                         metric_info[m].overlay_unit);
+    }
+
+    if (used < size) {
+        snprintf(text + used, size - used, "A/V offset %+.1f ms, dropped %llu / presented %llu",
+                 __atomic_load_n(&stats_av_offset_us, __ATOMIC_RELAXED) / 1000.0,
+                 (unsigned long long)statsCounter(COUNTER_DROPPED),
+                 (unsigned long long)statsCounter(COUNTER_PRESENTED));
+    }
+}
+
+static void statsWriteMetric(FILE *file, const char *indent, const char *name, const uint64_t *buckets,
+                             uint64_t count, uint64_t sum, uint64_t max, bool last) {
+    StatsSummary summary;
+    statsSummarizeBuckets(buckets, count, sum, max, &summary);
+
+    fprintf(file, "%s\"%s\": {\"count\": %llu, \"mean\": %.1f, \"p50\": %.1f, \"p90\": %.1f, \"p99\": %.1f, \"max\": %.1f, \"buckets\": [",
+            indent, name, (unsigned long long)summary.count, summary.mean,
+            summary.p50, summary.p90, summary.p99, summary.max);
+    bool first = true;
+    for (int b = 0; b < STATS_BUCKETS; b++) {
+        if (buckets[b]) {
+            fprintf(file, "%s[%.0f, %llu]", first ? "" : ", ", statsBucketValue(b), (unsigned long long)buckets[b]);
+            first = false;
+        }
+    }
+    fprintf(file, "]}%s\n", last ? "" : ",");
+}
+
+/*
+  Function statsWriteJson
+  dumps merged and per-thread histograms. Stage values are in
+  nanoseconds, buckets are [bucket midpoint, count] pairs.
+*/
+bool statsWriteJson(const char *path) {
+    uint64_t buckets[STATS_BUCKETS], count, sum, max;
+    FILE *file = fopen(path, "w");
+    if (!file) {
+        fprintf(stderr, "Error: Could not write stats to '%s'\n", path);
+        return false;
+    }
+
+    fprintf(file, "{\n  \"units\": {\"stages\": \"ns\", \"video_queue_frames\": \"frames\", \"video_queue_kib\": \"KiB\", \"av_offset_us\": \"us\"},\n");
+    fprintf(file, "  \"counters\": {");
+    for (int c = 0; c < COUNTER_COUNT; c++) {
+        fprintf(file, "%s\"%s\": %llu", c ? ", " : "", counter_names[c], (unsigned long long)statsCounter(c));
+    }
+    fprintf(file, "},\n  \"startup_ms\": {");
+    for (int m = STARTUP_PROBED; m < STARTUP_COUNT; m++) {
+        fprintf(file, "%s\"%s\": %.3f", m == STARTUP_PROBED ? "" : ", ", startup_names[m], statsStartupMs(m));
+    }
+    fprintf(file, "},\n  \"metrics\": {\n");
+    for (int m = 0; m < STAT_COUNT; m++) {
+        statsMerge(NULL, m, buckets, &count, &sum, &max);
+        statsWriteMetric(file, "    ", metric_info[m].name, buckets, count, sum, max, m == STAT_COUNT - 1);
+    }
+    fprintf(file, "  },\n  \"threads\": [\n");
+
+    for (StatsThread *block = __atomic_load_n(&stats_threads, __ATOMIC_ACQUIRE); block; block = block->next) {
+        fprintf(file, "    {\"name\": \"%s\", \"metrics\": {\n", block->name);
+        int last = -1;
+        for (int m = 0; m < STAT_COUNT; m++) {
+            if (block->count[m]) {
+                last = m;
+            }
+        }
+        for (int m = 0; m <= last; m++) {
+            if (!block->count[m]) {
+                continue;
+            }
+            statsMerge(block, m, buckets, &count, &sum, &max);
+            statsWriteMetric(file, "      ", metric_info[m].name, buckets, count, sum, max, m == last);
+        }
+        fprintf(file, "    }}%s\n", block->next ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+
+    return fclose(file) == 0;
+}
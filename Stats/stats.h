@@ -0,0 +1,68 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Histogrammed metrics; stages are durations in nanoseconds
+typedef enum {
+    STAT_DEMUX,            // av_read_frame
+    STAT_VIDEO_DECODE,     // send + receive per video packet
+    STAT_AUDIO_DECODE,     // send + receive per audio packet
+    STAT_SCALE,            // sws_scale per displayed frame
+    STAT_VIDEO_PUSH_WAIT,  // videoBufferPush blocked on a full buffer
+    STAT_VIDEO_POP_WAIT,   // Converter blocked on an empty video buffer
+    STAT_DISPLAY_WAIT,     // updateDisplay blocked with no converted frame ready
+    STAT_PACKET_WAIT,      // Decoder blocked on an empty packet queue
+    STAT_AUDIO_WRITE,      // pa_simple_write
+    STAT_PRESENT,          // Texture upload and set in updateDisplay
+    STAT_VIDEO_QUEUE,      // Frames queued, sampled on push/pop
+    STAT_VIDEO_QUEUE_KIB,  // Memory held by queued frames, KiB
+    STAT_AV_OFFSET,        // |video pts - audio clock| at present, microseconds
+    STAT_INPUT_LATENCY,    // Live input: video packet read to its frame presented
+    STAT_BLEND,            // Display-rate mode: mixing two converted frames
+    STAT_COUNT
+} StatsMetric;
+
+typedef enum {
+    COUNTER_PRESENTED,
+    COUNTER_DROPPED,       // Late frames skipped before conversion
+    COUNTER_CONVERTED,     // Frames converted for display
+    COUNTER_COUNT
+} StatsCounter;
+
+// One-shot startup milestones, each kept the first time it is reached
+typedef enum {
+    STARTUP_LAUNCH,          // main() entered
+    STARTUP_PROBED,          // Input opened, probed and tracks picked
+    STARTUP_WINDOW,          // Window shown (GTK only)
+    STARTUP_FIRST_DECODED,   // First video frame out of the decoder
+    STARTUP_FIRST_FRAME,     // First frame presented (time to first frame)
+    STARTUP_FIRST_AUDIO,     // First audio accepted by the sink (time to first audio)
+    STARTUP_COUNT
+} StartupMark;
+
+#define STATS_BUCKETS 256
+
+// Summary of one metric merged over all threads
+typedef struct {
+    uint64_t count;
+    double mean, p50, p90, p99, max;
+} StatsSummary;
+
+uint64_t statsNow();
+void statsThreadName(const char *name);
+void statsRecord(StatsMetric metric, uint64_t value);
+void statsCount(StatsCounter counter);
+void statsSetAvOffset(double seconds);
+void statsMarkStartup(StartupMark mark);
+void statsPrintStartup(FILE *out, double target_ms);
+
+void statsSummarize(StatsMetric metric, StatsSummary *summary);
+uint64_t statsCounter(StatsCounter counter);
+void statsFormatOverlay(char *text, size_t size);
+bool statsWriteJson(const char *path);
+
+#endif // STATS_H
@@ -0,0 +1,144 @@
+#include "trace.h"
+#include "stats.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    const char *name;
+    uint64_t ts;       // statsNow() nanoseconds
+    int64_t value;     // Counter value for 'C' events
+    char phase;        // Chrome trace-event phase: B, E, i or C
+} TraceRecord;
+
+/*
+  One ring per thread, written only by its owner, so recording takes
+  no lock. Rings are linked once on first use and read when the trace
+  is written, after the pipeline threads have been joined and the
+  scheduler's workers stopped.
+*/
+typedef struct TraceThread {
+    TraceRecord *records;
+    uint64_t written;      // Total events recorded, ring slot is written % capacity
+    int tid;
+    char name[16];
+    struct TraceThread *next;
+} TraceThread;
+
+bool trace_enabled = false;
+
+static size_t trace_capacity = 0;
+static TraceThread *trace_threads = NULL;
+static int trace_next_tid = 1;
+static __thread TraceThread *trace_local = NULL;
+
+bool traceStart(size_t events_per_thread) {
+    if (events_per_thread == 0) {
+        return false;
+    }
+    trace_capacity = events_per_thread;
+    trace_enabled = true;
+    return true;
+}
+
+static TraceThread *traceLocal() {
+    if (!trace_local) {
+        TraceThread *thread = calloc(1, sizeof(TraceThread));
+        if (!thread || !(thread->records = malloc(trace_capacity * sizeof(TraceRecord)))) {
+            free(thread);
+            return NULL;
+        }
+        thread->tid = __atomic_fetch_add(&trace_next_tid, 1, __ATOMIC_RELAXED);
+        snprintf(thread->name, sizeof(thread->name), "thread-%d", thread->tid);
+        thread->next = __atomic_load_n(&trace_threads, __ATOMIC_RELAXED);
+        while (!__atomic_compare_exchange_n(&trace_threads, &thread->next, thread, false,
+                                            __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+        }
+        trace_local = thread;
+    }
+    return trace_local;
+}
+
+void traceThreadName(const char *name) {
+    if (!trace_enabled) {
+        return;
+    }
+    TraceThread *thread = traceLocal();
+    if (thread) {
+        strncpy(thread->name, name, sizeof(thread->name) - 1);
+    }
+}
+
+void traceEvent(const char *name, char phase, int64_t value) {
+    TraceThread *thread = traceLocal();
+    if (!thread) {
+        return;
+    }
+    TraceRecord *record = &thread->records[thread->written % trace_capacity];
+    record->name = name;
+    record->ts = statsNow();
+    record->value = value;
+    record->phase = phase;
+    __atomic_store_n(&thread->written, thread->written + 1, __ATOMIC_RELEASE);
+}
+
+/*
+  Function traceWrite
+  writes every ring as Chrome trace-event JSON (loadable in Perfetto or
+  chrome://tracing). Timestamps are microseconds from the first event.
+  A ring that wrapped may start with end events whose begin was lost.
+  Call it only once no traced thread can record any more.
+*/
+bool traceWrite(const char *path) {
+    if (!trace_enabled) {
+        return true;
+    }
+    FILE *file = fopen(path, "w");
+    if (!file) {
+        fprintf(stderr, "Error: Could not write trace to '%s'\n", path);
+        return false;
+    }
+
+    uint64_t origin = UINT64_MAX;
+    for (TraceThread *thread = __atomic_load_n(&trace_threads, __ATOMIC_ACQUIRE); thread; thread = thread->next) {
+        uint64_t written = __atomic_load_n(&thread->written, __ATOMIC_ACQUIRE);
+        uint64_t first = written > trace_capacity ? written - trace_capacity : 0;
+        if (written > first && thread->records[first % trace_capacity].ts < origin) {
+            origin = thread->records[first % trace_capacity].ts;
+        }
+    }
+
+    fprintf(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    fprintf(file, "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 0, \"args\": {\"name\": \"mediaplayer\"}}");
+    uint64_t dropped = 0;
+
+    for (TraceThread *thread = __atomic_load_n(&trace_threads, __ATOMIC_ACQUIRE); thread; thread = thread->next) {
+        uint64_t written = __atomic_load_n(&thread->written, __ATOMIC_ACQUIRE);
+        uint64_t first = written > trace_capacity ? written - trace_capacity : 0;
+        dropped += first;
+
+        fprintf(file, ",\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, \"args\": {\"name\": \"%s\"}}",
+                thread->tid, thread->name);
+        for (uint64_t i = first; i < written; i++) {
+            const TraceRecord *record = &thread->records[i % trace_capacity];
+            double ts = (record->ts - origin) / 1000.0;
+
+            fprintf(file, ",\n{\"name\": \"%s\", \"ph\": \"%c\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f",
+                    record->name, record->phase, thread->tid, ts);
+            if (record->phase == 'C') {
+                fprintf(file, ", \"args\": {\"value\": %lld}", (long long)record->value);
+            } else if (record->phase == 'i') {
+                fprintf(file, ", \"s\": \"t\"");
+            }
+            fprintf(file, "}");
+        }
+    }
+    fprintf(file, "\n]}\n");
+
+    if (dropped) {
+        fprintf(stderr, "Trace: %llu oldest events overwritten, raise the ring size for a full session\n",
+                (unsigned long long)dropped);
+    }
+    return fclose(file) == 0;
+}
@@ -0,0 +1,36 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Events kept per thread; older ones are overwritten once a ring is full
+#define TRACE_EVENTS_PER_THREAD 65536
+
+extern bool trace_enabled;
+
+bool traceStart(size_t events_per_thread);
+void traceThreadName(const char *name);
+bool traceWrite(const char *path);
+
+// name must be a string literal (only the pointer is stored)
+void traceEvent(const char *name, char phase, int64_t value);
+
+static inline void traceBegin(const char *name) {
+    if (trace_enabled) traceEvent(name, 'B', 0);
+}
+
+static inline void traceEnd(const char *name) {
+    if (trace_enabled) traceEvent(name, 'E', 0);
+}
+
+static inline void traceInstant(const char *name) {
+    if (trace_enabled) traceEvent(name, 'i', 0);
+}
+
+static inline void traceCounter(const char *name, int64_t value) {
+    if (trace_enabled) traceEvent(name, 'C', value);
+}
+
+#endif // TRACE_H
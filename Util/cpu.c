@@ -0,0 +1,48 @@
+#include "cpu.h"
+
+#include <pthread.h>
+
+static const char *level_names[CPU_LEVEL_COUNT] = {
+    [CPU_SCALAR] = "scalar",
+    [CPU_SSE41] = "sse4.1",
+    [CPU_AVX2] = "avx2",
+    [CPU_AVX512] = "avx512",
+};
+
+static pthread_once_t detect_once = PTHREAD_ONCE_INIT;
+static bool level_available[CPU_LEVEL_COUNT];
+
+// CPU features are probed once, on first use
+static void cpuDetect() {
+    level_available[CPU_SCALAR] = true;
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    level_available[CPU_SSE41] = __builtin_cpu_supports("sse4.1");
+    level_available[CPU_AVX2] = level_available[CPU_SSE41] && __builtin_cpu_supports("avx2");
+    level_available[CPU_AVX512] = level_available[CPU_AVX2] && __builtin_cpu_supports("avx512f") &&
+                                  __builtin_cpu_supports("avx512bw");
+#endif
+}
+
+bool cpuHas(CpuLevel level) {
+    pthread_once(&detect_once, cpuDetect);
+    return (unsigned)level < CPU_LEVEL_COUNT && level_available[level];
+}
+
+/*
+  Function cpuBestLevel
+  returns the highest level the CPU has that is not above max, the
+  highest level a module has kernels for.
+*/
+CpuLevel cpuBestLevel(CpuLevel max) {
+    for (int level = max < CPU_LEVEL_COUNT ? max : CPU_LEVEL_COUNT - 1; level > CPU_SCALAR; level--) {
+        if (cpuHas(level)) {
+            return level;
+        }
+    }
+    return CPU_SCALAR;
+}
+
+const char *cpuLevelName(CpuLevel level) {
+    return (unsigned)level < CPU_LEVEL_COUNT ? level_names[level] : "none";
+}
@@ -0,0 +1,27 @@
+#ifndef CPU_H
+#define CPU_H
+
+#include <stdbool.h>
+
+/*
+  Instruction set levels the hand-written kernels are built for, each
+  including the ones before it. Modules keep one kernel table indexed
+  by level and pick the highest level the CPU has, capped at the
+  highest they have a kernel for. Every SIMD kernel gives exactly what
+  the scalar one does: integer kernels by staying within exact fixed
+  point, float kernels by doing the scalar loop's multiplies and adds
+  per lane, in the same order.
+*/
+typedef enum {
+    CPU_SCALAR,
+    CPU_SSE41,
+    CPU_AVX2,
+    CPU_AVX512,        // AVX-512 F and BW, so byte and word lanes are there too
+    CPU_LEVEL_COUNT
+} CpuLevel;
+
+bool cpuHas(CpuLevel level);
+CpuLevel cpuBestLevel(CpuLevel max);
+const char *cpuLevelName(CpuLevel level);
+
+#endif // CPU_H
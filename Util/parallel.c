@@ -0,0 +1,61 @@
+#include "parallel.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+typedef struct {
+    int count;
+    int next;                  // Claimed with an atomic increment by the workers
+    ParallelTask task;
+    void *context;
+} ParallelRun;
+
+int parallelDefaultThreads() {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    return cores > 0 ? (int)cores : 1;
+}
+
+static void *parallelWorker(void *args) {
+    ParallelRun *run = args;
+
+    for (;;) {
+        int index = __atomic_fetch_add(&run->next, 1, __ATOMIC_RELAXED);
+        if (index >= run->count) {
+            break;
+        }
+        run->task(index, run->context);
+    }
+    return NULL;
+}
+
+/*
+  Function parallelFor
+  runs task for every index in [0, count) on up to threads workers,
+  the calling thread being one of them. Items are handed out one at a
+  time, so uneven item costs (big vs. small files) balance themselves.
+*/
+void parallelFor(int count, int threads, ParallelTask task, void *context) {
+    ParallelRun run = {count, 0, task, context};
+
+    if (threads > count) {
+        threads = count;
+    }
+    if (threads < 1) {
+        threads = 1;
+    }
+
+    // Without room for the workers the calling thread runs every item itself
+    pthread_t *workers = malloc((threads - 1) * sizeof(pthread_t) + 1);
+    int started = 0;
+    for (int i = 0; workers && i < threads - 1; i++) {
+        if (pthread_create(&workers[started], NULL, parallelWorker, &run) == 0) {
+            started++;
+        }
+    }
+    parallelWorker(&run);
+    for (int i = 0; i < started; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    free(workers);
+}
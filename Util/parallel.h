@@ -0,0 +1,10 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+// Called once per index, from whichever worker claims it
+typedef void (*ParallelTask)(int index, void *context);
+
+int parallelDefaultThreads();
+void parallelFor(int count, int threads, ParallelTask task, void *context);
+
+#endif // PARALLEL_H
@@ -0,0 +1,409 @@
+#include "scheduler.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define DEQUE_INITIAL_CAPACITY 64
+
+static __thread SchedulerWorker *scheduler_self = NULL;
+
+static uint64_t schedulerNow() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void schedulerBump(uint64_t *counter, uint64_t value) {
+    __atomic_fetch_add(counter, value, __ATOMIC_RELAXED);
+}
+
+static bool dequeInit(TaskDeque *dq) {
+    dq->tasks = malloc(DEQUE_INITIAL_CAPACITY * sizeof(Task));
+    dq->capacity = dq->tasks ? DEQUE_INITIAL_CAPACITY : 0;
+    dq->head = dq->count = 0;
+    pthread_mutex_init(&dq->lock, NULL);
+    return dq->tasks != NULL;
+}
+
+static void dequeDestroy(TaskDeque *dq) {
+    free(dq->tasks);
+    pthread_mutex_destroy(&dq->lock);
+}
+
+static bool dequePush(TaskDeque *dq, const Task *task) {
+    pthread_mutex_lock(&dq->lock);
+    if (dq->count == dq->capacity) {
+        Task *grown = malloc(2 * dq->capacity * sizeof(Task));
+        if (!grown) {
+            pthread_mutex_unlock(&dq->lock);
+            return false;
+        }
+        for (int i = 0; i < dq->count; i++) {
+            grown[i] = dq->tasks[(dq->head + i) % dq->capacity];
+        }
+        free(dq->tasks);
+        dq->tasks = grown;
+        dq->capacity *= 2;
+        dq->head = 0;
+    }
+    dq->tasks[(dq->head + dq->count) % dq->capacity] = *task;
+    __atomic_store_n(&dq->count, dq->count + 1, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&dq->lock);
+    return true;
+}
+
+// Newest task for the owner (LIFO keeps its data cache-warm), oldest for a thief
+static bool dequeTake(TaskDeque *dq, Task *task, bool steal) {
+    if (__atomic_load_n(&dq->count, __ATOMIC_RELAXED) == 0) {
+        return false;
+    }
+    pthread_mutex_lock(&dq->lock);
+    bool found = dq->count > 0;
+    if (found) {
+        if (steal) {
+            *task = dq->tasks[dq->head];
+            dq->head = (dq->head + 1) % dq->capacity;
+        } else {
+            *task = dq->tasks[(dq->head + dq->count - 1) % dq->capacity];
+        }
+        __atomic_store_n(&dq->count, dq->count - 1, __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock(&dq->lock);
+    return found;
+}
+
+// self is NULL for threads outside the pool: they only ever steal
+static bool schedulerFind(Scheduler *scheduler, SchedulerWorker *self, TaskPriority lowest, Task *task,
+                          bool *stolen) {
+    for (int priority = 0; priority <= (int)lowest; priority++) {
+        if (self && dequeTake(&self->deques[priority], task, false)) {
+            *stolen = false;
+            return true;
+        }
+        unsigned start = self ? (self->seed = self->seed * 1103515245u + 12345u) >> 16
+                              : __atomic_load_n(&scheduler->next_worker, __ATOMIC_RELAXED);
+        for (int i = 0; i < scheduler->threads; i++) {
+            SchedulerWorker *victim = &scheduler->workers[(start + i) % scheduler->threads];
+            if (victim != self && dequeTake(&victim->deques[priority], task, true)) {
+                *stolen = true;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+static void schedulerExecute(Scheduler *scheduler, SchedulerWorker *self, Task *task, bool stolen) {
+    TaskPriority priority = task->group->priority;
+    SchedulerCounters *counters = &(self ? self : &scheduler->external)->counters[priority];
+    __atomic_sub_fetch(&scheduler->queued, 1, __ATOMIC_SEQ_CST);
+    __atomic_sub_fetch(&scheduler->depth[priority], 1, __ATOMIC_RELAXED);
+
+    uint64_t latency = schedulerNow() - task->submitted_ns;
+    int bucket = latency ? 63 - __builtin_clzll(latency) : 0;
+    schedulerBump(&counters->latency_buckets[bucket < SCHEDULER_LATENCY_BUCKETS ? bucket : SCHEDULER_LATENCY_BUCKETS - 1], 1);
+    schedulerBump(&counters->latency_sum_ns, latency);
+    if (latency > __atomic_load_n(&counters->latency_max_ns, __ATOMIC_RELAXED)) {
+        __atomic_store_n(&counters->latency_max_ns, latency, __ATOMIC_RELAXED);
+    }
+    schedulerBump(&counters->executed, 1);
+    if (stolen) {
+        schedulerBump(&counters->stolen, 1);
+    }
+
+    task->task(task->index, task->context);
+
+    if (__atomic_sub_fetch(&task->group->pending, 1, __ATOMIC_ACQ_REL) == 0) {
+        pthread_mutex_lock(&scheduler->done_lock);
+        pthread_cond_broadcast(&scheduler->done);
+        pthread_mutex_unlock(&scheduler->done_lock);
+    }
+}
+
+typedef struct {
+    Scheduler *scheduler;
+    SchedulerWorker *worker;
+} WorkerArgs;
+
+static void *schedulerWorker(void *args) {
+    Scheduler *scheduler = ((WorkerArgs *)args)->scheduler;
+    SchedulerWorker *self = ((WorkerArgs *)args)->worker;
+    free(args);
+    scheduler_self = self;
+
+    for (;;) {
+        Task task;
+        bool stolen;
+        if (schedulerFind(scheduler, self, TASK_BACKGROUND, &task, &stolen)) {
+            schedulerExecute(scheduler, self, &task, stolen);
+            continue;
+        }
+
+        // Announce the sleep before the last look, so a submitter either sees us or we see its task
+        pthread_mutex_lock(&scheduler->sleep_lock);
+        __atomic_add_fetch(&scheduler->sleepers, 1, __ATOMIC_SEQ_CST);
+        while (!scheduler->stopping && __atomic_load_n(&scheduler->queued, __ATOMIC_SEQ_CST) == 0) {
+            pthread_cond_wait(&scheduler->wake, &scheduler->sleep_lock);
+        }
+        __atomic_sub_fetch(&scheduler->sleepers, 1, __ATOMIC_SEQ_CST);
+        bool stop = scheduler->stopping && __atomic_load_n(&scheduler->queued, __ATOMIC_SEQ_CST) == 0;
+        pthread_mutex_unlock(&scheduler->sleep_lock);
+        if (stop) {
+            break;
+        }
+    }
+    return NULL;
+}
+
+/*
+  Function schedulerInit
+  starts threads stealing workers (at least one). Returns false if
+  none could be started, with everything set up so far released again.
+*/
+bool schedulerInit(Scheduler *scheduler, int threads) {
+    memset(scheduler, 0, sizeof(Scheduler));
+    if (threads < 1) {
+        threads = 1;
+    }
+    pthread_mutex_init(&scheduler->sleep_lock, NULL);
+    pthread_mutex_init(&scheduler->done_lock, NULL);
+    pthread_cond_init(&scheduler->wake, NULL);
+    pthread_cond_init(&scheduler->done, NULL);
+
+    scheduler->workers = calloc(threads, sizeof(SchedulerWorker));
+    scheduler->worker_threads = calloc(threads, sizeof(pthread_t));
+    if (!scheduler->workers || !scheduler->worker_threads) {
+        schedulerDestroy(scheduler);
+        return false;
+    }
+    for (int i = 0; i < threads; i++) {
+        scheduler->workers[i].index = i;
+        scheduler->workers[i].seed = 2654435761u * (i + 1);
+        for (int p = 0; p < TASK_PRIORITY_COUNT; p++) {
+            if (!dequeInit(&scheduler->workers[i].deques[p])) {
+                for (int q = 0; q <= p; q++) {
+                    dequeDestroy(&scheduler->workers[i].deques[q]);
+                }
+                scheduler->threads = i;   // Only the workers before this one are torn down below
+                schedulerDestroy(scheduler);
+                return false;
+            }
+        }
+    }
+    scheduler->threads = threads;   // Deques of workers that fail to start are still stolen from
+
+    for (int i = 0; i < threads; i++) {
+        WorkerArgs *args = malloc(sizeof(WorkerArgs));
+        if (!args) {
+            break;
+        }
+        args->scheduler = scheduler;
+        args->worker = &scheduler->workers[i];
+        if (pthread_create(&scheduler->worker_threads[scheduler->started], NULL, schedulerWorker, args) != 0) {
+            free(args);
+            break;
+        }
+        scheduler->started++;
+    }
+    if (scheduler->started == 0) {
+        schedulerDestroy(scheduler);
+        return false;
+    }
+    return true;
+}
+
+// Runs whatever is still queued, then stops the workers; spawned stages must be joined first
+void schedulerDestroy(Scheduler *scheduler) {
+    pthread_mutex_lock(&scheduler->sleep_lock);
+    scheduler->stopping = true;
+    pthread_cond_broadcast(&scheduler->wake);
+    pthread_mutex_unlock(&scheduler->sleep_lock);
+
+    for (int i = 0; i < scheduler->started; i++) {
+        pthread_join(scheduler->worker_threads[i], NULL);
+    }
+    for (int i = 0; scheduler->workers && i < scheduler->threads; i++) {
+        for (int p = 0; p < TASK_PRIORITY_COUNT; p++) {
+            dequeDestroy(&scheduler->workers[i].deques[p]);
+        }
+    }
+    free(scheduler->workers);
+    free(scheduler->worker_threads);
+    pthread_mutex_destroy(&scheduler->sleep_lock);
+    pthread_mutex_destroy(&scheduler->done_lock);
+    pthread_cond_destroy(&scheduler->wake);
+    pthread_cond_destroy(&scheduler->done);
+}
+
+void taskGroupInit(TaskGroup *group, TaskPriority priority) {
+    group->pending = 0;
+    group->priority = priority;
+}
+
+/*
+  Function schedulerSubmit
+  queues task(index, context) in group. A worker pushes onto its own
+  deque; other threads spread their tasks over the workers round-robin.
+*/
+bool schedulerSubmit(Scheduler *scheduler, TaskGroup *group, ParallelTask task, void *context, int index) {
+    SchedulerWorker *self = scheduler_self;
+    if (self && (self < scheduler->workers || self >= scheduler->workers + scheduler->threads)) {
+        self = NULL;   // Worker of another scheduler
+    }
+    SchedulerWorker *target = self ? self :
+        &scheduler->workers[__atomic_fetch_add(&scheduler->next_worker, 1, __ATOMIC_RELAXED) % scheduler->threads];
+    Task entry = {task, context, index, group, schedulerNow()};
+
+    __atomic_add_fetch(&group->pending, 1, __ATOMIC_ACQ_REL);
+    if (!dequePush(&target->deques[group->priority], &entry)) {
+        __atomic_sub_fetch(&group->pending, 1, __ATOMIC_ACQ_REL);
+        return false;
+    }
+    schedulerBump(&(self ? self : &scheduler->external)->counters[group->priority].submitted, 1);
+
+    int depth = __atomic_add_fetch(&scheduler->depth[group->priority], 1, __ATOMIC_RELAXED);
+    int peak = __atomic_load_n(&scheduler->peak_depth[group->priority], __ATOMIC_RELAXED);
+    while (depth > peak && !__atomic_compare_exchange_n(&scheduler->peak_depth[group->priority], &peak, depth,
+                                                        false, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+
+    __atomic_add_fetch(&scheduler->queued, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&scheduler->sleepers, __ATOMIC_SEQ_CST) > 0) {
+        pthread_mutex_lock(&scheduler->sleep_lock);
+        pthread_cond_signal(&scheduler->wake);
+        pthread_mutex_unlock(&scheduler->sleep_lock);
+    }
+    return true;
+}
+
+/*
+  Function schedulerWait
+  returns once every task of group ran. The waiting thread helps in the
+  meantime, but only with tasks at least as urgent as the group, so a
+  realtime wait never ends up inside a background job.
+*/
+void schedulerWait(Scheduler *scheduler, TaskGroup *group) {
+    SchedulerWorker *self = scheduler_self;
+    if (self && (self < scheduler->workers || self >= scheduler->workers + scheduler->threads)) {
+        self = NULL;
+    }
+
+    while (__atomic_load_n(&group->pending, __ATOMIC_ACQUIRE) > 0) {
+        Task task;
+        bool stolen;
+        if (schedulerFind(scheduler, self, group->priority, &task, &stolen)) {
+            schedulerExecute(scheduler, self, &task, stolen);
+            continue;
+        }
+        pthread_mutex_lock(&scheduler->done_lock);
+        while (__atomic_load_n(&group->pending, __ATOMIC_ACQUIRE) > 0) {
+            pthread_cond_wait(&scheduler->done, &scheduler->done_lock);
+        }
+        pthread_mutex_unlock(&scheduler->done_lock);
+    }
+}
+
+// Same contract as threadPoolRun, at the given priority
+void schedulerRun(Scheduler *scheduler, TaskPriority priority, int count, ParallelTask task, void *context) {
+    TaskGroup group;
+    taskGroupInit(&group, priority);
+    for (int i = 0; i < count; i++) {
+        if (!schedulerSubmit(scheduler, &group, task, context, i)) {
+            task(i, context);
+        }
+    }
+    schedulerWait(scheduler, &group);
+}
+
+/*
+  Function schedulerSpawn
+  starts a long-running stage (a loop that blocks on its queues) on a
+  thread of its own, so it never occupies a stealing worker. Returns
+  the handle for schedulerJoin, -1 on failure.
+*/
+int schedulerSpawn(Scheduler *scheduler, const char *name, SchedulerStage stage, void *args) {
+    if (scheduler->stage_count == SCHEDULER_MAX_STAGES) {
+        fprintf(stderr, "Error: Too many pipeline stages\n");
+        return -1;
+    }
+    int handle = scheduler->stage_count;
+    if (pthread_create(&scheduler->stages[handle], NULL, stage, args) != 0) {
+        fprintf(stderr, "Error: Could not start the %s stage\n", name);
+        return -1;
+    }
+    scheduler->stage_names[handle] = name;
+    scheduler->stage_joined[handle] = false;
+    scheduler->stage_count++;
+    return handle;
+}
+
+void schedulerJoin(Scheduler *scheduler, int stage) {
+    if (stage < 0 || stage >= scheduler->stage_count || scheduler->stage_joined[stage]) {
+        return;
+    }
+    pthread_join(scheduler->stages[stage], NULL);
+    scheduler->stage_joined[stage] = true;
+}
+
+static void schedulerAddCounters(SchedulerCounters *sum, SchedulerCounters *counters) {
+    sum->submitted += __atomic_load_n(&counters->submitted, __ATOMIC_RELAXED);
+    sum->executed += __atomic_load_n(&counters->executed, __ATOMIC_RELAXED);
+    sum->stolen += __atomic_load_n(&counters->stolen, __ATOMIC_RELAXED);
+    sum->latency_sum_ns += __atomic_load_n(&counters->latency_sum_ns, __ATOMIC_RELAXED);
+    uint64_t max = __atomic_load_n(&counters->latency_max_ns, __ATOMIC_RELAXED);
+    if (max > sum->latency_max_ns) {
+        sum->latency_max_ns = max;
+    }
+    for (int b = 0; b < SCHEDULER_LATENCY_BUCKETS; b++) {
+        sum->latency_buckets[b] += __atomic_load_n(&counters->latency_buckets[b], __ATOMIC_RELAXED);
+    }
+}
+
+// Totals over every worker and outside helper; safe to call while tasks run
+void schedulerGetStats(Scheduler *scheduler, SchedulerStats *stats) {
+    memset(stats, 0, sizeof(SchedulerStats));
+    stats->workers = scheduler->started;
+    stats->stages = scheduler->stage_count;
+    for (int p = 0; p < TASK_PRIORITY_COUNT; p++) {
+        stats->depth[p] = __atomic_load_n(&scheduler->depth[p], __ATOMIC_RELAXED);
+        stats->peak_depth[p] = __atomic_load_n(&scheduler->peak_depth[p], __ATOMIC_RELAXED);
+        for (int i = 0; i < scheduler->threads; i++) {
+            schedulerAddCounters(&stats->priority[p], &scheduler->workers[i].counters[p]);
+        }
+        schedulerAddCounters(&stats->priority[p], &scheduler->external.counters[p]);
+    }
+}
+
+// Upper bound of the bucket holding the given fraction of the samples, in microseconds
+static double schedulerLatencyQuantile(const SchedulerCounters *counters, double quantile) {
+    uint64_t seen = 0, target = (uint64_t)(quantile * counters->executed + 0.5);
+    for (int b = 0; b < SCHEDULER_LATENCY_BUCKETS; b++) {
+        seen += counters->latency_buckets[b];
+        if (seen >= target && seen > 0) {
+            return (double)(2ull << b) / 1e3;
+        }
+    }
+    return 0.0;
+}
+
+void schedulerPrintStats(Scheduler *scheduler, FILE *out) {
+    static const char *names[TASK_PRIORITY_COUNT] = {"realtime", "background"};
+    SchedulerStats stats;
+    schedulerGetStats(scheduler, &stats);
+
+    fprintf(out, "Scheduler: %d workers, %d stages (", stats.workers, stats.stages);
+    for (int i = 0; i < scheduler->stage_count; i++) {
+        fprintf(out, "%s%s", i ? ", " : "", scheduler->stage_names[i]);
+    }
+    fprintf(out, ")\n");
+    for (int p = 0; p < TASK_PRIORITY_COUNT; p++) {
+        const SchedulerCounters *c = &stats.priority[p];
+        fprintf(out, "  %-10s %llu tasks, %llu stolen, queue depth %d (peak %d), start latency "
+                "mean %.1f us, p50 <%.0f us, p99 <%.0f us, max %.1f us\n",
+                names[p], (unsigned long long)c->executed, (unsigned long long)c->stolen,
+                stats.depth[p], stats.peak_depth[p],
+                c->executed ? c->latency_sum_ns / (double)c->executed / 1e3 : 0.0,
+                schedulerLatencyQuantile(c, 0.50), schedulerLatencyQuantile(c, 0.99), c->latency_max_ns / 1e3);
+    }
+}
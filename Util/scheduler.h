@@ -0,0 +1,104 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "parallel.h"
+
+#define SCHEDULER_MAX_STAGES 8
+#define SCHEDULER_LATENCY_BUCKETS 40   // Powers of two of nanoseconds
+
+// Realtime tasks are always picked before background ones, locally and when stealing
+typedef enum {
+    TASK_REALTIME,     // Playback work with a deadline (frame conversion)
+    TASK_BACKGROUND,   // Work that only has to be done eventually (subtitle rasterization, scans)
+    TASK_PRIORITY_COUNT
+} TaskPriority;
+
+// Tasks submitted together and waited for together
+typedef struct {
+    int pending;
+    TaskPriority priority;
+} TaskGroup;
+
+typedef struct {
+    ParallelTask task;
+    void *context;
+    int index;
+    TaskGroup *group;
+    uint64_t submitted_ns;
+} Task;
+
+// Ring of tasks: the owner pushes and pops at the bottom, thieves take from the top
+typedef struct {
+    Task *tasks;
+    int capacity, head, count;
+    pthread_mutex_t lock;
+} TaskDeque;
+
+typedef struct {
+    uint64_t submitted, executed, stolen;
+    uint64_t latency_buckets[SCHEDULER_LATENCY_BUCKETS];   // Submit to start of execution
+    uint64_t latency_sum_ns, latency_max_ns;
+} SchedulerCounters;
+
+typedef struct {
+    TaskDeque deques[TASK_PRIORITY_COUNT];
+    SchedulerCounters counters[TASK_PRIORITY_COUNT];
+    unsigned seed;   // Victim selection
+    int index;
+} SchedulerWorker;
+
+/*
+  Work-stealing pool sized to the machine. Every worker owns one deque
+  per priority; a worker with nothing local steals the oldest task of
+  a random victim. Tasks must not block: the pipeline stages, which do
+  block on their queues, are spawned as long-running stages on threads
+  of their own and submit their short work here.
+*/
+typedef struct {
+    int threads;
+    SchedulerWorker *workers;
+    pthread_t *worker_threads;
+    int started;
+    SchedulerWorker external;     // Submissions and help from threads outside the pool
+    unsigned next_worker;         // Round-robin target for external submissions
+
+    int queued;                   // Tasks in all deques
+    int depth[TASK_PRIORITY_COUNT], peak_depth[TASK_PRIORITY_COUNT];
+    int sleepers;
+    bool stopping;
+    pthread_mutex_t sleep_lock, done_lock;
+    pthread_cond_t wake, done;
+
+    pthread_t stages[SCHEDULER_MAX_STAGES];
+    const char *stage_names[SCHEDULER_MAX_STAGES];
+    bool stage_joined[SCHEDULER_MAX_STAGES];
+    int stage_count;
+} Scheduler;
+
+typedef struct {
+    int workers, stages;
+    int depth[TASK_PRIORITY_COUNT], peak_depth[TASK_PRIORITY_COUNT];
+    SchedulerCounters priority[TASK_PRIORITY_COUNT];
+} SchedulerStats;
+
+typedef void *(*SchedulerStage)(void *args);
+
+bool schedulerInit(Scheduler *scheduler, int threads);
+void schedulerDestroy(Scheduler *scheduler);
+
+void taskGroupInit(TaskGroup *group, TaskPriority priority);
+bool schedulerSubmit(Scheduler *scheduler, TaskGroup *group, ParallelTask task, void *context, int index);
+void schedulerWait(Scheduler *scheduler, TaskGroup *group);
+void schedulerRun(Scheduler *scheduler, TaskPriority priority, int count, ParallelTask task, void *context);
+
+int schedulerSpawn(Scheduler *scheduler, const char *name, SchedulerStage stage, void *args);
+void schedulerJoin(Scheduler *scheduler, int stage);
+
+void schedulerGetStats(Scheduler *scheduler, SchedulerStats *stats);
+void schedulerPrintStats(Scheduler *scheduler, FILE *out);
+
+#endif // SCHEDULER_H
@@ -0,0 +1,137 @@
+#include "threadpool.h"
+
+#include <stdlib.h>
+
+// Claims and runs items of the current run until none are left
+static void threadPoolDrain(ThreadPool *pool, ParallelTask task, void *context, int count) {
+    for (;;) {
+        int index = __atomic_fetch_add(&pool->next, 1, __ATOMIC_RELAXED);
+        if (index >= count) {
+            break;
+        }
+        task(index, context);
+        if (__atomic_add_fetch(&pool->finished, 1, __ATOMIC_ACQ_REL) == count) {
+            pthread_mutex_lock(&pool->mutex);
+            pthread_cond_signal(&pool->done);
+            pthread_mutex_unlock(&pool->mutex);
+        }
+    }
+}
+
+static void *threadPoolWorker(void *args) {
+    ThreadPool *pool = args;
+    unsigned seen = 0;
+
+    pthread_mutex_lock(&pool->mutex);
+    for (;;) {
+        while (!pool->stopping && pool->generation == seen) {
+            pthread_cond_wait(&pool->wake, &pool->mutex);
+        }
+        if (pool->stopping) {
+            break;
+        }
+        seen = pool->generation;
+        ParallelTask task = pool->task;
+        void *context = pool->context;
+        int count = pool->count;
+        pool->busy++;
+        pthread_mutex_unlock(&pool->mutex);
+
+        threadPoolDrain(pool, task, context, count);
+
+        pthread_mutex_lock(&pool->mutex);
+        pool->busy--;
+        pthread_cond_signal(&pool->done);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+    return NULL;
+}
+
+/*
+  Function threadPoolInit
+  starts threads - 1 workers that sleep between runs; the thread
+  calling threadPoolRun makes up the last one.
+*/
+bool threadPoolInit(ThreadPool *pool, int threads) {
+    if (threads < 1) {
+        threads = 1;
+    }
+    pool->threads = threads;
+    pool->started = 0;
+    pool->generation = 0;
+    pool->stopping = false;
+    pool->count = pool->next = pool->finished = pool->busy = 0;
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->wake, NULL);
+    pthread_cond_init(&pool->done, NULL);
+
+    pool->workers = malloc((threads - 1) * sizeof(pthread_t) + 1);
+    if (!pool->workers) {
+        return false;
+    }
+    for (int i = 0; i < threads - 1; i++) {
+        if (pthread_create(&pool->workers[pool->started], NULL, threadPoolWorker, pool) == 0) {
+            pool->started++;
+        }
+    }
+    pool->threads = pool->started + 1;
+    return true;
+}
+
+void threadPoolDestroy(ThreadPool *pool) {
+    pthread_mutex_lock(&pool->mutex);
+    pool->stopping = true;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->mutex);
+
+    for (int i = 0; i < pool->started; i++) {
+        pthread_join(pool->workers[i], NULL);
+    }
+    free(pool->workers);
+    pthread_mutex_destroy(&pool->mutex);
+    pthread_cond_destroy(&pool->wake);
+    pthread_cond_destroy(&pool->done);
+}
+
+/*
+  Function threadPoolRun
+  same contract as parallelFor, on the pool's sleeping workers. Returns
+  once every item is done and no worker still looks at this run. A
+  worker only catching up with a finished run can still pick up its
+  fields afterwards, so a run is not published until busy is back to
+  zero; such a worker finds nothing left to claim and leaves at once.
+*/
+void threadPoolRun(ThreadPool *pool, int count, ParallelTask task, void *context) {
+    if (count <= 0) {
+        return;
+    }
+    if (pool->started == 0 || count == 1) {
+        for (int i = 0; i < count; i++) {
+            task(i, context);
+        }
+        return;
+    }
+
+    // A worker that woke too late for the last run may still have claimed it; publishing
+    // now would let it run that run's task on this run's indices
+    pthread_mutex_lock(&pool->mutex);
+    while (pool->busy > 0) {
+        pthread_cond_wait(&pool->done, &pool->mutex);
+    }
+    pool->task = task;
+    pool->context = context;
+    pool->count = count;
+    pool->next = 0;
+    pool->finished = 0;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->mutex);
+
+    threadPoolDrain(pool, task, context, count);
+
+    pthread_mutex_lock(&pool->mutex);
+    while (__atomic_load_n(&pool->finished, __ATOMIC_ACQUIRE) < count || pool->busy > 0) {
+        pthread_cond_wait(&pool->done, &pool->mutex);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+}
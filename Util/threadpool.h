@@ -0,0 +1,32 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include "parallel.h"
+
+// Persistent workers for work issued many times a second (per frame)
+typedef struct {
+    int threads;               // Including the calling thread
+    pthread_t *workers;
+    int started;
+
+    pthread_mutex_t mutex;
+    pthread_cond_t wake, done;
+    unsigned generation;       // Bumped for every run
+    bool stopping;
+
+    // Current run
+    ParallelTask task;
+    void *context;
+    int count;
+    int next;                  // Claimed with an atomic increment
+    int finished;              // Items completed
+    int busy;                  // Workers inside the run
+} ThreadPool;
+
+bool threadPoolInit(ThreadPool *pool, int threads);
+void threadPoolDestroy(ThreadPool *pool);
+void threadPoolRun(ThreadPool *pool, int count, ParallelTask task, void *context);
+
+#endif // THREADPOOL_H
@@ -0,0 +1,304 @@
+#include "wall.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../Decoding/pipeline.h"
+
+static double wallNow() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Largest rectangle of the picture's display aspect that fits the cell, centered in it
+static void wallPlaceTile(VideoWall *wall, WallTile *tile, int cell) {
+    AVStream *stream = tile->format_context->streams[tile->stream_index];
+    AVRational sar = av_guess_sample_aspect_ratio(tile->format_context, stream, NULL);
+    double aspect = (double)stream->codecpar->width / stream->codecpar->height;
+    if (sar.num > 0 && sar.den > 0) {
+        aspect *= av_q2d(sar);
+    }
+
+    int cell_width = wall->config.tile_width, cell_height = wall->config.tile_height;
+    tile->width = cell_width;
+    tile->height = (int)lrint(cell_width / aspect);
+    if (tile->height > cell_height) {
+        tile->height = cell_height;
+        tile->width = (int)lrint(cell_height * aspect);
+    }
+    // Even for 4:2:0, and never 0 however skewed the aspect: swscale rejects empty pictures
+    tile->width = tile->width < 2 ? 2 : tile->width & ~1;
+    tile->height = tile->height < 2 ? 2 : tile->height & ~1;
+    tile->x = (cell % wall->config.columns) * cell_width + (cell_width - tile->width) / 2;
+    tile->y = (cell / wall->config.columns) * cell_height + (cell_height - tile->height) / 2;
+}
+
+static bool wallOpenTile(VideoWall *wall, WallTile *tile, const char *input, int cell) {
+    tile->input = input;
+    tile->first_pts = AV_NOPTS_VALUE;
+
+    if (ioOpenInput(&tile->format_context, input, wall->config.io_mode) < 0) {
+        fprintf(stderr, "Error: Could not open input file '%s'\n", input);
+        return false;
+    }
+    if (avformat_find_stream_info(tile->format_context, NULL) < 0) {
+        fprintf(stderr, "Error: Could not find stream information in '%s'\n", input);
+        return false;
+    }
+    tile->stream_index = findFirstStream(tile->format_context, AVMEDIA_TYPE_VIDEO);
+    if (tile->stream_index < 0) {
+        fprintf(stderr, "Error: '%s' has no video stream\n", input);
+        return false;
+    }
+    AVCodecParameters *codecpar = tile->format_context->streams[tile->stream_index]->codecpar;
+    if (codecpar->width <= 0 || codecpar->height <= 0) {
+        fprintf(stderr, "Error: '%s' has a video stream without a picture size\n", input);
+        return false;
+    }
+    for (int i = 0; i < tile->format_context->nb_streams; i++) {
+        if (i != tile->stream_index) {
+            tile->format_context->streams[i]->discard = AVDISCARD_ALL;
+        }
+    }
+
+    AVStream *stream = tile->format_context->streams[tile->stream_index];
+    AVRational rate = stream->avg_frame_rate.num ? stream->avg_frame_rate : stream->r_frame_rate;
+    tile->frame_interval = rate.num > 0 && rate.den > 0 ? (double)rate.den / rate.num : 1.0 / 30;
+
+    wallPlaceTile(wall, tile, cell);
+    // One thread per decoder: the shared pool is the only parallelism
+    tile->codec_context = openSizedVideoDecoder(tile->format_context, tile->stream_index, 1,
+                                                tile->width, tile->height);
+    tile->packet = av_packet_alloc();
+    tile->pending = av_frame_alloc();
+    tile->due = av_frame_alloc();
+    if (!tile->codec_context || !tile->packet || !tile->pending || !tile->due) {
+        return false;
+    }
+    return true;
+}
+
+static void wallCloseTile(WallTile *tile) {
+    sws_freeContext(tile->sws);
+    av_frame_free(&tile->pending);
+    av_frame_free(&tile->due);
+    av_packet_free(&tile->packet);
+    avcodec_free_context(&tile->codec_context);
+    if (tile->format_context) {
+        ioCloseInput(&tile->format_context);
+    }
+}
+
+/*
+  Function wallOpen
+  opens every input and lays them out row by row. The canvas starts
+  black, so letterbox bars never need to be drawn.
+*/
+bool wallOpen(VideoWall *wall, const WallConfig *config, const char *const *inputs, int count, ThreadPool *pool) {
+    memset(wall, 0, sizeof(VideoWall));
+    if (count < 1 || count > WALL_MAX_TILES) {
+        fprintf(stderr, "Error: A wall takes 1 to %d inputs\n", WALL_MAX_TILES);
+        return false;
+    }
+    wall->config = *config;
+    if (wall->config.columns <= 0) {
+        wall->config.columns = (int)ceil(sqrt(count));
+    }
+    if (wall->config.columns > count) {
+        wall->config.columns = count;
+    }
+    wall->count = count;
+    wall->rows = (count + wall->config.columns - 1) / wall->config.columns;
+    wall->pool = pool;
+
+    wall->canvas_width = wall->config.columns * wall->config.tile_width;
+    wall->canvas_height = wall->rows * wall->config.tile_height;
+    wall->canvas_linesize = wall->canvas_width * 3;
+    wall->canvas = calloc((size_t)wall->canvas_linesize * wall->canvas_height, 1);
+    if (!wall->canvas) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        return false;
+    }
+
+    for (int i = 0; i < count; i++) {
+        if (!wallOpenTile(wall, &wall->tiles[i], inputs[i], i)) {
+            wallClose(wall);
+            return false;
+        }
+    }
+    return true;
+}
+
+void wallClose(VideoWall *wall) {
+    for (int i = 0; i < wall->count; i++) {
+        wallCloseTile(&wall->tiles[i]);
+    }
+    free(wall->canvas);
+    wall->canvas = NULL;
+    wall->count = 0;
+}
+
+// Seeks back to the start; timestamps continue one frame after the last one
+static bool wallRestart(WallTile *tile) {
+    int64_t start = tile->format_context->start_time != AV_NOPTS_VALUE ? tile->format_context->start_time : 0;
+    if (av_seek_frame(tile->format_context, -1, start, AVSEEK_FLAG_BACKWARD) < 0) {
+        return false;
+    }
+    avcodec_flush_buffers(tile->codec_context);
+    tile->loop_offset = tile->pending_time + tile->frame_interval;
+    tile->first_pts = AV_NOPTS_VALUE;
+    tile->draining = false;
+    tile->loops++;
+    return true;
+}
+
+// Decodes the next frame into tile->pending; false once the input is exhausted
+static bool wallDecodeNext(const VideoWall *wall, WallTile *tile) {
+    for (;;) {
+        int ret = avcodec_receive_frame(tile->codec_context, tile->pending);
+        if (ret == 0) {
+            break;
+        }
+        if (ret == AVERROR_EOF) {
+            if (!wall->config.loop || !wallRestart(tile)) {
+                return false;
+            }
+            continue;
+        }
+
+        if (av_read_frame(tile->format_context, tile->packet) < 0) {
+            if (tile->draining) {
+                return false;   // Decoder asked for input after its end
+            }
+            avcodec_send_packet(tile->codec_context, NULL);
+            tile->draining = true;
+            continue;
+        }
+        if (tile->packet->stream_index == tile->stream_index) {
+            avcodec_send_packet(tile->codec_context, tile->packet);   // Undecodable packets are skipped
+        }
+        av_packet_unref(tile->packet);
+    }
+
+    int64_t pts = tile->pending->best_effort_timestamp;
+    if (pts == AV_NOPTS_VALUE) {
+        tile->pending_time += tile->frame_interval;
+    } else {
+        if (tile->first_pts == AV_NOPTS_VALUE) {
+            tile->first_pts = pts;
+        }
+        AVRational time_base = tile->format_context->streams[tile->stream_index]->time_base;
+        tile->pending_time = tile->loop_offset + (pts - tile->first_pts) * av_q2d(time_base);
+    }
+    tile->decoded++;
+    return true;
+}
+
+// Scales the frame into the tile's rectangle of the canvas, no intermediate picture
+static void wallScaleTile(VideoWall *wall, WallTile *tile) {
+    const AVFrame *frame = tile->due;
+    tile->sws = sws_getCachedContext(tile->sws, frame->width, frame->height, frame->format,
+                                     tile->width, tile->height, AV_PIX_FMT_RGB24,
+                                     SWS_BILINEAR, NULL, NULL, NULL);
+    if (!tile->sws) {
+        return;
+    }
+    uint8_t *dst[4] = {wall->canvas + (size_t)tile->y * wall->canvas_linesize + tile->x * 3, NULL, NULL, NULL};
+    int dst_linesize[4] = {wall->canvas_linesize, 0, 0, 0};
+    sws_scale(tile->sws, (const uint8_t *const *)frame->data, frame->linesize, 0, frame->height, dst, dst_linesize);
+    tile->shown++;
+}
+
+/*
+  Function wallTileStep
+  pool item for one tile: decodes every frame due by the wall's time,
+  keeps only the newest of them and scales that one. Frames replaced
+  before their tick came (the wall fell behind, or the input has a
+  higher frame rate) are counted as skipped and never converted.
+*/
+static void wallTileStep(int index, void *context) {
+    VideoWall *wall = context;
+    WallTile *tile = &wall->tiles[index];
+    bool have_due = false;
+    double start = wallNow();
+
+    while (!tile->ended) {
+        if (!tile->has_pending) {
+            tile->has_pending = wallDecodeNext(wall, tile);
+            if (!tile->has_pending) {
+                tile->ended = true;   // Last picture stays up
+                break;
+            }
+        }
+        if (tile->pending_time > wall->time) {
+            break;
+        }
+        if (have_due) {
+            tile->skipped++;
+        }
+        av_frame_unref(tile->due);
+        av_frame_move_ref(tile->due, tile->pending);
+        tile->has_pending = false;
+        have_due = true;
+    }
+
+    double decoded = wallNow();
+    tile->decode_seconds += decoded - start;
+    if (have_due) {
+        wallScaleTile(wall, tile);
+        av_frame_unref(tile->due);
+        tile->scale_seconds += wallNow() - decoded;
+    }
+}
+
+/*
+  Function wallStep
+  brings every tile to time (seconds since the start) on the shared
+  pool and returns how many tiles are still playing.
+*/
+int wallStep(VideoWall *wall, double time) {
+    double start = wallNow();
+    wall->time = time;
+    threadPoolRun(wall->pool, wall->count, wallTileStep, wall);
+
+    double took = wallNow() - start;
+    wall->ticks++;
+    wall->step_seconds += took;
+    wall->step_max = fmax(wall->step_max, took);
+
+    int playing = 0;
+    for (int i = 0; i < wall->count; i++) {
+        playing += !wall->tiles[i].ended;
+    }
+    return playing;
+}
+
+// Aggregate throughput in streams x frames per second, then one line per tile
+void wallPrintStats(const VideoWall *wall, double elapsed, FILE *out) {
+    uint64_t shown = 0, skipped = 0;
+    for (int i = 0; i < wall->count; i++) {
+        shown += wall->tiles[i].shown;
+        skipped += wall->tiles[i].skipped;
+    }
+    fprintf(out, "Wall: %d streams (%dx%d) on %d threads, %llu ticks in %.2fs: %llu frames shown = %.1f stream-fps "
+            "(%.1f per stream), %llu skipped late; step mean %.2f ms, max %.2f ms\n",
+            wall->count, wall->config.columns, wall->rows, wall->pool->threads,
+            (unsigned long long)wall->ticks, elapsed, (unsigned long long)shown,
+            elapsed > 0 ? shown / elapsed : 0.0, elapsed > 0 ? shown / elapsed / wall->count : 0.0,
+            (unsigned long long)skipped, wall->ticks ? wall->step_seconds / wall->ticks * 1e3 : 0.0,
+            wall->step_max * 1e3);
+
+    for (int i = 0; i < wall->count; i++) {
+        const WallTile *tile = &wall->tiles[i];
+        const AVCodecParameters *par = tile->format_context->streams[tile->stream_index]->codecpar;
+        fprintf(out, "  %2d %s: %dx%d -> %dx%d (lowres %d), %llu decoded, %llu shown, %llu skipped, %llu loops, "
+                "decode %.2f ms/frame, scale %.2f ms/frame\n",
+                i, tile->input, par->width, par->height, tile->width, tile->height, tile->codec_context->lowres,
+                (unsigned long long)tile->decoded, (unsigned long long)tile->shown,
+                (unsigned long long)tile->skipped, (unsigned long long)tile->loops,
+                tile->decoded ? tile->decode_seconds / tile->decoded * 1e3 : 0.0,
+                tile->shown ? tile->scale_seconds / tile->shown * 1e3 : 0.0);
+    }
+}
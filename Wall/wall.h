@@ -0,0 +1,70 @@
+#ifndef WALL_H
+#define WALL_H
+
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libswscale/swscale.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "../IO/mmapio.h"
+#include "../Util/threadpool.h"
+
+#define WALL_MAX_TILES 64
+
+// One input of the wall, decoded and scaled straight into its cell of the canvas
+typedef struct {
+    const char *input;
+    AVFormatContext *format_context;
+    AVCodecContext *codec_context;
+    struct SwsContext *sws;
+    int stream_index;
+    AVPacket *packet;
+    AVFrame *pending;           // Decoded, not due yet
+    AVFrame *due;               // Newest frame due at the current tick
+    bool has_pending, ended, draining;
+    double pending_time;        // Seconds since the tile's first frame
+    double frame_interval;      // Guess for frames without a timestamp
+    int64_t first_pts;
+    double loop_offset;         // Added to timestamps after each restart
+    int x, y, width, height;    // Picture inside the canvas, aspect ratio kept
+
+    // Counters, only touched by the worker running the tile
+    uint64_t decoded, shown, skipped, loops;
+    double decode_seconds, scale_seconds;
+} WallTile;
+
+typedef struct {
+    int columns;                // 0: as square as the tile count allows
+    int tile_width, tile_height;
+    bool loop;                  // Restart inputs at their end instead of freezing
+    IOMode io_mode;
+} WallConfig;
+
+/*
+  N inputs played side by side on one shared ThreadPool. Every tick
+  each tile is one pool item: it decodes up to the tick's time and
+  scales only the newest due frame into its cell of one RGB24 canvas.
+  Decoders run single-threaded, so the pool size is the whole CPU
+  budget however many tiles there are.
+*/
+typedef struct {
+    WallConfig config;
+    WallTile tiles[WALL_MAX_TILES];
+    int count;
+    int rows;
+    ThreadPool *pool;
+    uint8_t *canvas;
+    int canvas_width, canvas_height, canvas_linesize;
+    double time;                // Media time of the current tick, seconds
+
+    uint64_t ticks;
+    double step_seconds, step_max;
+} VideoWall;
+
+bool wallOpen(VideoWall *wall, const WallConfig *config, const char *const *inputs, int count, ThreadPool *pool);
+void wallClose(VideoWall *wall);
+int wallStep(VideoWall *wall, double time);
+void wallPrintStats(const VideoWall *wall, double elapsed, FILE *out);
+
+#endif // WALL_H
@@ -0,0 +1,230 @@
+#include <getopt.h>
+#include <libgen.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "Decoding/pipeline.h"
+#include "Export/export.h"
+#include "Util/parallel.h"
+
+typedef struct {
+    ExportJob *jobs;
+    pthread_mutex_t print_lock;
+} ExportQueue;
+
+static void printUsage(const char *program) {
+    fprintf(stderr, "Usage: %s [options] <input_file>...\n", program);
+    fprintf(stderr, "  --wav                 export audio as 16-bit stereo WAV\n");
+    fprintf(stderr, "  --y4m                 export video as raw YUV4MPEG2 (4:2:0)\n");
+    fprintf(stderr, "  -o, --output-dir=DIR  write <name>.wav / <name>.y4m into DIR (default: .); inputs sharing\n"
+                    "                        a name get -<N>, their position on the command line, appended\n");
+    fprintf(stderr, "  --stdout              write the single requested stream of one input to stdout\n");
+    fprintf(stderr, "  -j, --jobs=N          inputs processed in parallel (default: one per core)\n");
+    fprintf(stderr, "  --rate=HZ             WAV sample rate (default: %d)\n", OUTPUT_SAMPLE_RATE);
+    fprintf(stderr, "  --io=mmap|read|ffmpeg input I/O path (default: mmap)\n");
+}
+
+// Input file name without directory and extension, malloc'd; NULL if out of memory
+static char *outputStem(const char *input) {
+    char *copy = strdup(input);
+    if (!copy) {
+        return NULL;
+    }
+    char *name = basename(copy);
+    char *dot = strrchr(name, '.');
+    if (dot && dot != name) {
+        *dot = '\0';
+    }
+    char *stem = strdup(name);
+    free(copy);
+    return stem;
+}
+
+// <dir>/<stem>.<extension>, or <dir>/<stem>-<N>.<extension> for the Nth input when stems collide
+static char *outputPath(const char *dir, const char *stem, int suffix, const char *extension) {
+    size_t length = strlen(dir) + strlen(stem) + strlen(extension) + 16;
+    char *path = malloc(length);
+    if (!path) {
+        return NULL;
+    }
+    if (suffix > 0) {
+        snprintf(path, length, "%s/%s-%d.%s", dir, stem, suffix, extension);
+    } else {
+        snprintf(path, length, "%s/%s.%s", dir, stem, extension);
+    }
+    return path;
+}
+
+/*
+  Function assignOutputPaths
+  names every job's outputs. Inputs sharing a file name (from different
+  directories, or the same file twice) would write to one path from two
+  workers at once, so each of them gets its position on the command
+  line as a suffix. Should a suffixed name still clash with another
+  input's, nothing is started.
+*/
+static bool assignOutputPaths(ExportJob *jobs, int count, const char *dir, bool want_wav, bool want_y4m) {
+    char **stems = calloc(count, sizeof(char *));
+    bool ok = stems != NULL;
+    for (int i = 0; ok && i < count; i++) {
+        stems[i] = outputStem(jobs[i].input);
+        ok = stems[i] != NULL;
+    }
+    for (int i = 0; ok && i < count; i++) {
+        bool shared = false;
+        for (int j = 0; j < count && !shared; j++) {
+            shared = j != i && strcmp(stems[i], stems[j]) == 0;
+        }
+        jobs[i].wav_path = want_wav ? outputPath(dir, stems[i], shared ? i + 1 : 0, "wav") : NULL;
+        jobs[i].y4m_path = want_y4m ? outputPath(dir, stems[i], shared ? i + 1 : 0, "y4m") : NULL;
+        ok = (!want_wav || jobs[i].wav_path) && (!want_y4m || jobs[i].y4m_path);
+    }
+    for (int i = 0; stems && i < count; i++) {
+        free(stems[i]);
+    }
+    free(stems);
+    if (!ok) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        return false;
+    }
+
+    for (int i = 0; i < count; i++) {
+        const char *path = jobs[i].wav_path ? jobs[i].wav_path : jobs[i].y4m_path;
+        for (int j = i + 1; j < count; j++) {
+            const char *other = jobs[j].wav_path ? jobs[j].wav_path : jobs[j].y4m_path;
+            if (strcmp(path, other) == 0) {
+                fprintf(stderr, "Error: '%s' and '%s' would both be written to %s\n", jobs[i].input, jobs[j].input,
+                        path);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static void exportTask(int index, void *context) {
+    ExportQueue *queue = context;
+    ExportJob *job = &queue->jobs[index];
+
+    exportRun(job);
+
+    pthread_mutex_lock(&queue->print_lock);
+    fprintf(stderr, "%s: %s, %llu frames, %llu samples, %.2fs media in %.2fs (%.1fx realtime)\n",
+            job->input, job->ok ? "ok" : "FAILED",
+            (unsigned long long)job->video_frames, (unsigned long long)job->audio_samples,
+            job->media_seconds, job->wall_seconds,
+            job->wall_seconds > 0 ? job->media_seconds / job->wall_seconds : 0.0);
+    pthread_mutex_unlock(&queue->print_lock);
+}
+
+static double wallNow() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv) {
+    bool want_wav = false, want_y4m = false, to_stdout = false;
+    const char *output_dir = ".";
+    int jobs = parallelDefaultThreads();
+    int sample_rate = OUTPUT_SAMPLE_RATE;
+    IOMode io_mode = IO_MODE_MMAP;
+
+    static struct option long_options[] = {
+        {"wav", no_argument, NULL, 'w'},
+        {"y4m", no_argument, NULL, 'y'},
+        {"output-dir", required_argument, NULL, 'o'},
+        {"stdout", no_argument, NULL, 's'},
+        {"jobs", required_argument, NULL, 'j'},
+        {"rate", required_argument, NULL, 'r'},
+        {"io", required_argument, NULL, 'i'},
+        {NULL, 0, NULL, 0}
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "o:j:", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 'w': want_wav = true; break;
+            case 'y': want_y4m = true; break;
+            case 'o': output_dir = optarg; break;
+            case 's': to_stdout = true; break;
+            case 'j': jobs = atoi(optarg); break;
+            case 'r': sample_rate = atoi(optarg); break;
+            case 'i': io_mode = ioParseMode(optarg); break;
+            default:
+                printUsage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    int input_count = argc - optind;
+    if (input_count < 1 || (!want_wav && !want_y4m) || sample_rate <= 0) {
+        printUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (to_stdout && (input_count != 1 || (want_wav && want_y4m))) {
+        fprintf(stderr, "Error: --stdout takes exactly one input and one of --wav/--y4m\n");
+        return EXIT_FAILURE;
+    }
+    if (jobs < 1) {
+        jobs = 1;
+    }
+    if (jobs > input_count) {
+        jobs = input_count;
+    }
+
+    av_log_set_level(AV_LOG_ERROR);
+
+    ExportQueue queue;
+    queue.jobs = calloc(input_count, sizeof(ExportJob));
+    if (!queue.jobs) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        return EXIT_FAILURE;
+    }
+    pthread_mutex_init(&queue.print_lock, NULL);
+
+    for (int i = 0; i < input_count; i++) {
+        ExportJob *job = &queue.jobs[i];
+        job->input = argv[optind + i];
+        if (to_stdout) {
+            job->wav_path = want_wav ? "-" : NULL;
+            job->y4m_path = want_y4m ? "-" : NULL;
+        }
+        job->sample_rate = sample_rate;
+        // One file per core already keeps every core busy; a lone file gets frame threads instead
+        job->thread_count = jobs > 1 ? 1 : 0;
+        job->io_mode = io_mode;
+    }
+
+    if (!to_stdout && !assignOutputPaths(queue.jobs, input_count, output_dir, want_wav, want_y4m)) {
+        for (int i = 0; i < input_count; i++) {
+            free((char *)queue.jobs[i].wav_path);
+            free((char *)queue.jobs[i].y4m_path);
+        }
+        free(queue.jobs);
+        return EXIT_FAILURE;
+    }
+
+    double start = wallNow();
+    parallelFor(input_count, jobs, exportTask, &queue);
+    double wall = wallNow() - start;
+
+    double media = 0.0;
+    int failed = 0;
+    for (int i = 0; i < input_count; i++) {
+        media += queue.jobs[i].media_seconds;
+        failed += !queue.jobs[i].ok;
+        if (!to_stdout) {
+            free((char *)queue.jobs[i].wav_path);
+            free((char *)queue.jobs[i].y4m_path);
+        }
+    }
+
+    fprintf(stderr, "Total: %d files (%d failed) on %d workers, %.2fs media in %.2fs (%.1fx realtime)\n",
+            input_count, failed, jobs, media, wall, wall > 0 ? media / wall : 0.0);
+
+    free(queue.jobs);
+    pthread_mutex_destroy(&queue.print_lock);
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -1,44 +1,429 @@
+#include <getopt.h>
+#include <string.h>
 #include "Buffer/buffer.h"
 #include "Decoding/decoding.h"
+#include "Decoding/demux.h"
+#include "Decoding/pipeline.h"
+#include "Decoding/reverse.h"
+#include "Decoding/subtitle.h"
 #include "GUI/gui.h"
+#include "Output/spectrum.h"
+#include "Output/videosink.h"
+#include "Stats/stats.h"
+#include "Stats/trace.h"
+#include "Util/parallel.h"
 
-#define VIDEO_BUFFER_SIZE 20
+#define VIDEO_BUFFER_SLOTS 240   // Hard frame cap; the memory and duration bounds normally bind first
+#define VIDEO_BUFFER_MB 256
+#define VIDEO_BUFFER_MS 500
+#define DISPLAY_BUFFER_SIZE 2    // Converted frames waiting for the GUI
+#define CONVERT_THREADS_MAX 4    // Default cap; conversion shares the cores with the decoder
 #define AUDIO_BUFFER_SIZE 8192
+#define VIDEO_PACKET_QUEUE_SIZE 256
+#define AUDIO_PACKET_QUEUE_SIZE 512
+#define SUBTITLE_PACKET_QUEUE_SIZE 64
+#define LOOP_CACHE_MB 256
+#define LIVE_VIDEO_BUFFER_SLOTS 2      // Live: decoded frames waiting for conversion
+#define LIVE_DISPLAY_BUFFER_SIZE 1
+#define LIVE_AUDIO_LATENCY_MS 50       // Live: PulseAudio target buffering
+#define STARTUP_TARGET_MS 150          // Time to first frame reported against this
+#define BLEND_BUFFER_SIZE 2            // Blended frames waiting for their display refresh
 
+// Opens the input and starts the pipeline while the main thread brings up the window
+typedef struct {
+    DecodeData *data;
+    Scheduler *scheduler;
+    GtkApplication *app;           // Quit when the input cannot be played; NULL without a window
+    int video_track, audio_track, subtitle_track;
+    double loop_a, loop_b;
+    size_t loop_cache_bytes;
+    bool ok;
+    int demux_stage, video_stage, convert_stage, audio_stage, subtitle_stage, blend_stage;
+} Startup;
 
-int main(int argc, char **argv) {
-    putenv("LIBGL_ALWAYS_SOFTWARE=1");
-    if (argc < 3) {
-        fprintf(stderr, "Usage: %s <input_file> <frame_rate>\n", argv[0]);
-        return EXIT_FAILURE;
+static void printUsage(const char *program) {
+    fprintf(stderr, "Usage: %s [options] <input_file> <frame_rate>\n", program);
+    fprintf(stderr, "  --io=mmap|read|ffmpeg   input I/O path (default: mmap)\n");
+    fprintf(stderr, "  --live                  low-latency input from - (stdin) or a FIFO: minimal probing, %d-frame queues,\n"
+                    "                          newest frame shown on the next refresh, input-to-present latency on exit\n",
+            LIVE_VIDEO_BUFFER_SLOTS);
+    fprintf(stderr, "  --display-rate=HZ       show frames at the display refresh rate, blending neighbours (e.g. 60)\n");
+    fprintf(stderr, "  --reverse[=START]       play backwards from START seconds or the end, GOP by GOP and without audio;\n"
+                    "                          while paused, , or Left steps one frame back\n");
+    fprintf(stderr, "  --reverse-cache-mb=N    memory budget of decoded GOPs in reverse mode (default: %d)\n", REVERSE_CACHE_MB);
+    fprintf(stderr, "  --adaptive-quality      skip video loop filtering, then non-reference frames, then IDCT while\n"
+                    "                          decoding cannot keep up, and restore them once it can\n");
+    fprintf(stderr, "  --eq=PRESET|GAINS       equalizer preset (flat, bass, treble, vocal, rock, pop, jazz, classical,\n"
+                    "                          loudness) or up to %d gains in dB, each GAIN[@HZ[/Q]]; e shows the panel\n",
+            EQ_BANDS);
+    fprintf(stderr, "  --loop=A:B              loop between A and B seconds from a packet cache (l releases)\n");
+    fprintf(stderr, "  --loop-cache-mb=N       memory budget of the loop cache (default: %d)\n", LOOP_CACHE_MB);
+    fprintf(stderr, "  --video-buffer-mb=N     memory budget of decoded frames waiting for display (default: %d)\n", VIDEO_BUFFER_MB);
+    fprintf(stderr, "  --video-buffer-ms=N     decoded video to keep queued, grows with decode jitter (default: %d)\n", VIDEO_BUFFER_MS);
+    fprintf(stderr, "  --convert-threads=N     bands each frame's color conversion is split into (default: cores, at most %d)\n",
+            CONVERT_THREADS_MAX);
+    fprintf(stderr, "  --workers=N             shared work-stealing workers for conversion and background tasks (default: cores)\n");
+    fprintf(stderr, "  --video-track=N         Nth video stream of the file, from 0 (default: 0)\n");
+    fprintf(stderr, "  --audio-track=N         Nth audio stream, from 0; a cycles live (default: 0)\n");
+    fprintf(stderr, "  --subtitle-track=N|off  Nth subtitle stream, from 0; t cycles live (default: 0)\n");
+    fprintf(stderr, "  --audio-sink=SINK       pulse, null (discard) or wav:FILE (capture) (default: pulse)\n");
+    fprintf(stderr, "  --audio-fast            null and wav sinks take audio as fast as it decodes, not in real time\n");
+    fprintf(stderr, "  --video-sink=SINK       gtk (window), null (discard) or raw:FILE (packed RGB24) (default: gtk)\n");
+    fprintf(stderr, "  --video-fast            null and raw sinks take each frame as soon as it is converted\n");
+    fprintf(stderr, "  --stats-json=FILE       write per-stage latency histograms to FILE on exit (s shows them live)\n");
+    fprintf(stderr, "  --trace=FILE            record a Chrome/Perfetto trace of every pipeline thread to FILE\n");
+}
+
+static gboolean quitApplication(gpointer app) {
+    g_application_quit(G_APPLICATION(app));
+    return G_SOURCE_REMOVE;
+}
+
+/*
+  Function startupThread
+  opens and probes the input, picks the tracks and spawns the pipeline
+  stages. It runs as a stage of its own while the main thread sets up
+  GTK, so the window and the first decoded frame get ready side by side
+  instead of one after the other.
+*/
+static void *startupThread(void *args) {
+    Startup *startup = args;
+    DecodeData *data = startup->data;
+
+    statsThreadName("startup");
+    traceThreadName("startup");
+    bool opened = demuxOpen(&demuxer, data->input_filename, data->io_mode);
+    if (opened && !demuxSelectTracks(&demuxer, startup->video_track, startup->audio_track, startup->subtitle_track)) {
+        demuxClose(&demuxer);
+        opened = false;
+    }
+    if (!opened) {
+        if (startup->app) {
+            g_idle_add(quitApplication, startup->app);
+        }
+        return NULL;
     }
+    if (startup->loop_b > startup->loop_a) {
+        demuxSetLoop(&demuxer, startup->loop_a, startup->loop_b, startup->loop_cache_bytes);
+    }
+    statsMarkStartup(STARTUP_PROBED);
+    __atomic_store_n(&demuxer.ready, true, __ATOMIC_RELEASE);
+
+    // Stages block on their queues and get threads of their own; their short work goes to the workers
+    if (data->reverse) {
+        // The GOP decoder takes the demuxer's place and the reverse stage the video decoder's; no audio
+        startup->demux_stage = schedulerSpawn(startup->scheduler, "reverse-decode", reverseDecodeThread, data);
+        startup->video_stage = schedulerSpawn(startup->scheduler, "reverse", reverseThread, data);
+        startup->convert_stage = schedulerSpawn(startup->scheduler, "convert", convertThread, data);
+        startup->audio_stage = startup->subtitle_stage = startup->blend_stage = -1;
+        startup->ok = true;
+        return NULL;
+    }
+    startup->demux_stage = schedulerSpawn(startup->scheduler, "demux", demuxThread, data);
+    startup->video_stage = schedulerSpawn(startup->scheduler, "video", videoThread, data);
+    startup->convert_stage = schedulerSpawn(startup->scheduler, "convert", convertThread, data);
+    startup->audio_stage = schedulerSpawn(startup->scheduler, "audio", audioThread, data);
+    startup->subtitle_stage = schedulerSpawn(startup->scheduler, "subtitle", subtitleThread, data);
+    startup->blend_stage = data->display_rate > 0 ? schedulerSpawn(startup->scheduler, "blend", blendThread, data) : -1;
+    startup->ok = true;
+    return NULL;
+}
 
+int main(int argc, char **argv) {
+    statsMarkStartup(STARTUP_LAUNCH);
     DecodeData data;
-    data.input_filename = argv[1];
-    data.frame_rate = atoi(argv[2]);
     data.pixbuf = NULL;
+    data.audio_sink = (AudioSinkConfig){AUDIO_SINK_PULSE, NULL, false, NULL, NULL};
+    data.io_mode = IO_MODE_MMAP;
+    data.live = false;
+    data.display_rate = 0;
+    data.adaptive_quality = false;
+    data.reverse = false;
+    data.reverse_from = 0.0;
+    data.convert_threads = parallelDefaultThreads();
+    if (data.convert_threads > CONVERT_THREADS_MAX) {
+        data.convert_threads = CONVERT_THREADS_MAX;
+    }
+    double loop_a = 0.0, loop_b = 0.0;
+    int loop_cache_mb = LOOP_CACHE_MB;
+    int reverse_cache_mb = REVERSE_CACHE_MB;
+    int video_buffer_mb = VIDEO_BUFFER_MB, video_buffer_ms = VIDEO_BUFFER_MS;
+    const char *stats_json = NULL;
+    const char *trace_path = NULL;
+    const char *eq_spec = NULL;
+    VideoSinkConfig video_sink = {VIDEO_SINK_GTK, NULL, false};
+    int workers = parallelDefaultThreads();
+    int video_track = 0, audio_track = 0, subtitle_track = 0;
+
+    static struct option long_options[] = {
+        {"io", required_argument, NULL, 'i'},
+        {"live", no_argument, NULL, 'L'},
+        {"display-rate", required_argument, NULL, 'R'},
+        {"adaptive-quality", no_argument, NULL, 'q'},
+        {"reverse", optional_argument, NULL, 'r'},
+        {"reverse-cache-mb", required_argument, NULL, 'G'},
+        {"eq", required_argument, NULL, 'e'},
+        {"loop", required_argument, NULL, 'l'},
+        {"loop-cache-mb", required_argument, NULL, 'c'},
+        {"video-buffer-mb", required_argument, NULL, 'm'},
+        {"video-buffer-ms", required_argument, NULL, 'd'},
+        {"convert-threads", required_argument, NULL, 'x'},
+        {"workers", required_argument, NULL, 'w'},
+        {"video-track", required_argument, NULL, 'V'},
+        {"audio-track", required_argument, NULL, 'A'},
+        {"subtitle-track", required_argument, NULL, 'S'},
+        {"audio-sink", required_argument, NULL, 'a'},
+        {"audio-fast", no_argument, NULL, 'f'},
+        {"video-sink", required_argument, NULL, 'v'},
+        {"video-fast", no_argument, NULL, 'g'},
+        {"stats-json", required_argument, NULL, 's'},
+        {"trace", required_argument, NULL, 't'},
+        {NULL, 0, NULL, 0}
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 'i':
+                data.io_mode = ioParseMode(optarg);
+                break;
+            case 'L':
+                data.live = true;
+                break;
+            case 'R':
+                data.display_rate = atoi(optarg);
+                break;
+            case 'q':
+                data.adaptive_quality = true;
+                break;
+            case 'r':
+                data.reverse = true;
+                data.reverse_from = optarg ? atof(optarg) : 0.0;
+                break;
+            case 'G':
+                reverse_cache_mb = atoi(optarg);
+                break;
+            case 'e':
+                eq_spec = optarg;
+                break;
+            case 'l':
+                if (sscanf(optarg, "%lf:%lf", &loop_a, &loop_b) != 2 || loop_b <= loop_a) {
+                    fprintf(stderr, "Error: --loop expects A:B in seconds with A < B\n");
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'c':
+                loop_cache_mb = atoi(optarg);
+                break;
+            case 'm':
+                video_buffer_mb = atoi(optarg);
+                break;
+            case 'd':
+                video_buffer_ms = atoi(optarg);
+                break;
+            case 'x':
+                data.convert_threads = atoi(optarg);
+                break;
+            case 'w':
+                workers = atoi(optarg);
+                break;
+            case 'V':
+                video_track = atoi(optarg);
+                break;
+            case 'A':
+                audio_track = atoi(optarg);
+                break;
+            case 'S':
+                subtitle_track = strcmp(optarg, "off") == 0 ? -1 : atoi(optarg);
+                break;
+            case 'a':
+                if (!audioSinkParse(optarg, &data.audio_sink)) {
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'f':
+                data.audio_sink.fast = true;
+                break;
+            case 'v':
+                if (!videoSinkParse(optarg, &video_sink)) {
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'g':
+                video_sink.fast = true;
+                break;
+            case 's':
+                stats_json = optarg;
+                break;
+            case 't':
+                trace_path = optarg;
+                break;
+            default:
+                printUsage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    if (argc - optind < 2) {
+        printUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    data.input_filename = argv[optind];
+    data.frame_rate = atoi(argv[optind + 1]);
+    if (data.live) {
+        if (loop_b > loop_a) {
+            fprintf(stderr, "Error: --loop needs a seekable input, not --live\n");
+            return EXIT_FAILURE;
+        }
+        if (data.display_rate > 0) {
+            fprintf(stderr, "Error: --display-rate delays frames to blend them, which --live avoids\n");
+            return EXIT_FAILURE;
+        }
+        data.io_mode = IO_MODE_LIVE;
+        data.audio_sink.latency = LIVE_AUDIO_LATENCY_MS / 1000.0;
+        video_sink.fast = true;   // Present every frame as soon as it is converted
+    }
+    if (data.reverse) {
+        if (data.live || loop_b > loop_a || data.display_rate > 0) {
+            fprintf(stderr, "Error: --reverse cannot be combined with --live, --loop or --display-rate\n");
+            return EXIT_FAILURE;
+        }
+        subtitle_track = -1;   // Cues are routed by the demux stage, which reverse mode replaces
+    }
+
+    // Set up even when flat, so that the window's panel can change it; flat audio passes untouched
+    data.equalizer = equalizerInit(&audioEqualizer, OUTPUT_SAMPLE_RATE) ? &audioEqualizer : NULL;
+    if (data.equalizer && eq_spec && !equalizerParse(&audioEqualizer, eq_spec)) {
+        return EXIT_FAILURE;
+    }
+
+    if (trace_path) {
+        traceStart(TRACE_EVENTS_PER_THREAD);
+    }
 
-    videoBufferInit(&videoBuffer, VIDEO_BUFFER_SIZE);
+    videoBufferInit(&videoBuffer, data.live ? LIVE_VIDEO_BUFFER_SLOTS : VIDEO_BUFFER_SLOTS,
+                    (size_t)video_buffer_mb * 1024 * 1024, data.live ? 0 : video_buffer_ms, data.frame_rate);
+    displayBufferInit(&displayBuffer, data.live ? LIVE_DISPLAY_BUFFER_SIZE : DISPLAY_BUFFER_SIZE);
+    if (data.display_rate > 0) {
+        displayBufferInit(&blendBuffer, BLEND_BUFFER_SIZE);
+    }
     audioBufferInit(&audioBuffer, AUDIO_BUFFER_SIZE);
+    packetQueueInit(&videoPacketQueue, VIDEO_PACKET_QUEUE_SIZE);
+    packetQueueInit(&audioPacketQueue, AUDIO_PACKET_QUEUE_SIZE);
+    packetQueueInit(&subtitlePacketQueue, SUBTITLE_PACKET_QUEUE_SIZE);
+    subtitleCacheInit(&subtitleCache);
+    if (data.reverse) {
+        gopCacheInit(&gopCache, (size_t)reverse_cache_mb * 1024 * 1024);
+    }
+
+    Scheduler scheduler;
+    if (!schedulerInit(&scheduler, workers)) {
+        fprintf(stderr, "Error: Could not start the scheduler\n");
+        return EXIT_FAILURE;
+    }
+    data.scheduler = &scheduler;
 
-    pthread_t video_thread, audio_thread;
-    pthread_create(&video_thread, NULL, videoThread, &data);
-    pthread_create(&audio_thread, NULL, audioThread, &data);
+    // The window's spectrum analyzer sees exactly what goes to the audio sink
+    bool spectrum = video_sink.kind == VIDEO_SINK_GTK &&
+                    spectrumInit(&spectrumAnalyzer, &scheduler, OUTPUT_SAMPLE_RATE);
+    if (spectrum) {
+        data.audio_sink.tap = spectrumTap;
+        data.audio_sink.tap_context = &spectrumAnalyzer;
+    }
+
+    GtkApplication *app = NULL;
+    if (video_sink.kind == VIDEO_SINK_GTK) {
+        putenv("LIBGL_ALWAYS_SOFTWARE=1");
+        app = gtk_application_new("org.mediaplayer.app", G_APPLICATION_HANDLES_COMMAND_LINE);
+        g_signal_connect(app, "activate", G_CALLBACK(activate), &data);
+        g_signal_connect(app, "command-line", G_CALLBACK(command_line_cb), &data);
+    }
+
+    // Only the window shows subtitles
+    Startup startup = {&data, &scheduler, app, video_track, audio_track,
+                       video_sink.kind == VIDEO_SINK_GTK ? subtitle_track : -1,
+                       loop_a, loop_b, (size_t)loop_cache_mb * 1024 * 1024, false};
+    int startup_stage = schedulerSpawn(&scheduler, "startup", startupThread, &startup);
+
+    int status;
+    if (app) {
+        // Our own options are already consumed, GApplication would reject them
+        status = g_application_run(G_APPLICATION(app), 1, argv);
+        schedulerJoin(&scheduler, startup_stage);
+    } else {
+        schedulerJoin(&scheduler, startup_stage);
+        statsThreadName("present");
+        traceThreadName("present");
+        bool blended = data.display_rate > 0;
+        status = startup.ok && videoSinkRun(&video_sink, blended ? &blendBuffer : &displayBuffer,
+                                            blended ? data.display_rate : data.frame_rate) ? EXIT_SUCCESS : EXIT_FAILURE;
+        if (startup.ok && !video_sink.fast) {
+            schedulerJoin(&scheduler, startup.audio_stage);  // Play the audio out as well
+        }
+    }
 
-    GtkApplication *app = gtk_application_new("org.mediaplayer.app", 
-                    G_APPLICATION_HANDLES_COMMAND_LINE);
-    g_signal_connect(app, "activate", G_CALLBACK(activate), &data);
-    g_signal_connect(app, "command-line", G_CALLBACK(command_line_cb), &data);
-    int status = g_application_run(G_APPLICATION(app), argc, argv);
+    stopPlayback();
 
-    is_running = 0;
+    if (!startup.ok) {
+        status = EXIT_FAILURE;
+    } else {
+        schedulerJoin(&scheduler, startup.demux_stage);
+        schedulerJoin(&scheduler, startup.video_stage);
+        schedulerJoin(&scheduler, startup.convert_stage);
+        schedulerJoin(&scheduler, startup.subtitle_stage);
+        schedulerJoin(&scheduler, startup.blend_stage);
+        schedulerJoin(&scheduler, startup.audio_stage);
 
-    pthread_join(video_thread, NULL);
-    pthread_join(audio_thread, NULL);
+        statsPrintStartup(stderr, STARTUP_TARGET_MS);
+        demuxPrintTrackStats(&demuxer, stderr);
+        demuxPrintLiveStats(&demuxer, stderr);
+        demuxClose(&demuxer);
+    }
+    ioPrintStats(stderr);
+    videoBufferPrintStats(&videoBuffer, stderr);
+    printConversionStats(stderr);
+    printBlendStats(&data, stderr);
+    printQualityStats(&data, stderr);
+    if (data.reverse) {
+        gopCachePrintStats(&gopCache, stderr);
+    }
+    subtitleCachePrintStats(&subtitleCache, stderr);
+    if (spectrum) {
+        spectrumDestroy(&spectrumAnalyzer);   // Waits for a running analysis, so its counters are final
+        spectrumPrintStats(&spectrumAnalyzer, stderr);
+    }
+    if (data.equalizer) {
+        equalizerPrintStats(&audioEqualizer, stderr);
+    }
+    schedulerPrintStats(&scheduler, stderr);
+    if (stats_json) {
+        statsWriteJson(stats_json);
+    }
 
     videoBufferDestroy(&videoBuffer);
+    displayBufferDestroy(&displayBuffer);
+    if (data.display_rate > 0) {
+        displayBufferDestroy(&blendBuffer);
+    }
     audioBufferDestroy(&audioBuffer);
+    packetQueueDestroy(&videoPacketQueue);
+    packetQueueDestroy(&audioPacketQueue);
+    packetQueueDestroy(&subtitlePacketQueue);
+    subtitleCacheDestroy(&subtitleCache);
+    if (data.reverse) {
+        gopCacheDestroy(&gopCache);
+    }
+    if (data.equalizer) {
+        equalizerDestroy(&audioEqualizer);
+    }
+    schedulerDestroy(&scheduler);
 
-    g_object_unref(app);
+    // Only now has every traced thread stopped: the stages are joined and the workers gone with the scheduler
+    if (trace_path) {
+        traceWrite(trace_path);
+    }
+
+    if (app) {
+        g_object_unref(app);
+    }
     return status;
-}
\ No newline at end of file
+}
@@ -0,0 +1,450 @@
+#include <getopt.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "Buffer/buffer.h"
+#include "Decoding/clock.h"
+#include "Decoding/decoding.h"
+#include "Decoding/demux.h"
+#include "Decoding/pipeline.h"
+#include "Regress/synth.h"
+#include "Stats/stats.h"
+#include "Stats/trace.h"
+
+// Same queue sizes as the player, so the harness exercises the real configuration
+#define VIDEO_BUFFER_SLOTS 240
+#define VIDEO_BUFFER_MB 256
+#define VIDEO_BUFFER_MS 500
+#define DISPLAY_BUFFER_SIZE 2
+#define CONVERT_THREADS 2
+#define AUDIO_BUFFER_SIZE 8192
+#define VIDEO_PACKET_QUEUE_SIZE 256
+#define AUDIO_PACKET_QUEUE_SIZE 512
+
+#define CLIP_SAMPLE_RATE 48000       // Resampled to OUTPUT_SAMPLE_RATE on the way out
+#define STALL_SECONDS 10.0           // Wall time without a frame before the run is declared hung
+#define PTS_TOLERANCE 0.001          // Timestamp vs. frame content, seconds
+#define AUDIO_GAP_TOLERANCE 0.002    // Between consecutive audio chunks, seconds
+#define TONE_TOLERANCE_HZ 5.0
+#define TONE_EDGE 0.01               // Chunks this close to a pitch step are not measured
+#define BASELINE_SLACK_MS 0.1        // Absolute allowance on top of --tolerance for tiny timings
+
+// Audio content check, fed from the audio thread through the audio tap
+typedef struct {
+    double origin;                   // pts of the first chunk
+    double next_pts;                 // Where the previous chunk ended
+    double end;
+    double max_gap;
+    int chunks;
+    int slots;
+    int16_t last_sample;
+    uint64_t *crossings;             // Per second of the clip: rising zero crossings, samples measured
+    uint64_t *samples;
+} AudioCheck;
+
+typedef struct {
+    const char *name;
+    double value;
+    bool timing;                     // Compared against the baseline
+} ReportValue;
+
+static volatile int64_t last_progress_ns;
+static volatile bool run_finished = false;
+static volatile bool run_stalled = false;
+
+static void printUsage(const char *program) {
+    fprintf(stderr, "Usage: %s [options]\n", program);
+    fprintf(stderr, "  --clip=FILE           write the synthetic clip to FILE and keep it (default: temporary)\n");
+    fprintf(stderr, "  --seconds=N           clip length (default: 10)\n");
+    fprintf(stderr, "  --fps=N               clip frame rate (default: 25)\n");
+    fprintf(stderr, "  --size=WxH            clip size, W a multiple of %d (default: 320x240)\n", SYNTH_CODE_COLUMNS);
+    fprintf(stderr, "  --max-drift-ms=N      allowed A/V offset at presentation (default: one frame)\n");
+    fprintf(stderr, "  --convert-threads=N   threads sharing each frame's color conversion (default: %d)\n", CONVERT_THREADS);
+    fprintf(stderr, "  --io=mmap|read|ffmpeg input I/O path (default: mmap)\n");
+    fprintf(stderr, "  --report=FILE         write results as 'key value' lines to FILE\n");
+    fprintf(stderr, "  --baseline=FILE       fail if timings are worse than a previous --report\n");
+    fprintf(stderr, "  --tolerance=PCT       allowed slowdown against the baseline (default: 25)\n");
+    fprintf(stderr, "  --trace=FILE          record a Chrome/Perfetto trace of the run to FILE\n");
+}
+
+static double wallNow() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+  Function audioTap
+  checks what the virtual audio device receives: chunks must follow
+  each other without gaps, and the pitch heard in each second of the
+  clip must be the one synthesized for it.
+*/
+static void audioTap(const int16_t *samples, int count, double pts, void *context) {
+    AudioCheck *check = context;
+
+    if (check->chunks++ == 0) {
+        check->origin = pts;
+    } else {
+        double gap = fabs(pts - check->next_pts);
+        check->max_gap = fmax(check->max_gap, gap);
+    }
+    check->next_pts = pts + (double)count / OUTPUT_SAMPLE_RATE;
+    check->end = check->next_pts;
+
+    double start = pts - check->origin, end = check->next_pts - check->origin;
+    int slot = (int)floor(start + TONE_EDGE);
+    if (slot >= 0 && slot < check->slots && start >= slot + TONE_EDGE && end <= slot + 1 - TONE_EDGE) {
+        int16_t previous = check->last_sample;
+        for (int i = 0; i < count; i++) {
+            int16_t sample = samples[i * OUTPUT_CHANNELS];  // Left channel
+            if (previous < 0 && sample >= 0) {
+                check->crossings[slot]++;
+            }
+            previous = sample;
+        }
+        check->samples[slot] += count;
+    }
+    check->last_sample = samples[(count - 1) * OUTPUT_CHANNELS];
+}
+
+// Declares the run hung when no frame arrives for STALL_SECONDS
+static void *watchdogThread(void *args) {
+    while (!run_finished) {
+        usleep(100000);
+        int64_t idle = (int64_t)statsNow() - __atomic_load_n(&last_progress_ns, __ATOMIC_RELAXED);
+        if (idle > STALL_SECONDS * 1e9) {
+            fprintf(stderr, "Error: No frame for %.0f s, pipeline stalled\n", STALL_SECONDS);
+            run_stalled = true;
+            stopPlayback();
+            break;
+        }
+    }
+    return NULL;
+}
+
+static void reportStage(ReportValue *values, int *count, StatsMetric metric, const char *p50, const char *p99) {
+    StatsSummary summary;
+    statsSummarize(metric, &summary);
+    values[(*count)++] = (ReportValue){p50, summary.p50 / 1e6, true};
+    values[(*count)++] = (ReportValue){p99, summary.p99 / 1e6, true};
+}
+
+static bool writeReport(const char *path, const ReportValue *values, int count) {
+    FILE *file = fopen(path, "w");
+    if (!file) {
+        fprintf(stderr, "Error: Could not write report to '%s'\n", path);
+        return false;
+    }
+    for (int i = 0; i < count; i++) {
+        fprintf(file, "%s %.6f\n", values[i].name, values[i].value);
+    }
+    return fclose(file) == 0;
+}
+
+// Every timing over its baseline value by more than the tolerance is a regression
+static int compareBaseline(const char *path, const ReportValue *values, int count, double tolerance) {
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        fprintf(stderr, "Error: Could not read baseline '%s'\n", path);
+        return 1;
+    }
+
+    char name[64];
+    double baseline;
+    int regressions = 0;
+    while (fscanf(file, "%63s %lf", name, &baseline) == 2) {
+        for (int i = 0; i < count; i++) {
+            if (!values[i].timing || strcmp(values[i].name, name) != 0) {
+                continue;
+            }
+            double slack = strstr(name, "_ms") ? BASELINE_SLACK_MS : BASELINE_SLACK_MS / 1000.0;
+            double limit = baseline * (1.0 + tolerance / 100.0) + slack;
+            if (values[i].value > limit) {
+                fprintf(stderr, "REGRESSION: %s %.3f, baseline %.3f (limit %.3f)\n",
+                        name, values[i].value, baseline, limit);
+                regressions++;
+            }
+        }
+    }
+    fclose(file);
+    return regressions;
+}
+
+int main(int argc, char **argv) {
+    SynthClip clip = {NULL, 320, 240, 25, 10, CLIP_SAMPLE_RATE};
+    DecodeData data;
+    data.pixbuf = NULL;
+    data.io_mode = IO_MODE_MMAP;
+    data.live = false;
+    data.display_rate = 0;
+    data.reverse = false;
+    data.adaptive_quality = false;   // Skipped work would make the frames depend on machine load
+    data.equalizer = NULL;           // Audio compared as decoded
+    data.convert_threads = CONVERT_THREADS;
+    double max_drift_ms = -1.0, tolerance = 25.0;
+    const char *report_path = NULL, *baseline_path = NULL, *trace_path = NULL;
+    char temp_path[] = "/tmp/mediaregress-XXXXXX.mkv";
+
+    static struct option long_options[] = {
+        {"clip", required_argument, NULL, 'c'},
+        {"seconds", required_argument, NULL, 'n'},
+        {"fps", required_argument, NULL, 'f'},
+        {"size", required_argument, NULL, 'z'},
+        {"max-drift-ms", required_argument, NULL, 'd'},
+        {"convert-threads", required_argument, NULL, 'x'},
+        {"io", required_argument, NULL, 'i'},
+        {"report", required_argument, NULL, 'r'},
+        {"baseline", required_argument, NULL, 'b'},
+        {"tolerance", required_argument, NULL, 'o'},
+        {"trace", required_argument, NULL, 't'},
+        {NULL, 0, NULL, 0}
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 'c': clip.path = optarg; break;
+            case 'n': clip.seconds = atoi(optarg); break;
+            case 'f': clip.frame_rate = atoi(optarg); break;
+            case 'z':
+                if (sscanf(optarg, "%dx%d", &clip.width, &clip.height) != 2) {
+                    fprintf(stderr, "Error: --size expects WxH\n");
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'd': max_drift_ms = atof(optarg); break;
+            case 'x': data.convert_threads = atoi(optarg); break;
+            case 'i': data.io_mode = ioParseMode(optarg); break;
+            case 'r': report_path = optarg; break;
+            case 'b': baseline_path = optarg; break;
+            case 'o': tolerance = atof(optarg); break;
+            case 't': trace_path = optarg; break;
+            default:
+                printUsage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    int frame_count = clip.frame_rate * clip.seconds;
+    if (optind != argc || clip.seconds < 1 || clip.frame_rate < 1 || frame_count > 0xFFFF ||
+        clip.width % SYNTH_CODE_COLUMNS || clip.width < 8 * SYNTH_CODE_COLUMNS ||
+        clip.height < SYNTH_CODE_ROWS * SYNTH_CODE_ROW_HEIGHT || clip.height % 2) {
+        printUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    double interval = 1.0 / clip.frame_rate;
+    if (max_drift_ms < 0) {
+        max_drift_ms = interval * 1000.0;
+    }
+
+    av_log_set_level(AV_LOG_ERROR);
+    statsThreadName("regress");
+
+    // Clip
+    bool temporary = !clip.path;
+    if (temporary) {
+        int fd = mkstemps(temp_path, 4);
+        if (fd < 0) {
+            fprintf(stderr, "Error: Could not create a temporary clip\n");
+            return EXIT_FAILURE;
+        }
+        close(fd);
+        clip.path = temp_path;
+    }
+    double generate_start = wallNow();
+    if (!synthWriteClip(&clip)) {
+        if (temporary) unlink(clip.path);
+        return EXIT_FAILURE;
+    }
+    fprintf(stderr, "Clip: %s, %dx%d, %d fps, %d s, generated in %.2fs\n",
+            clip.path, clip.width, clip.height, clip.frame_rate, clip.seconds, wallNow() - generate_start);
+
+    // Pipeline, headless and on virtual time
+    data.input_filename = (char *)clip.path;
+    data.frame_rate = clip.frame_rate;
+    AudioCheck audio = {0};
+    audio.slots = clip.seconds;
+    audio.crossings = calloc(audio.slots, sizeof(uint64_t));
+    audio.samples = calloc(audio.slots, sizeof(uint64_t));
+    data.audio_sink = (AudioSinkConfig){AUDIO_SINK_VIRTUAL, NULL, false, audioTap, &audio};
+
+    if (!demuxOpen(&demuxer, data.input_filename, data.io_mode)) {
+        if (temporary) unlink(clip.path);
+        return EXIT_FAILURE;
+    }
+    clockUseVirtual();
+    if (trace_path) {
+        traceStart(TRACE_EVENTS_PER_THREAD);
+        traceThreadName("regress");
+    }
+
+    videoBufferInit(&videoBuffer, VIDEO_BUFFER_SLOTS, (size_t)VIDEO_BUFFER_MB * 1024 * 1024,
+                    VIDEO_BUFFER_MS, data.frame_rate);
+    displayBufferInit(&displayBuffer, DISPLAY_BUFFER_SIZE);
+    audioBufferInit(&audioBuffer, AUDIO_BUFFER_SIZE);
+    packetQueueInit(&videoPacketQueue, VIDEO_PACKET_QUEUE_SIZE);
+    packetQueueInit(&audioPacketQueue, AUDIO_PACKET_QUEUE_SIZE);
+
+    double run_start = wallNow();
+    __atomic_store_n(&last_progress_ns, (int64_t)statsNow(), __ATOMIC_RELAXED);
+
+    // Same scheduler setup as the player, so its task path is covered too
+    Scheduler scheduler;
+    if (!schedulerInit(&scheduler, CONVERT_THREADS)) {
+        fprintf(stderr, "Error: Could not start the scheduler\n");
+        demuxClose(&demuxer);
+        if (temporary) unlink(clip.path);
+        return EXIT_FAILURE;
+    }
+    data.scheduler = &scheduler;
+
+    pthread_t watchdog_thread;
+    int demux_stage = schedulerSpawn(&scheduler, "demux", demuxThread, &data);
+    int video_stage = schedulerSpawn(&scheduler, "video", videoThread, &data);
+    int convert_stage = schedulerSpawn(&scheduler, "convert", convertThread, &data);
+    int audio_stage = schedulerSpawn(&scheduler, "audio", audioThread, &data);
+    pthread_create(&watchdog_thread, NULL, watchdogThread, NULL);
+
+    /*
+      Present every frame in lockstep: wait until audio has caught up with
+      virtual time, take the next frame, check it, then move time on to
+      when the following frame is due.
+    */
+    int expected = 0, presented = 0, missing = 0, out_of_order = 0, unreadable = 0;
+    double origin = NAN, max_pts_error = 0.0, max_drift = 0.0;
+    while (expected < frame_count && clockWaitAudioIdle()) {
+        GdkPixbuf *pixbuf;
+        double pts;
+        if (!displayBufferPop(&displayBuffer, &pixbuf, &pts)) {
+            break;
+        }
+        __atomic_store_n(&last_progress_ns, (int64_t)statsNow(), __ATOMIC_RELAXED);
+
+        int index = synthReadFrameIndex(gdk_pixbuf_get_pixels(pixbuf), gdk_pixbuf_get_rowstride(pixbuf),
+                                        gdk_pixbuf_get_n_channels(pixbuf), gdk_pixbuf_get_width(pixbuf));
+        g_object_unref(pixbuf);
+        presented++;
+        statsCount(COUNTER_PRESENTED);
+
+        if (index < 0) {
+            unreadable++;
+            index = expected;
+        } else if (index > expected) {
+            fprintf(stderr, "Frame %d missing%s\n", expected, index - expected > 1 ? " (and following)" : "");
+            missing += index - expected;
+        } else if (index < expected) {
+            fprintf(stderr, "Frame %d presented after frame %d\n", index, expected - 1);
+            out_of_order++;
+        }
+
+        if (isnan(origin)) {
+            origin = pts - index * interval;  // The muxer may shift every stream by the same amount
+        }
+        max_pts_error = fmax(max_pts_error, fabs(pts - (origin + index * interval)));
+
+        double audio_clock = clockGetAudio();
+        if (!isnan(audio_clock)) {
+            statsSetAvOffset(pts - audio_clock);
+            max_drift = fmax(max_drift, fabs(pts - audio_clock));
+        }
+
+        expected = index >= expected ? index + 1 : expected;
+        clockAdvanceTo(origin + expected * interval);
+    }
+
+    // Let audio play out to the end of the stream
+    clockAdvanceTo(INFINITY);
+    clockWaitAudioIdle();
+
+    run_finished = true;
+    double wall = wallNow() - run_start;
+    stopPlayback();
+    schedulerJoin(&scheduler, demux_stage);
+    schedulerJoin(&scheduler, video_stage);
+    schedulerJoin(&scheduler, convert_stage);
+    schedulerJoin(&scheduler, audio_stage);
+    pthread_join(watchdog_thread, NULL);
+    schedulerPrintStats(&scheduler, stderr);
+    schedulerDestroy(&scheduler);
+    demuxClose(&demuxer);
+
+    // Verdict
+    int failures = 0;
+    uint64_t dropped = statsCounter(COUNTER_DROPPED);
+    int tone_errors = 0, tone_measured = 0;
+    for (int s = 0; s < audio.slots; s++) {
+        if (audio.samples[s] < OUTPUT_SAMPLE_RATE / 2) {
+            continue;  // Too little of this second reached the tap to measure it
+        }
+        tone_measured++;
+        double heard = (double)audio.crossings[s] * OUTPUT_SAMPLE_RATE / audio.samples[s];
+        if (fabs(heard - synthToneFrequency(s)) > TONE_TOLERANCE_HZ) {
+            fprintf(stderr, "Audio at %ds: %.1f Hz, expected %.1f Hz\n", s, heard, synthToneFrequency(s));
+            tone_errors++;
+        }
+    }
+    double audio_start_skew = isnan(origin) || !audio.chunks ? NAN : audio.origin - origin;
+
+#define CHECK(condition, ...) \
+    do { if (!(condition)) { fprintf(stderr, "FAIL: " __VA_ARGS__); fprintf(stderr, "\n"); failures++; } } while (0)
+
+    CHECK(!run_stalled, "pipeline stalled");
+    CHECK(expected == frame_count, "%d of %d frames reached the display", expected, frame_count);
+    CHECK(missing == 0, "%d frames missing", missing);
+    CHECK(dropped == 0, "%llu frames dropped as late", (unsigned long long)dropped);
+    CHECK(out_of_order == 0, "%d frames out of order", out_of_order);
+    CHECK(unreadable == 0, "%d frames with an unreadable index", unreadable);
+    CHECK(max_pts_error <= PTS_TOLERANCE, "frame timestamps off by up to %.1f ms", max_pts_error * 1000);
+    CHECK(max_drift * 1000 <= max_drift_ms, "A/V drift up to %.1f ms (limit %.1f ms)", max_drift * 1000, max_drift_ms);
+    CHECK(!isnan(audio_start_skew) && fabs(audio_start_skew) * 1000 <= max_drift_ms,
+          "audio starts %.1f ms from video", audio_start_skew * 1000);
+    CHECK(audio.max_gap <= AUDIO_GAP_TOLERANCE, "gap of %.1f ms between audio chunks", audio.max_gap * 1000);
+    CHECK(audio.chunks && audio.end - audio.origin >= clip.seconds - interval,
+          "audio ends at %.2fs of %ds", audio.end - audio.origin, clip.seconds);
+    CHECK(tone_measured == audio.slots, "pitch measured in %d of %d seconds", tone_measured, audio.slots);
+    CHECK(tone_errors == 0, "%d of %d seconds with the wrong pitch", tone_errors, audio.slots);
+
+    ReportValue values[32];
+    int count = 0;
+    values[count++] = (ReportValue){"frames", presented, false};
+    values[count++] = (ReportValue){"dropped", dropped, false};
+    values[count++] = (ReportValue){"max_drift_ms", max_drift * 1000, false};
+    values[count++] = (ReportValue){"max_audio_gap_ms", audio.max_gap * 1000, false};
+    values[count++] = (ReportValue){"realtime_factor", wall > 0 ? clip.seconds / wall : 0.0, false};
+    values[count++] = (ReportValue){"wall_seconds", wall, true};
+    reportStage(values, &count, STAT_DEMUX, "demux_p50_ms", "demux_p99_ms");
+    reportStage(values, &count, STAT_VIDEO_DECODE, "video_decode_p50_ms", "video_decode_p99_ms");
+    reportStage(values, &count, STAT_SCALE, "sws_scale_p50_ms", "sws_scale_p99_ms");
+    reportStage(values, &count, STAT_AUDIO_DECODE, "audio_decode_p50_ms", "audio_decode_p99_ms");
+    reportStage(values, &count, STAT_DISPLAY_WAIT, "display_wait_p50_ms", "display_wait_p99_ms");
+
+    for (int i = 0; i < count; i++) {
+        fprintf(stderr, "%-20s %10.3f\n", values[i].name, values[i].value);
+    }
+    if (report_path) {
+        writeReport(report_path, values, count);
+    }
+    if (baseline_path) {
+        failures += compareBaseline(baseline_path, values, count, tolerance);
+    }
+    if (trace_path) {
+        traceWrite(trace_path);
+    }
+    fprintf(stderr, "%s: %d frames, %.2fs media in %.2fs (%.1fx realtime)\n",
+            failures ? "FAILED" : "PASSED", presented, (double)clip.seconds, wall,
+            wall > 0 ? clip.seconds / wall : 0.0);
+
+    videoBufferDestroy(&videoBuffer);
+    displayBufferDestroy(&displayBuffer);
+    audioBufferDestroy(&audioBuffer);
+    packetQueueDestroy(&videoPacketQueue);
+    packetQueueDestroy(&audioPacketQueue);
+    free(audio.crossings);
+    free(audio.samples);
+    if (temporary) {
+        unlink(clip.path);
+    }
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,93 @@
+#include <getopt.h>
+#include <libavcodec/avcodec.h>
+#include <libavutil/log.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "Library/index.h"
+#include "Library/scanner.h"
+#include "Util/parallel.h"
+
+#define DEFAULT_INDEX "library.idx"
+
+static void printUsage(const char *program) {
+    fprintf(stderr, "Usage: %s [options] <directory>...\n", program);
+    fprintf(stderr, "       %s --list [--index=FILE]\n", program);
+    fprintf(stderr, "  --index=FILE          index to update or list (default: %s)\n", DEFAULT_INDEX);
+    fprintf(stderr, "  -j, --jobs=N          files probed in parallel (default: one per core)\n");
+    fprintf(stderr, "  --io=mmap|read|ffmpeg input I/O path for probing (default: read)\n");
+    fprintf(stderr, "  --list                print the index instead of scanning\n");
+}
+
+static int listIndex(const char *index_path) {
+    LibraryIndex index;
+
+    if (!libraryIndexOpen(&index, index_path)) {
+        fprintf(stderr, "Error: Could not open index '%s'\n", index_path);
+        return EXIT_FAILURE;
+    }
+
+    for (uint32_t i = 0; i < index.header->record_count; i++) {
+        const LibraryRecord *record = &index.records[i];
+        if (record->flags & LIBRARY_PROBE_FAILED) {
+            continue;
+        }
+        printf("%s\t%.3fs\t%u streams", libraryRecordPath(&index, record),
+               record->duration_us >= 0 ? record->duration_us / 1e6 : 0.0, record->stream_count);
+        if (record->video_streams) {
+            printf("\t%s %ux%u", avcodec_get_name(record->video_codec), record->width, record->height);
+        }
+        if (record->audio_streams) {
+            printf("\t%s %u Hz %uch", avcodec_get_name(record->audio_codec), record->sample_rate, record->channels);
+        }
+        printf("\n");
+    }
+
+    libraryIndexClose(&index);
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char **argv) {
+    const char *index_path = DEFAULT_INDEX;
+    int jobs = parallelDefaultThreads();
+    IOMode io_mode = IO_MODE_READ;
+    int list = 0;
+
+    static struct option long_options[] = {
+        {"index", required_argument, NULL, 'x'},
+        {"jobs", required_argument, NULL, 'j'},
+        {"io", required_argument, NULL, 'i'},
+        {"list", no_argument, NULL, 'l'},
+        {NULL, 0, NULL, 0}
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "j:", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 'x': index_path = optarg; break;
+            case 'j': jobs = atoi(optarg); break;
+            case 'i': io_mode = ioParseMode(optarg); break;
+            case 'l': list = 1; break;
+            default:
+                printUsage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    if (list) {
+        return listIndex(index_path);
+    }
+    if (argc - optind < 1) {
+        printUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    av_log_set_level(AV_LOG_QUIET);  // Non-media files are expected
+
+    ScanStats stats;
+    bool ok = libraryScan(index_path, argv + optind, argc - optind, jobs, io_mode, &stats);
+
+    fprintf(stderr, "%d files: %d unchanged, %d probed (%d not media), %d removed\n",
+            stats.files, stats.reused, stats.probed, stats.failed, stats.removed);
+    fprintf(stderr, "walk %.3fs, probe %.3fs on %d workers, write %.3fs\n",
+            stats.walk_seconds, stats.probe_seconds, jobs, stats.write_seconds);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
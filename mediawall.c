@@ -0,0 +1,289 @@
+#include <getopt.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "Buffer/buffer.h"
+#include "Util/parallel.h"
+#include "Util/threadpool.h"
+#include "Wall/wall.h"
+
+#define TILE_WIDTH 480
+#define TILE_HEIGHT 270
+#define WALL_FRAME_RATE 30
+#define SWEEP_SECONDS 10
+#define WALL_DISPLAY_SLOTS 2
+
+// The display ring consults the player's run/pause state; the wall never pauses
+volatile int is_running = 1;
+volatile int is_paused = 0;
+
+bool checkPauseState() {
+    return is_running;
+}
+
+typedef struct {
+    VideoWall wall;
+    int frame_rate;
+    double seconds;    // Stop after this much media time, 0 plays to the end
+    bool fast;         // Step as fast as the pool allows instead of at frame_rate
+    double elapsed;
+} WallRun;
+
+static void printUsage(const char *program) {
+    fprintf(stderr, "Usage: %s [options] <input_file>...\n", program);
+    fprintf(stderr, "  --fps=N                 wall refresh rate (default: %d)\n", WALL_FRAME_RATE);
+    fprintf(stderr, "  --columns=N             tiles per row (default: as square as possible)\n");
+    fprintf(stderr, "  --tile=WxH              size of one tile (default: %dx%d)\n", TILE_WIDTH, TILE_HEIGHT);
+    fprintf(stderr, "  --threads=N             shared decode/scale pool size (default: cores)\n");
+    fprintf(stderr, "  --repeat=N              show every input N times, to load the pool (default: 1)\n");
+    fprintf(stderr, "  --loop                  restart inputs at their end\n");
+    fprintf(stderr, "  --seconds=S             stop after S seconds of media (default: when every input ended)\n");
+    fprintf(stderr, "  --headless              no window, just decode and scale\n");
+    fprintf(stderr, "  --fast                  headless: step as fast as the pool allows\n");
+    fprintf(stderr, "  --sweep                 headless and fast with 1, 2, 4 ... N tiles, one throughput line each\n");
+    fprintf(stderr, "  --io=mmap|read|ffmpeg   input I/O path (default: mmap)\n");
+}
+
+static double wallClockNow() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void sleepUntil(double deadline) {
+    struct timespec ts;
+    ts.tv_sec = (time_t)deadline;
+    ts.tv_nsec = (long)((deadline - ts.tv_sec) * 1e9);
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+}
+
+static GdkPixbuf *copyCanvas(const VideoWall *wall) {
+    GdkPixbuf *pixbuf = gdk_pixbuf_new(GDK_COLORSPACE_RGB, FALSE, 8, wall->canvas_width, wall->canvas_height);
+    if (!pixbuf) {
+        return NULL;
+    }
+    uint8_t *pixels = gdk_pixbuf_get_pixels(pixbuf);
+    int rowstride = gdk_pixbuf_get_rowstride(pixbuf);
+    for (int y = 0; y < wall->canvas_height; y++) {
+        memcpy(pixels + (size_t)y * rowstride, wall->canvas + (size_t)y * wall->canvas_linesize, wall->canvas_linesize);
+    }
+    return pixbuf;
+}
+
+/*
+  Function runWall
+  steps the wall until every tile ended, the time limit or a window
+  close. Paced runs follow the monotonic clock, so a slow step makes
+  tiles skip frames rather than drift; fast runs advance one frame
+  interval per step. With a window each canvas is handed to the GUI
+  through displayBuffer.
+*/
+static void runWall(WallRun *run, bool to_display) {
+    double interval = 1.0 / run->frame_rate;
+    double start = wallClockNow(), due = start;
+
+    for (uint64_t tick = 0; is_running; tick++) {
+        double time = run->fast ? tick * interval : wallClockNow() - start;
+        if (run->seconds > 0 && time >= run->seconds) {
+            break;
+        }
+        int playing = wallStep(&run->wall, time);
+
+        if (to_display) {
+            GdkPixbuf *pixbuf = copyCanvas(&run->wall);
+            if (pixbuf && !displayBufferPush(&displayBuffer, pixbuf, time)) {
+                g_object_unref(pixbuf);
+            }
+        } else if (!run->fast) {
+            due = fmax(due, wallClockNow()) + interval;
+            sleepUntil(due);
+        }
+        if (playing == 0) {
+            break;
+        }
+    }
+    run->elapsed = wallClockNow() - start;
+    if (to_display) {
+        displayBufferFinish(&displayBuffer);
+    }
+}
+
+static void *wallThread(void *args) {
+    runWall(args, true);
+    return NULL;
+}
+
+// Shows the newest canvas; the window closes itself once the wall ran out
+static gboolean updateWall(gpointer user_data) {
+    GtkWidget *picture = user_data;
+    GdkPixbuf *pixbuf;
+    double time;
+    if (!displayBufferPop(&displayBuffer, &pixbuf, &time)) {
+        gtk_window_destroy(GTK_WINDOW(gtk_widget_get_root(picture)));
+        return G_SOURCE_REMOVE;
+    }
+    GdkTexture *texture = gdk_texture_new_for_pixbuf(pixbuf);
+    gtk_picture_set_paintable(GTK_PICTURE(picture), (GdkPaintable *)texture);
+    g_object_unref(texture);
+    g_object_unref(pixbuf);
+    return G_SOURCE_CONTINUE;
+}
+
+static void onWallDestroy(GtkWidget *widget, gpointer app) {
+    is_running = 0;
+    pthread_cond_broadcast(&displayBuffer.notEmpty);
+    pthread_cond_broadcast(&displayBuffer.notFull);
+    g_application_quit(G_APPLICATION(app));
+}
+
+static void activateWall(GtkApplication *app, gpointer user_data) {
+    WallRun *run = user_data;
+    GtkWidget *window = gtk_application_window_new(app);
+    gtk_window_set_title(GTK_WINDOW(window), "Video Wall");
+    gtk_window_set_default_size(GTK_WINDOW(window), run->wall.canvas_width, run->wall.canvas_height);
+
+    GtkWidget *picture = gtk_picture_new();
+    gtk_window_set_child(GTK_WINDOW(window), picture);
+    g_signal_connect(window, "destroy", G_CALLBACK(onWallDestroy), app);
+    g_timeout_add(1000 / run->frame_rate, updateWall, picture);
+    gtk_widget_set_visible(window, true);
+}
+
+/*
+  Throughput as the wall grows: the first 1, 2, 4 ... inputs (and all
+  of them) are stepped headless and unpaced over the same stretch of
+  media, on the same pool.
+*/
+static bool sweepWall(const WallConfig *config, const char *const *inputs, int count, ThreadPool *pool,
+                      int frame_rate, double seconds) {
+    fprintf(stderr, "%8s %10s %12s %12s %10s %10s\n", "streams", "ticks", "stream-fps", "per-stream", "skipped", "step-ms");
+    for (int n = 1; ; n = n * 2 < count ? n * 2 : count) {
+        WallRun run = {.frame_rate = frame_rate, .seconds = seconds, .fast = true};
+        WallConfig sized = *config;
+        sized.columns = 0;
+        if (!wallOpen(&run.wall, &sized, inputs, n, pool)) {
+            return false;
+        }
+        runWall(&run, false);
+
+        uint64_t shown = 0, skipped = 0;
+        for (int i = 0; i < n; i++) {
+            shown += run.wall.tiles[i].shown;
+            skipped += run.wall.tiles[i].skipped;
+        }
+        fprintf(stderr, "%8d %10llu %12.1f %12.1f %10llu %10.2f\n", n, (unsigned long long)run.wall.ticks,
+                shown / run.elapsed, shown / run.elapsed / n, (unsigned long long)skipped,
+                run.wall.step_seconds / run.wall.ticks * 1e3);
+        wallClose(&run.wall);
+        if (n == count) {
+            return true;
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    WallConfig config = {0, TILE_WIDTH, TILE_HEIGHT, false, IO_MODE_MMAP};
+    WallRun run = {.frame_rate = WALL_FRAME_RATE};
+    int threads = parallelDefaultThreads();
+    int repeat = 1;
+    bool headless = false, sweep = false;
+
+    static struct option long_options[] = {
+        {"fps", required_argument, NULL, 'r'},
+        {"columns", required_argument, NULL, 'c'},
+        {"tile", required_argument, NULL, 't'},
+        {"threads", required_argument, NULL, 'j'},
+        {"repeat", required_argument, NULL, 'n'},
+        {"loop", no_argument, NULL, 'l'},
+        {"seconds", required_argument, NULL, 's'},
+        {"headless", no_argument, NULL, 'h'},
+        {"fast", no_argument, NULL, 'f'},
+        {"sweep", no_argument, NULL, 'w'},
+        {"io", required_argument, NULL, 'i'},
+        {NULL, 0, NULL, 0}
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 'r': run.frame_rate = atoi(optarg); break;
+            case 'c': config.columns = atoi(optarg); break;
+            case 't':
+                if (sscanf(optarg, "%dx%d", &config.tile_width, &config.tile_height) != 2 ||
+                    config.tile_width < 16 || config.tile_height < 16) {
+                    fprintf(stderr, "Error: --tile expects WxH, at least 16x16\n");
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'j': threads = atoi(optarg); break;
+            case 'n': repeat = atoi(optarg); break;
+            case 'l': config.loop = true; break;
+            case 's': run.seconds = atof(optarg); break;
+            case 'h': headless = true; break;
+            case 'f': run.fast = true; break;
+            case 'w': sweep = true; break;
+            case 'i': config.io_mode = ioParseMode(optarg); break;
+            default:
+                printUsage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    int count = (argc - optind) * (repeat > 0 ? repeat : 1);
+    if (argc - optind < 1 || run.frame_rate <= 0) {
+        printUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (count > WALL_MAX_TILES) {
+        fprintf(stderr, "Error: At most %d tiles\n", WALL_MAX_TILES);
+        return EXIT_FAILURE;
+    }
+    const char *inputs[WALL_MAX_TILES];
+    for (int i = 0; i < count; i++) {
+        inputs[i] = argv[optind + i % (argc - optind)];
+    }
+    if (run.fast && !headless && !sweep) {
+        fprintf(stderr, "Error: --fast needs --headless\n");
+        return EXIT_FAILURE;
+    }
+
+    av_log_set_level(AV_LOG_ERROR);
+    ThreadPool pool;
+    if (!threadPoolInit(&pool, threads)) {
+        fprintf(stderr, "Error: Could not start the worker pool\n");
+        return EXIT_FAILURE;
+    }
+
+    int status = EXIT_SUCCESS;
+    if (sweep) {
+        status = sweepWall(&config, inputs, count, &pool, run.frame_rate,
+                           run.seconds > 0 ? run.seconds : SWEEP_SECONDS) ? EXIT_SUCCESS : EXIT_FAILURE;
+    } else if (!wallOpen(&run.wall, &config, inputs, count, &pool)) {
+        status = EXIT_FAILURE;
+    } else if (headless) {
+        runWall(&run, false);
+        wallPrintStats(&run.wall, run.elapsed, stderr);
+        wallClose(&run.wall);
+    } else {
+        displayBufferInit(&displayBuffer, WALL_DISPLAY_SLOTS);
+        pthread_t wall_thread;
+        pthread_create(&wall_thread, NULL, wallThread, &run);
+
+        putenv("LIBGL_ALWAYS_SOFTWARE=1");
+        GtkApplication *app = gtk_application_new("org.mediaplayer.wall", G_APPLICATION_NON_UNIQUE);
+        g_signal_connect(app, "activate", G_CALLBACK(activateWall), &run);
+        status = g_application_run(G_APPLICATION(app), 1, argv);
+
+        is_running = 0;
+        pthread_cond_broadcast(&displayBuffer.notFull);
+        pthread_join(wall_thread, NULL);
+        wallPrintStats(&run.wall, run.elapsed, stderr);
+        wallClose(&run.wall);
+        displayBufferDestroy(&displayBuffer);
+        g_object_unref(app);
+    }
+
+    threadPoolDestroy(&pool);
+    return status;
+}